@@ -0,0 +1,213 @@
+//
+// AudioClipCache.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Implementation of the process-wide cache of the clips the APOs mix
+//
+
+#include "AudioClipCache.h"
+#include "AudioPcmCache.h"
+
+#include <new>
+#include <tuple>
+
+bool IsSameAudioClipFormat(const AUDIO_CLIP_FORMAT& first, const AUDIO_CLIP_FORMAT& second)
+{
+    return std::tie(first.u32SampleRate, first.u32ChannelCount, first.dwChannelMask, first.u32MaxFrameCount,
+                    first.u32CrossfadeFrames, first.u32StreamMinMs) ==
+           std::tie(second.u32SampleRate, second.u32ChannelCount, second.dwChannelMask, second.u32MaxFrameCount,
+                    second.u32CrossfadeFrames, second.u32StreamMinMs);
+}
+
+bool AudioClipCache::CLIP_KEY::operator<(const CLIP_KEY& other) const
+{
+    return std::tie(path, u64WriteTime, cbFile, format.u32SampleRate, format.u32ChannelCount, format.dwChannelMask,
+                    format.u32CrossfadeFrames, format.u32StreamMinMs) <
+           std::tie(other.path, other.u64WriteTime, other.cbFile, other.format.u32SampleRate, other.format.u32ChannelCount,
+                    other.format.dwChannelMask, other.format.u32CrossfadeFrames, other.format.u32StreamMinMs);
+}
+
+AudioClipCache::AudioClipCache(const std::wstring& pcmCacheDirectory)
+    : m_pcmCacheDirectory(pcmCacheDirectory)
+    , m_u32Loads(0)
+{
+}
+
+// Clips are only cached in memory if there is no directory for the cache files
+static std::wstring GetDefaultPcmCacheDirectory()
+{
+    std::wstring directory;
+    if (FAILED(GetAudioPcmCacheDirectory(&directory)))
+        directory.clear();
+    return directory;
+}
+
+AudioClipCache& AudioClipCache::GetInstance()
+{
+    static AudioClipCache s_cache(GetDefaultPcmCacheDirectory());
+    return s_cache;
+}
+
+HRESULT AudioClipCache::Load(LPCWSTR filePath, const AUDIO_CLIP_FORMAT& format, std::shared_ptr<AudioFileReader>* ppReader) const
+{
+    std::shared_ptr<AudioFileReader> reader;
+    try {
+        reader = std::make_shared<AudioFileReader>();
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    // Long clips are decoded ahead by a worker thread instead of all at once
+    HRESULT hr = reader->Open(filePath, format.u32SampleRate, format.u32MaxFrameCount, format.u32StreamMinMs,
+                              m_pcmCacheDirectory.c_str());
+    if (FAILED(hr)) return hr;
+
+    // The clip keeps its channels, the mix kernels spread them over the ones of the stream
+    hr = reader->ResampleAudio(format.u32SampleRate, reader->GetChannelCount());
+    if (FAILED(hr)) return hr;
+
+    // The loop point is smoothed once here, the mix keeps reading the clip straight through
+    hr = reader->CrossfadeLoop(format.u32CrossfadeFrames);
+    if (FAILED(hr)) return hr;
+
+    hr = reader->MapChannels(format.u32ChannelCount, format.dwChannelMask);
+    if (FAILED(hr)) return hr;
+
+    // The same length for every period, the mix loops around a clip as often as a longer one needs
+    hr = reader->RepeatToLength(AUDIO_CLIP_REPEAT_FRAMES);
+    if (FAILED(hr)) return hr;
+
+    // 16 bit sources are mixed from 16 bit samples
+    hr = reader->UseSourceBitDepth();
+    if (FAILED(hr)) return hr;
+
+    *ppReader = std::move(reader);
+    return S_OK;
+}
+
+HRESULT AudioClipCache::Acquire(LPCWSTR filePath, const AUDIO_CLIP_FORMAT& format, std::shared_ptr<AudioFileReader>* ppReader)
+{
+    ppReader->reset();
+
+    // A file that changed on disk is another clip, the old one lives on while it is mixed
+    CLIP_KEY key;
+    HRESULT hr = GetAudioFileStamp(filePath, &key.u64WriteTime, &key.cbFile);
+    if (FAILED(hr)) return hr;
+    key.format = format;
+
+    std::shared_ptr<CLIP_ENTRY> entry;
+    try {
+        key.path = filePath;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool bShare = true;
+        for (;;)
+        {
+            auto it = m_clips.find(key);
+            if (it == m_clips.end())
+            {
+                break;
+            }
+
+            // Whoever asked first loads the clip, the others wait for it
+            const std::shared_ptr<CLIP_ENTRY> found = it->second;
+            if (found->bLoading)
+            {
+                m_loaded.wait(lock, [&found]() { return !found->bLoading; });
+                if (FAILED(found->hr))
+                {
+                    return found->hr;
+                }
+                if (!found->bShared)
+                {
+                    // Streamed, every caller gets a ring of its own
+                    bShare = false;
+                    break;
+                }
+                continue;
+            }
+
+            *ppReader = found->reader.lock();
+            if (*ppReader)
+            {
+                return S_OK;
+            }
+            break;
+        }
+
+        m_u32Loads++;
+        if (bShare)
+        {
+            Prune();
+            entry = std::make_shared<CLIP_ENTRY>();
+            entry->bLoading = true;
+            entry->bShared = true;
+            entry->hr = S_OK;
+            m_clips[key] = entry;
+        }
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    // Decoding takes a while, other clips are handed out meanwhile
+    std::shared_ptr<AudioFileReader> reader;
+    hr = Load(filePath, format, &reader);
+    if (entry)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            entry->bLoading = false;
+            entry->bShared = SUCCEEDED(hr) && reader->GetStream() == nullptr;
+            entry->hr = hr;
+            if (entry->bShared)
+            {
+                entry->reader = reader;
+            }
+            else
+            {
+                // Failures are not kept, the next caller tries again
+                auto it = m_clips.find(key);
+                if (it != m_clips.end() && it->second == entry)
+                {
+                    m_clips.erase(it);
+                }
+            }
+        }
+        m_loaded.notify_all();
+    }
+
+    if (FAILED(hr)) return hr;
+    *ppReader = std::move(reader);
+    return S_OK;
+}
+
+void AudioClipCache::Prune()
+{
+    for (auto it = m_clips.begin(); it != m_clips.end();)
+    {
+        if (!it->second->bLoading && it->second->reader.expired())
+        {
+            it = m_clips.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+UINT32 AudioClipCache::GetLoadCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_u32Loads;
+}
+
+UINT32 AudioClipCache::GetClipCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Prune();
+    return static_cast<UINT32>(m_clips.size());
+}
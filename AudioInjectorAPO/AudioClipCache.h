@@ -0,0 +1,107 @@
+//
+// AudioClipCache.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Process-wide cache of the clips the APOs mix, so that every endpoint that
+//  plays the same file at the same format shares one decoded and resampled
+//  copy of it.  A clip is loaded once however many instances ask for it at the
+//  same time, and freed when the last one lets go of it.  What it took to decode
+//  and resample a clip is kept on disk as well, see AudioPcmCache.h, so it is
+//  not done again after the clip was freed or the process restarted.  Platform
+//  independent.
+//
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "AudioFileReader.h"
+
+// Clips shorter than this are repeated to this length, so a period of up to as many frames wraps around them at most once
+#define AUDIO_CLIP_REPEAT_FRAMES 4096
+
+//
+// Format a clip is prepared for, see AudioClipCache::Acquire.  Every field but
+// u32MaxFrameCount changes the samples or the channel map of the clip, so it is
+// part of the key, endpoints that only differ in their periods share the clip.
+//
+struct AUDIO_CLIP_FORMAT
+{
+    UINT32      u32SampleRate;          // of the stream
+    UINT32      u32ChannelCount;        // of the stream
+    DWORD       dwChannelMask;          // of the stream, the clip channels are mapped on it
+    UINT32      u32MaxFrameCount;       // of the periods, sizes the ring of a streamed clip, which is never shared
+    UINT32      u32CrossfadeFrames;     // at the loop point, 0 for a hard wrap
+    UINT32      u32StreamMinMs;         // clips longer than this are streamed, see AudioFileReader::Open
+};
+
+// Check whether a reader prepared for one format serves another, the period included for the ring of a streamed clip
+bool IsSameAudioClipFormat(const AUDIO_CLIP_FORMAT& first, const AUDIO_CLIP_FORMAT& second);
+
+class AudioClipCache
+{
+public:
+    // Keep decoded and resampled clips in pcmCacheDirectory as well, none if it is empty
+    explicit AudioClipCache(const std::wstring& pcmCacheDirectory = std::wstring());
+
+    AudioClipCache(const AudioClipCache&) = delete;
+    AudioClipCache& operator=(const AudioClipCache&) = delete;
+
+    // Get the cache the APOs of the process share, with its files in GetAudioPcmCacheDirectory
+    static AudioClipCache& GetInstance();
+
+    //
+    // Gets the clip of filePath prepared for format: opened, resampled, crossfaded at
+    // its loop point, mapped on the channels of the stream, repeated to at least
+    // AUDIO_CLIP_REPEAT_FRAMES and stored at its source bit depth.  A clip in memory is shared by every caller with
+    // the same file, unchanged on disk, and format, and must not be modified.  Callers
+    // that ask while it loads wait for that load and get its result.  A streamed clip
+    // has a worker and a ring of its own, so every caller gets a reader of its own.
+    // The read position of a clip is kept by the mix context of each caller.
+    //
+    HRESULT Acquire(LPCWSTR filePath, const AUDIO_CLIP_FORMAT& format, std::shared_ptr<AudioFileReader>* ppReader);
+
+    // Get the number of clips loaded so far, shared or not
+    UINT32 GetLoadCount();
+
+    // Get the number of clips in memory that are shared
+    UINT32 GetClipCount();
+
+private:
+    struct CLIP_KEY
+    {
+        std::wstring        path;
+        UINT64              u64WriteTime;
+        UINT64              cbFile;
+        AUDIO_CLIP_FORMAT   format;
+
+        bool operator<(const CLIP_KEY& other) const;
+    };
+
+    // A clip that is loading or loaded, the readers of the callers keep it alive
+    struct CLIP_ENTRY
+    {
+        bool                                bLoading;
+        bool                                bShared;    // false once it turned out to be streamed or failed
+        HRESULT                             hr;         // of the load
+        std::weak_ptr<AudioFileReader>      reader;
+    };
+
+    // Open the clip and prepare it for the format, the body of a load
+    HRESULT Load(LPCWSTR filePath, const AUDIO_CLIP_FORMAT& format, std::shared_ptr<AudioFileReader>* ppReader) const;
+
+    // Drop the entries of clips no one holds any more, with m_mutex held
+    void Prune();
+
+    const std::wstring m_pcmCacheDirectory;
+    std::mutex m_mutex;
+    std::condition_variable m_loaded;       // signaled whenever a load ends
+    std::map<CLIP_KEY, std::shared_ptr<CLIP_ENTRY>> m_clips;
+    UINT32 m_u32Loads;
+};
@@ -0,0 +1,424 @@
+//
+// AudioFileMapping.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Memory mapping of audio files and the RIFF/WAVE header parser
+//
+
+#include "AudioFileMapping.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Smallest page size of the supported platforms, touching more often than once a page does no harm
+static const size_t c_cbPrefaultStride = 4096;
+
+// KSDATAFORMAT_SUBTYPE_PCM and _IEEE_FLOAT differ from this in their first two bytes only
+static const BYTE c_abSubformatTail[14] =
+    { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+static UINT16 ReadLE16(const BYTE *pb)
+{
+    return static_cast<UINT16>(pb[0] | (pb[1] << 8));
+}
+
+static UINT32 ReadLE32(const BYTE *pb)
+{
+    return static_cast<UINT32>(pb[0]) | (static_cast<UINT32>(pb[1]) << 8) |
+           (static_cast<UINT32>(pb[2]) << 16) | (static_cast<UINT32>(pb[3]) << 24);
+}
+
+HRESULT ParseWavHeader(
+    const BYTE         *pbFile,
+    UINT64              cbFile,
+    WAV_FILE_FORMAT    *pFormat)
+{
+    std::memset(pFormat, 0, sizeof(*pFormat));
+
+    if (pbFile == nullptr || cbFile < 12 ||
+        std::memcmp(pbFile, "RIFF", 4) != 0 || std::memcmp(pbFile + 8, "WAVE", 4) != 0)
+    {
+        return E_FAIL;
+    }
+
+    // The RIFF size is not trusted, writers that stream leave it unset.  smpl and cue
+    // chunks often follow the data, so all chunks are looked at.
+    bool bFormat = false;
+    bool bData = false;
+    UINT32 u32LoopStart = 0;
+    UINT32 u32LoopEnd = 0;
+    UINT32 u32CuePoints = 0;
+    const BYTE *pbCuePoints = nullptr;
+    UINT64 u64Offset = 12;
+    while (u64Offset + 8 <= cbFile)
+    {
+        const BYTE *pbChunk = pbFile + u64Offset;
+        const UINT64 u64Body = u64Offset + 8;
+        const UINT32 u32Size = ReadLE32(pbChunk + 4);
+
+        if (std::memcmp(pbChunk, "fmt ", 4) == 0)
+        {
+            if (u32Size < 16 || u64Body + u32Size > cbFile)
+            {
+                return E_FAIL;
+            }
+
+            const BYTE *pbFormat = pbFile + u64Body;
+            pFormat->u16FormatTag = ReadLE16(pbFormat);
+            pFormat->u16Channels = ReadLE16(pbFormat + 2);
+            pFormat->u32SampleRate = ReadLE32(pbFormat + 4);
+            pFormat->u16BlockAlign = ReadLE16(pbFormat + 12);
+            pFormat->u16BitsPerSample = ReadLE16(pbFormat + 14);
+            pFormat->u16ValidBitsPerSample = pFormat->u16BitsPerSample;
+
+            // The subformat of an extensible file says what its samples are
+            if (pFormat->u16FormatTag == WAVE_FORMAT_EXTENSIBLE && u32Size >= 40)
+            {
+                const UINT16 u16ValidBits = ReadLE16(pbFormat + 18);
+                if (u16ValidBits != 0 && u16ValidBits <= pFormat->u16BitsPerSample)
+                {
+                    pFormat->u16ValidBitsPerSample = u16ValidBits;
+                }
+                pFormat->dwChannelMask = ReadLE32(pbFormat + 20);
+                pFormat->u16FormatTag = (std::memcmp(pbFormat + 26, c_abSubformatTail, sizeof(c_abSubformatTail)) == 0) ?
+                                        ReadLE16(pbFormat + 24) : WAVE_FORMAT_EXTENSIBLE;
+            }
+            bFormat = true;
+        }
+        else if (std::memcmp(pbChunk, "data", 4) == 0)
+        {
+            // A data chunk running past the end of the file holds what is there
+            pFormat->u64DataOffset = u64Body;
+            pFormat->u64DataBytes = (u64Body + u32Size <= cbFile) ? u32Size : cbFile - u64Body;
+            bData = true;
+        }
+        else if (std::memcmp(pbChunk, "smpl", 4) == 0 && u64Body + u32Size <= cbFile && u32Size >= 36 + 24 &&
+                 ReadLE32(pbFile + u64Body + 28) != 0)
+        {
+            // Only the first loop is played, its end is the last frame of it
+            const BYTE *pbLoop = pbFile + u64Body + 36;
+            u32LoopStart = ReadLE32(pbLoop + 8);
+            u32LoopEnd = ReadLE32(pbLoop + 12) + 1;
+        }
+        else if (std::memcmp(pbChunk, "cue ", 4) == 0 && u64Body + u32Size <= cbFile && u32Size >= 4)
+        {
+            u32CuePoints = ReadLE32(pbFile + u64Body);
+            if (u32CuePoints > (u32Size - 4) / 24)
+            {
+                u32CuePoints = (u32Size - 4) / 24;
+            }
+            pbCuePoints = pbFile + u64Body + 4;
+        }
+
+        // Chunks are padded to even sizes
+        u64Offset = u64Body + u32Size + (u32Size & 1);
+    }
+
+    if (!bFormat || !bData ||
+        pFormat->u16Channels == 0 || pFormat->u32SampleRate == 0 ||
+        pFormat->u16BitsPerSample == 0 || pFormat->u16BitsPerSample % 8 != 0 ||
+        pFormat->u16BlockAlign != pFormat->u16Channels * (pFormat->u16BitsPerSample / 8))
+    {
+        return E_FAIL;
+    }
+
+    pFormat->u64DataBytes -= pFormat->u64DataBytes % pFormat->u16BlockAlign;
+
+    // Markers are kept only where they point at frames the file has
+    const UINT64 u64Frames = pFormat->u64DataBytes / pFormat->u16BlockAlign;
+    if (u32LoopStart < u32LoopEnd && u32LoopEnd <= u64Frames)
+    {
+        pFormat->bLoop = TRUE;
+        pFormat->u32LoopStart = u32LoopStart;
+        pFormat->u32LoopEnd = u32LoopEnd;
+    }
+
+    for (UINT32 i = 0; i < u32CuePoints && pFormat->u32CuePoints < WAV_MAX_CUE_POINTS; i++)
+    {
+        const UINT32 u32Frame = ReadLE32(pbCuePoints + 24 * static_cast<size_t>(i) + 20);
+        if (u32Frame < u64Frames)
+        {
+            pFormat->au32CueFrames[pFormat->u32CuePoints++] = u32Frame;
+        }
+    }
+    return S_OK;
+}
+
+const void* GetWavSamplesInPlace(
+    const BYTE             *pbFile,
+    const WAV_FILE_FORMAT  *pFormat)
+{
+    UINT32 u32Alignment = 0;
+    if (pFormat->u16FormatTag == WAVE_FORMAT_IEEE_FLOAT && pFormat->u16BitsPerSample == 32)
+    {
+        u32Alignment = sizeof(FLOAT32);
+    }
+    else if (pFormat->u16FormatTag == WAVE_FORMAT_PCM && pFormat->u16BitsPerSample == 16)
+    {
+        u32Alignment = sizeof(INT16);
+    }
+
+    // The kernels read the samples as their type, which must not straddle its alignment
+    const BYTE *pbSamples = pbFile + pFormat->u64DataOffset;
+    if (u32Alignment == 0 || reinterpret_cast<uintptr_t>(pbSamples) % u32Alignment != 0)
+    {
+        return nullptr;
+    }
+    return pbSamples;
+}
+
+AudioFileMapping::AudioFileMapping()
+#if defined(_WIN32)
+    : m_hFile(INVALID_HANDLE_VALUE)
+    , m_hMapping(nullptr)
+#else
+    : m_fd(-1)
+#endif
+    , m_pbData(nullptr)
+    , m_cbData(0)
+    , m_isLocked(false)
+{
+}
+
+AudioFileMapping::~AudioFileMapping()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+HRESULT AudioFileMapping::Open(LPCWSTR filePath, DWORD flags)
+{
+    Close();
+
+    // Writers are kept out while the file is mapped.  It may be deleted or renamed, a new
+    // file in its place has another GetAudioFileStamp and is loaded as another clip.
+    m_hFile = CreateFileW(filePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_hMapping == nullptr)
+    {
+        const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    m_pbData = static_cast<const BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_pbData == nullptr)
+    {
+        const HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+    m_cbData = static_cast<UINT64>(size.QuadPart);
+
+    // Locking needs room in the working set, without it the pages are only prefaulted
+    if (flags & AUDIO_MAPPING_LOCK)
+    {
+        m_isLocked = LockAudioMemory(m_pbData, m_cbData) != FALSE;
+    }
+
+    if ((flags & AUDIO_MAPPING_PREFAULT) && !m_isLocked)
+    {
+        volatile BYTE bTouch = 0;
+        for (UINT64 i = 0; i < m_cbData; i += c_cbPrefaultStride)
+        {
+            bTouch = static_cast<BYTE>(bTouch + m_pbData[i]);
+        }
+    }
+    return S_OK;
+}
+
+BOOL LockAudioMemory(const void *pv, UINT64 cb)
+{
+    return VirtualLock(const_cast<void*>(pv), static_cast<SIZE_T>(cb));
+}
+
+void UnlockAudioMemory(const void *pv, UINT64 cb)
+{
+    VirtualUnlock(const_cast<void*>(pv), static_cast<SIZE_T>(cb));
+}
+
+HRESULT GetAudioFileStamp(LPCWSTR filePath, UINT64 *pu64WriteTime, UINT64 *pcbFile)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    if (!GetFileAttributesExW(filePath, GetFileExInfoStandard, &attributes))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    *pu64WriteTime = (static_cast<UINT64>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    *pcbFile = (static_cast<UINT64>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    return S_OK;
+}
+
+void AudioFileMapping::Close()
+{
+    if (m_pbData != nullptr)
+    {
+        if (m_isLocked)
+        {
+            UnlockAudioMemory(m_pbData, m_cbData);
+        }
+        UnmapViewOfFile(m_pbData);
+    }
+    if (m_hMapping != nullptr)
+    {
+        CloseHandle(m_hMapping);
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+    }
+
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_hMapping = nullptr;
+    m_pbData = nullptr;
+    m_cbData = 0;
+    m_isLocked = false;
+}
+
+#else // !_WIN32
+
+std::string GetUtf8Path(LPCWSTR filePath)
+{
+    std::string path;
+    for (const WCHAR *pwc = filePath; *pwc != 0; pwc++)
+    {
+        const UINT32 c = static_cast<UINT32>(*pwc);
+        if (c < 0x80)
+        {
+            path += static_cast<char>(c);
+        }
+        else if (c < 0x800)
+        {
+            path += static_cast<char>(0xC0 | (c >> 6));
+            path += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            path += static_cast<char>(0xE0 | (c >> 12));
+            path += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            path += static_cast<char>(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            path += static_cast<char>(0xF0 | (c >> 18));
+            path += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            path += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            path += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return path;
+}
+
+HRESULT AudioFileMapping::Open(LPCWSTR filePath, DWORD flags)
+{
+    Close();
+
+    m_fd = open(GetUtf8Path(filePath).c_str(), O_RDONLY);
+    if (m_fd < 0)
+    {
+        return E_FAIL;
+    }
+
+    struct stat status;
+    if (fstat(m_fd, &status) != 0 || status.st_size <= 0)
+    {
+        Close();
+        return E_FAIL;
+    }
+
+    void *pvData = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, m_fd, 0);
+    if (pvData == MAP_FAILED)
+    {
+        Close();
+        return E_FAIL;
+    }
+    m_pbData = static_cast<const BYTE*>(pvData);
+    m_cbData = static_cast<UINT64>(status.st_size);
+
+    // Locking is bound by RLIMIT_MEMLOCK, without it the pages are only prefaulted
+    if (flags & AUDIO_MAPPING_LOCK)
+    {
+        m_isLocked = LockAudioMemory(m_pbData, m_cbData) != FALSE;
+    }
+
+    if ((flags & AUDIO_MAPPING_PREFAULT) && !m_isLocked)
+    {
+        madvise(pvData, static_cast<size_t>(m_cbData), MADV_WILLNEED);
+
+        volatile BYTE bTouch = 0;
+        for (UINT64 i = 0; i < m_cbData; i += c_cbPrefaultStride)
+        {
+            bTouch = static_cast<BYTE>(bTouch + m_pbData[i]);
+        }
+    }
+    return S_OK;
+}
+
+BOOL LockAudioMemory(const void *pv, UINT64 cb)
+{
+    return (mlock(pv, static_cast<size_t>(cb)) == 0) ? TRUE : FALSE;
+}
+
+void UnlockAudioMemory(const void *pv, UINT64 cb)
+{
+    munlock(pv, static_cast<size_t>(cb));
+}
+
+HRESULT GetAudioFileStamp(LPCWSTR filePath, UINT64 *pu64WriteTime, UINT64 *pcbFile)
+{
+    struct stat status;
+    if (stat(GetUtf8Path(filePath).c_str(), &status) != 0)
+    {
+        return E_FAIL;
+    }
+
+    *pu64WriteTime = static_cast<UINT64>(status.st_mtim.tv_sec) * 1000000000ull + static_cast<UINT64>(status.st_mtim.tv_nsec);
+    *pcbFile = static_cast<UINT64>(status.st_size);
+    return S_OK;
+}
+
+void AudioFileMapping::Close()
+{
+    if (m_pbData != nullptr)
+    {
+        if (m_isLocked)
+        {
+            UnlockAudioMemory(m_pbData, m_cbData);
+        }
+        munmap(const_cast<BYTE*>(m_pbData), static_cast<size_t>(m_cbData));
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+
+    m_fd = -1;
+    m_pbData = nullptr;
+    m_cbData = 0;
+    m_isLocked = false;
+}
+
+#endif // _WIN32
@@ -0,0 +1,143 @@
+//
+// AudioFileMapping.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Read-only memory mapping of an audio file and the RIFF/WAVE header parser
+//  that finds the samples in it, so WAV clips can be mixed straight out of the
+//  page cache without being decoded or copied.  Platform independent: the
+//  mapping is made with MapViewOfFile on Windows and mmap elsewhere.
+//
+
+#pragma once
+
+#include "PortableTypes.h"
+
+// Flags of AudioFileMapping::Open
+#define AUDIO_MAPPING_PREFAULT  0x1     // touch every page up front, so reading the clip never faults
+#define AUDIO_MAPPING_LOCK      0x2     // lock the pages in memory as well, where the limits allow it
+
+// Cue points of a WAV file kept by ParseWavHeader, the others are dropped
+#define WAV_MAX_CUE_POINTS      16
+
+//
+// Format and position of the samples of a WAV file, see ParseWavHeader.  The
+// format tag of a WAVE_FORMAT_EXTENSIBLE file is the one of its subformat.
+// Loop and cue points are in frames and always within the data.
+//
+struct WAV_FILE_FORMAT
+{
+    UINT16      u16FormatTag;           // WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT for the ones the mix reads
+    UINT16      u16Channels;
+    UINT32      u32SampleRate;
+    UINT16      u16BlockAlign;          // bytes per frame
+    UINT16      u16BitsPerSample;       // of the sample containers
+    UINT16      u16ValidBitsPerSample;  // of the samples in them, fewer only in WAVE_FORMAT_EXTENSIBLE files
+    DWORD       dwChannelMask;          // speaker positions of the channels, 0 if the file does not tell
+    UINT64      u64DataOffset;          // of the first sample from the start of the file
+    UINT64      u64DataBytes;           // whole frames only, cut short where the file is
+
+    // The first loop of the smpl chunk, the end is exclusive
+    BOOL        bLoop;
+    UINT32      u32LoopStart;
+    UINT32      u32LoopEnd;
+
+    // Sample offsets of the cue chunk, in the order of the file
+    UINT32      u32CuePoints;
+    UINT32      au32CueFrames[WAV_MAX_CUE_POINTS];
+};
+
+//
+// Reads the fmt, data, smpl and cue chunks of the RIFF/WAVE file in pbFile.  The
+// sizes in the file are trusted only as far as cbFile goes, so a truncated or
+// still growing file gives the frames that are there.  Loops and cue points past
+// those frames are dropped.  Returns E_FAIL for anything that is not a WAV file
+// with whole byte samples.
+//
+HRESULT ParseWavHeader(
+    const BYTE         *pbFile,
+    UINT64              cbFile,
+    WAV_FILE_FORMAT    *pFormat);
+
+//
+// Returns the samples of the data chunk if the mix can read them where they
+// are: 32 bit float or 16 bit PCM samples, aligned for their type.  nullptr if
+// they have to be converted or copied first.
+//
+const void* GetWavSamplesInPlace(
+    const BYTE             *pbFile,
+    const WAV_FILE_FORMAT  *pFormat);
+
+//
+// Gets the time the file was last written, in units the platform chooses, and
+// its size in bytes.  A file that changes gets a different pair, which is what
+// caches of the clips decoded from it key on.
+//
+HRESULT GetAudioFileStamp(
+    LPCWSTR             filePath,
+    UINT64             *pu64WriteTime,
+    UINT64             *pcbFile);
+
+//
+// Locks memory the process owns in the working set, as AUDIO_MAPPING_LOCK does for a
+// mapping.  Returns FALSE where the limits of the process do not allow it.
+//
+BOOL LockAudioMemory(
+    const void         *pv,
+    UINT64              cb);
+
+// Unlocks memory LockAudioMemory locked, before it is freed
+void UnlockAudioMemory(
+    const void         *pv,
+    UINT64              cb);
+
+#if !defined(_WIN32)
+#include <string>
+
+//
+// Gets the name the system takes for filePath, file names are UTF-8 outside of
+// Windows.
+//
+std::string GetUtf8Path(
+    LPCWSTR             filePath);
+#endif
+
+//
+// Read-only view of a whole file.  The view stays valid until Close, which the
+// destructor calls.
+//
+class AudioFileMapping
+{
+public:
+    AudioFileMapping();
+    ~AudioFileMapping();
+
+    AudioFileMapping(const AudioFileMapping&) = delete;
+    AudioFileMapping& operator=(const AudioFileMapping&) = delete;
+
+    // Map the file, with AUDIO_MAPPING_PREFAULT and AUDIO_MAPPING_LOCK as asked for by flags
+    HRESULT Open(LPCWSTR filePath, DWORD flags);
+
+    // Unmap the file
+    void Close();
+
+    // Get the bytes of the file, nullptr if none is mapped
+    const BYTE* GetData() const { return m_pbData; }
+
+    // Get the size of the file in bytes
+    UINT64 GetSize() const { return m_cbData; }
+
+    // Check whether the pages could be locked in memory, see AUDIO_MAPPING_LOCK
+    bool IsLocked() const { return m_isLocked; }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+#else
+    int m_fd;
+#endif
+    const BYTE *m_pbData;
+    UINT64 m_cbData;
+    bool m_isLocked;
+};
@@ -7,37 +7,343 @@
 //
 
 #include "AudioFileReader.h"
+#include "AudioPcmCache.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <system_error>
+
+#if defined(_WIN32)
 #include <mfapi.h>
 #include <mfreadwrite.h>
-#include <wmcodecdsp.h>
-#include <mftransform.h>
 
 #pragma comment(lib, "mfplat.lib")
 #pragma comment(lib, "mfreadwrite.lib")
 #pragma comment(lib, "mfuuid.lib")
-#pragma comment(lib, "wmcodecdspuuid.lib")
+#endif
+
+// Length of the ring of a streamed clip, the worker tops it up every quarter of it
+static const UINT32 c_streamRingMs = 1000;
+
+// Frames ResampleAudio converts at a time on their way into the new clip
+static const UINT32 c_resampleChunkFrames = 4096;
 
 AudioFileReader::AudioFileReader()
-    : m_frameCount(0)
+    : m_pMappedData(nullptr)
+    , m_pMappedDataInt16(nullptr)
+    , m_lockOwnedData(false)
+    , m_pvLockedData(nullptr)
+    , m_cbLockedData(0)
+    , m_frameCount(0)
     , m_channelCount(0)
+    , m_channelMask(0)
     , m_sampleRate(0)
+    , m_sourceBitsPerSample(0)
+    , m_loopStart(0)
+    , m_loopEnd(0)
     , m_isInitialized(false)
+    , m_streamPendingOffset(0)
+    , m_streamEnded(false)
+    , m_stopStreaming(false)
 {
+#if defined(_WIN32)
     // Initialize MF platform
     MFStartup(MF_VERSION, MFSTARTUP_FULL);
+#endif
 }
 
 AudioFileReader::~AudioFileReader()
 {
     Cleanup();
+#if defined(_WIN32)
     MFShutdown();
+#endif
 }
 
-HRESULT AudioFileReader::Initialize(LPCWSTR filePath)
+HRESULT AudioFileReader::Initialize(LPCWSTR filePath, DWORD mappingFlags)
 {
     // Clean up any previous data
     Cleanup();
 
+    // WAV files are read without the decoder
+    HRESULT hr = ReadWavFile(filePath, mappingFlags);
+    if (hr != S_FALSE) return hr;
+
+    // So are FLAC files, on all processors at once
+    hr = ReadFlacFile(filePath);
+    if (hr != S_FALSE) return hr;
+
+    return DecodeFile(filePath);
+}
+
+// Maps the file and opens the FLAC decoder on it, S_FALSE if it is not a FLAC file the decoder takes
+static HRESULT OpenFlacFile(LPCWSTR filePath, std::unique_ptr<AudioFileMapping>& pMapping, std::unique_ptr<FlacDecoder>& pDecoder)
+{
+    try {
+        pMapping = std::make_unique<AudioFileMapping>();
+        pDecoder = std::make_unique<FlacDecoder>();
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    // The pages are read once while decoding, there is nothing to prefault them for
+    HRESULT hr = pMapping->Open(filePath, 0);
+    if (SUCCEEDED(hr))
+        hr = pDecoder->Open(pMapping->GetData(), pMapping->GetSize());
+    if (hr == E_OUTOFMEMORY)
+        return hr;
+    if (FAILED(hr))
+    {
+        pDecoder.reset();
+        pMapping.reset();
+        return S_FALSE;
+    }
+    return S_OK;
+}
+
+HRESULT AudioFileReader::ReadWavFile(LPCWSTR filePath, DWORD mappingFlags)
+{
+    // Anything that is not a WAV file of PCM or float samples is left to the decoder
+    std::unique_ptr<AudioFileMapping> pMapping;
+    try {
+        pMapping = std::make_unique<AudioFileMapping>();
+    }
+    catch (std::bad_alloc&) {
+        return S_FALSE;
+    }
+
+    WAV_FILE_FORMAT format;
+    if (FAILED(pMapping->Open(filePath, mappingFlags)) ||
+        FAILED(ParseWavHeader(pMapping->GetData(), pMapping->GetSize(), &format)))
+        return S_FALSE;
+
+    const UINT32 bytesPerSample = format.u16BitsPerSample / 8;
+    const bool isFloat = format.u16FormatTag == WAVE_FORMAT_IEEE_FLOAT && bytesPerSample == 4;
+    const bool isPcm = format.u16FormatTag == WAVE_FORMAT_PCM && bytesPerSample <= 4;
+    const UINT64 frameCount = format.u64DataBytes / format.u16BlockAlign;
+    if ((!isFloat && !isPcm) || frameCount == 0 || frameCount > UINT32_MAX)
+        return S_FALSE;
+
+    const BYTE* pbSamples = pMapping->GetData() + format.u64DataOffset;
+    const UINT64 samples = frameCount * format.u16Channels;
+
+    m_channelCount = format.u16Channels;
+    m_channelMask = format.dwChannelMask;
+    m_sampleRate = format.u32SampleRate;
+    m_sourceBitsPerSample = isPcm ? format.u16ValidBitsPerSample : 0;
+    m_frameCount = static_cast<UINT32>(frameCount);
+    if (format.bLoop)
+    {
+        m_loopStart = format.u32LoopStart;
+        m_loopEnd = format.u32LoopEnd;
+    }
+
+    try {
+        m_cuePoints.assign(format.au32CueFrames, format.au32CueFrames + format.u32CuePoints);
+
+        // Float and 16 bit samples are read where they are, if aligned for their type
+        const void* pvInPlace = GetWavSamplesInPlace(pMapping->GetData(), &format);
+        if (pvInPlace != nullptr)
+        {
+            m_pMappedData = isFloat ? static_cast<const FLOAT32*>(pvInPlace) : nullptr;
+            m_pMappedDataInt16 = isFloat ? nullptr : static_cast<const INT16*>(pvInPlace);
+            m_pMapping = std::move(pMapping);
+        }
+        else if (isFloat)
+        {
+            m_pAudioData = std::make_unique<FLOAT32[]>(samples);
+            memcpy(m_pAudioData.get(), pbSamples, static_cast<size_t>(format.u64DataBytes));
+        }
+        else if (bytesPerSample == 2)
+        {
+            m_pAudioDataInt16 = std::make_unique<INT16[]>(samples);
+            memcpy(m_pAudioDataInt16.get(), pbSamples, static_cast<size_t>(format.u64DataBytes));
+        }
+        else
+        {
+            // 8, 24 and 32 bit samples are converted to float, a block at a time
+            m_pAudioData = std::make_unique<FLOAT32[]>(samples);
+
+            const MIX_KERNELS* pKernels = SelectMixKernels();
+            for (UINT64 first = 0; first < samples; first += MIX_FORMAT_BLOCK_SAMPLES)
+            {
+                const UINT32 count = (samples - first < MIX_FORMAT_BLOCK_SAMPLES) ? static_cast<UINT32>(samples - first) : MIX_FORMAT_BLOCK_SAMPLES;
+                pKernels->pfnConvertPcmSpan(&m_pAudioData[first], pbSamples + first * bytesPerSample, count, bytesPerSample);
+            }
+        }
+    }
+    catch (std::bad_alloc&) {
+        Cleanup();
+        return E_OUTOFMEMORY;
+    }
+
+    m_isInitialized = true;
+
+    // Pages that could not be locked would be faulted in by the real-time thread, and a file
+    // truncated under the view would fault for good, so the samples are copied instead
+    if (m_pMapping && (mappingFlags & AUDIO_MAPPING_LOCK) && !m_pMapping->IsLocked())
+    {
+        HRESULT hr = UseLockedOwnedData();
+        if (FAILED(hr))
+        {
+            Cleanup();
+            return hr;
+        }
+    }
+
+    // Scanning for silence reads every page, which is only worth it once they are in memory
+    if (!m_pMapping || mappingFlags != 0)
+        UpdateSilentBlocks();
+    return S_OK;
+}
+
+HRESULT AudioFileReader::ReadFlacFile(LPCWSTR filePath)
+{
+    std::unique_ptr<AudioFileMapping> pMapping;
+    std::unique_ptr<FlacDecoder> pDecoder;
+    HRESULT hr = OpenFlacFile(filePath, pMapping, pDecoder);
+    if (hr != S_OK) return hr;
+
+    const FLAC_STREAM_INFO& info = pDecoder->GetStreamInfo();
+    if (info.u64TotalFrames > UINT32_MAX)
+        return E_FAIL;
+
+    m_channelCount = info.u16Channels;
+    m_channelMask = pDecoder->GetChannelMask();
+    m_sampleRate = info.u32SampleRate;
+    m_sourceBitsPerSample = info.u16BitsPerSample;
+
+    try {
+        if (info.u64TotalFrames != 0)
+        {
+            // The frames of a stream of known length are split between the threads
+            m_pAudioData = std::make_unique<FLOAT32[]>(info.u64TotalFrames * m_channelCount);
+            hr = pDecoder->DecodeAll(m_pAudioData.get(), std::thread::hardware_concurrency());
+            m_frameCount = static_cast<UINT32>(info.u64TotalFrames);
+        }
+        else
+        {
+            // Otherwise there is no telling where a frame starts in the output but to decode the ones before it
+            std::vector<FLOAT32> frames;
+            std::vector<FLOAT32> block(static_cast<size_t>(info.u32MaxBlockSize) * m_channelCount);
+            UINT32 blockFrames = 0;
+            while ((hr = pDecoder->DecodeBlock(block.data(), &blockFrames)) == S_OK)
+            {
+                frames.insert(frames.end(), block.begin(), block.begin() + static_cast<size_t>(blockFrames) * m_channelCount);
+            }
+
+            const size_t frameCount = frames.size() / m_channelCount;
+            if (SUCCEEDED(hr) && (frameCount == 0 || frameCount > UINT32_MAX))
+                hr = E_FAIL;
+            if (SUCCEEDED(hr))
+            {
+                m_pAudioData = std::make_unique<FLOAT32[]>(frames.size());
+                memcpy(m_pAudioData.get(), frames.data(), frames.size() * sizeof(FLOAT32));
+                m_frameCount = static_cast<UINT32>(frameCount);
+            }
+        }
+    }
+    catch (std::bad_alloc&) {
+        hr = E_OUTOFMEMORY;
+    }
+
+    if (FAILED(hr))
+    {
+        Cleanup();
+        return hr;
+    }
+
+    m_isInitialized = true;
+    UpdateSilentBlocks();
+    return S_OK;
+}
+
+HRESULT AudioFileReader::UseOwnedFloatData()
+{
+    if (m_pAudioData)
+        return S_OK;
+
+    const FLOAT32* pf32Data = GetAudioData();
+    const INT16* pi16Data = GetAudioDataInt16();
+    if (pf32Data == nullptr && pi16Data == nullptr)
+        return E_FAIL;
+
+    const UINT64 samples = static_cast<UINT64>(m_frameCount) * m_channelCount;
+    std::unique_ptr<FLOAT32[]> newAudioData;
+    try {
+        newAudioData = std::make_unique<FLOAT32[]>(samples);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    if (pf32Data != nullptr)
+    {
+        memcpy(newAudioData.get(), pf32Data, samples * sizeof(FLOAT32));
+    }
+    else
+    {
+        // The same scaling as the decoder applies to 16 bit samples
+        const MIX_KERNELS* pKernels = SelectMixKernels();
+        for (UINT64 first = 0; first < samples; first += MIX_FORMAT_BLOCK_SAMPLES)
+        {
+            const UINT32 count = (samples - first < MIX_FORMAT_BLOCK_SAMPLES) ? static_cast<UINT32>(samples - first) : MIX_FORMAT_BLOCK_SAMPLES;
+            pKernels->pfnConvertInt16Span(&newAudioData[first], &pi16Data[first], count);
+        }
+    }
+
+    UnlockOwnedData();
+    m_pAudioData = std::move(newAudioData);
+    m_pAudioDataInt16.reset();
+    ReleaseMapping();
+    LockOwnedData();
+    return S_OK;
+}
+
+void AudioFileReader::ReleaseMapping()
+{
+    m_pMappedData = nullptr;
+    m_pMappedDataInt16 = nullptr;
+    m_pMapping.reset();
+}
+
+HRESULT AudioFileReader::UseLockedOwnedData()
+{
+    // Every later copy of the samples is locked too, see LockOwnedData
+    m_lockOwnedData = true;
+    return UseOwnedFloatData();
+}
+
+void AudioFileReader::LockOwnedData()
+{
+    if (!m_lockOwnedData || m_pvLockedData != nullptr)
+        return;
+
+    const UINT64 samples = static_cast<UINT64>(m_frameCount) * m_channelCount;
+    const void* pvData = m_pAudioData ? static_cast<const void*>(m_pAudioData.get()) : static_cast<const void*>(m_pAudioDataInt16.get());
+    const size_t cbData = static_cast<size_t>(samples * (m_pAudioData ? sizeof(FLOAT32) : sizeof(INT16)));
+
+    // Without room for the lock the samples are still owned, they are only not pinned
+    if (pvData != nullptr && cbData != 0 && LockAudioMemory(pvData, cbData))
+    {
+        m_pvLockedData = pvData;
+        m_cbLockedData = cbData;
+    }
+}
+
+void AudioFileReader::UnlockOwnedData()
+{
+    if (m_pvLockedData != nullptr)
+        UnlockAudioMemory(m_pvLockedData, m_cbLockedData);
+    m_pvLockedData = nullptr;
+    m_cbLockedData = 0;
+}
+
+#if defined(_WIN32)
+
+HRESULT AudioFileReader::OpenSourceReader(LPCWSTR filePath, IMFSourceReader** ppSourceReader, LONGLONG* pDuration)
+{
     // Define all resources
     IMFSourceReader* pSourceReader = nullptr;
     IMFMediaType* pMediaType = nullptr;
@@ -75,6 +381,18 @@ HRESULT AudioFileReader::Initialize(LPCWSTR filePath)
     hr = MFCreateSourceReaderFromURL(filePath, nullptr, &pSourceReader);
     if (FAILED(hr)) return hr;
 
+    // Remember the bit depth of PCM sources, a 16 bit clip can be stored compactly
+    IMFMediaType* pNativeType = nullptr;
+    if (SUCCEEDED(pSourceReader->GetNativeMediaType(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), 0, &pNativeType)))
+    {
+        GUID subtype = GUID_NULL;
+        if (SUCCEEDED(pNativeType->GetGUID(MF_MT_SUBTYPE, &subtype)) && subtype == MFAudioFormat_PCM)
+        {
+            m_sourceBitsPerSample = MFGetAttributeUINT32(pNativeType, MF_MT_AUDIO_BITS_PER_SAMPLE, 0);
+        }
+        SafeRelease(&pNativeType);
+    }
+
     // Configure the source reader to give us PCM audio
     hr = MFCreateMediaType(&pAudioType);
     if (FAILED(hr)) return hr;
@@ -98,15 +416,31 @@ HRESULT AudioFileReader::Initialize(LPCWSTR filePath)
     if (FAILED(hr)) return hr;
 
     m_channelCount = pWaveFormat->nChannels;
+    if (pWaveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && waveFormatSize >= sizeof(WAVEFORMATEXTENSIBLE))
+    {
+        m_channelMask = reinterpret_cast<WAVEFORMATEXTENSIBLE*>(pWaveFormat)->dwChannelMask;
+    }
     m_sampleRate = pWaveFormat->nSamplesPerSec;
 
-    // Get duration to pre-allocate buffer
+    // Duration is in 100-nanosecond units
     hr = pSourceReader->GetPresentationAttribute(static_cast<DWORD>(MF_SOURCE_READER_MEDIASOURCE),
                                                 MF_PD_DURATION, &propVariant);
     if (FAILED(hr)) return hr;
 
-    // Duration is in 100-nanosecond units
-    LONGLONG duration = propVariant.uhVal.QuadPart;
+    *pDuration = static_cast<LONGLONG>(propVariant.uhVal.QuadPart);
+
+    // The caller owns the reader now
+    *ppSourceReader = pSourceReader;
+    pSourceReader = nullptr;
+    return S_OK;
+}
+
+HRESULT AudioFileReader::DecodeFile(LPCWSTR filePath)
+{
+    CComPtr<IMFSourceReader> spSourceReader;
+    LONGLONG duration = 0;
+    HRESULT hr = OpenSourceReader(filePath, &spSourceReader, &duration);
+    if (FAILED(hr)) return hr;
 
     // Calculate number of frames based on duration and sample rate
     UINT64 totalFrames = (duration * m_sampleRate) / 10000000;
@@ -135,7 +469,7 @@ HRESULT AudioFileReader::Initialize(LPCWSTR filePath)
     {
         IMFSample* pSample = nullptr;
 
-        hr = pSourceReader->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM),
+        hr = spSourceReader->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM),
                                      0, &actualStreamIndex, &flags, &timestamp, &pSample);
         if (FAILED(hr)) {
             SafeRelease(&pSample);
@@ -188,245 +522,767 @@ HRESULT AudioFileReader::Initialize(LPCWSTR filePath)
     // Update actual frame count
     m_frameCount = currentFrame;
     m_isInitialized = true;
+    UpdateSilentBlocks();
     return S_OK;
 }
 
-HRESULT AudioFileReader::ResampleAudio(UINT32 targetSampleRate, UINT32 targetChannelCount)
+HRESULT AudioFileReader::ReadStreamSample()
+{
+    DWORD flags = 0;
+    DWORD actualStreamIndex = 0;
+    LONGLONG timestamp = 0;
+    CComPtr<IMFSample> spSample;
+
+    HRESULT hr = m_spStreamReader->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM),
+                                      0, &actualStreamIndex, &flags, &timestamp, &spSample);
+    if (FAILED(hr)) return hr;
+
+    if (flags & MF_SOURCE_READERF_ENDOFSTREAM)
+    {
+        // Twice in a row, the file has no frames to loop
+        if (m_streamEnded) return E_FAIL;
+        m_streamEnded = true;
+
+        // The clip loops, the resampler carries on across the loop point without a seam
+        PROPVARIANT position;
+        PropVariantInit(&position);
+        position.vt = VT_I8;
+        position.hVal.QuadPart = 0;
+        return m_spStreamReader->SetCurrentPosition(GUID_NULL, position);
+    }
+
+    if (!spSample)
+        return S_OK;
+    m_streamEnded = false;
+
+    return AppendStreamSample(spSample);
+}
+
+HRESULT AudioFileReader::AppendStreamSample(IMFSample* pSample)
+{
+    CComPtr<IMFMediaBuffer> spBuffer;
+    HRESULT hr = pSample->ConvertToContiguousBuffer(&spBuffer);
+    if (FAILED(hr)) return hr;
+
+    BYTE* pData = nullptr;
+    DWORD cbData = 0;
+    hr = spBuffer->Lock(&pData, nullptr, &cbData);
+    if (FAILED(hr)) return hr;
+
+    // Whole frames only
+    const UINT32 frames = static_cast<UINT32>(cbData / (sizeof(FLOAT32) * m_channelCount));
+    hr = AppendStreamFrames(reinterpret_cast<const FLOAT32*>(pData), frames);
+
+    spBuffer->Unlock();
+    return hr;
+}
+
+#else // !_WIN32
+
+HRESULT AudioFileReader::DecodeFile(LPCWSTR filePath)
+{
+    // Without Media Foundation only WAV files can be read
+    UNREFERENCED_PARAMETER(filePath);
+    return E_NOTIMPL;
+}
+
+#endif // _WIN32
+
+// Spreads the frames over the channels of the default layout of targetChannelCount as the mix
+// would, see BuildMixChannelMap, or gives channel n channel n modulo channelCount where that
+// takes more than a matrix
+static void ConvertChannels(const FLOAT32* pf32Input, UINT32 frameCount, UINT32 channelCount, DWORD channelMask,
+                            FLOAT32* pf32Output, UINT32 targetChannelCount)
+{
+    MIX_CHANNEL_MAP map;
+    if (BuildMixChannelMap(channelCount, channelMask, targetChannelCount, 0, &map))
+    {
+        MapMixChannels(&map, pf32Input, frameCount, pf32Output);
+        return;
+    }
+
+    for (UINT32 i = 0; i < frameCount; i++)
+    {
+        for (UINT32 c = 0; c < targetChannelCount; c++)
+            pf32Output[c] = pf32Input[c % channelCount];
+        pf32Input += channelCount;
+        pf32Output += targetChannelCount;
+    }
+}
+
+HRESULT AudioFileReader::ResampleAudio(UINT32 targetSampleRate, UINT32 targetChannelCount, AUDIO_RESAMPLE_QUALITY quality)
 {
     // If already matching the target format, no need to resample
     if (m_sampleRate == targetSampleRate && m_channelCount == targetChannelCount)
         return S_OK;
 
-    // Validate input
-    if (!m_isInitialized || m_frameCount == 0 || !m_pAudioData)
+    if (targetSampleRate == 0 || targetChannelCount == 0)
+        return E_INVALIDARG;
+
+    if (!m_isInitialized || m_frameCount == 0 || !HasAudioData())
         return E_FAIL;
 
-    // Create media foundation resources for resampling
-    IMFMediaBuffer* pInputBuffer = nullptr;
-    IMFSample* pInputSample = nullptr;
-    IMFMediaType* pInputType = nullptr;
-    IMFMediaType* pOutputType = nullptr;
-    IMFTransform* pResampler = nullptr;
-    IMFMediaBuffer* pOutputBuffer = nullptr;
-    IMFSample* pOutputSample = nullptr;
-    HRESULT hr = S_OK;
+    const FLOAT32* pf32Data = GetAudioData();
+    const INT16* pi16Data = GetAudioDataInt16();
+    const bool resample = (m_sampleRate != targetSampleRate);
+    const bool convert = (m_channelCount != targetChannelCount);
 
-    // Resource cleanup helper using RAII
-    struct ResourceGuard {
-        IMFMediaBuffer*& inputBuffer;
-        IMFSample*& inputSample;
-        IMFMediaType*& inputType;
-        IMFMediaType*& outputType;
-        IMFTransform*& resampler;
-        IMFMediaBuffer*& outputBuffer;
-        IMFSample*& outputSample;
-
-        ResourceGuard(IMFMediaBuffer*& ib, IMFSample*& is, IMFMediaType*& it, IMFMediaType*& ot,
-                     IMFTransform*& r, IMFMediaBuffer*& ob, IMFSample*& os)
-            : inputBuffer(ib), inputSample(is), inputType(it), outputType(ot),
-              resampler(r), outputBuffer(ob), outputSample(os) {}
+    AudioResampler resampler;
+    UINT64 clipFrames = m_frameCount;
+    if (resample)
+    {
+        HRESULT hr = resampler.Initialize(m_sampleRate, targetSampleRate, m_channelCount, quality);
+        if (FAILED(hr)) return hr;
 
-        ~ResourceGuard() {
-            SafeRelease(&inputBuffer);
-            SafeRelease(&inputSample);
-            SafeRelease(&inputType);
-            SafeRelease(&outputType);
-            SafeRelease(&resampler);
-            SafeRelease(&outputBuffer);
-            SafeRelease(&outputSample);
+        clipFrames = resampler.GetClipFrames(m_frameCount);
+        if (clipFrames > UINT32_MAX)
+            return E_INVALIDARG;
+    }
+
+    // Only the clip at the new format is allocated whole, the samples get there a chunk at a
+    // time: 16 bit ones converted to float, resampled straight into the clip unless the channels
+    // change as well, then spread over the new channels
+    std::unique_ptr<FLOAT32[]> newAudioData;
+    std::unique_ptr<FLOAT32[]> floatChunk;
+    std::unique_ptr<FLOAT32[]> resampledChunk;
+    try {
+        newAudioData = std::make_unique<FLOAT32[]>(clipFrames * targetChannelCount);
+        if (pf32Data == nullptr)
+            floatChunk = std::make_unique<FLOAT32[]>(static_cast<size_t>(c_resampleChunkFrames) * m_channelCount);
+        if (resample && convert)
+            resampledChunk = std::make_unique<FLOAT32[]>(static_cast<size_t>(resampler.GetMaxOutputFrames(c_resampleChunkFrames)) * m_channelCount);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    const MIX_KERNELS* pKernels = SelectMixKernels();
+    UINT64 frameCount = 0;
+    for (UINT64 first = 0; ; first += c_resampleChunkFrames)
+    {
+        // A chunk past the end of the clip flushes the resampler
+        const bool flush = (first >= m_frameCount);
+        if (flush && !resample)
+            break;
+
+        const UINT32 chunkFrames = flush ? 0 : ((m_frameCount - first < c_resampleChunkFrames) ? static_cast<UINT32>(m_frameCount - first) : c_resampleChunkFrames);
+        const FLOAT32* pf32Chunk = nullptr;
+        if (pf32Data != nullptr)
+        {
+            pf32Chunk = pf32Data + static_cast<size_t>(first) * m_channelCount;
+        }
+        else if (!flush)
+        {
+            // The same scaling as the decoder applies to 16 bit samples
+            pKernels->pfnConvertInt16Span(floatChunk.get(), pi16Data + static_cast<size_t>(first) * m_channelCount, chunkFrames * m_channelCount);
+            pf32Chunk = floatChunk.get();
         }
-    };
 
-    // Create the guard object to automatically clean up resources
-    ResourceGuard guard(pInputBuffer, pInputSample, pInputType, pOutputType,
-                       pResampler, pOutputBuffer, pOutputSample);
+        UINT32 outputFrames = chunkFrames;
+        if (resample)
+        {
+            // Process never hands out frames past GetClipFrames of the input, so they fit in the clip
+            FLOAT32* pf32Output = convert ? resampledChunk.get() : newAudioData.get() + frameCount * targetChannelCount;
+            HRESULT hr = flush ? resampler.Flush(pf32Output, &outputFrames) : resampler.Process(pf32Chunk, chunkFrames, pf32Output, &outputFrames);
+            if (FAILED(hr)) return hr;
+            pf32Chunk = pf32Output;
+        }
 
-    // Calculate input buffer size in bytes
-    UINT32 inputBufferSize = (UINT64)m_frameCount * m_channelCount * sizeof(FLOAT32);
+        if (convert)
+            ConvertChannels(pf32Chunk, outputFrames, m_channelCount, m_channelMask, newAudioData.get() + frameCount * targetChannelCount, targetChannelCount);
+        frameCount += outputFrames;
 
-    try {
-        // 1. Create a Media Foundation resampler transform
-        hr = CoCreateInstance(CLSID_CResamplerMediaObject, nullptr, CLSCTX_INPROC_SERVER,
-                             IID_IMFTransform, (void**)&pResampler);
-        if (FAILED(hr)) return hr;
+        if (flush)
+            break;
+    }
 
-        // 2. Create and configure input media type
-        hr = MFCreateMediaType(&pInputType);
-        if (FAILED(hr)) return hr;
+    UnlockOwnedData();
+    m_pAudioData = std::move(newAudioData);
+    m_pAudioDataInt16.reset();
+    ReleaseMapping();
+    m_frameCount = static_cast<UINT32>(frameCount);
+    ScaleMarkers(m_sampleRate, targetSampleRate);
+    m_sampleRate = targetSampleRate;
+    if (convert)
+    {
+        // The clip now has the default layout of the stream
+        m_channelCount = targetChannelCount;
+        m_channelMask = 0;
+        m_pChannelMap.reset();
+    }
 
-        hr = pInputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
-        if (FAILED(hr)) return hr;
+    LockOwnedData();
+    UpdateSilentBlocks();
+    return S_OK;
+}
 
-        hr = pInputType->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
-        if (FAILED(hr)) return hr;
+HRESULT AudioFileReader::Open(LPCWSTR filePath, UINT32 targetSampleRate, UINT32 maxFrameCount, UINT32 streamMinMs,
+                              LPCWSTR pcmCacheDirectory)
+{
+    // Clean up any previous data
+    Cleanup();
 
-        hr = pInputType->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, m_channelCount);
-        if (FAILED(hr)) return hr;
+    // FLAC files are decoded here, a streamed one a block at a time
+    HRESULT hr = OpenFlacFile(filePath, m_pStreamMapping, m_pStreamDecoder);
+    if (FAILED(hr)) return hr;
 
-        hr = pInputType->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, m_sampleRate);
-        if (FAILED(hr)) return hr;
+    if (hr == S_OK)
+    {
+        // Short clips are mixed from memory, see below.  Without a length a clip is streamed.
+        const FLAC_STREAM_INFO& info = m_pStreamDecoder->GetStreamInfo();
+        if (info.u64TotalFrames != 0 && info.u64TotalFrames * 1000 <= static_cast<UINT64>(streamMinMs) * info.u32SampleRate)
+            return ReadClip(filePath, targetSampleRate, pcmCacheDirectory);
+
+        m_channelCount = info.u16Channels;
+        m_channelMask = m_pStreamDecoder->GetChannelMask();
+        m_sampleRate = info.u32SampleRate;
+        m_sourceBitsPerSample = info.u16BitsPerSample;
+
+        hr = StartStreaming(targetSampleRate, maxFrameCount);
+        if (FAILED(hr))
+            Cleanup();
+        return hr;
+    }
 
-        hr = pInputType->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, m_channelCount * sizeof(FLOAT32));
-        if (FAILED(hr)) return hr;
+#if defined(_WIN32)
+    LONGLONG duration = 0;
+    hr = OpenSourceReader(filePath, &m_spStreamReader, &duration);
+    if (FAILED(hr)) return hr;
 
-        hr = pInputType->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, (UINT64)m_sampleRate * m_channelCount * sizeof(FLOAT32));
-        if (FAILED(hr)) return hr;
+    // Short clips are mixed from memory, opening the file again costs little next to decoding it.
+    // Mapped ones are read by the real-time thread, which must not fault the pages in.
+    if (duration <= static_cast<LONGLONG>(streamMinMs) * 10000)
+        return ReadClip(filePath, targetSampleRate, pcmCacheDirectory);
+
+    hr = StartStreaming(targetSampleRate, maxFrameCount);
+    if (FAILED(hr))
+        Cleanup();
+    return hr;
+#else
+    // Other files are not streamed without Media Foundation, the whole file is read
+    return ReadClip(filePath, targetSampleRate, pcmCacheDirectory);
+#endif
+}
 
-        hr = pInputType->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, 32); // 32-bit float
-        if (FAILED(hr)) return hr;
+HRESULT AudioFileReader::ReadClip(LPCWSTR filePath, UINT32 targetSampleRate, LPCWSTR pcmCacheDirectory)
+{
+    // Mapped clips are read by the real-time thread, which must not fault the pages in
+    if (pcmCacheDirectory == nullptr || *pcmCacheDirectory == 0)
+        return Initialize(filePath, AUDIO_MAPPING_PREFAULT | AUDIO_MAPPING_LOCK);
 
-        hr = pInputType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
-        if (FAILED(hr)) return hr;
+    // Drop what Open probed the file with, the clip is read whole
+    Cleanup();
 
-        // 3. Create and configure output media type
-        hr = MFCreateMediaType(&pOutputType);
-        if (FAILED(hr)) return hr;
+    // The cache file is named after what is in the source, a copied or renamed clip still finds it
+    UINT64 sourceHash = 0;
+    UINT64 cbSource = 0;
+    {
+        AudioFileMapping source;
+        HRESULT hrSource = source.Open(filePath, 0);
+        if (FAILED(hrSource)) return hrSource;
 
-        hr = pOutputType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
-        if (FAILED(hr)) return hr;
+        sourceHash = HashAudioBytes(source.GetData(), source.GetSize(), 0);
+        cbSource = source.GetSize();
+    }
 
-        hr = pOutputType->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
-        if (FAILED(hr)) return hr;
+    std::wstring cachePath;
+    HRESULT hr = GetAudioPcmCachePath(pcmCacheDirectory, sourceHash, targetSampleRate, &cachePath);
+    if (FAILED(hr)) return hr;
 
-        hr = pOutputType->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, targetChannelCount);
-        if (FAILED(hr)) return hr;
+    hr = ReadPcmCacheFile(cachePath.c_str(), sourceHash, cbSource, targetSampleRate);
+    if (hr != S_FALSE) return hr;
 
-        hr = pOutputType->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, targetSampleRate);
-        if (FAILED(hr)) return hr;
+    hr = Initialize(filePath, AUDIO_MAPPING_PREFAULT | AUDIO_MAPPING_LOCK);
+    if (FAILED(hr)) return hr;
 
-        hr = pOutputType->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, targetChannelCount * sizeof(FLOAT32));
-        if (FAILED(hr)) return hr;
+    // WAV files at the stream rate are mixed out of their own mapping, or a locked copy of it
+    // where it could not be locked, there is nothing to save
+    if ((IsMapped() || m_lockOwnedData) && m_sampleRate == targetSampleRate)
+        return S_OK;
 
-        hr = pOutputType->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, (UINT64)targetSampleRate * targetChannelCount * sizeof(FLOAT32));
-        if (FAILED(hr)) return hr;
+    hr = ResampleAudio(targetSampleRate, m_channelCount);
+    if (FAILED(hr)) return hr;
 
-        hr = pOutputType->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, 32); // 32-bit float
-        if (FAILED(hr)) return hr;
+    // Only float clips are written, a 16 bit one is stored as it came
+    const FLOAT32* pf32Data = GetAudioData();
+    if (pf32Data == nullptr)
+        return S_OK;
 
-        hr = pOutputType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
-        if (FAILED(hr)) return hr;
+    AUDIO_PCM_CACHE_INFO info = {};
+    info.u64SourceHash = sourceHash;
+    info.cbSource = cbSource;
+    info.u32SampleRate = m_sampleRate;
+    info.u32ChannelCount = m_channelCount;
+    info.dwChannelMask = m_channelMask;
+    info.u32SourceBitsPerSample = m_sourceBitsPerSample;
+    info.u32FrameCount = m_frameCount;
+    info.u32LoopStart = m_loopStart;
+    info.u32LoopEnd = m_loopEnd;
+    info.u32CuePoints = (m_cuePoints.size() < WAV_MAX_CUE_POINTS) ? static_cast<UINT32>(m_cuePoints.size()) : WAV_MAX_CUE_POINTS;
+    for (UINT32 i = 0; i < info.u32CuePoints; i++)
+        info.au32CueFrames[i] = m_cuePoints[i];
+
+    // A cache that cannot be written costs the next load a decode, nothing else
+    WriteAudioPcmCache(cachePath.c_str(), &info, pf32Data);
+    return S_OK;
+}
 
-        // 4. Set input and output types on the resampler transform
-        hr = pResampler->SetInputType(0, pInputType, 0);
-        if (FAILED(hr)) return hr;
+HRESULT AudioFileReader::ReadPcmCacheFile(LPCWSTR cachePath, UINT64 sourceHash, UINT64 cbSource, UINT32 targetSampleRate)
+{
+    std::unique_ptr<AudioFileMapping> pMapping;
+    try {
+        pMapping = std::make_unique<AudioFileMapping>();
+    }
+    catch (std::bad_alloc&) {
+        return S_FALSE;
+    }
 
-        hr = pResampler->SetOutputType(0, pOutputType, 0);
-        if (FAILED(hr)) return hr;
+    // Checking the samples against their checksum prefaults them as well
+    AUDIO_PCM_CACHE_INFO info;
+    const FLOAT32* pf32Samples = nullptr;
+    if (FAILED(pMapping->Open(cachePath, AUDIO_MAPPING_PREFAULT | AUDIO_MAPPING_LOCK)) ||
+        FAILED(ParseAudioPcmCache(pMapping->GetData(), pMapping->GetSize(), &info, &pf32Samples)) ||
+        info.u64SourceHash != sourceHash || info.cbSource != cbSource || info.u32SampleRate != targetSampleRate)
+        return S_FALSE;
 
-        // 5. Process the audio data through the resampler
+    try {
+        m_cuePoints.assign(info.au32CueFrames, info.au32CueFrames + info.u32CuePoints);
+    }
+    catch (std::bad_alloc&) {
+        Cleanup();
+        return E_OUTOFMEMORY;
+    }
 
-        // Create input sample
-        hr = MFCreateSample(&pInputSample);
-        if (FAILED(hr)) return hr;
+    m_channelCount = info.u32ChannelCount;
+    m_channelMask = info.dwChannelMask;
+    m_sampleRate = info.u32SampleRate;
+    m_sourceBitsPerSample = info.u32SourceBitsPerSample;
+    m_frameCount = info.u32FrameCount;
+    m_loopStart = info.u32LoopStart;
+    m_loopEnd = info.u32LoopEnd;
+    m_pMappedData = pf32Samples;
+    m_pMapping = std::move(pMapping);
+    m_isInitialized = true;
 
-        // Create input buffer
-        hr = MFCreateMemoryBuffer(inputBufferSize, &pInputBuffer);
-        if (FAILED(hr)) return hr;
+    // As in ReadWavFile, samples that could not be locked are copied into locked memory
+    if (!m_pMapping->IsLocked())
+    {
+        HRESULT hr = UseLockedOwnedData();
+        if (FAILED(hr))
+        {
+            Cleanup();
+            return hr;
+        }
+    }
 
-        // Copy audio data to input buffer
-        BYTE* pInputData = nullptr;
-        hr = pInputBuffer->Lock(&pInputData, nullptr, nullptr);
-        if (FAILED(hr)) return hr;
+    UpdateSilentBlocks();
+    return S_OK;
+}
 
-        memcpy(pInputData, m_pAudioData.get(), inputBufferSize);
+HRESULT AudioFileReader::StartStreaming(UINT32 targetSampleRate, UINT32 maxFrameCount)
+{
+    if (m_channelCount == 0 || targetSampleRate == 0 || maxFrameCount == 0)
+        return E_INVALIDARG;
 
-        hr = pInputBuffer->Unlock();
-        if (FAILED(hr)) return hr;
+    HRESULT hr = S_OK;
 
-        hr = pInputBuffer->SetCurrentLength(inputBufferSize);
-        if (FAILED(hr)) return hr;
+    // The worker resamples on the way, so the ring holds frames at the rate of the stream
+    if (m_sampleRate != targetSampleRate)
+    {
+        try {
+            m_pStreamResampler = std::make_unique<AudioResampler>();
+        }
+        catch (std::bad_alloc&) {
+            return E_OUTOFMEMORY;
+        }
 
-        hr = pInputSample->AddBuffer(pInputBuffer);
+        hr = m_pStreamResampler->Initialize(m_sampleRate, targetSampleRate, m_channelCount);
         if (FAILED(hr)) return hr;
+    }
 
-        // Set sample timestamp and duration
-        LONGLONG sampleDuration = static_cast<LONGLONG>(m_frameCount) * 10000000 / m_sampleRate;
-        hr = pInputSample->SetSampleTime(0);
-        if (FAILED(hr)) return hr;
+    // A few periods at least, whatever the rate
+    UINT32 ringFrames = static_cast<UINT32>(static_cast<UINT64>(targetSampleRate) * c_streamRingMs / 1000);
+    if (ringFrames < 4 * maxFrameCount)
+        ringFrames = 4 * maxFrameCount;
 
-        hr = pInputSample->SetSampleDuration(sampleDuration);
-        if (FAILED(hr)) return hr;
+    try {
+        m_pStream = std::make_unique<MIX_STREAM>();
+        m_pStreamBuffer = std::make_unique<BYTE[]>(GetMixStreamBufferSize(ringFrames, maxFrameCount, m_channelCount));
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+    InitMixStream(m_pStream.get(), ringFrames, maxFrameCount, m_channelCount, m_pStreamBuffer.get());
 
-        // Process input
-        hr = pResampler->ProcessInput(0, pInputSample, 0);
-        if (FAILED(hr)) return hr;
+    // The clip has no length of its own any more, it is a stream at the target rate
+    m_frameCount = 0;
+    m_sampleRate = targetSampleRate;
 
-        // 6. Get the output from the transform
-        MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {};
-        DWORD dwStatus = 0;
+    // The ring starts full, so the first periods do not wait for the worker
+    hr = FillStream();
+    if (FAILED(hr)) return hr;
 
-        // Create output sample
-        hr = MFCreateSample(&pOutputSample);
-        if (FAILED(hr)) return hr;
+    try {
+        m_streamThread = std::thread(&AudioFileReader::StreamWorker, this);
+    }
+    catch (std::system_error&) {
+        return E_FAIL;
+    }
 
-        // Calculate expected output buffer size
-        UINT32 expectedFrames = (UINT32)((UINT64)m_frameCount * targetSampleRate / m_sampleRate);
-        UINT32 outputBufferSize = (UINT64)expectedFrames * targetChannelCount * sizeof(FLOAT32);
+    m_isInitialized = true;
+    return S_OK;
+}
 
-        // Create output buffer
-        hr = MFCreateMemoryBuffer(outputBufferSize, &pOutputBuffer);
-        if (FAILED(hr)) return hr;
+void AudioFileReader::StopStreaming()
+{
+    if (m_streamThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_streamMutex);
+            m_stopStreaming = true;
+        }
+        m_streamStopped.notify_all();
+        m_streamThread.join();
+    }
+    m_stopStreaming = false;
+
+#if defined(_WIN32)
+    m_spStreamReader.Release();
+#endif
+    m_pStreamResampler.reset();
+    m_pStreamDecoder.reset();
+    m_pStreamMapping.reset();
+    std::vector<FLOAT32>().swap(m_streamPending);
+    std::vector<FLOAT32>().swap(m_streamDecoded);
+    m_streamPendingOffset = 0;
+    m_streamEnded = false;
+    m_pStream.reset();
+    m_pStreamBuffer.reset();
+}
 
-        hr = pOutputSample->AddBuffer(pOutputBuffer);
-        if (FAILED(hr)) return hr;
+void AudioFileReader::StreamWorker()
+{
+#if defined(_WIN32)
+    // The source reader is a COM object
+    const HRESULT hrCom = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+
+    // Woken a few times per ring, so the ring never drains while the worker sleeps
+    std::unique_lock<std::mutex> lock(m_streamMutex);
+    while (!m_streamStopped.wait_for(lock, std::chrono::milliseconds(c_streamRingMs / 4), [this]() { return m_stopStreaming; }))
+    {
+        lock.unlock();
+        const HRESULT hr = FillStream();
+        lock.lock();
 
-        outputDataBuffer.pSample = pOutputSample;
+        // A file that cannot be read any more lets the stream run dry, which shows as underruns
+        if (FAILED(hr))
+            break;
+    }
+    lock.unlock();
 
-        // Process output
-        hr = pResampler->ProcessOutput(0, 1, &outputDataBuffer, &dwStatus);
-        if (FAILED(hr)) return hr;
+#if defined(_WIN32)
+    if (SUCCEEDED(hrCom))
+        CoUninitialize();
+#endif
+}
+
+HRESULT AudioFileReader::FillStream()
+{
+    for (;;)
+    {
+        // Frames decoded earlier go first, what does not fit waits for the next time round
+        if (m_streamPendingOffset < m_streamPending.size())
+        {
+            const UINT32 frames = static_cast<UINT32>((m_streamPending.size() - m_streamPendingOffset) / m_channelCount);
+            const UINT32 written = WriteMixStream(m_pStream.get(), &m_streamPending[m_streamPendingOffset], frames);
 
-        // 7. Copy resampled data from output buffer to our member variable
+            m_streamPendingOffset += static_cast<size_t>(written) * m_channelCount;
+            if (written < frames)
+                return S_OK;
+        }
 
-        // Get output buffer details
-        IMFMediaBuffer* pActualOutputBuffer = nullptr;
-        hr = pOutputSample->GetBufferByIndex(0, &pActualOutputBuffer);
+        HRESULT hr = DecodeStream();
         if (FAILED(hr)) return hr;
+    }
+}
 
-        BYTE* pOutputData = nullptr;
-        DWORD cbOutputLength = 0;
+HRESULT AudioFileReader::DecodeStream()
+{
+    // The buffer keeps its capacity, so it stops growing after the largest sample of the file
+    m_streamPending.clear();
+    m_streamPendingOffset = 0;
 
-        // Use a scope to ensure proper cleanup of the output buffer
-        {
-            hr = pActualOutputBuffer->Lock(&pOutputData, nullptr, &cbOutputLength);
-            if (FAILED(hr)) {
-                SafeRelease(&pActualOutputBuffer);
-                return hr;
-            }
+#if defined(_WIN32)
+    if (!m_pStreamDecoder)
+        return ReadStreamSample();
+#endif
+
+    return DecodeStreamBlock();
+}
+
+HRESULT AudioFileReader::DecodeStreamBlock()
+{
+    // A block on its way into the resampler waits in a buffer of its own
+    std::vector<FLOAT32>& block = m_pStreamResampler ? m_streamDecoded : m_streamPending;
+    const FLAC_STREAM_INFO& info = m_pStreamDecoder->GetStreamInfo();
+    try {
+        block.resize(static_cast<size_t>(info.u32MaxBlockSize) * m_channelCount);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
 
-            // Calculate actual frame count from output buffer size
-            UINT32 actualFrames = cbOutputLength / (targetChannelCount * sizeof(FLOAT32));
+    UINT32 frames = 0;
+    HRESULT hr = m_pStreamDecoder->DecodeBlock(block.data(), &frames);
+    block.resize(static_cast<size_t>(frames) * m_channelCount);
+    if (FAILED(hr)) return hr;
 
-            // Allocate new buffer for the resampled audio
-            std::unique_ptr<FLOAT32[]> newAudioData = std::make_unique<FLOAT32[]>(static_cast<UINT64>(actualFrames) * targetChannelCount);
+    if (hr == S_FALSE)
+    {
+        // Twice in a row, the file has no frames to loop
+        if (m_streamEnded) return E_FAIL;
+        m_streamEnded = true;
 
-            // Copy resampled data
-            memcpy(newAudioData.get(), pOutputData, cbOutputLength);
+        // The clip loops, its first frame is where the decoder starts
+        return m_pStreamDecoder->Seek(0);
+    }
+    m_streamEnded = false;
 
-            // Unlock buffer before updating our member variables
-            pActualOutputBuffer->Unlock();
+    if (m_pStreamResampler)
+        return AppendStreamFrames(m_streamDecoded.data(), frames);
+    return S_OK;
+}
 
-            // 8. Update member variables with new audio data
-            m_pAudioData = std::move(newAudioData);
-            m_frameCount = actualFrames;
-            m_sampleRate = targetSampleRate;
-            m_channelCount = targetChannelCount;
+HRESULT AudioFileReader::AppendStreamFrames(const FLOAT32* pf32Frames, UINT32 frameCount)
+{
+    const size_t pending = m_streamPending.size();
+    if (!m_pStreamResampler)
+    {
+        try {
+            m_streamPending.insert(m_streamPending.end(), pf32Frames, pf32Frames + static_cast<size_t>(frameCount) * m_channelCount);
         }
+        catch (std::bad_alloc&) {
+            return E_OUTOFMEMORY;
+        }
+        return S_OK;
+    }
+
+    // The resampler carries its filter across the loop point, so the clip loops without a seam
+    try {
+        m_streamPending.resize(pending + static_cast<size_t>(m_pStreamResampler->GetMaxOutputFrames(frameCount)) * m_channelCount);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    UINT32 resampledFrames = 0;
+    HRESULT hr = m_pStreamResampler->Process(pf32Frames, frameCount, m_streamPending.data() + pending, &resampledFrames);
+    m_streamPending.resize(pending + static_cast<size_t>(resampledFrames) * m_channelCount);
+    return hr;
+}
+
+HRESULT AudioFileReader::MapChannels(UINT32 targetChannelCount, DWORD targetChannelMask)
+{
+    if (!m_isInitialized || (!m_pStream && (m_frameCount == 0 || !HasAudioData())))
+        return E_FAIL;
+
+    try {
+        std::unique_ptr<MIX_CHANNEL_MAP> channelMap = std::make_unique<MIX_CHANNEL_MAP>();
 
-        SafeRelease(&pActualOutputBuffer);
+        if (!BuildMixChannelMap(m_channelCount, m_channelMask, targetChannelCount, targetChannelMask, channelMap.get()))
+        {
+            // Too many channels for a matrix, let the resampler convert the clip, which
+            // takes the whole clip in memory
+            m_pChannelMap.reset();
+            if (m_pStream)
+                return E_NOTIMPL;
+            return ResampleAudio(m_sampleRate, targetChannelCount);
+        }
+
+        if (channelMap->mapping == MIX_MAPPING_IDENTITY)
+            channelMap.reset();
+
+        m_pChannelMap = std::move(channelMap);
+        return S_OK;
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+}
+
+HRESULT AudioFileReader::CrossfadeLoop(UINT32 crossfadeFrames)
+{
+    // A streamed clip loops as decoded, the crossfade needs the whole clip
+    if (m_pStream)
+        return S_OK;
+
+    if (!m_isInitialized || m_frameCount == 0 || !HasAudioData())
+        return E_FAIL;
+
+    if (crossfadeFrames == 0)
         return S_OK;
 
-    } catch (std::bad_alloc&) {
+    // The crossfade is worked out in place on float samples, so mapped ones are copied
+    HRESULT hr = UseOwnedFloatData();
+    if (FAILED(hr)) return hr;
+
+    // The dropped tail stays allocated, the clip just ends before it
+    m_frameCount = CrossfadeMixLoop(m_pAudioData.get(), m_frameCount, m_channelCount, crossfadeFrames);
+    ScaleMarkers(m_sampleRate, m_sampleRate);
+    UpdateSilentBlocks();
+    return S_OK;
+}
+
+template <class T>
+static void RepeatSamples(std::unique_ptr<T[]>& data, const T* source, UINT64 frameSamples, UINT32 repeats)
+{
+    std::unique_ptr<T[]> newData = std::make_unique<T[]>(frameSamples * repeats);
+
+    for (UINT32 i = 0; i < repeats; i++)
+    {
+        memcpy(&newData[frameSamples * i], source, frameSamples * sizeof(T));
+    }
+
+    data = std::move(newData);
+}
+
+HRESULT AudioFileReader::RepeatToLength(UINT32 minFrameCount)
+{
+    // A streamed clip is played a period at a time, it never wraps within one
+    if (m_pStream)
+        return S_OK;
+
+    if (!m_isInitialized || m_frameCount == 0 || !HasAudioData())
+        return E_FAIL;
+
+    if (m_frameCount >= minFrameCount)
+        return S_OK;
+
+    // Whole loops only, so the looped playback stays unchanged
+    const UINT32 repeats = (minFrameCount + m_frameCount - 1) / m_frameCount;
+    const UINT64 frameSamples = static_cast<UINT64>(m_frameCount) * m_channelCount;
+
+    UnlockOwnedData();
+    try {
+        // Mapped samples are repeated straight out of the mapping
+        if (GetAudioData())
+            RepeatSamples(m_pAudioData, GetAudioData(), frameSamples, repeats);
+        else
+            RepeatSamples(m_pAudioDataInt16, GetAudioDataInt16(), frameSamples, repeats);
+
+        ReleaseMapping();
+        m_frameCount *= repeats;
+        LockOwnedData();
+        UpdateSilentBlocks();
+        return S_OK;
+    }
+    catch (std::bad_alloc&) {
+        LockOwnedData();
         return E_OUTOFMEMORY;
     }
 }
 
+HRESULT AudioFileReader::UseSourceBitDepth()
+{
+    // A streamed clip only ever holds a ring of float frames
+    if (m_pStream)
+        return S_OK;
+
+    if (!m_isInitialized || m_frameCount == 0 || !HasAudioData())
+        return E_FAIL;
+
+    // Already compact, or the source needs more than 16 bits
+    if (!m_pAudioData || m_sourceBitsPerSample == 0 || m_sourceBitsPerSample > 16)
+        return S_OK;
+
+    const UINT64 samples = static_cast<UINT64>(m_frameCount) * m_channelCount;
+
+    try {
+        std::unique_ptr<INT16[]> newAudioData = std::make_unique<INT16[]>(samples);
+
+        // Exact for clips that were not resampled, the decoder scaled them by 1/32768
+        for (UINT64 i = 0; i < samples; i++)
+        {
+            FLOAT32 sample = m_pAudioData[i] * 32768.0f;
+            if (sample > 32767.0f) sample = 32767.0f;
+            if (sample < -32768.0f) sample = -32768.0f;
+            newAudioData[i] = static_cast<INT16>(lrintf(sample));
+        }
+
+        UnlockOwnedData();
+        m_pAudioDataInt16 = std::move(newAudioData);
+        m_pAudioData.reset();
+        LockOwnedData();
+        return S_OK;
+    }
+    catch (std::bad_alloc&) {
+        // Keep mixing the float samples
+        return S_OK;
+    }
+}
+
+void AudioFileReader::UpdateSilentBlocks()
+{
+    m_pSilentBlocks.reset();
+
+    if (!HasAudioData() || m_frameCount == 0)
+        return;
+
+    // Without a map the clip is just never taken for silent
+    try {
+        m_pSilentBlocks = std::make_unique<BYTE[]>(GetMixSilentBlockCount(m_frameCount));
+        if (GetAudioData())
+            FindMixSilentBlocks(GetAudioData(), m_frameCount, m_channelCount, m_pSilentBlocks.get());
+        else
+            FindMixSilentBlocks(GetAudioDataInt16(), m_frameCount, m_channelCount, m_pSilentBlocks.get());
+    }
+    catch (std::bad_alloc&) {
+    }
+}
+
+void AudioFileReader::ScaleMarkers(UINT32 sourceRate, UINT32 targetRate)
+{
+    const UINT64 loopStart = static_cast<UINT64>(m_loopStart) * targetRate / sourceRate;
+    const UINT64 loopEnd = static_cast<UINT64>(m_loopEnd) * targetRate / sourceRate;
+    if (loopStart < loopEnd && loopEnd <= m_frameCount)
+    {
+        m_loopStart = static_cast<UINT32>(loopStart);
+        m_loopEnd = static_cast<UINT32>(loopEnd);
+    }
+    else
+    {
+        m_loopStart = 0;
+        m_loopEnd = 0;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < m_cuePoints.size(); i++)
+    {
+        const UINT64 cue = static_cast<UINT64>(m_cuePoints[i]) * targetRate / sourceRate;
+        if (cue < m_frameCount)
+            m_cuePoints[kept++] = static_cast<UINT32>(cue);
+    }
+    m_cuePoints.resize(kept);
+}
 
 void AudioFileReader::Cleanup()
 {
+    StopStreaming();
+    UnlockOwnedData();
+    m_lockOwnedData = false;
     m_pAudioData.reset();
+    m_pAudioDataInt16.reset();
+    ReleaseMapping();
+    m_pSilentBlocks.reset();
+    m_pChannelMap.reset();
     m_frameCount = 0;
     m_channelCount = 0;
+    m_channelMask = 0;
     m_sampleRate = 0;
+    m_sourceBitsPerSample = 0;
+    m_loopStart = 0;
+    m_loopEnd = 0;
+    m_cuePoints.clear();
     m_isInitialized = false;
 }
@@ -3,19 +3,32 @@
 //
 // Description:
 //
-//  Implementation of AudioFileReader class
+//  Implementation of AudioFileReader class.  WAV files are read by the portable
+//  parser of AudioFileMapping.h and FLAC files by the decoder of FlacDecoder.h on
+//  every platform, and clips are resampled by AudioResampler.h everywhere; other
+//  files need Media Foundation and are only available on Windows.
 //
 
 #pragma once
 
+#if defined(_WIN32)
 #include <atlbase.h>
 #include <mmreg.h>
 #include <mfapi.h>
 #include <mfidl.h>
 #include <mfreadwrite.h>
 #include <atlcoll.h>
-#include <memory>
 #include <AudioAPOTypes.h>
+#endif
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AudioFileMapping.h"
+#include "AudioMixKernels.h"
+#include "AudioResampler.h"
+#include "FlacDecoder.h"
 
 template <class T>
 void SafeRelease(T** ppT)
@@ -33,34 +46,201 @@ public:
     AudioFileReader();
     ~AudioFileReader();
 
-    // Initialize the reader with a file path
-    HRESULT Initialize(LPCWSTR filePath);
+    // Initialize the reader with a file path.  WAV files are not decoded: float and 16 bit
+    // samples are read straight out of a mapping of the file, mappingFlags tell whether
+    // its pages are prefaulted or locked, see AUDIO_MAPPING_PREFAULT.  8, 24 and 32 bit
+    // samples are converted to float.  FLAC files are decoded by as many threads as there
+    // are processors.
+    HRESULT Initialize(LPCWSTR filePath, DWORD mappingFlags = 0);
+
+    // Open the file for a stream at targetSampleRate processing periods of up to maxFrameCount
+    // frames.  A clip longer than streamMinMs is not decoded up front: a worker thread decodes
+    // and resamples it ahead into a ring of fixed size, see GetStream, so its memory does not
+    // grow with its length.  Shorter clips are decoded whole, as by Initialize.  FLAC files
+    // are streamed a FLAC block at a time.
+    // With a pcmCacheDirectory a short clip that has to be decoded or resampled is kept at
+    // targetSampleRate in a cache file there, see AudioPcmCache.h, and mapped from it when
+    // opened again at that rate.
+    HRESULT Open(LPCWSTR filePath, UINT32 targetSampleRate, UINT32 maxFrameCount, UINT32 streamMinMs,
+                 LPCWSTR pcmCacheDirectory = nullptr);
+
+    // Get the loaded audio data, nullptr once it is stored as 16 bit samples
+    const FLOAT32* GetAudioData() const { return m_pAudioData ? m_pAudioData.get() : m_pMappedData; }
+
+    // Get the loaded audio data stored as 16 bit samples, see UseSourceBitDepth
+    const INT16* GetAudioDataInt16() const { return m_pAudioDataInt16 ? m_pAudioDataInt16.get() : m_pMappedDataInt16; }
 
-    // Get the loaded audio data
-    const FLOAT32* GetAudioData() const { return m_pAudioData.get(); }
+    // Check whether the audio data is read straight out of the mapping of the file
+    bool IsMapped() const { return m_pMapping != nullptr; }
 
-    // Get the number of frames in the audio file
+    // Get the map of all zero blocks of the audio data, see FindMixSilentBlocks
+    const BYTE* GetSilentBlocks() const { return m_pSilentBlocks.get(); }
+
+    // Get the number of frames in the audio file, 0 for a streamed clip
     UINT32 GetFrameCount() const { return m_frameCount; }
 
+    // Get the ring the worker decodes a streamed clip into, nullptr for a clip in memory
+    MIX_STREAM* GetStream() const { return m_pStream.get(); }
+
+    // Get the number of periods a streamed clip ran short of frames and went silent
+    UINT32 GetStreamUnderruns() const { return m_pStream ? m_pStream->u32Underruns.load() : 0; }
+
     // Get the number of channels in the audio file
     UINT32 GetChannelCount() const { return m_channelCount; }
 
+    // Get the speaker positions of the channels, 0 if the file does not tell
+    DWORD GetChannelMask() const { return m_channelMask; }
+
+    // Get the map of the clip channels on the stream, nullptr if they match, see MapChannels
+    const MIX_CHANNEL_MAP* GetChannelMap() const { return m_pChannelMap.get(); }
+
     // Get the sample rate of the audio file
     UINT32 GetSampleRate() const { return m_sampleRate; }
 
+    // Get the loop of the smpl chunk of a WAV file, in frames with an exclusive end, 0 and 0 without one
+    UINT32 GetLoopStart() const { return m_loopStart; }
+    UINT32 GetLoopEnd() const { return m_loopEnd; }
+
+    // Get the cue points of a WAV file in frames, see WAV_MAX_CUE_POINTS
+    const std::vector<UINT32>& GetCuePoints() const { return m_cuePoints; }
+
     // Check if reader is initialized and valid
     bool IsValid() const { return m_isInitialized; }
 
-    // Resample the audio data to match the target sample rate and channel count
-    HRESULT ResampleAudio(UINT32 targetSampleRate, UINT32 targetChannelCount);
+    // Resample the audio data to match the target sample rate and channel count, with the
+    // filter of quality.  A clip of another channel count gets the default layout of
+    // targetChannelCount, its channels spread over it as the mix would.  The samples go
+    // into the new clip a chunk at a time, so next to it only the old clip is held.
+    HRESULT ResampleAudio(UINT32 targetSampleRate, UINT32 targetChannelCount,
+                          AUDIO_RESAMPLE_QUALITY quality = AUDIO_RESAMPLE_QUALITY_HIGH);
+
+    // Prepare the clip for a stream of targetChannelCount channels at the speaker positions
+    // of targetChannelMask.  The clip keeps its own channels and is spread over the stream
+    // by the mix kernels; only a layout the channel map does not cover is converted here.
+    HRESULT MapChannels(UINT32 targetChannelCount, DWORD targetChannelMask);
+
+    // Crossfade the end of the clip into its start over crossfadeFrames frames, so it
+    // loops without a click while the mix still reads it straight through, see
+    // CrossfadeMixLoop.  Call once the clip is resampled and before RepeatToLength.
+    HRESULT CrossfadeLoop(UINT32 crossfadeFrames);
+
+    // Loop a clip shorter than minFrameCount until it is at least that long, so a
+    // processing period of up to minFrameCount frames wraps around it at most once
+    HRESULT RepeatToLength(UINT32 minFrameCount);
+
+    // Store the clip as 16 bit samples if the source has no more than 16 bits, halving
+    // its memory and the bandwidth of mixing it.  Call once the clip is resampled.
+    HRESULT UseSourceBitDepth();
 
     // Clean up and release resources
     void Cleanup();
 
 private:
+    // Rebuild the silent block map once the audio data has changed
+    void UpdateSilentBlocks();
+
+    // Read a WAV file without the decoder, S_FALSE if the decoder has to read it
+    HRESULT ReadWavFile(LPCWSTR filePath, DWORD mappingFlags);
+
+    // Decode a whole FLAC file without Media Foundation, S_FALSE if it is not one
+    HRESULT ReadFlacFile(LPCWSTR filePath);
+
+    // Decode a whole file with Media Foundation
+    HRESULT DecodeFile(LPCWSTR filePath);
+
+    // Read a short clip at targetSampleRate, from the cache file in pcmCacheDirectory if there
+    // is a good one, otherwise decoded, resampled and written to the cache, see Open
+    HRESULT ReadClip(LPCWSTR filePath, UINT32 targetSampleRate, LPCWSTR pcmCacheDirectory);
+
+    // Map the clip out of a cache file, S_FALSE if it is not there or not the one of the source
+    HRESULT ReadPcmCacheFile(LPCWSTR cachePath, UINT64 sourceHash, UINT64 cbSource, UINT32 targetSampleRate);
+
+    // Move the loop and cue points from sourceRate to targetRate, dropping the ones past the clip
+    void ScaleMarkers(UINT32 sourceRate, UINT32 targetRate);
+
+    // Make the audio data owned float samples, for the stages that rewrite it
+    HRESULT UseOwnedFloatData();
+
+    // Drop the mapping once the audio data no longer points into it
+    void ReleaseMapping();
+
+    // Copy a mapping that could not be locked into owned samples that are locked instead
+    HRESULT UseLockedOwnedData();
+
+    // Lock the owned samples if m_lockOwnedData, and unlock them before they are replaced
+    void LockOwnedData();
+    void UnlockOwnedData();
+
+    // Check whether there is audio data, owned or mapped
+    bool HasAudioData() const { return GetAudioData() != nullptr || GetAudioDataInt16() != nullptr; }
+
+    // Set up the ring of the clip m_spStreamReader or m_pStreamDecoder reads, fill it and start the worker
+    HRESULT StartStreaming(UINT32 targetSampleRate, UINT32 maxFrameCount);
+
+    // Stop the worker and drop the ring
+    void StopStreaming();
+
+    // Body of the worker, tops the ring up until StopStreaming
+    void StreamWorker();
+
+    // Decode into the ring until it is full
+    HRESULT FillStream();
+
+    // Decode the next frames of the clip into m_streamPending, looping at the end of the file
+    HRESULT DecodeStream();
+
+    // Decode the next FLAC block of the clip into m_streamPending, through the resampler if there is one
+    HRESULT DecodeStreamBlock();
+
+    // Append frames of the clip to m_streamPending, through the resampler if there is one
+    HRESULT AppendStreamFrames(const FLOAT32* pf32Frames, UINT32 frameCount);
+
+#if defined(_WIN32)
+    // Open the source reader at float output and read the format and the duration of the file
+    HRESULT OpenSourceReader(LPCWSTR filePath, IMFSourceReader** ppSourceReader, LONGLONG* pDuration);
+
+    // Read the next sample of the clip from the source reader into m_streamPending
+    HRESULT ReadStreamSample();
+
+    // Append the frames of a sample to m_streamPending, see AppendStreamFrames
+    HRESULT AppendStreamSample(IMFSample* pSample);
+#endif
+
     std::unique_ptr<FLOAT32[]> m_pAudioData;
+    std::unique_ptr<INT16[]> m_pAudioDataInt16;
+    std::unique_ptr<BYTE[]> m_pSilentBlocks;
+    std::unique_ptr<MIX_CHANNEL_MAP> m_pChannelMap;
+    std::unique_ptr<AudioFileMapping> m_pMapping;
+    const FLOAT32* m_pMappedData;       // samples in the mapping, used while m_pAudioData is not set
+    const INT16* m_pMappedDataInt16;
+    bool m_lockOwnedData;               // the owned samples stand in for a mapping that could not be locked
+    const void* m_pvLockedData;         // owned samples locked by LockOwnedData
+    size_t m_cbLockedData;
     UINT32 m_frameCount;
     UINT32 m_channelCount;
+    DWORD m_channelMask;
     UINT32 m_sampleRate;
+    UINT32 m_sourceBitsPerSample;   // of PCM sources, 0 for compressed or float ones
+    UINT32 m_loopStart;
+    UINT32 m_loopEnd;
+    std::vector<UINT32> m_cuePoints;
     bool m_isInitialized;
+
+    // Streamed clips, see Open
+    std::unique_ptr<MIX_STREAM> m_pStream;
+    std::unique_ptr<BYTE[]> m_pStreamBuffer;
+    std::unique_ptr<AudioFileMapping> m_pStreamMapping;    // of a streamed FLAC file
+    std::unique_ptr<FlacDecoder> m_pStreamDecoder;         // nullptr for a file Media Foundation reads
+    std::unique_ptr<AudioResampler> m_pStreamResampler;    // nullptr if the file is at the stream rate
+#if defined(_WIN32)
+    CComPtr<IMFSourceReader> m_spStreamReader;
+#endif
+    std::vector<FLOAT32> m_streamPending;          // decoded frames the ring had no room for yet
+    std::vector<FLOAT32> m_streamDecoded;          // FLAC block on its way into the resampler
+    size_t m_streamPendingOffset;                  // in samples
+    bool m_streamEnded;                            // the last read hit the end of the file
+    bool m_stopStreaming;                          // guarded by m_streamMutex
+    std::mutex m_streamMutex;
+    std::condition_variable m_streamStopped;
+    std::thread m_streamThread;
 };
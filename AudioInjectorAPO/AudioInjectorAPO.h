@@ -18,7 +18,10 @@
 #include <devicetopology.h>
 #include <memory>
 #include <string>
+#include <vector>
+#include "AudioClipCache.h"
 #include "AudioFileReader.h"
+#include "AudioMixKernels.h"
 
 _Analysis_mode_(_Analysis_code_type_user_driver_)
 
@@ -41,6 +44,26 @@ DEFINE_GUID(InjectEffectId,     0x2EC92F27, 0x3A3E, 0x486D, 0xB0, 0x38, 0xAC, 0x
 // Default audio file path
 #define DEFAULT_AUDIO_FILE_PATH L"C:\\Windows\\Media\\notify.wav"
 
+// Length of the gain ramps that make mix changes click-free, in milliseconds
+#define DEFAULT_MIX_RAMP_MS 10
+
+// Longest wait for the clip to fade out before it is replaced, in milliseconds
+#define MAX_MIX_FADE_WAIT_MS 200
+
+// Clips longer than this are streamed from the file instead of decoded whole, in milliseconds
+#define MIN_STREAMED_CLIP_MS 30000
+
+//
+// Clips an APO layers over its input, one reader per file, see LoadAudioFileLayers
+//
+struct AUDIO_FILE_LAYERS
+{
+    std::vector<std::shared_ptr<AudioFileReader>>   readers;    // of every layer, nullptr for a file that failed to load
+    std::vector<std::wstring>                       paths;      // file of every reader
+    AUDIO_CLIP_FORMAT                               format;     // the readers are prepared for
+    std::vector<std::shared_ptr<AudioFileReader>>   retired;    // replaced while the stream was stopped
+};
+
 LONG GetCurrentEffectsSetting(IPropertyStore* properties, PROPERTYKEY pkeyEnable, GUID processingMode);
 
 #pragma AVRT_VTABLES_BEGIN
@@ -62,9 +85,20 @@ public:    // constructor
     ,   m_hEffectsChangedEvent(NULL)
     ,   m_AudioProcessingMode(AUDIO_SIGNALPROCESSINGMODE_DEFAULT)
     ,   m_bEnableAudioMix(FALSE)
-    ,   m_fileIndex(0)
     ,   m_mixRatio(DEFAULT_MIX_RATIO)
-    ,   m_audioFilePath(DEFAULT_AUDIO_FILE_PATH)
+    ,   m_mixLaw(MIX_LAW_LINEAR)
+    ,   m_audioFileLayers()
+    ,   m_audioFilePaths(1, DEFAULT_AUDIO_FILE_PATH)
+    ,   m_u32LoopCrossfadeMs(0)
+    ,   m_pMixKernels(NULL)
+    ,   m_u32MaxFrameCount(0)
+    ,   m_bInPlace(FALSE)
+    ,   m_dwChannelMask(0)
+    ,   m_MixContext()
+    ,   m_MixFormat()
+    ,   m_u32LimiterLookaheadMs(0)
+    ,   m_MixLimiter()
+    ,   m_pfnProcessPeriod(NULL)
     {
         m_pf32Coefficients = NULL;
     }
@@ -152,20 +186,51 @@ public:
     CComPtr<IMMDeviceEnumerator>            m_spEnumerator;
     static const CRegAPOProperties<1>       sm_RegProperties;   // registration properties
 
-    // Locked memory
+    // Locked memory, the gain of the input on every channel followed by the gain of the clip
     FLOAT32                                 *m_pf32Coefficients;
 
-    // Audio file mixing properties
-    std::unique_ptr<AudioFileReader>        m_pAudioFileReader;
+    // Per channel gains as set by the properties, see ExpandChannelGains
+    std::vector<FLOAT32>                    m_inputGains;
+    std::vector<FLOAT32>                    m_injectionGains;
+
+    // Audio file mixing properties, one layer per file.  Clips in memory are shared through AudioClipCache.
     FLOAT32                                 m_mixRatio;
-    UINT32                                  m_fileIndex;
-    std::wstring                            m_audioFilePath;
+    MIX_LAW                                 m_mixLaw;       // turns m_mixRatio into the mix weights
+    AUDIO_FILE_LAYERS                       m_audioFileLayers;
+    std::vector<std::wstring>               m_audioFilePaths;
+    std::vector<FLOAT32>                    m_audioFileGains;   // per layer, 1 for layers without one
+    UINT32                                  m_u32LoopCrossfadeMs;   // at the loop point of every clip, 0 for a hard wrap
+
+    // Mix kernels for this CPU and the largest period, set at LockForProcess
+    const MIX_KERNELS                       *m_pMixKernels;
+    UINT32                                  m_u32MaxFrameCount;
+    BOOL                                    m_bInPlace;
+    DWORD                                   m_dwChannelMask;     // speaker positions of the endpoint, for the clip channel maps
+
+    // Processing kernels and their state, see UpdateMixProcessor
+    MIX_CONTEXT                             m_MixContext;
+
+    // Sample format of the connections, and the conversion state of fixed point ones
+    MIX_FORMAT                              m_MixFormat;
+
+    // Lookahead limiter after the mix, its delay is the latency of the APO
+    UINT32                                  m_u32LimiterLookaheadMs;
+    MIX_LIMITER                             m_MixLimiter;
+    std::vector<BYTE>                       m_limiterBuffer;
+
+    // Kernel for the sample format and the limiter, picked at LockForProcess
+    PFN_MIX_PROCESS_FORMAT                  m_pfnProcessPeriod;
+
 
 private:
     CCriticalSection                        m_EffectsLock;
     HANDLE                                  m_hEffectsChangedEvent;
 
     HRESULT ProprietaryCommunicationWithDriver(APOInitSystemEffects2 *_pAPOSysFxInit2);
+    UINT32 UpdateMixProcessor(MIX_RAMP_SHAPE rampShape);
+    void LoadAudioFiles(
+        const std::vector<std::wstring> &paths,
+        std::vector<std::shared_ptr<AudioFileReader>> *pReplaced);
 
 };
 #pragma AVRT_VTABLES_END
@@ -187,9 +252,20 @@ public:    // constructor
     ,   m_hEffectsChangedEvent(NULL)
     ,   m_AudioProcessingMode(AUDIO_SIGNALPROCESSINGMODE_DEFAULT)
     ,   m_bEnableAudioMix(FALSE)
-    ,   m_fileIndex(0)
     ,   m_mixRatio(DEFAULT_MIX_RATIO)
-    ,   m_audioFilePath(DEFAULT_AUDIO_FILE_PATH)
+    ,   m_mixLaw(MIX_LAW_LINEAR)
+    ,   m_audioFileLayers()
+    ,   m_audioFilePaths(1, DEFAULT_AUDIO_FILE_PATH)
+    ,   m_u32LoopCrossfadeMs(0)
+    ,   m_pMixKernels(NULL)
+    ,   m_u32MaxFrameCount(0)
+    ,   m_bInPlace(FALSE)
+    ,   m_dwChannelMask(0)
+    ,   m_MixContext()
+    ,   m_MixFormat()
+    ,   m_u32LimiterLookaheadMs(0)
+    ,   m_MixLimiter()
+    ,   m_pfnProcessPeriod(NULL)
     {
     }
 
@@ -261,35 +337,46 @@ public:
     CCriticalSection                        m_EffectsLock;
     HANDLE                                  m_hEffectsChangedEvent;
 
-    // Audio file mixing properties
-    std::unique_ptr<AudioFileReader>        m_pAudioFileReader;
+    // Audio file mixing properties, one layer per file.  Clips in memory are shared through AudioClipCache.
     FLOAT32                                 m_mixRatio;
-    UINT32                                  m_fileIndex;
-    std::wstring                            m_audioFilePath;
+    MIX_LAW                                 m_mixLaw;       // turns m_mixRatio into the mix weights
+    AUDIO_FILE_LAYERS                       m_audioFileLayers;
+    std::vector<std::wstring>               m_audioFilePaths;
+    std::vector<FLOAT32>                    m_audioFileGains;   // per layer, 1 for layers without one
+    UINT32                                  m_u32LoopCrossfadeMs;   // at the loop point of every clip, 0 for a hard wrap
+
+    // Mix kernels for this CPU and the largest period, set at LockForProcess
+    const MIX_KERNELS                       *m_pMixKernels;
+    UINT32                                  m_u32MaxFrameCount;
+    BOOL                                    m_bInPlace;
+    DWORD                                   m_dwChannelMask;     // speaker positions of the endpoint, for the clip channel maps
+
+    // Processing kernels and their state, see UpdateMixProcessor
+    MIX_CONTEXT                             m_MixContext;
+
+    // Sample format of the connections, and the conversion state of fixed point ones
+    MIX_FORMAT                              m_MixFormat;
+
+    // Lookahead limiter after the mix, its delay is the latency of the APO
+    UINT32                                  m_u32LimiterLookaheadMs;
+    MIX_LIMITER                             m_MixLimiter;
+    std::vector<BYTE>                       m_limiterBuffer;
+
+    // Kernel for the sample format and the limiter, picked at LockForProcess
+    PFN_MIX_PROCESS_FORMAT                  m_pfnProcessPeriod;
+
+
+private:
+    UINT32 UpdateMixProcessor(MIX_RAMP_SHAPE rampShape);
+    void LoadAudioFiles(
+        const std::vector<std::wstring> &paths,
+        std::vector<std::shared_ptr<AudioFileReader>> *pReplaced);
 };
 #pragma AVRT_VTABLES_END
 
 OBJECT_ENTRY_AUTO(__uuidof(AudioInjectorAPOMFX), CAudioInjectorAPOMFX)
 OBJECT_ENTRY_AUTO(__uuidof(AudioInjectorAPOSFX), CAudioInjectorAPOSFX)
 
-//
-//   Declaration of the ProcessAudioMix routine.
-//
-void ProcessAudioMix(
-    _Out_writes_(u32ValidFrameCount * u32SamplesPerFrame)
-        FLOAT32 *pf32OutputFrames,
-    _In_reads_(u32ValidFrameCount * u32SamplesPerFrame)
-        const FLOAT32 *pf32InputFrames,
-    UINT32       u32ValidFrameCount,
-    UINT32       u32SamplesPerFrame,
-    _In_reads_opt_(u32FileFrameCount * u32SamplesPerFrame)
-        const FLOAT32 *pf32FileBuffer,
-    UINT32       u32FileFrameCount,
-    _Inout_
-        UINT32  *pu32FileIndex,
-    FLOAT32     fMixRatio);
-
-
 //
 //   Convenience methods
 //
@@ -307,3 +394,141 @@ void CopyFrames(
         const FLOAT32 *pf32InFrames,
     UINT32 u32FrameCount,
     UINT32 u32SamplesPerFrame );
+
+BOOL WaitForMixRequest(
+    _In_
+        const MIX_CONTEXT *pContext,
+    UINT32 u32Serial,
+    UINT32 u32TimeoutMs );
+
+BOOL GetAudioFilePaths(
+    _In_
+        const PROPVARIANT *pVar,
+    _Out_
+        std::vector<std::wstring> *pPaths );
+
+BOOL GetAudioFilePaths(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        std::vector<std::wstring> *pPaths );
+
+BOOL GetAudioFileGains(
+    _In_
+        const PROPVARIANT *pVar,
+    _Out_
+        std::vector<FLOAT32> *pGains );
+
+BOOL GetAudioFileGains(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        std::vector<FLOAT32> *pGains );
+
+BOOL GetMixRatio(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        FLOAT32 *pf32Ratio );
+
+void InitAudioClipFormat(
+    _Out_
+        AUDIO_CLIP_FORMAT *pFormat,
+    UINT32 u32FramesPerSecond,
+    UINT32 u32Channels,
+    DWORD dwChannelMask,
+    UINT32 u32MaxFrameCount,
+    UINT32 u32LoopCrossfadeMs );
+
+void LoadAudioFileLayers(
+    _Inout_
+        AUDIO_FILE_LAYERS *pLayers,
+    const std::vector<std::wstring> &paths,
+    const AUDIO_CLIP_FORMAT &format,
+    _Out_
+        std::vector<std::shared_ptr<AudioFileReader>> *pReplaced );
+
+void RetireAudioFileReaders(
+    _Inout_
+        AUDIO_FILE_LAYERS *pLayers,
+    _In_
+        const MIX_CONTEXT *pContext,
+    UINT32 u32Serial,
+    _Inout_
+        std::vector<std::shared_ptr<AudioFileReader>> *pReplaced );
+
+void ReleaseAudioFileLayers(
+    _Inout_
+        AUDIO_FILE_LAYERS *pLayers );
+
+void SetMixSources(
+    _Inout_
+        MIX_REQUEST *pRequest,
+    _In_
+        const AUDIO_FILE_LAYERS *pLayers,
+    const std::vector<FLOAT32> &gains,
+    FLOAT32 f32FileWeight );
+
+DWORD GetChannelMask(
+    _In_
+        IAudioMediaType *pFormat );
+
+HRESULT GetMixSampleFormat(
+    _In_
+        IAudioMediaType *pFormat,
+    _Out_
+        MIX_SAMPLE_FORMAT *pSampleFormat );
+
+UINT32 GetLimiterLookahead(
+    _In_
+        IPropertyStore *pProperties );
+
+UINT32 GetLoopCrossfade(
+    _In_
+        IPropertyStore *pProperties );
+
+MIX_LAW GetMixLaw(
+    _In_
+        IPropertyStore *pProperties );
+
+HRESULT InitLimiter(
+    _Out_
+        MIX_LIMITER *pLimiter,
+    _Inout_
+        std::vector<BYTE> *pBuffer,
+    UINT32 u32LookaheadMs,
+    UINT32 u32FramesPerSecond,
+    UINT32 u32Channels );
+
+HNSTIME GetLimiterLatency(
+    UINT32 u32LookaheadFrames,
+    UINT32 u32FramesPerSecond );
+
+BOOL GetChannelGainValues(
+    _In_
+        const PROPVARIANT *pVar,
+    _Out_
+        std::vector<FLOAT32> *pGains );
+
+void GetChannelGains(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        std::vector<FLOAT32> *pInputGains,
+    _Out_
+        std::vector<FLOAT32> *pInjectionGains );
+
+void ExpandChannelGains(
+    const std::vector<FLOAT32> &gains,
+    UINT32 u32Channels,
+    _Out_writes_(u32Channels)
+        FLOAT32 *pf32Gains );
+
+void SetMixChannelGains(
+    _Inout_
+        MIX_REQUEST *pRequest,
+    _In_reads_(u32Channels)
+        const FLOAT32 *pf32InputGains,
+    _In_reads_(u32Channels)
+        const FLOAT32 *pf32InjectionGains,
+    UINT32 u32Channels );
@@ -21,6 +21,7 @@
 #include "AudioInjectorAPO.h"
 #include "SysVadShared.h"
 #include <CustomPropKeys.h>
+#include "AudioClipCache.h"
 #include "AudioFileReader.h"
 
 //{FD7F2B29 - 24D0 - 4B5C - B177 - 592C39F9CA10}
@@ -40,12 +41,16 @@ const AVRT_DATA CRegAPOProperties<1> CAudioInjectorAPOMFX::sm_RegProperties(
     0,                                              // minor version #
     __uuidof(IAudioInjectorAPOMFX)                           // iid of primary interface
 //
+// Processing in place lets the engine hand us one buffer for input and output:
+// the clips are mixed straight into it and passing through is a no-op.
+//
+    , APO_FLAG_INPLACE | APO_FLAG_SAMPLESPERFRAME_MUST_MATCH |
+      APO_FLAG_FRAMESPERSECOND_MUST_MATCH | APO_FLAG_BITSPERSAMPLE_MUST_MATCH
+//
 // If you need to change any of these attributes, uncomment everything up to
 // the point that you need to change something.  If you need to add IIDs, uncomment
 // everything and add additional IIDs at the end.
 //
-//   Enable inplace processing for this APO.
-//  , DEFAULT_APOREG_FLAGS
 //  , DEFAULT_APOREG_MININPUTCONNECTIONS
 //  , DEFAULT_APOREG_MAXINPUTCONNECTIONS
 //  , DEFAULT_APOREG_MINOUTPUTCONNECTIONS
@@ -136,8 +141,6 @@ STDMETHODIMP_(void) CAudioInjectorAPOMFX::APOProcess(
     UNREFERENCED_PARAMETER(u32NumInputConnections);
     UNREFERENCED_PARAMETER(u32NumOutputConnections);
 
-    FLOAT32 *pf32InputFrames, *pf32OutputFrames;
-
     ATLASSERT(m_bIsLocked);
 
     // assert that the number of input and output connectins fits our registration properties
@@ -146,78 +149,34 @@ STDMETHODIMP_(void) CAudioInjectorAPOMFX::APOProcess(
     ATLASSERT(m_pRegProperties->u32MinOutputConnections <= u32NumOutputConnections);
     ATLASSERT(m_pRegProperties->u32MaxOutputConnections >= u32NumOutputConnections);
 
-    // check APO_BUFFER_FLAGS.
-    switch( ppInputConnections[0]->u32BufferFlags )
-    {
-        case BUFFER_INVALID:
-        {
-            ATLASSERT(false);  // invalid flag - should never occur.  don't do anything.
-            break;
-        }
-        case BUFFER_VALID:
-        case BUFFER_SILENT:
-        {
-            // get input pointer to connection buffer
-            pf32InputFrames = reinterpret_cast<FLOAT32*>(ppInputConnections[0]->pBuffer);
-            ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32InputFrames) );            // get output pointer to connection buffer
-            pf32OutputFrames = reinterpret_cast<FLOAT32*>(ppOutputConnections[0]->pBuffer);
-            ATLASSERT( IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames) );
+    ATLASSERT(m_MixContext.pProcessor != NULL);
+    ATLASSERT(m_pfnProcessPeriod != NULL);
 
-            if (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags)
-            {
-                WriteSilence( pf32InputFrames,
-                              ppInputConnections[0]->u32ValidFrameCount,
-                              GetSamplesPerFrame() );
-            }
+    // Near silent clips and decaying ramps must not hit the slow denormal paths of the CPU
+    MixDenormalGuard denormalGuard;
 
-            // Process with audio mixing if enabled
-            if (
-                !IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) &&
-                m_bEnableAudioMix &&
-                m_pAudioFileReader &&
-                m_pAudioFileReader->IsValid()
-            )
-            {
-                // Mix the audio file with the input stream
-                ProcessAudioMix(
-                    pf32OutputFrames,
-                    pf32InputFrames,
-                    ppInputConnections[0]->u32ValidFrameCount,
-                    GetSamplesPerFrame(),
-                    m_pAudioFileReader->GetAudioData(),
-                    m_pAudioFileReader->GetFrameCount(),
-                    &m_fileIndex,
-                    m_mixRatio);
-
-                // we don't try to remember silence
-                ppOutputConnections[0]->u32BufferFlags = BUFFER_VALID;
-            }
-            else
-            {
-                // copy the memory only if there is an output connection, and input/output pointers are unequal
-                if ( (0 != u32NumOutputConnections) &&
-                      (ppOutputConnections[0]->pBuffer != ppInputConnections[0]->pBuffer) )
-                {
-                    CopyFrames( pf32OutputFrames, pf32InputFrames,
-                                ppInputConnections[0]->u32ValidFrameCount,
-                                GetSamplesPerFrame() );
-                }
+    // BUFFER_INVALID should never occur, the processor leaves such a buffer alone
+    ATLASSERT(ppInputConnections[0]->u32BufferFlags == BUFFER_VALID ||
+              ppInputConnections[0]->u32BufferFlags == BUFFER_SILENT);
 
-                // pass along buffer flags
-                ppOutputConnections[0]->u32BufferFlags = ppInputConnections[0]->u32BufferFlags;
-            }
+    // Streamed clips move the frames of this period out of their rings first
+    PrepareMixStreams(&m_MixContext, ppInputConnections[0]->u32ValidFrameCount);
 
-            // Set the valid frame count.
-            ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
+    // Fixed point periods are converted to float, mixed, limited and converted back
+    // a block at a time, float ones are mixed and limited where they are.  The
+    // processor of the mix context handles the state, the channel count and running
+    // gain ramps, the buffer flags pick its silent or valid input variant.
+    ppOutputConnections[0]->u32BufferFlags = m_pfnProcessPeriod(
+        &m_MixFormat,
+        &m_MixContext,
+        &m_MixLimiter,
+        reinterpret_cast<BYTE*>(ppOutputConnections[0]->pBuffer),
+        reinterpret_cast<const BYTE*>(ppInputConnections[0]->pBuffer),
+        ppInputConnections[0]->u32ValidFrameCount,
+        ppInputConnections[0]->u32BufferFlags);
 
-            break;
-        }
-        default:
-        {
-            ATLASSERT(false);  // invalid flag - should never occur
-            break;
-        }
-    } // switch
+    // Set the valid frame count.
+    ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
 
 } // APOProcess
 #pragma AVRT_CODE_END
@@ -247,7 +206,10 @@ STDMETHODIMP CAudioInjectorAPOMFX::GetLatency(HNSTIME* pTime)
     }
     else
     {
-        *pTime = (m_bEnableAudioMix ? 0 : 0); // No latency for audio mixing
+        // The mix itself adds no delay, the limiter delays the output by its lookahead
+        *pTime = m_bIsLocked ?
+            GetLimiterLatency(m_MixLimiter.u32LookaheadFrames, static_cast<UINT32>(GetFramesPerSecond())) :
+            static_cast<HNSTIME>(m_u32LimiterLookaheadMs) * 10000;
     }
 
 Exit:
@@ -278,41 +240,161 @@ STDMETHODIMP CAudioInjectorAPOMFX::LockForProcess(UINT32 u32NumInputConnections,
     UINT32 u32NumOutputConnections, APO_CONNECTION_DESCRIPTOR** ppOutputConnections)
 {
     ASSERT_NONREALTIME();
-    HRESULT hr = S_OK;    hr = CBaseAudioProcessingObject::LockForProcess(u32NumInputConnections,
+    HRESULT hr = S_OK;
+    MIX_SAMPLE_FORMAT sampleFormat = MIX_SAMPLE_FLOAT32;
+
+    // m_bIsLocked is set by the base class before the state below is, so property
+    // notifications wait for it to be set up and for the mix request to be posted
+    m_EffectsLock.Enter();
+
+    hr = CBaseAudioProcessingObject::LockForProcess(u32NumInputConnections,
         ppInputConnections, u32NumOutputConnections, ppOutputConnections);
     IF_FAILED_JUMP(hr, Exit);
 
-    if (!IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) && m_bEnableAudioMix)
+    // Pick the mix kernels for this CPU once, outside of the real-time path
+    m_pMixKernels = SelectMixKernels();
+    m_u32MaxFrameCount = ppOutputConnections[0]->u32MaxFrameCount;
+    m_bInPlace = (ppInputConnections[0]->pBuffer == ppOutputConnections[0]->pBuffer);
+    m_dwChannelMask = GetChannelMask(ppOutputConnections[0]->pFormat);
+
+    // Fixed point periods are mixed in place in the float blocks of m_MixFormat
+    hr = GetMixSampleFormat(ppOutputConnections[0]->pFormat, &sampleFormat);
+    IF_FAILED_JUMP(hr, Exit);
+    InitMixFormat(&m_MixFormat, sampleFormat, GetSamplesPerFrame());
+
+    // Start from passing the input through, the clips are faded in below
+    InitMixContext(
+        &m_MixContext,
+        m_pMixKernels,
+        GetSamplesPerFrame(),
+        m_bInPlace || sampleFormat != MIX_SAMPLE_FLOAT32,
+        static_cast<UINT32>(GetFramesPerSecond()) * DEFAULT_MIX_RAMP_MS / 1000);
+
+    // The limiter runs whether the clips are mixed or not, so the latency stays put while streaming
+    hr = InitLimiter(
+        &m_MixLimiter,
+        &m_limiterBuffer,
+        IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) ? 0 : m_u32LimiterLookaheadMs,
+        static_cast<UINT32>(GetFramesPerSecond()),
+        GetSamplesPerFrame());
+    IF_FAILED_JUMP(hr, Exit);
+
+    // The sample format and the lookahead stay until the next lock, so APOProcess checks neither
+    m_pfnProcessPeriod = m_pMixKernels->pfnProcessPeriod[sampleFormat][(m_MixLimiter.u32LookaheadFrames != 0) ? 1 : 0];
+
+    // The mix context no longer refers to the readers of an earlier lock.  The
+    // layers whose file and format did not change take theirs over, the others
+    // are let go of once the new ones are loaded.
     {
-        m_fileIndex = 0;
+        std::vector<std::shared_ptr<AudioFileReader>> replaced;
+        m_audioFileLayers.retired.clear();
 
-        // Initialize the audio file reader if needed
-        if (!m_pAudioFileReader || !m_pAudioFileReader->IsValid())
+        if (!IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) && m_bEnableAudioMix)
         {
-            m_pAudioFileReader = std::make_unique<AudioFileReader>();
-            hr = m_pAudioFileReader->Initialize(m_audioFilePath.c_str());
-            if (FAILED(hr))
-            {
-                m_pAudioFileReader.reset();
-                goto Exit;
-            }
-
-            // Resample if necessary to match our processing format
-            hr = m_pAudioFileReader->ResampleAudio(
-                static_cast<UINT32>(GetFramesPerSecond()),
-                GetSamplesPerFrame());
-            if (FAILED(hr))
-            {
-                m_pAudioFileReader.reset();
-                goto Exit;
-            }
+            LoadAudioFiles(m_audioFilePaths, &replaced);
+        }
+        else
+        {
+            ReleaseAudioFileLayers(&m_audioFileLayers);
         }
     }
 
+    UpdateMixProcessor(MIX_RAMP_EXPONENTIAL);
+
 Exit:
+    m_EffectsLock.Leave();
     return hr;
 }
 
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Hands the mixing state wanted by the current properties of the APO over to
+//  the real-time thread.
+//
+// Parameters:
+//
+//      rampShape - [in] shape of the gain ramp to the new mix weights
+//
+// Return values:
+//
+//      Serial of the request, see WaitForMixRequest
+//
+// Remarks:
+//
+//  Called whenever the connections are locked or a property that affects
+//  mixing changes, so that APOProcess makes a single indirect call without
+//  checking the mode, the enable state or the audio file on every period.
+//  The next period ramps the weights from where they are to the new ones
+//  within the mix loop, so none of the changes clicks.  Switching the clips on
+//  or off fades them in or out, and the passthrough processor is installed
+//  only once they have faded out.  New layers fade in from their first frame
+//  while the ones they replace fade out, layers kept play on.
+//
+UINT32 CAudioInjectorAPOMFX::UpdateMixProcessor(MIX_RAMP_SHAPE rampShape)
+{
+    ASSERT_NONREALTIME();
+
+    MIX_REQUEST request = {};
+
+    // The law gives the weight of the input and the one every layer gain applies to
+    FLOAT32 f32FileWeight = 0.0f;
+    GetMixLawWeights(m_mixLaw, m_mixRatio, &request.f32InputWeight, &f32FileWeight);
+
+    SetMixSources(&request, &m_audioFileLayers, m_audioFileGains, f32FileWeight);
+
+    request.bMix = !IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) &&
+                   m_bEnableAudioMix &&
+                   request.u32SourceCount != 0;
+    request.rampShape = rampShape;
+
+    if (!request.bMix)
+    {
+        // Keep the clips for the fade out
+        request.u32SourceCount = 0;
+    }
+
+    // The channel gains apply in the same pass as the mix, the input ones also while not mixing
+    if (!IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) && m_pf32Coefficients != NULL)
+    {
+        SetMixChannelGains(&request, m_pf32Coefficients, m_pf32Coefficients + m_u32SamplesPerFrame, m_u32SamplesPerFrame);
+    }
+
+    return PostMixRequest(&m_MixContext, &request);
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Loads the layered clips at the processing format.
+//
+// Parameters:
+//
+//      paths       - [in] file of every layer
+//      pReplaced   - [out] readers of the earlier layers that were not taken over
+//
+// Remarks:
+//
+//  See LoadAudioFileLayers.
+//
+void CAudioInjectorAPOMFX::LoadAudioFiles(
+    const std::vector<std::wstring> &paths,
+    std::vector<std::shared_ptr<AudioFileReader>> *pReplaced)
+{
+    ASSERT_NONREALTIME();
+
+    AUDIO_CLIP_FORMAT clipFormat = {};
+    InitAudioClipFormat(
+        &clipFormat,
+        static_cast<UINT32>(GetFramesPerSecond()),
+        GetSamplesPerFrame(),
+        m_dwChannelMask,
+        m_u32MaxFrameCount,
+        m_u32LoopCrossfadeMs);
+
+    LoadAudioFileLayers(&m_audioFileLayers, paths, clipFormat, pReplaced);
+}
+
 // The method that this long comment refers to is "Initialize()"
 //-------------------------------------------------------------------------
 // Description:
@@ -455,6 +537,26 @@ HRESULT CAudioInjectorAPOMFX::Initialize(UINT32 cbDataSize, BYTE* pbyData)
     if (m_spAPOSystemEffectsProperties != NULL)
     {
         m_bEnableAudioMix = GetCurrentEffectsSetting(m_spAPOSystemEffectsProperties, PKEY_Endpoint_Enable_Delay_MFX, m_AudioProcessingMode);
+
+        // A single path, or a vector of paths for layered clips
+        std::vector<std::wstring> paths;
+        if (GetAudioFilePaths(m_spAPOSystemEffectsProperties, &paths))
+        {
+            m_audioFilePaths = paths;
+        }
+
+        GetMixRatio(m_spAPOSystemEffectsProperties, &m_mixRatio);
+        GetAudioFileGains(m_spAPOSystemEffectsProperties, &m_audioFileGains);
+
+        // The lookahead of the limiter is the latency of the APO, it applies from the next lock on
+        m_u32LimiterLookaheadMs = GetLimiterLookahead(m_spAPOSystemEffectsProperties);
+
+        // Baked into the clips when they are loaded
+        m_u32LoopCrossfadeMs = GetLoopCrossfade(m_spAPOSystemEffectsProperties);
+
+        m_mixLaw = GetMixLaw(m_spAPOSystemEffectsProperties);
+
+        GetChannelGains(m_spAPOSystemEffectsProperties, &m_inputGains, &m_injectionGains);
     }
 
     //
@@ -739,6 +841,17 @@ HRESULT CAudioInjectorAPOMFX::OnPropertyValueChanged(LPCWSTR pwstrDeviceId, cons
             }
         }
 
+        // Fade the clips in or out, the ones of a lock with the mix off are loaded first
+        if ((nChanges > 0) && m_bIsLocked)
+        {
+            if (m_bEnableAudioMix && m_audioFileLayers.readers.empty())
+            {
+                std::vector<std::shared_ptr<AudioFileReader>> replaced;
+                LoadAudioFiles(m_audioFilePaths, &replaced);
+            }
+            UpdateMixProcessor(MIX_RAMP_EXPONENTIAL);
+        }
+
         // If anything changed and a change event handle exists
         if ((nChanges > 0) && (m_hEffectsChangedEvent != NULL))
         {
@@ -748,6 +861,96 @@ HRESULT CAudioInjectorAPOMFX::OnPropertyValueChanged(LPCWSTR pwstrDeviceId, cons
         m_EffectsLock.Leave();
     }
 
+    // Check for changes to the clips, their gains and the mix ratio
+    PROPERTYKEY PKEY_AudioMix_FilePath = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 0 };
+    PROPERTYKEY PKEY_AudioMix_Ratio = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 1 };
+    PROPERTYKEY PKEY_AudioMix_Gains = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 2 };
+
+    if (PK_EQUAL(key, PKEY_AudioMix_FilePath))
+    {
+        std::vector<std::wstring> paths;
+        if (GetAudioFilePaths(m_spAPOSystemEffectsProperties, &paths))
+        {
+            // The lock keeps mix requests from other notifications out of the swap
+            m_EffectsLock.Enter();
+
+            if (m_bIsLocked && m_bEnableAudioMix)
+            {
+                // Layers still wanted keep their readers, the replaced ones are
+                // released once the real-time thread has faded them out
+                std::vector<std::shared_ptr<AudioFileReader>> replaced;
+                LoadAudioFiles(paths, &replaced);
+                m_audioFilePaths = paths;
+                RetireAudioFileReaders(&m_audioFileLayers, &m_MixContext, UpdateMixProcessor(MIX_RAMP_EXPONENTIAL), &replaced);
+            }
+            else
+            {
+                // Loaded at the next LockForProcess
+                m_audioFilePaths = paths;
+            }
+
+            m_EffectsLock.Leave();
+        }
+    }
+    else if (PK_EQUAL(key, PKEY_AudioMix_Gains))
+    {
+        m_EffectsLock.Enter();
+        GetAudioFileGains(m_spAPOSystemEffectsProperties, &m_audioFileGains);
+
+        // Glide to the new gains
+        if (m_bIsLocked)
+        {
+            UpdateMixProcessor(MIX_RAMP_LINEAR);
+        }
+        m_EffectsLock.Leave();
+    }
+    else if (PK_EQUAL(key, PKEY_AudioMix_Ratio))
+    {
+        m_EffectsLock.Enter();
+
+        // Glide to the new ratio
+        if (GetMixRatio(m_spAPOSystemEffectsProperties, &m_mixRatio) && m_bIsLocked)
+        {
+            UpdateMixProcessor(MIX_RAMP_LINEAR);
+        }
+        m_EffectsLock.Leave();
+    }
+
+    // Check for changes to the channel gains
+    PROPERTYKEY PKEY_AudioMix_InputGains = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 4 };
+    PROPERTYKEY PKEY_AudioMix_InjectionGains = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 5 };
+
+    if (PK_EQUAL(key, PKEY_AudioMix_InputGains) || PK_EQUAL(key, PKEY_AudioMix_InjectionGains))
+    {
+        m_EffectsLock.Enter();
+        GetChannelGains(m_spAPOSystemEffectsProperties, &m_inputGains, &m_injectionGains);
+
+        // Glide to the new gains
+        if (m_bIsLocked && m_pf32Coefficients != NULL)
+        {
+            ExpandChannelGains(m_inputGains, m_u32SamplesPerFrame, m_pf32Coefficients);
+            ExpandChannelGains(m_injectionGains, m_u32SamplesPerFrame, m_pf32Coefficients + m_u32SamplesPerFrame);
+            UpdateMixProcessor(MIX_RAMP_LINEAR);
+        }
+        m_EffectsLock.Leave();
+    }
+
+    // Check for a change of the mix law
+    PROPERTYKEY PKEY_AudioMix_Law = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 7 };
+
+    if (PK_EQUAL(key, PKEY_AudioMix_Law) && m_spAPOSystemEffectsProperties)
+    {
+        m_EffectsLock.Enter();
+        m_mixLaw = GetMixLaw(m_spAPOSystemEffectsProperties);
+
+        // Glide to the weights of the new law
+        if (m_bIsLocked)
+        {
+            UpdateMixProcessor(MIX_RAMP_LINEAR);
+        }
+        m_EffectsLock.Leave();
+    }
+
     return hr;
 }
 
@@ -788,8 +991,8 @@ CAudioInjectorAPOMFX::~CAudioInjectorAPOMFX(void)
         CloseHandle(m_hEffectsChangedEvent);
     }
 
-    // Clean up the audio file reader
-    m_pAudioFileReader.reset();
+    // Release the audio file readers
+    ReleaseAudioFileLayers(&m_audioFileLayers);
 
     // Free locked memory allocations
     if (NULL != m_pf32Coefficients)
@@ -840,7 +1043,6 @@ HRESULT CAudioInjectorAPOMFX::ValidateAndCacheConnectionInfo(UINT32 u32NumInputC
     HRESULT hResult;
     CComPtr<IAudioMediaType> pFormat;
     UNCOMPRESSEDAUDIOFORMAT UncompInputFormat, UncompOutputFormat;
-    FLOAT32 f32InverseChannelCount;
 
     UNREFERENCED_PARAMETER(u32NumInputConnections);
     UNREFERENCED_PARAMETER(u32NumOutputConnections);
@@ -860,22 +1062,24 @@ HRESULT CAudioInjectorAPOMFX::ValidateAndCacheConnectionInfo(UINT32 u32NumInputC
 
     // Since we haven't overridden the IsIn{Out}putFormatSupported APIs in this example, this APO should
     // always have input channel count == output channel count.  The sampling rates should also be eqaul,
-    // and formats 32-bit float.
+    // and the sample formats, 32-bit float or the 16, 24 and 32-bit PCM ones the mix kernels convert.
     _ASSERTE(UncompOutputFormat.fFramesPerSecond == UncompInputFormat.fFramesPerSecond);
     _ASSERTE(UncompOutputFormat. dwSamplesPerFrame == UncompInputFormat.dwSamplesPerFrame);
 
-    // Allocate some locked memory.  We will use these as scaling coefficients during APOProcess->ProcessDelayScale
-    hResult = AERT_Allocate(sizeof(FLOAT32)*m_u32SamplesPerFrame, (void**)&m_pf32Coefficients);
-    IF_FAILED_JUMP(hResult, Exit);
-
-    // Set scalars to decrease volume from 1.0 to 1.0/N where N is the number of channels
-    // starting with the first channel.
-    f32InverseChannelCount = 1.0f/m_u32SamplesPerFrame;
-    for (UINT32 u32Index=0; u32Index<m_u32SamplesPerFrame; u32Index++)
+    // Coefficients of an earlier lock may be for another channel count
+    if (NULL != m_pf32Coefficients)
     {
-        m_pf32Coefficients[u32Index] = 1.0f - (FLOAT32)(f32InverseChannelCount)*u32Index;
+        AERT_Free(m_pf32Coefficients);
+        m_pf32Coefficients = NULL;
     }
 
+    // Allocate some locked memory for the per channel gains of the input and of the clip,
+    // which UpdateMixProcessor hands over to the mix kernels
+    hResult = AERT_Allocate(2*sizeof(FLOAT32)*m_u32SamplesPerFrame, (void**)&m_pf32Coefficients);
+    IF_FAILED_JUMP(hResult, Exit);
+
+    ExpandChannelGains(m_inputGains, m_u32SamplesPerFrame, m_pf32Coefficients);
+    ExpandChannelGains(m_injectionGains, m_u32SamplesPerFrame, m_pf32Coefficients + m_u32SamplesPerFrame);
 
 Exit:
     LeaveCriticalSection(&m_CritSec);
@@ -0,0 +1,1840 @@
+//
+// AudioMixKernels.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Scalar reference kernels, CPU feature detection and kernel dispatch
+//
+
+#include "AudioMixKernels.h"
+#include "AudioMixKernelsImpl.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(MIX_KERNELS_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <xmmintrin.h>
+#elif defined(MIX_KERNELS_ARM64) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// The processors are indexed by the input buffer flags
+static_assert(BUFFER_INVALID == 0 && BUFFER_VALID == 1 && BUFFER_SILENT == 2,
+              "MIX_PROCESSOR layout does not match APO_BUFFER_FLAGS");
+
+namespace
+{
+
+struct MixVecScalar
+{
+    typedef FLOAT32 Vec;
+    static const UINT32 Width = 1;
+
+    static Vec  Load(const FLOAT32 *p)      { return *p; }
+    static void Store(FLOAT32 *p, Vec v)    { *p = v; }
+    static Vec  Set1(FLOAT32 f)             { return f; }
+    static Vec  Add(Vec a, Vec b)           { return a + b; }
+    static Vec  Mul(Vec a, Vec b)           { return a * b; }
+    static Vec  Max(Vec a, Vec b)           { return (a > b) ? a : b; }
+    static Vec  Abs(Vec a)                  { return (a < 0.0f) ? -a : a; }
+    static Vec  Min(Vec a, Vec b)           { return (a < b) ? a : b; }
+    static Vec  LoadInt16(const INT16 *p)   { return static_cast<FLOAT32>(*p); }
+    static Vec  LoadInt32(const INT32 *p)   { return static_cast<FLOAT32>(*p); }
+
+    // Rounds to nearest even like the vector conversions, the value is in range
+    static void StoreInt16(INT16 *p, Vec v) { *p = static_cast<INT16>(std::nearbyint(v)); }
+    static void StoreInt32(INT32 *p, Vec v) { *p = static_cast<INT32>(std::nearbyint(v)); }
+
+    // A frame of two samples is the vector pair
+    static void Deinterleave2(Vec a, Vec b, Vec *pEven, Vec *pOdd)  { *pEven = a; *pOdd = b; }
+
+    static Vec  Dither(UINT32 *p)
+    {
+        UINT32 x = *p;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *p = x;
+        return static_cast<FLOAT32>(static_cast<INT32>(x & 0xFFFF) - static_cast<INT32>(x >> 16)) * (1.0f / 65536.0f);
+    }
+};
+
+const MIX_KERNELS g_MixKernelsScalar = MakeMixKernels<MixVecScalar>(MIX_ISA_SCALAR, "Scalar");
+
+#if defined(MIX_KERNELS_X64) && defined(_MSC_VER)
+//
+// MSVC has no __builtin_cpu_supports, query CPUID and XCR0 directly.  The OS must
+// have enabled saving of the YMM (and ZMM) state for the wider kernels to be usable.
+//
+MIX_ISA DetectX64Isa()
+{
+    int cpuInfo[4] = {};
+
+    __cpuid(cpuInfo, 0);
+    const int maxLeaf = cpuInfo[0];
+
+    __cpuid(cpuInfo, 1);
+    const bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+    const bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || maxLeaf < 7)
+    {
+        return MIX_ISA_SSE2;
+    }
+
+    const unsigned __int64 xcr0 = _xgetbv(0);
+    const bool ymmEnabled = (xcr0 & 0x06) == 0x06;
+    const bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;
+
+    __cpuidex(cpuInfo, 7, 0);
+    const bool avx2 = (cpuInfo[1] & (1 << 5)) != 0;
+    const bool avx512f = (cpuInfo[1] & (1 << 16)) != 0;
+
+    if (avx512f && zmmEnabled)
+    {
+        return MIX_ISA_AVX512;
+    }
+    if (avx2 && ymmEnabled)
+    {
+        return MIX_ISA_AVX2;
+    }
+    return MIX_ISA_SSE2;
+}
+#endif
+
+} // namespace
+
+MIX_ISA DetectMixIsa()
+{
+#if defined(MIX_KERNELS_X64)
+#if defined(_MSC_VER)
+    return DetectX64Isa();
+#else
+    // libgcc checks both the CPUID bits and the OS enabled XSAVE state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return MIX_ISA_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return MIX_ISA_AVX2;
+    }
+    return MIX_ISA_SSE2;
+#endif
+#elif defined(MIX_KERNELS_ARM64)
+    // Advanced SIMD is mandatory on ARM64
+    return MIX_ISA_NEON;
+#else
+    return MIX_ISA_SCALAR;
+#endif
+}
+
+const MIX_KERNELS* GetMixKernels(MIX_ISA isa)
+{
+    switch (isa)
+    {
+    case MIX_ISA_SCALAR:
+        return &g_MixKernelsScalar;
+#if defined(MIX_KERNELS_X64)
+    case MIX_ISA_SSE2:
+        return &g_MixKernelsSSE2;
+    case MIX_ISA_AVX2:
+        return &g_MixKernelsAVX2;
+    case MIX_ISA_AVX512:
+        return &g_MixKernelsAVX512;
+#elif defined(MIX_KERNELS_ARM64)
+    case MIX_ISA_NEON:
+        return &g_MixKernelsNEON;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const MIX_KERNELS* SelectMixKernels()
+{
+    static const MIX_KERNELS* s_pKernels = GetMixKernels(DetectMixIsa());
+    return s_pKernels;
+}
+
+#if defined(MIX_KERNELS_X64)
+// Flush to zero and denormals are zero bits of MXCSR
+static const UINT32 c_u32DenormalModeBits = 0x8040;
+
+static UINT32 ReadFloatControl()
+{
+    return _mm_getcsr();
+}
+
+static void WriteFloatControl(UINT32 u32Control)
+{
+    _mm_setcsr(u32Control);
+}
+#elif defined(MIX_KERNELS_ARM64)
+// Flush to zero bit of FPCR, it covers denormal inputs as well
+static const UINT32 c_u32DenormalModeBits = 1u << 24;
+
+static UINT32 ReadFloatControl()
+{
+#if defined(_MSC_VER)
+    return static_cast<UINT32>(_ReadStatusReg(ARM64_FPCR));
+#else
+    return __builtin_aarch64_get_fpcr();
+#endif
+}
+
+static void WriteFloatControl(UINT32 u32Control)
+{
+#if defined(_MSC_VER)
+    _WriteStatusReg(ARM64_FPCR, u32Control);
+#else
+    __builtin_aarch64_set_fpcr(u32Control);
+#endif
+}
+#else
+static const UINT32 c_u32DenormalModeBits = 0;
+
+static UINT32 ReadFloatControl()
+{
+    return 0;
+}
+
+static void WriteFloatControl(UINT32 u32Control)
+{
+    UNREFERENCED_PARAMETER(u32Control);
+}
+#endif
+
+UINT32 EnterMixDenormalMode()
+{
+    // Writing the control register stalls the pipeline, skip it when already set
+    const UINT32 u32Saved = ReadFloatControl();
+    if ((u32Saved & c_u32DenormalModeBits) != c_u32DenormalModeBits)
+    {
+        WriteFloatControl(u32Saved | c_u32DenormalModeBits);
+    }
+    return u32Saved;
+}
+
+void LeaveMixDenormalMode(UINT32 u32Saved)
+{
+    // Only the mode bits go back, exception flags raised while processing stay
+    const UINT32 u32Control = ReadFloatControl();
+    if (((u32Control ^ u32Saved) & c_u32DenormalModeBits) != 0)
+    {
+        WriteFloatControl((u32Control & ~c_u32DenormalModeBits) | (u32Saved & c_u32DenormalModeBits));
+    }
+}
+
+UINT32 PlanMixSegments(
+    UINT32          u32FrameCount,
+    UINT32          u32FileFrameCount,
+    UINT32         *pu32FileIndex,
+    MIX_SEGMENT    *pSegments,
+    UINT32         *pu32FramesPlanned)
+{
+    UINT32 u32FilePos = *pu32FileIndex;
+    UINT32 u32Frame = 0;
+    UINT32 u32Segments = 0;
+
+    // There is nothing to loop over in an empty clip
+    if (u32FileFrameCount == 0)
+    {
+        *pu32FramesPlanned = 0;
+        return 0;
+    }
+
+    // The clip may have been replaced by a shorter one since the last period
+    if (u32FilePos >= u32FileFrameCount)
+    {
+        u32FilePos %= u32FileFrameCount;
+    }
+
+    while (u32Frame < u32FrameCount && u32Segments < MIX_MAX_SEGMENTS)
+    {
+        // Up to the loop point or the end of the period, whichever comes first
+        UINT32 u32Run = u32FileFrameCount - u32FilePos;
+        if (u32Run > u32FrameCount - u32Frame)
+        {
+            u32Run = u32FrameCount - u32Frame;
+        }
+
+        pSegments[u32Segments].u32OutputFrame = u32Frame;
+        pSegments[u32Segments].u32FileFrame = u32FilePos;
+        pSegments[u32Segments].u32FrameCount = u32Run;
+        u32Segments++;
+
+        u32Frame += u32Run;
+        u32FilePos += u32Run;
+        if (u32FilePos == u32FileFrameCount)
+        {
+            u32FilePos = 0;
+        }
+    }
+
+    *pu32FileIndex = u32FilePos;
+    *pu32FramesPlanned = u32Frame;
+    return u32Segments;
+}
+
+void MixAudioFrames(
+    const MIX_KERNELS  *pKernels,
+    FLOAT32            *pf32OutputFrames,
+    const FLOAT32      *pf32InputFrames,
+    UINT32              u32FrameCount,
+    UINT32              u32SamplesPerFrame,
+    const FLOAT32      *pf32FileBuffer,
+    UINT32              u32FileFrameCount,
+    UINT32             *pu32FileIndex,
+    FLOAT32             f32InputWeight,
+    FLOAT32             f32FileWeight)
+{
+    MIX_SEGMENT segments[MIX_MAX_SEGMENTS];
+    UINT32 u32Done = 0;
+
+    // An empty clip mixes as silence, the input stands in for it with a weight of 0
+    if (u32FileFrameCount == 0)
+    {
+        pKernels->pfnMixSpan(pf32OutputFrames, pf32InputFrames, pf32InputFrames,
+                             u32FrameCount * u32SamplesPerFrame, f32InputWeight, 0.0f);
+        return;
+    }
+
+    // A single pass for clips of at least one period, more only for shorter ones
+    while (u32Done < u32FrameCount)
+    {
+        UINT32 u32Planned = 0;
+        const UINT32 u32Segments = PlanMixSegments(u32FrameCount - u32Done, u32FileFrameCount,
+                                                   pu32FileIndex, segments, &u32Planned);
+
+        for (UINT32 i = 0; i < u32Segments; i++)
+        {
+            const size_t offset = static_cast<size_t>(u32Done + segments[i].u32OutputFrame) * u32SamplesPerFrame;
+            pKernels->pfnMixSpan(pf32OutputFrames + offset,
+                                 pf32InputFrames + offset,
+                                 pf32FileBuffer + static_cast<size_t>(segments[i].u32FileFrame) * u32SamplesPerFrame,
+                                 segments[i].u32FrameCount * u32SamplesPerFrame,
+                                 f32InputWeight,
+                                 f32FileWeight);
+        }
+
+        u32Done += u32Planned;
+    }
+}
+
+UINT32 PlanMixSourceBlock(
+    MIX_SOURCE     *pSources,
+    UINT32          u32SourceCount,
+    UINT32          u32FrameCount,
+    UINT32         *pu32Active,
+    UINT32         *pu32ActiveCount)
+{
+    UINT32 u32Run = u32FrameCount;
+    UINT32 u32Active = 0;
+
+    for (UINT32 s = 0; s < u32SourceCount; s++)
+    {
+        MIX_SOURCE *pSource = &pSources[s];
+        if (pSource->u32FileFrameCount == 0)
+        {
+            continue;
+        }
+
+        if (pSource->u32FileIndex >= pSource->u32FileFrameCount)
+        {
+            // A one shot clip has ended, a looped one may have been replaced by a shorter one
+            if (!pSource->bLoop)
+            {
+                continue;
+            }
+            pSource->u32FileIndex %= pSource->u32FileFrameCount;
+        }
+
+        // Up to the loop point or the end of the clip
+        const UINT32 u32Left = pSource->u32FileFrameCount - pSource->u32FileIndex;
+        if (u32Run > u32Left)
+        {
+            u32Run = u32Left;
+        }
+
+        pu32Active[u32Active++] = s;
+    }
+
+    *pu32ActiveCount = u32Active;
+    return u32Run;
+}
+
+void AdvanceMixSources(
+    MIX_SOURCE     *pSources,
+    const UINT32   *pu32Active,
+    UINT32          u32ActiveCount,
+    UINT32          u32FrameCount)
+{
+    for (UINT32 a = 0; a < u32ActiveCount; a++)
+    {
+        MIX_SOURCE *pSource = &pSources[pu32Active[a]];
+
+        pSource->u32FileIndex += u32FrameCount;
+        if (pSource->u32FileIndex == pSource->u32FileFrameCount && pSource->bLoop)
+        {
+            pSource->u32FileIndex = 0;
+        }
+    }
+}
+
+UINT32 GetMixSourceFrames(
+    const MIX_SOURCE       *pSources,
+    const UINT32           *pu32Active,
+    UINT32                  u32ActiveCount,
+    UINT32                  u32FrameCount,
+    UINT32                  u32SamplesPerFrame,
+    PFN_CONVERT_INT16_SPAN  pfnConvertInt16Span,
+    FLOAT32                *pf32Scratch,
+    const FLOAT32         **ppf32Sources)
+{
+    // Every converted clip needs its own part of the scratch buffer, a 16 bit
+    // clip with a channel map one at its own layout and one at the stream layout
+    UINT32 u32ScratchPerFrame = 0;
+    for (UINT32 a = 0; a < u32ActiveCount; a++)
+    {
+        const MIX_SOURCE &source = pSources[pu32Active[a]];
+        const MIX_CHANNEL_MAP *pMap = source.pChannelMap;
+        const BOOL bMapped = (pMap != nullptr && pMap->mapping != MIX_MAPPING_IDENTITY);
+
+        if (source.pi16File != nullptr)
+        {
+            u32ScratchPerFrame += bMapped ? pMap->u32FileChannels : u32SamplesPerFrame;
+        }
+        if (bMapped)
+        {
+            u32ScratchPerFrame += u32SamplesPerFrame;
+        }
+    }
+
+    if (u32ScratchPerFrame != 0)
+    {
+        const UINT32 u32ScratchFrames = MIX_MAP_SCRATCH_SAMPLES / u32ScratchPerFrame;
+        if (u32FrameCount > u32ScratchFrames)
+        {
+            u32FrameCount = u32ScratchFrames;
+        }
+    }
+
+    for (UINT32 a = 0; a < u32ActiveCount; a++)
+    {
+        const MIX_SOURCE &source = pSources[pu32Active[a]];
+        const MIX_CHANNEL_MAP *pMap = source.pChannelMap;
+        const BOOL bMapped = (pMap != nullptr && pMap->mapping != MIX_MAPPING_IDENTITY);
+        const UINT32 u32FileChannels = bMapped ? pMap->u32FileChannels : u32SamplesPerFrame;
+        const size_t offset = static_cast<size_t>(source.u32FileIndex) * u32FileChannels;
+        const FLOAT32 *pf32Clip;
+
+        if (source.pi16File != nullptr)
+        {
+            pfnConvertInt16Span(pf32Scratch, source.pi16File + offset, u32FrameCount * u32FileChannels);
+            pf32Clip = pf32Scratch;
+            pf32Scratch += u32FrameCount * u32FileChannels;
+        }
+        else
+        {
+            pf32Clip = source.pf32File + offset;
+        }
+
+        if (bMapped)
+        {
+            MapMixChannels(pMap, pf32Clip, u32FrameCount, pf32Scratch);
+            pf32Clip = pf32Scratch;
+            pf32Scratch += u32FrameCount * u32SamplesPerFrame;
+        }
+
+        ppf32Sources[a] = pf32Clip;
+    }
+
+    return u32FrameCount;
+}
+
+void MixAudioSources(
+    const MIX_KERNELS  *pKernels,
+    FLOAT32            *pf32OutputFrames,
+    const FLOAT32      *pf32InputFrames,
+    UINT32              u32FrameCount,
+    UINT32              u32SamplesPerFrame,
+    MIX_SOURCE         *pSources,
+    UINT32              u32SourceCount,
+    FLOAT32             f32InputWeight)
+{
+    UINT32 au32Active[MIX_MAX_SOURCES];
+    const FLOAT32 *apf32Sources[MIX_MAX_SOURCES];
+    FLOAT32 af32Weights[MIX_MAX_SOURCES];
+    FLOAT32 af32Scratch[MIX_MAP_SCRATCH_SAMPLES];
+    UINT32 u32Done = 0;
+
+    if (u32SourceCount > MIX_MAX_SOURCES)
+    {
+        u32SourceCount = MIX_MAX_SOURCES;
+    }
+
+    while (u32Done < u32FrameCount)
+    {
+        UINT32 u32Active = 0;
+        UINT32 u32Frames = PlanMixSourceBlock(pSources, u32SourceCount, u32FrameCount - u32Done,
+                                              au32Active, &u32Active);
+        u32Frames = GetMixSourceFrames(pSources, au32Active, u32Active, u32Frames, u32SamplesPerFrame,
+                                       pKernels->pfnConvertInt16Span, af32Scratch, apf32Sources);
+
+        for (UINT32 a = 0; a < u32Active; a++)
+        {
+            af32Weights[a] = pSources[au32Active[a]].f32Weight;
+        }
+
+        const size_t offset = static_cast<size_t>(u32Done) * u32SamplesPerFrame;
+        pKernels->pfnMixSourcesSpan(pf32OutputFrames + offset, pf32InputFrames + offset, apf32Sources,
+                                    af32Weights, u32Active, u32Frames * u32SamplesPerFrame, f32InputWeight);
+
+        AdvanceMixSources(pSources, au32Active, u32Active, u32Frames);
+        u32Done += u32Frames;
+    }
+}
+
+// Speaker positions the ones missing from the stream fold into, tried in order
+struct MIX_FOLD
+{
+    DWORD   dwFrom;
+    DWORD   dwTo;
+    FLOAT32 f32Gain;
+};
+
+// -3 dB, keeps the power of a channel split into two
+const FLOAT32 c_f32FoldSplitGain = 0.70710678f;
+
+const MIX_FOLD c_aMixFolds[] =
+{
+    { SPEAKER_FRONT_LEFT_OF_CENTER,  SPEAKER_FRONT_LEFT,   1.0f },
+    { SPEAKER_FRONT_RIGHT_OF_CENTER, SPEAKER_FRONT_RIGHT,  1.0f },
+    { SPEAKER_FRONT_CENTER,          SPEAKER_FRONT_LEFT,   c_f32FoldSplitGain },
+    { SPEAKER_FRONT_CENTER,          SPEAKER_FRONT_RIGHT,  c_f32FoldSplitGain },
+    { SPEAKER_BACK_LEFT,             SPEAKER_SIDE_LEFT,    1.0f },
+    { SPEAKER_BACK_RIGHT,            SPEAKER_SIDE_RIGHT,   1.0f },
+    { SPEAKER_SIDE_LEFT,             SPEAKER_BACK_LEFT,    1.0f },
+    { SPEAKER_SIDE_RIGHT,            SPEAKER_BACK_RIGHT,   1.0f },
+    { SPEAKER_BACK_CENTER,           SPEAKER_BACK_LEFT,    c_f32FoldSplitGain },
+    { SPEAKER_BACK_CENTER,           SPEAKER_BACK_RIGHT,   c_f32FoldSplitGain },
+    { SPEAKER_TOP_CENTER,            SPEAKER_FRONT_CENTER, 1.0f },
+    { SPEAKER_TOP_FRONT_LEFT,        SPEAKER_FRONT_LEFT,   1.0f },
+    { SPEAKER_TOP_FRONT_CENTER,      SPEAKER_FRONT_CENTER, 1.0f },
+    { SPEAKER_TOP_FRONT_RIGHT,       SPEAKER_FRONT_RIGHT,  1.0f },
+    { SPEAKER_TOP_BACK_LEFT,         SPEAKER_BACK_LEFT,    1.0f },
+    { SPEAKER_TOP_BACK_CENTER,       SPEAKER_BACK_CENTER,  1.0f },
+    { SPEAKER_TOP_BACK_RIGHT,        SPEAKER_BACK_RIGHT,   1.0f },
+};
+
+const DWORD c_dwLeftSpeakers = SPEAKER_FRONT_LEFT | SPEAKER_BACK_LEFT | SPEAKER_SIDE_LEFT |
+                               SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_TOP_FRONT_LEFT | SPEAKER_TOP_BACK_LEFT;
+const DWORD c_dwRightSpeakers = SPEAKER_FRONT_RIGHT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_RIGHT |
+                                SPEAKER_FRONT_RIGHT_OF_CENTER | SPEAKER_TOP_FRONT_RIGHT | SPEAKER_TOP_BACK_RIGHT;
+
+static DWORD GetDefaultChannelMask(UINT32 u32Channels)
+{
+    switch (u32Channels)
+    {
+    case 1:     return KSAUDIO_SPEAKER_MONO;
+    case 2:     return KSAUDIO_SPEAKER_STEREO;
+    case 4:     return KSAUDIO_SPEAKER_QUAD;
+    case 6:     return KSAUDIO_SPEAKER_5POINT1;
+    case 8:     return KSAUDIO_SPEAKER_7POINT1_SURROUND;
+    default:    return 0;
+    }
+}
+
+// Speaker position of every channel, in mask order; 0 for channels beyond the mask
+static BOOL GetChannelPositions(UINT32 u32Channels, DWORD dwChannelMask, DWORD *pdwPositions)
+{
+    if (dwChannelMask == 0)
+    {
+        dwChannelMask = GetDefaultChannelMask(u32Channels);
+    }
+
+    for (UINT32 c = 0; c < u32Channels; c++)
+    {
+        pdwPositions[c] = dwChannelMask & (~dwChannelMask + 1);     // lowest bit left
+        dwChannelMask &= ~pdwPositions[c];
+    }
+
+    return (u32Channels != 0 && pdwPositions[0] != 0);
+}
+
+// Feeds the clip channel to the stream channel at the position, or to the ones it folds into
+static BOOL AddMixTaps(
+    MIX_CHANNEL_MAP    *pMap,
+    const DWORD        *pdwPositions,
+    UINT32              u32FileChannel,
+    DWORD               dwPosition,
+    FLOAT32             f32Gain,
+    UINT32              u32Depth)
+{
+    for (UINT32 c = 0; c < pMap->u32Channels; c++)
+    {
+        if (pdwPositions[c] != dwPosition)
+        {
+            continue;
+        }
+
+        for (UINT32 t = 0; t < pMap->au32TapCount[c]; t++)
+        {
+            if (pMap->aau8TapChannels[c][t] == u32FileChannel)
+            {
+                pMap->aaf32TapGains[c][t] += f32Gain;
+                return TRUE;
+            }
+        }
+
+        const UINT32 t = pMap->au32TapCount[c]++;
+        pMap->aau8TapChannels[c][t] = static_cast<BYTE>(u32FileChannel);
+        pMap->aaf32TapGains[c][t] = f32Gain;
+        return TRUE;
+    }
+
+    BOOL bAdded = FALSE;
+    if (u32Depth != 0)
+    {
+        for (const MIX_FOLD &fold : c_aMixFolds)
+        {
+            if (fold.dwFrom == dwPosition &&
+                AddMixTaps(pMap, pdwPositions, u32FileChannel, fold.dwTo, f32Gain * fold.f32Gain, u32Depth - 1))
+            {
+                bAdded = TRUE;
+            }
+        }
+    }
+    return bAdded;
+}
+
+BOOL BuildMixChannelMap(
+    UINT32              u32FileChannels,
+    DWORD               dwFileChannelMask,
+    UINT32              u32Channels,
+    DWORD               dwChannelMask,
+    MIX_CHANNEL_MAP    *pMap)
+{
+    *pMap = {};
+    pMap->u32FileChannels = u32FileChannels;
+    pMap->u32Channels = u32Channels;
+
+    if (u32FileChannels == u32Channels &&
+        (dwFileChannelMask == dwChannelMask || dwFileChannelMask == 0 || dwChannelMask == 0))
+    {
+        pMap->mapping = MIX_MAPPING_IDENTITY;
+        return TRUE;
+    }
+
+    if (u32FileChannels == 1)
+    {
+        pMap->mapping = MIX_MAPPING_MONO_TO_ALL;
+        return TRUE;
+    }
+
+    if (u32FileChannels > MIX_MAP_MAX_CHANNELS || u32Channels > MIX_MAP_MAX_CHANNELS)
+    {
+        return FALSE;
+    }
+
+    pMap->mapping = MIX_MAPPING_MATRIX;
+
+    DWORD adwFilePositions[MIX_MAP_MAX_CHANNELS];
+    DWORD adwPositions[MIX_MAP_MAX_CHANNELS];
+    if (!GetChannelPositions(u32FileChannels, dwFileChannelMask, adwFilePositions) ||
+        !GetChannelPositions(u32Channels, dwChannelMask, adwPositions))
+    {
+        // Nothing to go by, such as for a microphone array
+        for (UINT32 c = 0; c < u32Channels; c++)
+        {
+            pMap->au32TapCount[c] = 1;
+            pMap->aau8TapChannels[c][0] = static_cast<BYTE>(c % u32FileChannels);
+            pMap->aaf32TapGains[c][0] = 1.0f;
+        }
+        return TRUE;
+    }
+
+    for (UINT32 f = 0; f < u32FileChannels; f++)
+    {
+        const DWORD dwPosition = adwFilePositions[f];
+        if (dwPosition == 0 || dwPosition == SPEAKER_LOW_FREQUENCY ||
+            AddMixTaps(pMap, adwPositions, f, dwPosition, 1.0f, 2))
+        {
+            continue;
+        }
+
+        // Whatever is left over goes to the front pair, or the center of a mono stream
+        if (dwPosition & c_dwLeftSpeakers)
+        {
+            if (!AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_LEFT, 1.0f, 0))
+            {
+                AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_CENTER, c_f32FoldSplitGain, 0);
+            }
+        }
+        else if (dwPosition & c_dwRightSpeakers)
+        {
+            if (!AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_RIGHT, 1.0f, 0))
+            {
+                AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_CENTER, c_f32FoldSplitGain, 0);
+            }
+        }
+        else
+        {
+            const BOOL bLeft = AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_LEFT, c_f32FoldSplitGain, 0);
+            const BOOL bRight = AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_RIGHT, c_f32FoldSplitGain, 0);
+            if (!bLeft && !bRight)
+            {
+                AddMixTaps(pMap, adwPositions, f, SPEAKER_FRONT_CENTER, 1.0f, 0);
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+template <UINT32 C>
+static void SpreadMonoFrames(const FLOAT32 *pf32File, UINT32 u32FrameCount, UINT32 u32Channels, FLOAT32 *pf32Output)
+{
+    const UINT32 u32Stride = (C != 0) ? C : u32Channels;
+
+    for (UINT32 i = 0; i < u32FrameCount; i++)
+    {
+        const FLOAT32 f32Sample = pf32File[i];
+        for (UINT32 c = 0; c < u32Stride; c++)
+        {
+            pf32Output[c] = f32Sample;
+        }
+        pf32Output += u32Stride;
+    }
+}
+
+void MapMixChannels(
+    const MIX_CHANNEL_MAP  *pMap,
+    const FLOAT32          *pf32File,
+    UINT32                  u32FrameCount,
+    FLOAT32                *pf32Output)
+{
+    const UINT32 u32Channels = pMap->u32Channels;
+
+    switch (pMap->mapping)
+    {
+    case MIX_MAPPING_IDENTITY:
+        memcpy(pf32Output, pf32File, static_cast<size_t>(u32FrameCount) * u32Channels * sizeof(FLOAT32));
+        break;
+
+    case MIX_MAPPING_MONO_TO_ALL:
+        // A compile time stride for the common layouts lets the compiler unroll the frame
+        switch (u32Channels)
+        {
+        case 2:     SpreadMonoFrames<2>(pf32File, u32FrameCount, u32Channels, pf32Output); break;
+        case 4:     SpreadMonoFrames<4>(pf32File, u32FrameCount, u32Channels, pf32Output); break;
+        case 6:     SpreadMonoFrames<6>(pf32File, u32FrameCount, u32Channels, pf32Output); break;
+        case 8:     SpreadMonoFrames<8>(pf32File, u32FrameCount, u32Channels, pf32Output); break;
+        default:    SpreadMonoFrames<0>(pf32File, u32FrameCount, u32Channels, pf32Output); break;
+        }
+        break;
+
+    case MIX_MAPPING_MATRIX:
+        for (UINT32 i = 0; i < u32FrameCount; i++)
+        {
+            for (UINT32 c = 0; c < u32Channels; c++)
+            {
+                const UINT32 u32Taps = pMap->au32TapCount[c];
+                FLOAT32 f32Sample = 0.0f;
+                if (u32Taps != 0)
+                {
+                    f32Sample = pf32File[pMap->aau8TapChannels[c][0]] * pMap->aaf32TapGains[c][0];
+                    for (UINT32 t = 1; t < u32Taps; t++)
+                    {
+                        f32Sample = f32Sample + (pf32File[pMap->aau8TapChannels[c][t]] * pMap->aaf32TapGains[c][t]);
+                    }
+                }
+                pf32Output[c] = f32Sample;
+            }
+            pf32File += pMap->u32FileChannels;
+            pf32Output += u32Channels;
+        }
+        break;
+    }
+}
+
+UINT32 GetMixSilentBlockCount(UINT32 u32FileFrameCount)
+{
+    return (u32FileFrameCount + MIX_SILENT_BLOCK_FRAMES - 1) / MIX_SILENT_BLOCK_FRAMES;
+}
+
+template <class T>
+static void FindSilentBlocks(
+    const T        *pFile,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    BYTE           *pbSilentBlocks)
+{
+    const UINT32 u32BlockCount = GetMixSilentBlockCount(u32FileFrameCount);
+
+    for (UINT32 b = 0; b < u32BlockCount; b++)
+    {
+        const UINT32 u32First = b * MIX_SILENT_BLOCK_FRAMES;
+        UINT32 u32Frames = u32FileFrameCount - u32First;
+        if (u32Frames > MIX_SILENT_BLOCK_FRAMES)
+        {
+            u32Frames = MIX_SILENT_BLOCK_FRAMES;
+        }
+        const T *pBlock = pFile + static_cast<size_t>(u32First) * u32SamplesPerFrame;
+
+        BYTE bSilent = 1;
+        for (UINT32 i = 0; i < u32Frames * u32SamplesPerFrame && bSilent; i++)
+        {
+            bSilent = (pBlock[i] == 0);
+        }
+        pbSilentBlocks[b] = bSilent;
+    }
+}
+
+void FindMixSilentBlocks(
+    const FLOAT32  *pf32File,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    BYTE           *pbSilentBlocks)
+{
+    FindSilentBlocks(pf32File, u32FileFrameCount, u32SamplesPerFrame, pbSilentBlocks);
+}
+
+void FindMixSilentBlocks(
+    const INT16    *pi16File,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    BYTE           *pbSilentBlocks)
+{
+    FindSilentBlocks(pi16File, u32FileFrameCount, u32SamplesPerFrame, pbSilentBlocks);
+}
+
+//
+// The mix law tables are built by the compiler, which has no constexpr sin or exp.
+// The series below are evaluated in double precision over the small ranges the laws
+// need and are exact to well below the FLOAT32 step.
+//
+static constexpr FLOAT64 c_f64HalfPi = 1.5707963267948966;
+static constexpr FLOAT64 c_f64Ln10 = 2.302585092994046;
+
+// sin(x) for x from 0 to pi/2
+static constexpr FLOAT64 MixLawSin(FLOAT64 x)
+{
+    FLOAT64 f64Term = x;
+    FLOAT64 f64Sum = x;
+    for (int n = 1; n < 14; n++)
+    {
+        f64Term *= -x * x / ((2 * n) * (2 * n + 1));
+        f64Sum += f64Term;
+    }
+    return f64Sum;
+}
+
+// exp(x) for x down to about -7, from the series of x / 256 squared eight times
+static constexpr FLOAT64 MixLawExp(FLOAT64 x)
+{
+    const FLOAT64 y = x / 256.0;
+    FLOAT64 f64Term = 1.0;
+    FLOAT64 f64Sum = 1.0;
+    for (int n = 1; n < 12; n++)
+    {
+        f64Term *= y / n;
+        f64Sum += f64Term;
+    }
+    for (int n = 0; n < 8; n++)
+    {
+        f64Sum *= f64Sum;
+    }
+    return f64Sum;
+}
+
+// Clip weight of the law at the ratio, the input weight is the one at 1 - ratio
+static constexpr FLOAT64 MixLawWeight(MIX_LAW law, FLOAT64 f64Ratio)
+{
+    switch (law)
+    {
+    case MIX_LAW_EQUAL_POWER:
+        return MixLawSin(f64Ratio * c_f64HalfPi);
+
+    case MIX_LAW_DECIBEL:
+        if (f64Ratio >= 0.5)
+        {
+            return 1.0;
+        }
+        if (f64Ratio <= 0.0)
+        {
+            return 0.0;
+        }
+        return MixLawExp(-MIX_LAW_DECIBEL_RANGE_DB * (1.0 - 2.0 * f64Ratio) * c_f64Ln10 / 20.0);
+
+    default:
+        return f64Ratio;
+    }
+}
+
+struct MIX_LAW_TABLES
+{
+    FLOAT32 af32Weights[MIX_LAW_COUNT][MIX_LAW_TABLE_SIZE];
+};
+
+static constexpr MIX_LAW_TABLES MakeMixLawTables()
+{
+    MIX_LAW_TABLES tables = {};
+    for (int law = 0; law < MIX_LAW_COUNT; law++)
+    {
+        for (int i = 0; i < MIX_LAW_TABLE_SIZE; i++)
+        {
+            tables.af32Weights[law][i] = static_cast<FLOAT32>(
+                MixLawWeight(static_cast<MIX_LAW>(law), static_cast<FLOAT64>(i) / (MIX_LAW_TABLE_SIZE - 1)));
+        }
+    }
+    return tables;
+}
+
+static constexpr MIX_LAW_TABLES c_MixLawTables = MakeMixLawTables();
+
+static FLOAT32 InterpolateMixLaw(const FLOAT32 *pf32Table, FLOAT32 f32Ratio)
+{
+    const FLOAT32 f32Position = f32Ratio * (MIX_LAW_TABLE_SIZE - 1);
+    const UINT32 u32Index = static_cast<UINT32>(f32Position);
+    if (u32Index >= MIX_LAW_TABLE_SIZE - 1)
+    {
+        return pf32Table[MIX_LAW_TABLE_SIZE - 1];
+    }
+
+    const FLOAT32 f32Fraction = f32Position - static_cast<FLOAT32>(u32Index);
+    return pf32Table[u32Index] + (pf32Table[u32Index + 1] - pf32Table[u32Index]) * f32Fraction;
+}
+
+void GetMixLawWeights(
+    MIX_LAW         law,
+    FLOAT32         f32Ratio,
+    FLOAT32        *pf32InputWeight,
+    FLOAT32        *pf32FileWeight)
+{
+    if (static_cast<UINT32>(law) >= MIX_LAW_COUNT)
+    {
+        law = MIX_LAW_LINEAR;
+    }
+
+    // NaN ends up at 0 as well
+    if (!(f32Ratio > 0.0f))
+    {
+        f32Ratio = 0.0f;
+    }
+    if (f32Ratio > 1.0f)
+    {
+        f32Ratio = 1.0f;
+    }
+
+    *pf32FileWeight = InterpolateMixLaw(c_MixLawTables.af32Weights[law], f32Ratio);
+    *pf32InputWeight = InterpolateMixLaw(c_MixLawTables.af32Weights[law], 1.0f - f32Ratio);
+}
+
+UINT32 CrossfadeMixLoop(
+    FLOAT32        *pf32File,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    UINT32          u32CrossfadeFrames)
+{
+    if (u32CrossfadeFrames > u32FileFrameCount / 2)
+    {
+        u32CrossfadeFrames = u32FileFrameCount / 2;
+    }
+    if (u32CrossfadeFrames == 0)
+    {
+        return u32FileFrameCount;
+    }
+
+    // The tail is read before the head overwrites it, it never overlaps the head
+    const UINT32 u32FrameCount = u32FileFrameCount - u32CrossfadeFrames;
+    const FLOAT32 *pf32Tail = pf32File + static_cast<size_t>(u32FrameCount) * u32SamplesPerFrame;
+    const FLOAT64 f64QuarterTurn = 1.5707963267948966;
+
+    for (UINT32 i = 0; i < u32CrossfadeFrames; i++)
+    {
+        // Sampled at the middle of every frame, so neither end repeats a frame at full weight
+        const FLOAT64 f64Angle = f64QuarterTurn * (i + 0.5) / u32CrossfadeFrames;
+        const FLOAT32 f32HeadGain = static_cast<FLOAT32>(std::sin(f64Angle));
+        const FLOAT32 f32TailGain = static_cast<FLOAT32>(std::cos(f64Angle));
+
+        FLOAT32 *pf32Frame = pf32File + static_cast<size_t>(i) * u32SamplesPerFrame;
+        const FLOAT32 *pf32TailFrame = pf32Tail + static_cast<size_t>(i) * u32SamplesPerFrame;
+        for (UINT32 c = 0; c < u32SamplesPerFrame; c++)
+        {
+            pf32Frame[c] = pf32Frame[c] * f32HeadGain + pf32TailFrame[c] * f32TailGain;
+        }
+    }
+
+    return u32FrameCount;
+}
+
+static BOOL IsMixSourceSilent(const MIX_SOURCE *pSource, UINT32 u32FrameCount)
+{
+    if (pSource->u32FileFrameCount == 0 ||
+        (pSource->f32Weight == 0.0f && pSource->f32TargetWeight == 0.0f))
+    {
+        return TRUE;
+    }
+
+    UINT32 u32Index = pSource->u32FileIndex;
+    UINT32 u32Left = u32FrameCount;
+
+    while (u32Left > 0)
+    {
+        if (u32Index >= pSource->u32FileFrameCount)
+        {
+            // Same wrapping as PlanMixSourceBlock, an ended one shot clip adds nothing
+            if (!pSource->bLoop)
+            {
+                return TRUE;
+            }
+            u32Index %= pSource->u32FileFrameCount;
+        }
+
+        if (pSource->pbSilentBlocks == nullptr)
+        {
+            return FALSE;
+        }
+
+        UINT32 u32Run = pSource->u32FileFrameCount - u32Index;
+        if (u32Run > u32Left)
+        {
+            u32Run = u32Left;
+        }
+        const UINT32 u32LastBlock = (u32Index + u32Run - 1) / MIX_SILENT_BLOCK_FRAMES;
+        for (UINT32 b = u32Index / MIX_SILENT_BLOCK_FRAMES; b <= u32LastBlock; b++)
+        {
+            if (!pSource->pbSilentBlocks[b])
+            {
+                return FALSE;
+            }
+        }
+
+        u32Index += u32Run;
+        u32Left -= u32Run;
+    }
+
+    return TRUE;
+}
+
+BOOL AreMixSourcesSilent(
+    const MIX_SOURCE   *pSources,
+    UINT32              u32SourceCount,
+    UINT32              u32FrameCount)
+{
+    for (UINT32 s = 0; s < u32SourceCount; s++)
+    {
+        if (!IsMixSourceSilent(&pSources[s], u32FrameCount))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void SkipMixFrames(MIX_CONTEXT *pContext, UINT32 u32FrameCount)
+{
+    UINT32 au32Active[MIX_CONTEXT_SOURCES];
+    UINT32 u32Done = 0;
+
+    while (u32Done < u32FrameCount)
+    {
+        UINT32 u32Active = 0;
+        const UINT32 u32Frames = PlanMixSourceBlock(pContext->aSources, pContext->u32SourceCount,
+                                                    u32FrameCount - u32Done, au32Active, &u32Active);
+        AdvanceMixSources(pContext->aSources, au32Active, u32Active, u32Frames);
+        u32Done += u32Frames;
+    }
+
+    if (pContext->u32RampPosition < pContext->u32RampFrames)
+    {
+        const UINT32 u32RampLeft = pContext->u32RampFrames - pContext->u32RampPosition;
+        pContext->u32RampPosition += (u32FrameCount < u32RampLeft) ? u32FrameCount : u32RampLeft;
+        if (pContext->u32RampPosition == pContext->u32RampFrames)
+        {
+            FinishMixRamp(pContext);
+        }
+    }
+}
+
+// Counters of frames in a row stop here, far beyond any lookahead
+static UINT32 AddLimiterFrames(UINT32 u32Frames, UINT32 u32More)
+{
+    const UINT32 u32Max = 0x80000000;
+    return (u32More < u32Max - u32Frames) ? u32Frames + u32More : u32Max;
+}
+
+// A release this close to the held gain has arrived, the last steps would take forever
+static const FLOAT64 c_f64LimiterReleaseSnap = 1.0e-5;
+
+size_t GetMixStreamBufferSize(UINT32 u32RingFrames, UINT32 u32PeriodFrames, UINT32 u32Channels)
+{
+    return (static_cast<size_t>(u32RingFrames) + u32PeriodFrames) * u32Channels * sizeof(FLOAT32);
+}
+
+void InitMixStream(
+    MIX_STREAM     *pStream,
+    UINT32          u32RingFrames,
+    UINT32          u32PeriodFrames,
+    UINT32          u32Channels,
+    BYTE           *pbBuffer)
+{
+    std::memset(pbBuffer, 0, GetMixStreamBufferSize(u32RingFrames, u32PeriodFrames, u32Channels));
+
+    pStream->pf32Ring = reinterpret_cast<FLOAT32*>(pbBuffer);
+    pStream->u32RingFrames = u32RingFrames;
+    pStream->u32Channels = u32Channels;
+    pStream->pf32Period = pStream->pf32Ring + static_cast<size_t>(u32RingFrames) * u32Channels;
+    pStream->u32PeriodFrames = u32PeriodFrames;
+    pStream->u64WrittenFrames.store(0, std::memory_order_relaxed);
+    pStream->u64ReadFrames.store(0, std::memory_order_relaxed);
+    pStream->u32Underruns.store(0, std::memory_order_relaxed);
+    pStream->u64MissingFrames.store(0, std::memory_order_relaxed);
+}
+
+UINT32 GetMixStreamSpace(const MIX_STREAM *pStream)
+{
+    const UINT64 u64Written = pStream->u64WrittenFrames.load(std::memory_order_relaxed);
+    const UINT64 u64Read = pStream->u64ReadFrames.load(std::memory_order_acquire);
+    return pStream->u32RingFrames - static_cast<UINT32>(u64Written - u64Read);
+}
+
+UINT32 WriteMixStream(
+    MIX_STREAM     *pStream,
+    const FLOAT32  *pf32Frames,
+    UINT32          u32FrameCount)
+{
+    const UINT64 u64Written = pStream->u64WrittenFrames.load(std::memory_order_relaxed);
+    UINT32 u32Frames = GetMixStreamSpace(pStream);
+    if (u32Frames > u32FrameCount)
+    {
+        u32Frames = u32FrameCount;
+    }
+
+    // The frames may wrap around the end of the ring
+    const UINT32 u32Channels = pStream->u32Channels;
+    const UINT32 u32Position = static_cast<UINT32>(u64Written % pStream->u32RingFrames);
+    UINT32 u32First = pStream->u32RingFrames - u32Position;
+    if (u32First > u32Frames)
+    {
+        u32First = u32Frames;
+    }
+    std::memcpy(pStream->pf32Ring + static_cast<size_t>(u32Position) * u32Channels, pf32Frames,
+                static_cast<size_t>(u32First) * u32Channels * sizeof(FLOAT32));
+    std::memcpy(pStream->pf32Ring, pf32Frames + static_cast<size_t>(u32First) * u32Channels,
+                static_cast<size_t>(u32Frames - u32First) * u32Channels * sizeof(FLOAT32));
+
+    pStream->u64WrittenFrames.store(u64Written + u32Frames, std::memory_order_release);
+    return u32Frames;
+}
+
+UINT32 ReadMixStream(
+    MIX_STREAM     *pStream,
+    FLOAT32        *pf32Frames,
+    UINT32          u32FrameCount)
+{
+    const UINT64 u64Read = pStream->u64ReadFrames.load(std::memory_order_relaxed);
+    const UINT64 u64Written = pStream->u64WrittenFrames.load(std::memory_order_acquire);
+    UINT32 u32Frames = static_cast<UINT32>(u64Written - u64Read);
+    if (u32Frames > u32FrameCount)
+    {
+        u32Frames = u32FrameCount;
+    }
+
+    const UINT32 u32Channels = pStream->u32Channels;
+    const UINT32 u32Position = static_cast<UINT32>(u64Read % pStream->u32RingFrames);
+    UINT32 u32First = pStream->u32RingFrames - u32Position;
+    if (u32First > u32Frames)
+    {
+        u32First = u32Frames;
+    }
+    std::memcpy(pf32Frames, pStream->pf32Ring + static_cast<size_t>(u32Position) * u32Channels,
+                static_cast<size_t>(u32First) * u32Channels * sizeof(FLOAT32));
+    std::memcpy(pf32Frames + static_cast<size_t>(u32First) * u32Channels, pStream->pf32Ring,
+                static_cast<size_t>(u32Frames - u32First) * u32Channels * sizeof(FLOAT32));
+
+    // The worker fell behind, the rest of the period is silent rather than stale
+    if (u32Frames < u32FrameCount)
+    {
+        std::memset(pf32Frames + static_cast<size_t>(u32Frames) * u32Channels, 0,
+                    static_cast<size_t>(u32FrameCount - u32Frames) * u32Channels * sizeof(FLOAT32));
+        pStream->u32Underruns.fetch_add(1, std::memory_order_relaxed);
+        pStream->u64MissingFrames.fetch_add(u32FrameCount - u32Frames, std::memory_order_relaxed);
+    }
+
+    pStream->u64ReadFrames.store(u64Read + u32Frames, std::memory_order_release);
+    return u32Frames;
+}
+
+void PrepareMixStreams(MIX_CONTEXT *pContext, UINT32 u32FrameCount)
+{
+    // The processor would pick the request up itself, but only after the streams are read
+    if (IsMixRequestPending(pContext))
+    {
+        ApplyMixRequest(pContext);
+    }
+
+    for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+    {
+        MIX_SOURCE *pSource = &pContext->aSources[s];
+        MIX_STREAM *pStream = pSource->pStream;
+        if (pStream == nullptr)
+        {
+            continue;
+        }
+
+        // A period longer than the stream was set up for loops what fits
+        UINT32 u32Frames = u32FrameCount;
+        if (u32Frames > pStream->u32PeriodFrames)
+        {
+            u32Frames = pStream->u32PeriodFrames;
+        }
+        if (u32Frames == 0)
+        {
+            continue;
+        }
+
+        ReadMixStream(pStream, pStream->pf32Period, u32Frames);
+        pSource->pf32File = pStream->pf32Period;
+        pSource->pi16File = nullptr;
+        pSource->u32FileFrameCount = u32Frames;
+        pSource->u32FileIndex = 0;
+        pSource->bLoop = TRUE;
+        pSource->pbSilentBlocks = nullptr;
+    }
+}
+
+size_t GetMixLimiterBufferSize(UINT32 u32LookaheadFrames, UINT32 u32Channels)
+{
+    const size_t window = static_cast<size_t>(u32LookaheadFrames) + 1;
+    return (static_cast<size_t>(u32LookaheadFrames) * u32Channels + 2 * window) * sizeof(FLOAT32) +
+           window * sizeof(UINT32);
+}
+
+void InitMixLimiter(
+    MIX_LIMITER    *pLimiter,
+    UINT32          u32LookaheadFrames,
+    UINT32          u32Channels,
+    FLOAT32         f32Ceiling,
+    UINT32          u32ReleaseFrames,
+    BYTE           *pbBuffer)
+{
+    if (u32LookaheadFrames == 0 || u32Channels == 0 || u32Channels > MIX_LIMITER_BLOCK_SAMPLES || pbBuffer == nullptr)
+    {
+        std::memset(pLimiter, 0, sizeof(*pLimiter));
+        return;
+    }
+
+    const UINT32 u32Window = u32LookaheadFrames + 1;
+    const size_t delaySamples = static_cast<size_t>(u32LookaheadFrames) * u32Channels;
+
+    pLimiter->u32LookaheadFrames = u32LookaheadFrames;
+    pLimiter->u32Channels = u32Channels;
+    pLimiter->u32BlockFrames = MIX_LIMITER_BLOCK_SAMPLES / u32Channels;
+    if (pLimiter->u32BlockFrames > MIX_LIMITER_BLOCK_FRAMES)
+    {
+        pLimiter->u32BlockFrames = MIX_LIMITER_BLOCK_FRAMES;
+    }
+    pLimiter->f32Ceiling = f32Ceiling;
+    pLimiter->f64Release = (u32ReleaseFrames != 0) ? 1.0 - std::exp(-1.0 / static_cast<FLOAT64>(u32ReleaseFrames)) : 1.0;
+
+    pLimiter->pf32Delay = reinterpret_cast<FLOAT32*>(pbBuffer);
+    pLimiter->pf32Gains = pLimiter->pf32Delay + delaySamples;
+    pLimiter->pf32HoldGains = pLimiter->pf32Gains + u32Window;
+    pLimiter->pu32HoldFrames = reinterpret_cast<UINT32*>(pLimiter->pf32HoldGains + u32Window);
+
+    std::memset(pLimiter->pf32Delay, 0, delaySamples * sizeof(FLOAT32));
+    for (UINT32 i = 0; i < u32Window; i++)
+    {
+        pLimiter->pf32Gains[i] = 1.0f;
+    }
+
+    pLimiter->u32DelayPosition = 0;
+    pLimiter->u32GainPosition = 0;
+    pLimiter->f64GainSum = static_cast<FLOAT64>(u32Window);
+    pLimiter->f64ReleaseGain = 1.0;
+    pLimiter->u32Frame = 0;
+
+    // The sliding minimum starts out with a single unity gain just before frame 0
+    pLimiter->u32HoldFirst = 0;
+    pLimiter->u32HoldCount = 1;
+    pLimiter->pf32HoldGains[0] = 1.0f;
+    pLimiter->pu32HoldFrames[0] = pLimiter->u32Frame - 1;
+
+    pLimiter->u32UnityFrames = u32Window;
+    pLimiter->u32QuietFrames = u32LookaheadFrames;
+}
+
+void UpdateMixLimiterGains(
+    MIX_LIMITER    *pLimiter,
+    const FLOAT32  *pf32Frames,
+    UINT32          u32FrameCount)
+{
+    const UINT32 u32Lookahead = pLimiter->u32LookaheadFrames;
+    const UINT32 u32Window = u32Lookahead + 1;
+    const UINT32 u32Channels = pLimiter->u32Channels;
+    FLOAT32 *pf32HoldGains = pLimiter->pf32HoldGains;
+    UINT32 *pu32HoldFrames = pLimiter->pu32HoldFrames;
+
+    for (UINT32 f = 0; f < u32FrameCount; f++)
+    {
+        const FLOAT32 *pf32Frame = pf32Frames + static_cast<size_t>(f) * u32Channels;
+        FLOAT32 f32Peak = 0.0f;
+        for (UINT32 c = 0; c < u32Channels; c++)
+        {
+            const FLOAT32 f32Magnitude = std::fabs(pf32Frame[c]);
+            if (f32Magnitude > f32Peak)
+            {
+                f32Peak = f32Magnitude;
+            }
+        }
+
+        const FLOAT32 f32Required = (f32Peak > pLimiter->f32Ceiling) ? pLimiter->f32Ceiling / f32Peak : 1.0f;
+
+        // Sliding minimum over the frame and the u32Lookahead ones before it: a held
+        // gain that is not below the new one can never be the minimum again
+        UINT32 u32Last = pLimiter->u32HoldFirst + pLimiter->u32HoldCount;
+        if (u32Last >= u32Window)
+        {
+            u32Last -= u32Window;
+        }
+        while (pLimiter->u32HoldCount > 0)
+        {
+            const UINT32 u32Previous = (u32Last == 0) ? u32Window - 1 : u32Last - 1;
+            if (pf32HoldGains[u32Previous] < f32Required)
+            {
+                break;
+            }
+            u32Last = u32Previous;
+            pLimiter->u32HoldCount--;
+        }
+
+        pf32HoldGains[u32Last] = f32Required;
+        pu32HoldFrames[u32Last] = pLimiter->u32Frame;
+        pLimiter->u32HoldCount++;
+
+        while (pLimiter->u32Frame - pu32HoldFrames[pLimiter->u32HoldFirst] > u32Lookahead)
+        {
+            if (++pLimiter->u32HoldFirst == u32Window)
+            {
+                pLimiter->u32HoldFirst = 0;
+            }
+            pLimiter->u32HoldCount--;
+        }
+
+        // Drop to the held gain at once, the average below smooths the attack.  The
+        // release runs in double precision, in single precision its last steps
+        // would be lost to rounding and it would never get back to unity.
+        const FLOAT64 f64Held = pf32HoldGains[pLimiter->u32HoldFirst];
+        FLOAT64 f64Release = pLimiter->f64ReleaseGain;
+        if (f64Held <= f64Release)
+        {
+            f64Release = f64Held;
+        }
+        else
+        {
+            f64Release += (f64Held - f64Release) * pLimiter->f64Release;
+            if (f64Held - f64Release < c_f64LimiterReleaseSnap)
+            {
+                f64Release = f64Held;
+            }
+        }
+        pLimiter->f64ReleaseGain = f64Release;
+
+        // Rounds to at most the held gain, which is a float
+        const FLOAT32 f32Release = static_cast<FLOAT32>(f64Release);
+
+        // Moving average over the window, summed again from scratch once per lap
+        // so that the rounding errors do not pile up
+        pLimiter->f64GainSum += static_cast<FLOAT64>(f32Release) - pLimiter->pf32Gains[pLimiter->u32GainPosition];
+        pLimiter->pf32Gains[pLimiter->u32GainPosition] = f32Release;
+        if (++pLimiter->u32GainPosition == u32Window)
+        {
+            pLimiter->u32GainPosition = 0;
+            pLimiter->f64GainSum = 0.0;
+            for (UINT32 i = 0; i < u32Window; i++)
+            {
+                pLimiter->f64GainSum += pLimiter->pf32Gains[i];
+            }
+        }
+
+        pLimiter->af32FrameGains[f] = static_cast<FLOAT32>(pLimiter->f64GainSum / u32Window);
+
+        pLimiter->u32UnityFrames = (f32Release == 1.0f) ? AddLimiterFrames(pLimiter->u32UnityFrames, 1) : 0;
+        pLimiter->u32QuietFrames = (f32Peak == 0.0f) ? AddLimiterFrames(pLimiter->u32QuietFrames, 1) : 0;
+        pLimiter->u32Frame++;
+    }
+}
+
+void SkipMixLimiterGains(
+    MIX_LIMITER    *pLimiter,
+    UINT32          u32FrameCount,
+    FLOAT32         f32Peak)
+{
+    const UINT32 u32Window = pLimiter->u32LookaheadFrames + 1;
+
+    if (pLimiter->u32UnityFrames < u32Window)
+    {
+        for (UINT32 i = 0; i < u32Window; i++)
+        {
+            pLimiter->pf32Gains[i] = 1.0f;
+        }
+        pLimiter->f64ReleaseGain = 1.0;
+    }
+    pLimiter->f64GainSum = static_cast<FLOAT64>(u32Window);
+
+    pLimiter->u32Frame += u32FrameCount;
+    pLimiter->u32HoldFirst = 0;
+    pLimiter->u32HoldCount = 1;
+    pLimiter->pf32HoldGains[0] = 1.0f;
+    pLimiter->pu32HoldFrames[0] = pLimiter->u32Frame - 1;
+
+    if (pLimiter->u32UnityFrames < u32Window)
+    {
+        pLimiter->u32UnityFrames = u32Window;
+    }
+    pLimiter->u32UnityFrames = AddLimiterFrames(pLimiter->u32UnityFrames, u32FrameCount);
+    pLimiter->u32QuietFrames = (f32Peak == 0.0f) ? AddLimiterFrames(pLimiter->u32QuietFrames, u32FrameCount) : 0;
+}
+
+UINT32 GetMixSampleBytes(MIX_SAMPLE_FORMAT format)
+{
+    switch (format)
+    {
+    case MIX_SAMPLE_INT16:
+        return 2;
+    case MIX_SAMPLE_INT24:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+void InitMixFormat(
+    MIX_FORMAT         *pFormat,
+    MIX_SAMPLE_FORMAT   format,
+    UINT32              u32Channels)
+{
+    pFormat->format = format;
+    pFormat->u32Channels = u32Channels;
+    pFormat->u32BlockFrames = (u32Channels != 0 && u32Channels <= MIX_FORMAT_BLOCK_SAMPLES) ?
+        MIX_FORMAT_BLOCK_SAMPLES / u32Channels : 0;
+
+    // A float mix carries 24 bits, more than the 32 bit format keeps of it anyway
+    pFormat->bDither = (format == MIX_SAMPLE_INT16 || format == MIX_SAMPLE_INT24);
+
+    // Distinct non zero seeds, the same for every instruction set
+    UINT32 u32Seed = 0x2545F491;
+    for (UINT32 i = 0; i < MIX_DITHER_LANES; i++)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        pFormat->au32DitherState[i] = u32Seed | 1;
+    }
+}
+
+MIX_CHANNELS GetMixChannels(UINT32 u32SamplesPerFrame)
+{
+    switch (u32SamplesPerFrame)
+    {
+    case 1:
+        return MIX_CHANNELS_1;
+    case 2:
+        return MIX_CHANNELS_2;
+    case 4:
+        return MIX_CHANNELS_4;
+    case 6:
+        return MIX_CHANNELS_6;
+    case 8:
+        return MIX_CHANNELS_8;
+    default:
+        return MIX_CHANNELS_ANY;
+    }
+}
+
+const MIX_PROCESSOR* GetMixProcessor(
+    const MIX_KERNELS  *pKernels,
+    UINT32              u32SamplesPerFrame,
+    MIX_STATE           state)
+{
+    return &pKernels->channels[GetMixChannels(u32SamplesPerFrame)].states[state];
+}
+
+//
+// Samples of the ramp and gain lane pattern: whole frames and whole vectors if
+// possible, whole frames only otherwise
+//
+static UINT32 GetMixLanePattern(UINT32 u32Channels)
+{
+    UINT32 u32Pattern = u32Channels;
+    while (u32Pattern % MIX_RAMP_VECTOR_WIDTH != 0 && u32Pattern + u32Channels <= MIX_RAMP_PATTERN_MAX)
+    {
+        u32Pattern += u32Channels;
+    }
+    if (u32Pattern % MIX_RAMP_VECTOR_WIDTH != 0)
+    {
+        u32Pattern = u32Channels;
+    }
+    while (u32Pattern < MIX_RAMP_PATTERN_MIN && u32Pattern * 2 <= MIX_RAMP_PATTERN_MAX)
+    {
+        u32Pattern *= 2;
+    }
+    return u32Pattern;
+}
+
+void InitMixContext(
+    MIX_CONTEXT        *pContext,
+    const MIX_KERNELS  *pKernels,
+    UINT32              u32SamplesPerFrame,
+    BOOL                bInPlace,
+    UINT32              u32RampFrames)
+{
+    pContext->pMixProcessor = GetMixProcessor(pKernels, u32SamplesPerFrame,
+                                              bInPlace ? MIX_STATE_MIX_IN_PLACE : MIX_STATE_MIX);
+    pContext->pPassthroughProcessor = GetMixProcessor(pKernels, u32SamplesPerFrame,
+                                                      bInPlace ? MIX_STATE_PASSTHROUGH_IN_PLACE : MIX_STATE_PASSTHROUGH);
+    pContext->u32SamplesPerFrame = u32SamplesPerFrame;
+
+    // A ramp pattern holds at least one frame
+    pContext->u32RampFrames = (u32SamplesPerFrame <= MIX_RAMP_PATTERN_MAX) ? u32RampFrames : 0;
+
+    pContext->pProcessor = pContext->pPassthroughProcessor;
+    pContext->pSettledProcessor = pContext->pPassthroughProcessor;
+    pContext->u32SourceCount = 0;
+    pContext->f32InputWeight = 1.0f;
+    pContext->f32TargetInputWeight = 1.0f;
+    pContext->u32RampPosition = pContext->u32RampFrames;
+    pContext->rampShape = MIX_RAMP_LINEAR;
+    pContext->f32RampDecay = 0.0f;
+    pContext->u32RampPattern = (u32SamplesPerFrame <= MIX_RAMP_PATTERN_MAX) ? GetMixLanePattern(u32SamplesPerFrame) : 0;
+
+    pContext->bChannelGains = FALSE;
+    for (UINT32 k = 0; k < MIX_RAMP_PATTERN_MAX; k++)
+    {
+        pContext->af32InputGainLanes[k] = 1.0f;
+        pContext->af32InjectionGainLanes[k] = 1.0f;
+        pContext->af32InputGainSteps[k] = 0.0f;
+        pContext->af32InjectionGainSteps[k] = 0.0f;
+    }
+
+    pContext->request = MIX_REQUEST();
+    pContext->u32RequestSerial.store(0, std::memory_order_relaxed);
+    pContext->u32SettledSerial.store(0, std::memory_order_relaxed);
+    pContext->u32AppliedSerial = 0;
+}
+
+FLOAT32 ClampMixChannelGain(FLOAT32 f32Gain)
+{
+    if (f32Gain != f32Gain)
+    {
+        return 1.0f;
+    }
+    if (f32Gain < 0.0f)
+    {
+        return 0.0f;
+    }
+    return (f32Gain > MIX_MAX_CHANNEL_GAIN) ? MIX_MAX_CHANNEL_GAIN : f32Gain;
+}
+
+UINT32 PostMixRequest(
+    MIX_CONTEXT        *pContext,
+    const MIX_REQUEST  *pRequest)
+{
+    // Sequence lock: the serial is odd while the request is being written
+    const UINT32 u32Serial = pContext->u32RequestSerial.load(std::memory_order_relaxed);
+    pContext->u32RequestSerial.store(u32Serial + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    pContext->request = *pRequest;
+
+    pContext->u32RequestSerial.store(u32Serial + 2, std::memory_order_release);
+    return u32Serial + 2;
+}
+
+BOOL IsMixRequestSettled(const MIX_CONTEXT *pContext, UINT32 u32Serial)
+{
+    return static_cast<INT32>(pContext->u32SettledSerial.load(std::memory_order_acquire) - u32Serial) >= 0;
+}
+
+BOOL IsMixRequestPending(const MIX_CONTEXT *pContext)
+{
+    return pContext->u32RequestSerial.load(std::memory_order_acquire) != pContext->u32AppliedSerial;
+}
+
+// Share of the running ramp still to go u32RampFrame frames into it, g(f) of MixRampSpan
+static FLOAT32 GetMixRampRemainder(const MIX_CONTEXT *pContext, UINT32 u32RampFrame)
+{
+    // Past the end of the ramp every weight is at its target
+    FLOAT32 g = 0.0f;
+    if (u32RampFrame < pContext->u32RampFrames)
+    {
+        if (pContext->rampShape == MIX_RAMP_EXPONENTIAL)
+        {
+            g = (std::pow(pContext->f32RampDecay, static_cast<FLOAT32>(u32RampFrame)) - c_f32RampFloor) /
+                (1.0f - c_f32RampFloor);
+        }
+        else
+        {
+            g = 1.0f - static_cast<FLOAT32>(u32RampFrame) / static_cast<FLOAT32>(pContext->u32RampFrames);
+        }
+    }
+    return g;
+}
+
+void GetMixRampWeights(
+    const MIX_CONTEXT  *pContext,
+    UINT32              u32RampFrame,
+    FLOAT32            *pf32InputWeight,
+    FLOAT32            *pf32SourceWeights)
+{
+    const FLOAT32 g = GetMixRampRemainder(pContext, u32RampFrame);
+
+    *pf32InputWeight = pContext->f32TargetInputWeight + (pContext->f32InputWeight - pContext->f32TargetInputWeight) * g;
+    for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+    {
+        const MIX_SOURCE &source = pContext->aSources[s];
+        pf32SourceWeights[s] = source.f32TargetWeight + (source.f32Weight - source.f32TargetWeight) * g;
+    }
+}
+
+//
+// Fills the per sample term of the ramp weights, see MixRampSpan
+//
+static void PrepareRampLanes(MIX_CONTEXT *pContext)
+{
+    const UINT32 u32Channels = pContext->u32SamplesPerFrame;
+    const UINT32 u32Pattern = pContext->u32RampPattern;
+
+    FLOAT32 f32Power = 1.0f;
+    for (UINT32 t = 0, k = 0; k < u32Pattern; t++)
+    {
+        const FLOAT32 f32T = (pContext->rampShape == MIX_RAMP_EXPONENTIAL) ? f32Power : static_cast<FLOAT32>(t);
+        for (UINT32 c = 0; c < u32Channels; c++)
+        {
+            pContext->af32RampLanes[k++] = f32T;
+        }
+        f32Power *= pContext->f32RampDecay;
+    }
+}
+
+//
+// Sets the channel gains of the request as the targets of the gain lanes, which
+// start from wherever the running ramp has taken them.  Returns TRUE in
+// *pbSteady if none of them changes, in *pbUnity if all of them are unity.
+//
+static void ApplyMixChannelGains(MIX_CONTEXT *pContext, const MIX_REQUEST *pRequest, BOOL *pbSteady, BOOL *pbUnity)
+{
+    const UINT32 u32Channels = pContext->u32SamplesPerFrame;
+    const BOOL bGains = pRequest->bChannelGains && u32Channels <= MIX_MAP_MAX_CHANNELS;
+    const FLOAT32 g = GetMixRampRemainder(pContext, pContext->u32RampPosition);
+
+    *pbSteady = TRUE;
+    *pbUnity = TRUE;
+
+    for (UINT32 k = 0, c = 0; k < pContext->u32RampPattern; k++)
+    {
+        const FLOAT32 f32InputStart = pContext->af32InputGainLanes[k] + pContext->af32InputGainSteps[k] * g;
+        const FLOAT32 f32InjectionStart = pContext->af32InjectionGainLanes[k] + pContext->af32InjectionGainSteps[k] * g;
+        const FLOAT32 f32Input = bGains ? pRequest->af32InputGains[c] : 1.0f;
+        const FLOAT32 f32Injection = bGains ? pRequest->af32InjectionGains[c] : 1.0f;
+
+        pContext->af32InputGainLanes[k] = f32Input;
+        pContext->af32InjectionGainLanes[k] = f32Injection;
+        pContext->af32InputGainSteps[k] = f32InputStart - f32Input;
+        pContext->af32InjectionGainSteps[k] = f32InjectionStart - f32Injection;
+
+        *pbSteady = *pbSteady && f32InputStart == f32Input && f32InjectionStart == f32Injection;
+        *pbUnity = *pbUnity && f32Input == 1.0f && f32Injection == 1.0f;
+
+        if (++c == u32Channels)
+        {
+            c = 0;
+        }
+    }
+
+    pContext->bChannelGains = !(*pbSteady && *pbUnity);
+}
+
+BOOL ApplyMixRequest(MIX_CONTEXT *pContext)
+{
+    const UINT32 u32Serial = pContext->u32RequestSerial.load(std::memory_order_acquire);
+    if (u32Serial & 1)
+    {
+        return FALSE;
+    }
+
+    const MIX_REQUEST request = pContext->request;
+
+    // Torn by a request posted meanwhile, try again next period
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (pContext->u32RequestSerial.load(std::memory_order_relaxed) != u32Serial)
+    {
+        return FALSE;
+    }
+    pContext->u32AppliedSerial = u32Serial;
+
+    // Channel gains ramp along with the weights, from where they are right now
+    BOOL bGainsSteady, bGainsUnity;
+    ApplyMixChannelGains(pContext, &request, &bGainsSteady, &bGainsUnity);
+
+    // The new ramp starts wherever the weights are right now
+    FLOAT32 f32InputWeight = 1.0f;
+    FLOAT32 af32Weights[MIX_CONTEXT_SOURCES];
+    GetMixRampWeights(pContext, pContext->u32RampPosition, &f32InputWeight, af32Weights);
+    pContext->f32InputWeight = f32InputWeight;
+    for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+    {
+        pContext->aSources[s].f32Weight = af32Weights[s];
+    }
+
+    if (request.u32SourceCount != 0)
+    {
+        MIX_SOURCE aSources[MIX_CONTEXT_SOURCES];
+        BOOL abKept[MIX_CONTEXT_SOURCES] = {};
+        UINT32 u32Count = 0;
+
+        // Clips already playing carry on where they are, new ones fade in from their start
+        for (UINT32 r = 0; r < request.u32SourceCount && r < MIX_MAX_SOURCES; r++)
+        {
+            MIX_SOURCE source = request.aSources[r];
+            source.f32TargetWeight = source.f32Weight;
+            source.f32Weight = 0.0f;
+            source.u32FileIndex = 0;
+
+            // A new stream plays the period of its stream until PrepareMixStreams fills it
+            if (source.pStream != nullptr)
+            {
+                source.pf32File = source.pStream->pf32Period;
+                source.pi16File = nullptr;
+                source.u32FileFrameCount = source.pStream->u32PeriodFrames;
+                source.bLoop = TRUE;
+                source.pbSilentBlocks = nullptr;
+            }
+
+            for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+            {
+                // A stream is the same while it reads the same ring, its period moves on every period
+                const MIX_SOURCE &current = pContext->aSources[s];
+                const BOOL bSame = source.pStream != nullptr ?
+                                   current.pStream == source.pStream :
+                                   current.pStream == nullptr &&
+                                   current.pf32File == source.pf32File &&
+                                   current.pi16File == source.pi16File &&
+                                   current.u32FileFrameCount == source.u32FileFrameCount;
+                if (!abKept[s] && bSame)
+                {
+                    source.pf32File = current.pf32File;
+                    source.pi16File = current.pi16File;
+                    source.u32FileFrameCount = current.u32FileFrameCount;
+                    source.u32FileIndex = current.u32FileIndex;
+                    source.f32Weight = current.f32Weight;
+                    abKept[s] = TRUE;
+                    break;
+                }
+            }
+
+            aSources[u32Count++] = source;
+        }
+
+        // Clips no longer wanted fade out, they are dropped once the ramp ends
+        for (UINT32 s = 0; s < pContext->u32SourceCount && u32Count < MIX_CONTEXT_SOURCES; s++)
+        {
+            if (!abKept[s])
+            {
+                aSources[u32Count] = pContext->aSources[s];
+                aSources[u32Count].f32TargetWeight = 0.0f;
+                u32Count++;
+            }
+        }
+
+        for (UINT32 s = 0; s < u32Count; s++)
+        {
+            pContext->aSources[s] = aSources[s];
+        }
+        pContext->u32SourceCount = u32Count;
+    }
+
+    // Streams only ever move forward, the worker decides where they play from
+    if (request.bRestartClip)
+    {
+        for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+        {
+            if (pContext->aSources[s].pStream == nullptr)
+            {
+                pContext->aSources[s].u32FileIndex = 0;
+            }
+        }
+    }
+
+    if (request.bMix)
+    {
+        pContext->f32TargetInputWeight = request.f32InputWeight;
+    }
+    else
+    {
+        pContext->f32TargetInputWeight = 1.0f;
+        for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+        {
+            pContext->aSources[s].f32TargetWeight = 0.0f;
+        }
+    }
+
+    // Weights and gains that leave the input as is settle on the passthrough processor
+    BOOL bSteady = bGainsSteady && (pContext->f32InputWeight == pContext->f32TargetInputWeight);
+    BOOL bAudible = !bGainsUnity || (pContext->f32TargetInputWeight != 1.0f);
+    for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+    {
+        bSteady = bSteady && (pContext->aSources[s].f32Weight == pContext->aSources[s].f32TargetWeight);
+        bAudible = bAudible || (pContext->aSources[s].f32TargetWeight != 0.0f);
+    }
+    pContext->pSettledProcessor = bAudible ? pContext->pMixProcessor : pContext->pPassthroughProcessor;
+
+    if (pContext->u32RampFrames == 0 || bSteady)
+    {
+        pContext->u32RampPosition = pContext->u32RampFrames;
+        FinishMixRamp(pContext);
+        return TRUE;
+    }
+
+    pContext->u32RampPosition = 0;
+    pContext->rampShape = request.rampShape;
+    pContext->f32RampDecay = std::pow(c_f32RampFloor, 1.0f / static_cast<FLOAT32>(pContext->u32RampFrames));
+    PrepareRampLanes(pContext);
+    pContext->pProcessor = pContext->pMixProcessor;
+    return TRUE;
+}
+
+void FinishMixRamp(MIX_CONTEXT *pContext)
+{
+    pContext->f32InputWeight = pContext->f32TargetInputWeight;
+
+    BOOL bUnity = TRUE;
+    for (UINT32 k = 0; k < pContext->u32RampPattern; k++)
+    {
+        pContext->af32InputGainSteps[k] = 0.0f;
+        pContext->af32InjectionGainSteps[k] = 0.0f;
+        bUnity = bUnity && pContext->af32InputGainLanes[k] == 1.0f && pContext->af32InjectionGainLanes[k] == 1.0f;
+    }
+    pContext->bChannelGains = !bUnity;
+
+    // Clips faded out are no longer read
+    UINT32 u32Count = 0;
+    for (UINT32 s = 0; s < pContext->u32SourceCount; s++)
+    {
+        if (pContext->aSources[s].f32TargetWeight != 0.0f)
+        {
+            pContext->aSources[u32Count] = pContext->aSources[s];
+            pContext->aSources[u32Count].f32Weight = pContext->aSources[u32Count].f32TargetWeight;
+            u32Count++;
+        }
+    }
+    pContext->u32SourceCount = u32Count;
+
+    pContext->pProcessor = pContext->pSettledProcessor;
+    pContext->u32SettledSerial.store(pContext->u32AppliedSerial, std::memory_order_release);
+}
@@ -0,0 +1,931 @@
+//
+// AudioMixKernels.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Declaration of the vectorized mix kernels and of the run time CPU dispatch
+//  that picks the best kernel set for the processor the APO is running on.
+//
+//  The kernels are platform independent and do not depend on the audio engine
+//  headers, so they can be used from the unit tests and the benchmarks as is.
+//
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MIX_KERNELS_X64
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define MIX_KERNELS_ARM64
+#endif
+
+//
+// Instruction set a kernel table was built for.  Ordered from the least to the
+// most capable one within an architecture.
+//
+enum MIX_ISA
+{
+    MIX_ISA_SCALAR = 0,
+    MIX_ISA_SSE2,
+    MIX_ISA_AVX2,
+    MIX_ISA_AVX512,
+    MIX_ISA_NEON,
+    MIX_ISA_COUNT
+};
+
+//
+// Mixes a flat interleaved span:
+//
+//      pf32Output[i] = pf32Input[i] * f32InputWeight + pf32File[i] * f32FileWeight
+//
+// pf32Output may be equal to pf32Input.  Every implementation multiplies and adds
+// in single precision without contraction, so all of them produce bit identical
+// results.
+//
+typedef void (*PFN_MIX_SPAN)(
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    const FLOAT32  *pf32File,
+    UINT32          u32SampleCount,
+    FLOAT32         f32InputWeight,
+    FLOAT32         f32FileWeight);
+
+//
+// Mixes several clips into a flat interleaved span in a single pass:
+//
+//      pf32Output[i] = pf32Input[i] * f32InputWeight + sum of ppf32Sources[s][i] * pf32Weights[s]
+//
+// The clips are added in order after the weighted input, so a single clip gives
+// the same result as PFN_MIX_SPAN.  pf32Output may be equal to pf32Input.
+//
+typedef void (*PFN_MIX_SOURCES_SPAN)(
+    FLOAT32                *pf32Output,
+    const FLOAT32          *pf32Input,
+    const FLOAT32 * const  *ppf32Sources,
+    const FLOAT32          *pf32Weights,
+    UINT32                  u32SourceCount,
+    UINT32                  u32SampleCount,
+    FLOAT32                 f32InputWeight);
+
+//
+// Converts 16 bit clip samples to floats in [-1, 1)
+//
+typedef void (*PFN_CONVERT_INT16_SPAN)(
+    FLOAT32        *pf32Output,
+    const INT16    *pi16Input,
+    UINT32          u32SampleCount);
+
+//
+// Converts the little endian PCM samples of a WAV file to floats in [-1, 1),
+// u32BytesPerSample 1 for unsigned 8 bit samples and 2, 3 or 4 for signed ones.
+// pbInput needs no alignment.
+//
+typedef void (*PFN_CONVERT_PCM_SPAN)(
+    FLOAT32        *pf32Output,
+    const BYTE     *pbInput,
+    UINT32          u32SampleCount,
+    UINT32          u32BytesPerSample);
+
+//
+// Channel counts the processing kernels are specialized for.  Any other count is
+// served by the MIX_CHANNELS_ANY kernels, which read it from the mix context.
+//
+enum MIX_CHANNELS
+{
+    MIX_CHANNELS_1 = 0,
+    MIX_CHANNELS_2,
+    MIX_CHANNELS_4,
+    MIX_CHANNELS_6,
+    MIX_CHANNELS_8,
+    MIX_CHANNELS_ANY,
+    MIX_CHANNELS_COUNT
+};
+
+//
+// What the APO does with a period, decided outside of the real-time path whenever
+// the connections are locked or a property changes.  Whether the input of a period
+// is silent is only known in APOProcess, see MIX_PROCESSOR.
+//
+enum MIX_STATE
+{
+    MIX_STATE_PASSTHROUGH = 0,          // input copied to a separate output buffer
+    MIX_STATE_PASSTHROUGH_IN_PLACE,     // output buffer is the input buffer, nothing to copy
+    MIX_STATE_MIX,                      // clip mixed with the input into a separate output buffer
+    MIX_STATE_MIX_IN_PLACE,             // clip mixed into the input buffer
+    MIX_STATE_COUNT
+};
+
+//
+// Shape of the gain ramps every change of the mix weights goes through.  Ramps run
+// from the weights in effect when the change is picked up to the new ones over
+// MIX_CONTEXT::u32RampFrames frames.
+//
+enum MIX_RAMP_SHAPE
+{
+    MIX_RAMP_LINEAR = 0,            // constant slope, for changes of the mix ratio
+    MIX_RAMP_EXPONENTIAL            // fast start and slow settle, for fading the clip in and out
+};
+
+//
+// Law that turns the mix ratio into the weights of the input and of the clips, see
+// GetMixLawWeights.  Every law is symmetric: the input weight at a ratio is the clip
+// weight at one minus the ratio.
+//
+enum MIX_LAW
+{
+    MIX_LAW_LINEAR = 0,             // weights add up to 1, uncorrelated signals dip by 3 dB halfway
+    MIX_LAW_EQUAL_POWER,            // squares of the weights add up to 1, for a steady loudness
+    MIX_LAW_DECIBEL,                // full weight up to halfway, then a linear fade in dB down to silence
+    MIX_LAW_COUNT
+};
+
+//
+// Most clips mixed into the stream at the same time
+//
+#define MIX_MAX_SOURCES     8
+
+//
+// Granularity of the map of silent clip frames, see FindMixSilentBlocks
+//
+#define MIX_SILENT_BLOCK_FRAMES     64
+
+//
+// How the channels of a clip are spread over the channels of the stream
+//
+enum MIX_MAPPING
+{
+    MIX_MAPPING_IDENTITY = 0,       // same layout, the clip is mixed as it is
+    MIX_MAPPING_MONO_TO_ALL,        // the one clip channel goes to every stream channel
+    MIX_MAPPING_MATRIX              // every stream channel is a weighted sum of clip channels
+};
+
+// Most channels on either side of a MIX_MAPPING_MATRIX map
+#define MIX_MAP_MAX_CHANNELS    18
+
+//
+// Channel map of a clip kept at its own channel count, built by BuildMixChannelMap.
+// The matrix is stored as a list of taps per stream channel, so only the clip
+// channels that feed it are read.
+//
+struct MIX_CHANNEL_MAP
+{
+    MIX_MAPPING     mapping;
+    UINT32          u32FileChannels;
+    UINT32          u32Channels;
+    UINT32          au32TapCount[MIX_MAP_MAX_CHANNELS];                         // per stream channel
+    BYTE            aau8TapChannels[MIX_MAP_MAX_CHANNELS][MIX_MAP_MAX_CHANNELS]; // clip channel of each tap
+    FLOAT32         aaf32TapGains[MIX_MAP_MAX_CHANNELS][MIX_MAP_MAX_CHANNELS];
+};
+
+struct MIX_STREAM;
+
+//
+// Looped or one shot clip mixed into the stream.  The fused kernels mix all of
+// the sources of a period in a single pass over the output.
+//
+struct MIX_SOURCE
+{
+    const FLOAT32  *pf32File;           // clip, same layout as the stream unless pChannelMap is set
+    const INT16    *pi16File;           // the clip as 16 bit samples instead, pf32File is nullptr then
+    UINT32          u32FileFrameCount;
+    UINT32          u32FileIndex;       // next clip frame to mix, u32FileFrameCount once a one shot clip has ended
+    FLOAT32         f32Weight;          // steady weight, or where the running ramp started
+    FLOAT32         f32TargetWeight;    // where the running ramp ends, only used by the mix context
+    BOOL            bLoop;              // FALSE plays the clip once
+    const BYTE     *pbSilentBlocks;     // from FindMixSilentBlocks, nullptr if not known
+    const MIX_CHANNEL_MAP  *pChannelMap;    // how the clip channels map on the stream, nullptr for the same layout
+    MIX_STREAM     *pStream;            // clip streamed by PrepareMixStreams into pf32File, nullptr for a clip in memory
+};
+
+//
+// Mixing state wanted by the APO, handed over to the real-time thread by PostMixRequest
+//
+struct MIX_REQUEST
+{
+    MIX_SOURCE      aSources[MIX_MAX_SOURCES];  // clips to mix, f32Weight is the weight to ramp to
+    UINT32          u32SourceCount;     // 0 keeps the current clips
+    BOOL            bRestartClip;       // play the clips from their first frames
+    BOOL            bMix;               // FALSE fades the clips out and passes the input through
+    FLOAT32         f32InputWeight;     // input weight to ramp to when mixing
+    MIX_RAMP_SHAPE  rampShape;
+    BOOL            bChannelGains;      // FALSE for unity gains on every channel
+    FLOAT32         af32InputGains[MIX_MAP_MAX_CHANNELS];       // per channel gain of the input, see ClampMixChannelGain
+    FLOAT32         af32InjectionGains[MIX_MAP_MAX_CHANNELS];   // per channel gain of the sum of the clips
+};
+
+// Largest per channel gain, +12 dB.  The limiter after the mix keeps a boosted
+// channel under full scale.
+#define MIX_MAX_CHANNEL_GAIN        4.0f
+
+//
+// Returns a per channel gain of the input or of the clips clamped to
+// [0, MIX_MAX_CHANNEL_GAIN].  Gains above 1 boost the channel, 0 mutes it, and a
+// gain that is not a number is unity.
+//
+FLOAT32 ClampMixChannelGain(FLOAT32 f32Gain);
+
+//
+// Ramp weights and channel gains are computed per pattern of samples that holds
+// whole frames and, if it fits, whole vectors of the widest instruction set.  The
+// pattern is made at least MIX_RAMP_PATTERN_MIN samples long to amortize the per
+// pattern work.
+//
+#define MIX_RAMP_PATTERN_MIN    128
+#define MIX_RAMP_PATTERN_MAX    256
+#define MIX_RAMP_VECTOR_WIDTH   16
+
+// Requested clips plus the ones they replace, which are faded out
+#define MIX_CONTEXT_SOURCES     (2 * MIX_MAX_SOURCES)
+
+//
+// Samples the clips with a channel map or 16 bit samples are converted into before
+// they are mixed, enough for a few frames of every source at any mapped layout
+//
+#define MIX_MAP_SCRATCH_SAMPLES 4096
+
+struct MIX_PROCESSOR;
+
+//
+// Everything the processing kernels need besides the connection buffers.  It is
+// owned by the APO; once streaming only the real-time thread changes it, other
+// threads go through PostMixRequest.
+//
+struct MIX_CONTEXT
+{
+    // Set by InitMixContext
+    const MIX_PROCESSOR    *pMixProcessor;
+    const MIX_PROCESSOR    *pPassthroughProcessor;
+    UINT32                  u32SamplesPerFrame;     // only read by the MIX_CHANNELS_ANY kernels
+    UINT32                  u32RampFrames;          // length of every ramp, 0 for immediate changes
+
+    // Owned by the real-time thread
+    const MIX_PROCESSOR    *pProcessor;             // processor APOProcess calls
+    const MIX_PROCESSOR    *pSettledProcessor;      // installed once the running ramp ends
+    MIX_SOURCE              aSources[MIX_CONTEXT_SOURCES];
+    UINT32                  u32SourceCount;
+    FLOAT32                 f32InputWeight;         // steady weight, or where the running ramp started
+    FLOAT32                 f32TargetInputWeight;   // where the running ramp ends
+    UINT32                  u32RampPosition;        // frames of the running ramp done, u32RampFrames if none
+    MIX_RAMP_SHAPE          rampShape;
+    FLOAT32                 f32RampDecay;           // per frame factor of an exponential ramp
+    UINT32                  u32RampPattern;         // samples in af32RampLanes and the gain lanes, set by InitMixContext
+    FLOAT32                 af32RampLanes[MIX_RAMP_PATTERN_MAX];    // t or r^t of each sample
+    BOOL                    bChannelGains;          // gains other than unity in effect or being ramped
+    FLOAT32                 af32InputGainLanes[MIX_RAMP_PATTERN_MAX];       // input gain of the channel of each sample
+    FLOAT32                 af32InjectionGainLanes[MIX_RAMP_PATTERN_MAX];   // clip gain of the channel of each sample
+    FLOAT32                 af32InputGainSteps[MIX_RAMP_PATTERN_MAX];       // where the running ramp started minus the gain
+    FLOAT32                 af32InjectionGainSteps[MIX_RAMP_PATTERN_MAX];
+    FLOAT32                 af32MapScratch[MIX_MAP_SCRATCH_SAMPLES];    // converted clips of the current block
+    UINT32                  u32AppliedSerial;
+
+    // Handed over from other threads
+    MIX_REQUEST             request;
+    std::atomic<UINT32>     u32RequestSerial;       // odd while the request is being written
+    std::atomic<UINT32>     u32SettledSerial;       // last request whose ramp has ended
+};
+
+//
+// Processes one period and returns the APO_BUFFER_FLAGS of the output connection
+//
+typedef APO_BUFFER_FLAGS (*PFN_MIX_PROCESS)(
+    MIX_CONTEXT    *pContext,
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    UINT32          u32FrameCount);
+
+#define MIX_BUFFER_FLAGS_COUNT  (BUFFER_SILENT + 1)
+
+//
+// Frames whose limiter gains are worked out before they are applied, a period
+// is limited in blocks of at most this many frames, fewer for wide layouts
+//
+#define MIX_LIMITER_BLOCK_FRAMES    64
+
+// Samples of the per sample gains of a limiter block
+#define MIX_LIMITER_BLOCK_SAMPLES   (MIX_LIMITER_BLOCK_FRAMES * MIX_MAP_MAX_CHANNELS)
+
+//
+// Lookahead peak limiter run on the mixed period, see InitMixLimiter.  The output
+// is the mix delayed by u32LookaheadFrames frames, and every output frame is
+// scaled by the average of the last u32LookaheadFrames + 1 release gains, each
+// of which is at most the smallest gain that keeps the frames still ahead of it
+// under the ceiling.  So the gain is down before a peak leaves the delay line,
+// and it changes smoothly.  The buffers are owned by the caller.
+//
+struct MIX_LIMITER
+{
+    // Set by InitMixLimiter
+    UINT32          u32LookaheadFrames;     // delay added to the stream, 0 if the limiter is off
+    UINT32          u32Channels;
+    UINT32          u32BlockFrames;         // frames per gain block, whole blocks fit af32SampleGains
+    FLOAT32         f32Ceiling;             // largest magnitude of an output sample
+    FLOAT64         f64Release;             // share of the way back to the held gain per frame
+    FLOAT32        *pf32Delay;              // u32LookaheadFrames frames of the mix still to come out
+    FLOAT32        *pf32Gains;              // last u32LookaheadFrames + 1 release gains
+    FLOAT32        *pf32HoldGains;          // rising gains of the sliding minimum, a ring of u32LookaheadFrames + 1
+    UINT32         *pu32HoldFrames;         // frame each of them was required for
+
+    // Owned by the real-time thread
+    UINT32          u32DelayPosition;       // next sample of pf32Delay to come out
+    UINT32          u32GainPosition;        // oldest gain of pf32Gains
+    FLOAT64         f64GainSum;             // sum of pf32Gains
+    FLOAT64         f64ReleaseGain;         // gain following the held one, never above it
+    UINT32          u32HoldFirst;           // oldest entry of the sliding minimum
+    UINT32          u32HoldCount;
+    UINT32          u32Frame;               // frames limited so far, wraps around
+    UINT32          u32UnityFrames;         // frames in a row at unity gain
+    UINT32          u32QuietFrames;         // zero frames in a row that went into the delay line
+    FLOAT32         af32FrameGains[MIX_LIMITER_BLOCK_FRAMES];
+    FLOAT32         af32SampleGains[MIX_LIMITER_BLOCK_SAMPLES];
+};
+
+//
+// Limits a period in place after it has been processed and returns the flags of
+// the limited period.  A silent period is left alone once the delay line only
+// holds zeros; before that it is zeroed and the rest of the delay line comes out.
+//
+typedef APO_BUFFER_FLAGS (*PFN_MIX_LIMIT)(
+    MIX_LIMITER        *pLimiter,
+    FLOAT32            *pf32Frames,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags);
+
+//
+// Sample formats of the connection buffers.  The kernels mix in FLOAT32, fixed
+// point periods are converted on the way in and out of the mix.
+//
+enum MIX_SAMPLE_FORMAT
+{
+    MIX_SAMPLE_FLOAT32 = 0,
+    MIX_SAMPLE_INT16,               // 16 bit PCM
+    MIX_SAMPLE_INT24,               // 24 bit PCM packed into 3 bytes
+    MIX_SAMPLE_INT32,               // 32 bit PCM, or 24 bit PCM in the upper bytes of 32 bit containers
+    MIX_SAMPLE_FORMAT_COUNT
+};
+
+//
+// Samples of a fixed point period converted, mixed, limited and converted back
+// at a time, so the float copy of a block stays in the L1 cache in between
+//
+#define MIX_FORMAT_BLOCK_SAMPLES    1024
+
+//
+// Dither generators of a fixed point output.  Samples are dithered in rows of this
+// many, sample i of a row from generator i, so the dither does not depend on the
+// vector width.
+//
+#define MIX_DITHER_LANES    MIX_RAMP_VECTOR_WIDTH
+
+//
+// Conversion state of a fixed point connection, see InitMixFormat
+//
+struct MIX_FORMAT
+{
+    // Set by InitMixFormat
+    MIX_SAMPLE_FORMAT   format;                 // of both the input and the output connection
+    UINT32              u32Channels;
+    UINT32              u32BlockFrames;         // frames per block, whole blocks fit af32Block
+    BOOL                bDither;                // output narrower than the mix, TPDF dithered
+
+    // Owned by the real-time thread
+    UINT32              au32DitherState[MIX_DITHER_LANES];  // xorshift generator of every lane
+    FLOAT32             af32Block[MIX_FORMAT_BLOCK_SAMPLES];
+};
+
+//
+// Processes a fixed point period with the processor of the mix context and the
+// limiter, converting each block to float on the way in and back on the way out,
+// dithered if the output is narrower than the mix.  Returns the flags of the output.
+// Blocks the input passes through unchanged are not dithered, and periods passed
+// through without a limiter are copied as they are.  Float periods are processed
+// where they are.  The pfnProcessPeriod entries are built for one format and
+// limiter setting, so the APO picks its entry at LockForProcess instead of
+// checking both on every period.
+//
+typedef APO_BUFFER_FLAGS (*PFN_MIX_PROCESS_FORMAT)(
+    MIX_FORMAT         *pFormat,
+    MIX_CONTEXT        *pContext,
+    MIX_LIMITER        *pLimiter,
+    BYTE               *pbOutput,
+    const BYTE         *pbInput,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags);
+
+//
+// Splits u32FrameCount interleaved frames into a plane per channel.  Stereo runs
+// on whole vectors, other channel counts channel by channel.
+//
+typedef void (*PFN_MIX_DEINTERLEAVE)(
+    FLOAT32 *const     *ppf32Planes,
+    const FLOAT32      *pf32Frames,
+    UINT32              u32FrameCount,
+    UINT32              u32Channels);
+
+//
+// Polyphase filter of a resampler, designed by AudioResampler.h.  Output frame n
+// is taken at input position n * u32Down / u32Up of the ratio in lowest terms.
+// The filter is tabulated at u32Phases fractions of an input frame, a row of
+// u32TapCount taps each, plus a last row a whole frame on.  Positions between
+// two rows are interpolated linearly between their sums; with a row for every
+// position the fraction stays 0 and a single row is summed.
+//
+struct MIX_RESAMPLER
+{
+    const FLOAT32  *pf32Taps;           // u32Phases + 1 rows, u32TapCount a multiple of MIX_RAMP_VECTOR_WIDTH
+    UINT32          u32TapCount;
+    UINT32          u32Phases;
+    UINT32          u32Up;              // output frames per u32Down input frames
+    UINT32          u32StepFrames;      // whole input frames from one output frame to the next
+    UINT32          u32StepPhases;      // rows on top of them
+    UINT32          u32StepFraction;    // and 1/u32Up of a row on top of those
+    FLOAT32         f32FractionScale;   // 1 / u32Up
+};
+
+// Where a resampler takes its next output frame, see PFN_MIX_RESAMPLE
+struct MIX_RESAMPLE_POSITION
+{
+    UINT32      u32Frame;               // input frame under the first tap
+    UINT32      u32Phase;               // row of the taps
+    UINT32      u32Fraction;            // 1/u32Up of the way to the next row
+};
+
+//
+// Resamples the planes of u32InputFrames input frames into up to u32OutputFrames
+// interleaved frames, starting at *pPosition and moving it along.  Stops at the
+// first output frame whose taps reach past the input and returns the frames
+// written.  The taps are summed in MIX_RAMP_VECTOR_WIDTH lanes added up in a fixed
+// order, so the result does not depend on the instruction set.
+//
+typedef UINT32 (*PFN_MIX_RESAMPLE)(
+    const MIX_RESAMPLER    *pResampler,
+    MIX_RESAMPLE_POSITION  *pPosition,
+    FLOAT32                *pf32Output,
+    UINT32                  u32OutputFrames,
+    const FLOAT32 *const   *ppf32Planes,
+    UINT32                  u32InputFrames,
+    UINT32                  u32Channels);
+
+//
+// Clip decoded ahead by a worker thread into a ring of frames, for clips too long
+// to hold in memory.  The worker is the only writer and the real-time thread the
+// only reader; the counts of frames written and read only ever grow and hand the
+// frames over between them.  Before every period PrepareMixStreams moves the
+// frames of the period out of the ring into pf32Period, which the source of the
+// stream plays like a looped clip of one period.  The buffers are owned by the
+// caller, see InitMixStream.
+//
+struct MIX_STREAM
+{
+    FLOAT32            *pf32Ring;
+    UINT32              u32RingFrames;
+    UINT32              u32Channels;            // of the clip, mapped on the stream by the source
+    FLOAT32            *pf32Period;             // frames of the current period
+    UINT32              u32PeriodFrames;        // frames pf32Period holds
+
+    std::atomic<UINT64> u64WrittenFrames;       // by the worker
+    std::atomic<UINT64> u64ReadFrames;          // by the real-time thread
+    std::atomic<UINT32> u32Underruns;           // periods the ring ran short of frames
+    std::atomic<UINT64> u64MissingFrames;       // frames played as silence because of them
+};
+
+//
+// Kernels of one channel count and state, indexed by the APO_BUFFER_FLAGS of the
+// input connection, so APOProcess makes a single indirect call without looking
+// at the flags.  The BUFFER_SILENT entries never read the input.
+//
+struct MIX_PROCESSOR
+{
+    PFN_MIX_PROCESS pfnProcess[MIX_BUFFER_FLAGS_COUNT];
+};
+
+struct MIX_CHANNEL_PROCESSORS
+{
+    MIX_PROCESSOR   states[MIX_STATE_COUNT];
+};
+
+//
+// Set of kernels built for a single instruction set
+//
+struct MIX_KERNELS
+{
+    MIX_ISA                 isa;
+    const char             *pszName;
+    PFN_MIX_SPAN            pfnMixSpan;
+    PFN_MIX_SOURCES_SPAN    pfnMixSourcesSpan;
+    PFN_CONVERT_INT16_SPAN  pfnConvertInt16Span;
+    PFN_CONVERT_PCM_SPAN    pfnConvertPcmSpan;
+    PFN_MIX_LIMIT           pfnLimit;
+    PFN_MIX_PROCESS_FORMAT  pfnProcessFormat;
+    PFN_MIX_PROCESS_FORMAT  pfnProcessPeriod[MIX_SAMPLE_FORMAT_COUNT][2];   // pfnProcessFormat for a format, without and with the limiter
+    PFN_MIX_DEINTERLEAVE    pfnDeinterleave;
+    PFN_MIX_RESAMPLE        pfnResample;
+    MIX_CHANNEL_PROCESSORS  channels[MIX_CHANNELS_COUNT];
+};
+
+// Returns the most capable instruction set supported by both the build and the CPU
+MIX_ISA DetectMixIsa();
+
+// Returns the kernel table for the instruction set, or nullptr if it is not built for this target
+const MIX_KERNELS* GetMixKernels(MIX_ISA isa);
+
+// Returns the kernel table for DetectMixIsa(); the detection runs only once per process
+const MIX_KERNELS* SelectMixKernels();
+
+//
+// Flushes denormal floats to zero on the calling thread, as inputs and as results,
+// and returns the floating point control state to restore.  The near silent tails
+// of clips and the decaying state of the ramps and the limiter would otherwise take
+// the slow microcoded paths of many CPUs.  The rounding mode is left alone.
+//
+UINT32 EnterMixDenormalMode();
+
+// Restores the denormal handling saved by EnterMixDenormalMode
+void LeaveMixDenormalMode(UINT32 u32Saved);
+
+//
+// Keeps denormals flushed to zero for the scope of a processing call
+//
+class MixDenormalGuard
+{
+public:
+    MixDenormalGuard() : m_u32Saved(EnterMixDenormalMode()) {}
+    ~MixDenormalGuard() { LeaveMixDenormalMode(m_u32Saved); }
+
+    MixDenormalGuard(const MixDenormalGuard&) = delete;
+    MixDenormalGuard& operator=(const MixDenormalGuard&) = delete;
+
+private:
+    UINT32  m_u32Saved;
+};
+
+//
+// Contiguous part of a processing period in which the looped clip does not wrap
+//
+struct MIX_SEGMENT
+{
+    UINT32  u32OutputFrame;     // first frame of the segment within the period
+    UINT32  u32FileFrame;       // clip frame mixed into u32OutputFrame
+    UINT32  u32FrameCount;      // number of frames in the segment
+};
+
+// Enough for one pass over any period of a clip at least half a period long
+#define MIX_MAX_SEGMENTS    3
+
+//
+// Splits u32FrameCount frames of a looped clip into contiguous segments, starting
+// at clip frame *pu32FileIndex.  Writes at most MIX_MAX_SEGMENTS segments and
+// returns their number; *pu32FramesPlanned receives the frames they cover, which
+// is less than u32FrameCount only for clips shorter than a period.  *pu32FileIndex
+// is advanced past the planned frames.  There is no division unless the index is
+// out of range on entry.  An empty clip plans no segments and no frames.
+//
+UINT32 PlanMixSegments(
+    UINT32          u32FrameCount,
+    UINT32          u32FileFrameCount,
+    UINT32         *pu32FileIndex,
+    MIX_SEGMENT    *pSegments,
+    UINT32         *pu32FramesPlanned);
+
+//
+// Mixes u32FrameCount frames of looped file data into the output.  The file is
+// consumed from *pu32FileIndex on, and the index is advanced past the mixed frames.
+// Every segment returned by PlanMixSegments is mixed as one flat interleaved span.
+// An empty clip mixes as silence.
+//
+void MixAudioFrames(
+    const MIX_KERNELS  *pKernels,
+    FLOAT32            *pf32OutputFrames,
+    const FLOAT32      *pf32InputFrames,
+    UINT32              u32FrameCount,
+    UINT32              u32SamplesPerFrame,
+    const FLOAT32      *pf32FileBuffer,
+    UINT32              u32FileFrameCount,
+    UINT32             *pu32FileIndex,
+    FLOAT32             f32InputWeight,
+    FLOAT32             f32FileWeight);
+
+//
+// Returns how many of the u32FrameCount frames from the current clip indices on
+// all of the sources can mix without any of them wrapping or ending.  The indices
+// of the sources that still play are written to pu32Active, their number to
+// *pu32ActiveCount; a one shot clip that has ended is left out, an index beyond
+// a looped clip is wrapped first.  Without any source playing, all u32FrameCount.
+//
+UINT32 PlanMixSourceBlock(
+    MIX_SOURCE     *pSources,
+    UINT32          u32SourceCount,
+    UINT32          u32FrameCount,
+    UINT32         *pu32Active,
+    UINT32         *pu32ActiveCount);
+
+// Advances the sources planned by PlanMixSourceBlock past the frames mixed, wrapping looped clips
+void AdvanceMixSources(
+    MIX_SOURCE     *pSources,
+    const UINT32   *pu32Active,
+    UINT32          u32ActiveCount,
+    UINT32          u32FrameCount);
+
+//
+// Points ppf32Sources at the next frames of the active sources planned by
+// PlanMixSourceBlock.  16 bit clips are converted by pfnConvertInt16Span and the
+// clips with a channel map spread over the stream channels, both into pf32Scratch,
+// which holds MIX_MAP_SCRATCH_SAMPLES samples.  Returns how many of the
+// u32FrameCount frames the pointers cover, fewer only if those clips do not fit
+// into the scratch buffer at once.
+//
+UINT32 GetMixSourceFrames(
+    const MIX_SOURCE       *pSources,
+    const UINT32           *pu32Active,
+    UINT32                  u32ActiveCount,
+    UINT32                  u32FrameCount,
+    UINT32                  u32SamplesPerFrame,
+    PFN_CONVERT_INT16_SPAN  pfnConvertInt16Span,
+    FLOAT32                *pf32Scratch,
+    const FLOAT32         **ppf32Sources);
+
+//
+// Mixes u32FrameCount frames of up to MIX_MAX_SOURCES clips into the output, each
+// from its own u32FileIndex on and with its own f32Weight and bLoop.  The period
+// is split only where one of the clips wraps or ends, and every part is mixed in
+// a single pass over the output.  The indices are advanced past the mixed frames.
+//
+void MixAudioSources(
+    const MIX_KERNELS  *pKernels,
+    FLOAT32            *pf32OutputFrames,
+    const FLOAT32      *pf32InputFrames,
+    UINT32              u32FrameCount,
+    UINT32              u32SamplesPerFrame,
+    MIX_SOURCE         *pSources,
+    UINT32              u32SourceCount,
+    FLOAT32             f32InputWeight);
+
+//
+// Builds the map of a clip of u32FileChannels channels on a stream of u32Channels
+// channels.  The masks are the KSAUDIO_SPEAKER_* speaker positions of the two, 0
+// for the default layout of the channel count.  Matching positions are copied,
+// the others are folded into their nearest neighbours: the center into the front
+// pair, the back pair into the side pair and vice versa, everything left over
+// into the front pair, and the LFE channel is dropped.  Without positions on
+// either side, such as for a microphone array, stream channel n gets clip channel
+// n modulo u32FileChannels.  A mono clip goes to every channel.
+//
+// Returns FALSE if a matrix would be needed but either side has more than
+// MIX_MAP_MAX_CHANNELS channels.
+//
+BOOL BuildMixChannelMap(
+    UINT32              u32FileChannels,
+    DWORD               dwFileChannelMask,
+    UINT32              u32Channels,
+    DWORD               dwChannelMask,
+    MIX_CHANNEL_MAP    *pMap);
+
+//
+// Spreads u32FrameCount frames of a clip over the stream channels of the map.
+// Every stream sample is the sum of its taps in order, so the result does not
+// depend on the instruction set.
+//
+void MapMixChannels(
+    const MIX_CHANNEL_MAP  *pMap,
+    const FLOAT32          *pf32File,
+    UINT32                  u32FrameCount,
+    FLOAT32                *pf32Output);
+
+// Returns the number of bytes of the silent block map of a clip
+UINT32 GetMixSilentBlockCount(UINT32 u32FileFrameCount);
+
+//
+// Maps the clip in blocks of MIX_SILENT_BLOCK_FRAMES frames, the last one possibly
+// shorter, and sets the byte of every block whose samples are all zero.  Lets the
+// processing kernels tell a silent stretch of the clip without reading it.
+//
+void FindMixSilentBlocks(
+    const FLOAT32  *pf32File,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    BYTE           *pbSilentBlocks);
+
+void FindMixSilentBlocks(
+    const INT16    *pi16File,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    BYTE           *pbSilentBlocks);
+
+// Entries of the table of every mix law, ratios in between are interpolated
+#define MIX_LAW_TABLE_SIZE          257
+
+// Range the decibel mix law fades over before the weight drops to 0
+#define MIX_LAW_DECIBEL_RANGE_DB    60
+
+//
+// Returns the input weight and the clip weight of the mix law at f32Ratio, the share
+// of the clips from 0 to 1.  The laws are tabulated at compile time, so this only
+// interpolates; it runs when the ratio or the law changes, the processing kernels
+// just apply the two weights.
+//
+void GetMixLawWeights(
+    MIX_LAW         law,
+    FLOAT32         f32Ratio,
+    FLOAT32        *pf32InputWeight,
+    FLOAT32        *pf32FileWeight);
+
+// Longest crossfade at the loop point of a clip, in milliseconds
+#define MIX_LOOP_MAX_CROSSFADE_MS   1000
+
+//
+// Makes a looped clip wrap without a click.  The first u32CrossfadeFrames frames
+// become an equal power crossfade from the last u32CrossfadeFrames frames into the
+// head of the clip, and the last frames are dropped, so playback goes on from the
+// end of the clip into the faded tail and leaves the crossfade exactly where the
+// head continues.  Works in place, at most half of the clip is crossfaded.
+//
+// Returns the new frame count of the clip.
+//
+UINT32 CrossfadeMixLoop(
+    FLOAT32        *pf32File,
+    UINT32          u32FileFrameCount,
+    UINT32          u32SamplesPerFrame,
+    UINT32          u32CrossfadeFrames);
+
+//
+// Returns TRUE if none of the sources adds anything but zeros to the next
+// u32FrameCount frames: each one has ended, is muted for the whole time or has
+// only silent blocks there.  A source without a silent block map is never silent.
+//
+BOOL AreMixSourcesSilent(
+    const MIX_SOURCE   *pSources,
+    UINT32              u32SourceCount,
+    UINT32              u32FrameCount);
+
+//
+// Moves the sources and the running ramp on by u32FrameCount frames without
+// mixing anything, as if those frames had been mixed
+//
+void SkipMixFrames(MIX_CONTEXT *pContext, UINT32 u32FrameCount);
+
+// Returns the specialization for u32SamplesPerFrame channels
+MIX_CHANNELS GetMixChannels(UINT32 u32SamplesPerFrame);
+
+// Returns the processor for the channel count and state
+const MIX_PROCESSOR* GetMixProcessor(
+    const MIX_KERNELS  *pKernels,
+    UINT32              u32SamplesPerFrame,
+    MIX_STATE           state);
+
+//
+// Resets the context to pass the input through with the processors of the channel
+// count, at unity gain on every channel.  Must not be called while the context is
+// used for processing.
+//
+void InitMixContext(
+    MIX_CONTEXT        *pContext,
+    const MIX_KERNELS  *pKernels,
+    UINT32              u32SamplesPerFrame,
+    BOOL                bInPlace,
+    UINT32              u32RampFrames);
+
+//
+// Hands a new mixing state over to the real-time thread, which picks it up at the
+// start of the next period and ramps to it.  Returns a serial for IsMixRequestSettled.
+// Calls must be serialized by the caller.
+//
+UINT32 PostMixRequest(
+    MIX_CONTEXT        *pContext,
+    const MIX_REQUEST  *pRequest);
+
+// Returns TRUE once the ramp to the request with the serial has ended
+BOOL IsMixRequestSettled(const MIX_CONTEXT *pContext, UINT32 u32Serial);
+
+//
+// Real-time side of the hand over, used by the processing kernels.  ApplyMixRequest
+// starts the ramp to a pending request and returns FALSE if none could be read,
+// FinishMixRamp settles the weights and the processor once a ramp has ended.
+//
+BOOL IsMixRequestPending(const MIX_CONTEXT *pContext);
+BOOL ApplyMixRequest(MIX_CONTEXT *pContext);
+void FinishMixRamp(MIX_CONTEXT *pContext);
+
+// Returns the input weight and the weight of every source u32RampFrame frames into the running ramp
+void GetMixRampWeights(
+    const MIX_CONTEXT  *pContext,
+    UINT32              u32RampFrame,
+    FLOAT32            *pf32InputWeight,
+    FLOAT32            *pf32SourceWeights);
+
+// Ceiling of the output limiter, -0.1 dBFS
+#define MIX_LIMITER_CEILING         0.9885531f
+
+// Time the limiter takes to recover most of a gain reduction, in milliseconds
+#define MIX_LIMITER_RELEASE_MS      50
+
+// Longest lookahead of the limiter, in milliseconds
+#define MIX_LIMITER_MAX_LOOKAHEAD_MS    20
+
+// Returns the bytes of the buffer InitMixStream needs for the ring, the period and the channel count
+size_t GetMixStreamBufferSize(UINT32 u32RingFrames, UINT32 u32PeriodFrames, UINT32 u32Channels);
+
+//
+// Resets the stream to an empty ring of u32RingFrames frames and a silent period
+// of u32PeriodFrames frames, both laid out in pbBuffer, which holds
+// GetMixStreamBufferSize bytes and must outlive the stream.  Must not be called
+// while the stream is written or read.
+//
+void InitMixStream(
+    MIX_STREAM     *pStream,
+    UINT32          u32RingFrames,
+    UINT32          u32PeriodFrames,
+    UINT32          u32Channels,
+    BYTE           *pbBuffer);
+
+// Returns the frames WriteMixStream takes right now, called by the worker only
+UINT32 GetMixStreamSpace(const MIX_STREAM *pStream);
+
+// Appends as many of the frames as fit to the ring and returns how many did, called by the worker only
+UINT32 WriteMixStream(
+    MIX_STREAM     *pStream,
+    const FLOAT32  *pf32Frames,
+    UINT32          u32FrameCount);
+
+//
+// Takes u32FrameCount frames out of the ring into pf32Frames and returns how many
+// there were.  The frames missing are silenced and counted as an underrun.
+// Called by the real-time thread only.
+//
+UINT32 ReadMixStream(
+    MIX_STREAM     *pStream,
+    FLOAT32        *pf32Frames,
+    UINT32          u32FrameCount);
+
+//
+// Real-time side of the streams, called at the start of every period before the
+// processor.  Picks up a pending request, then reads the next u32FrameCount frames
+// of every streamed source into the period of its stream and rewinds the source
+// to it.
+//
+void PrepareMixStreams(MIX_CONTEXT *pContext, UINT32 u32FrameCount);
+
+// Returns the bytes of the buffer InitMixLimiter needs for the lookahead and channel count
+size_t GetMixLimiterBufferSize(UINT32 u32LookaheadFrames, UINT32 u32Channels);
+
+//
+// Resets the limiter to unity gain with an empty, zeroed delay line.  pbBuffer
+// holds GetMixLimiterBufferSize bytes, aligned for FLOAT32 and UINT32, and must
+// outlive the use of the limiter.  A lookahead of 0 turns the limiter off, as
+// does a channel count the gain blocks cannot hold.  u32ReleaseFrames is the
+// time constant of the release in frames.  Must not be called while the limiter
+// is used for processing.
+//
+void InitMixLimiter(
+    MIX_LIMITER    *pLimiter,
+    UINT32          u32LookaheadFrames,
+    UINT32          u32Channels,
+    FLOAT32         f32Ceiling,
+    UINT32          u32ReleaseFrames,
+    BYTE           *pbBuffer);
+
+//
+// Works out the gains of the next u32FrameCount frames of the mix, at most
+// MIX_LIMITER_BLOCK_FRAMES, into af32FrameGains.  The gain of a frame applies to
+// the frame coming out of the delay line at the same time.
+//
+void UpdateMixLimiterGains(
+    MIX_LIMITER    *pLimiter,
+    const FLOAT32  *pf32Frames,
+    UINT32          u32FrameCount);
+
+//
+// Records that u32FrameCount frames went through the limiter at unity gain
+// without updating the gains frame by frame, f32Peak being their largest
+// magnitude.  Either the gains were already at unity and none of the frames
+// needs less, or the delay line only holds zeros, which come out the same
+// whatever the gain; the gains are reset to unity then, as the release would
+// have done anyway.
+//
+void SkipMixLimiterGains(
+    MIX_LIMITER    *pLimiter,
+    UINT32          u32FrameCount,
+    FLOAT32         f32Peak);
+
+// Returns the bytes of a sample in the format
+UINT32 GetMixSampleBytes(MIX_SAMPLE_FORMAT format);
+
+//
+// Resets the conversion state of a fixed point connection.  The mix context of
+// the connection must process in place, the blocks are mixed in af32Block.  A
+// frame must fit a block, so at most MIX_FORMAT_BLOCK_SAMPLES channels.  Must not
+// be called while the state is used for processing.
+//
+void InitMixFormat(
+    MIX_FORMAT         *pFormat,
+    MIX_SAMPLE_FORMAT   format,
+    UINT32              u32Channels);
+
+#if defined(MIX_KERNELS_X64)
+extern const MIX_KERNELS g_MixKernelsSSE2;
+extern const MIX_KERNELS g_MixKernelsAVX2;
+extern const MIX_KERNELS g_MixKernelsAVX512;
+#elif defined(MIX_KERNELS_ARM64)
+extern const MIX_KERNELS g_MixKernelsNEON;
+#endif
@@ -0,0 +1,77 @@
+//
+// AudioMixKernelsAVX2.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  AVX2 instantiation of the mix kernels.  GCC and Clang need -mavx2 for this
+//  file only; it is entered only after DetectMixIsa() has confirmed AVX2 support.
+//  FMA is deliberately not used to stay bit compatible with the scalar kernels.
+//
+
+#include "AudioMixKernels.h"
+
+#if defined(MIX_KERNELS_X64)
+
+#include <immintrin.h>
+
+#include "AudioMixKernelsImpl.h"
+
+namespace
+{
+
+struct MixVecAVX2
+{
+    typedef __m256 Vec;
+    static const UINT32 Width = 8;
+
+    static Vec  Load(const FLOAT32 *p)      { return _mm256_loadu_ps(p); }
+    static void Store(FLOAT32 *p, Vec v)    { _mm256_storeu_ps(p, v); }
+    static Vec  Set1(FLOAT32 f)             { return _mm256_set1_ps(f); }
+    static Vec  Add(Vec a, Vec b)           { return _mm256_add_ps(a, b); }
+    static Vec  Mul(Vec a, Vec b)           { return _mm256_mul_ps(a, b); }
+    static Vec  Max(Vec a, Vec b)           { return _mm256_max_ps(a, b); }
+    static Vec  Abs(Vec a)                  { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static Vec  Min(Vec a, Vec b)           { return _mm256_min_ps(a, b); }
+    static Vec  LoadInt16(const INT16 *p)
+    {
+        return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+    }
+    static Vec  LoadInt32(const INT32 *p)
+    {
+        return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+    }
+    static void StoreInt16(INT16 *p, Vec v)
+    {
+        // The 256 bit pack works within 128 bit halves, pack the halves instead
+        const __m256i i = _mm256_cvtps_epi32(v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                         _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1)));
+    }
+    static void StoreInt32(INT32 *p, Vec v)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_cvtps_epi32(v));
+    }
+    static void Deinterleave2(Vec a, Vec b, Vec *pEven, Vec *pOdd)
+    {
+        // The shuffles work within the 128 bit halves, the permute puts their pairs in order
+        *pEven = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, 0x88)), 0xD8));
+        *pOdd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, 0xDD)), 0xD8));
+    }
+    static Vec  Dither(UINT32 *p)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+        x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+        x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x);
+
+        const __m256i d = _mm256_sub_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(x, 16));
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(1.0f / 65536.0f));
+    }
+};
+
+} // namespace
+
+const MIX_KERNELS g_MixKernelsAVX2 = MakeMixKernels<MixVecAVX2>(MIX_ISA_AVX2, "AVX2");
+
+#endif // MIX_KERNELS_X64
@@ -0,0 +1,80 @@
+//
+// AudioMixKernelsAVX512.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  AVX-512F instantiation of the mix kernels.  GCC and Clang need -mavx512f for
+//  this file only; it is entered only after DetectMixIsa() has confirmed AVX-512F
+//  support.  FMA is deliberately not used to stay bit compatible with the scalar
+//  kernels.
+//
+
+#include "AudioMixKernels.h"
+
+#if defined(MIX_KERNELS_X64)
+
+#include <immintrin.h>
+
+#include "AudioMixKernelsImpl.h"
+
+namespace
+{
+
+struct MixVecAVX512
+{
+    typedef __m512 Vec;
+    static const UINT32 Width = 16;
+
+    static Vec  Load(const FLOAT32 *p)      { return _mm512_loadu_ps(p); }
+    static void Store(FLOAT32 *p, Vec v)    { _mm512_storeu_ps(p, v); }
+    static Vec  Set1(FLOAT32 f)             { return _mm512_set1_ps(f); }
+    static Vec  Add(Vec a, Vec b)           { return _mm512_add_ps(a, b); }
+    static Vec  Mul(Vec a, Vec b)           { return _mm512_mul_ps(a, b); }
+    static Vec  Max(Vec a, Vec b)           { return _mm512_mask_max_ps(a, 0xFFFF, a, b); }
+    static Vec  Abs(Vec a)                  { return _mm512_abs_ps(a); }
+    static Vec  Min(Vec a, Vec b)           { return _mm512_mask_min_ps(a, 0xFFFF, a, b); }
+    static Vec  LoadInt16(const INT16 *p)
+    {
+        // Masked forms with all lanes set, the plain ones start from an undefined
+        // register that GCC reports as maybe uninitialized, so do the others below
+        const __m512i v = _mm512_mask_cvtepi16_epi32(_mm512_setzero_si512(), 0xFFFF,
+                                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+        return _mm512_mask_cvtepi32_ps(_mm512_setzero_ps(), 0xFFFF, v);
+    }
+    static Vec  LoadInt32(const INT32 *p)
+    {
+        return _mm512_mask_cvtepi32_ps(_mm512_setzero_ps(), 0xFFFF, _mm512_loadu_si512(p));
+    }
+    static void StoreInt16(INT16 *p, Vec v)
+    {
+        _mm512_mask_cvtsepi32_storeu_epi16(p, 0xFFFF, _mm512_mask_cvtps_epi32(_mm512_setzero_si512(), 0xFFFF, v));
+    }
+    static void StoreInt32(INT32 *p, Vec v)
+    {
+        _mm512_storeu_si512(p, _mm512_mask_cvtps_epi32(_mm512_setzero_si512(), 0xFFFF, v));
+    }
+    static void Deinterleave2(Vec a, Vec b, Vec *pEven, Vec *pOdd)
+    {
+        // Indices 16 and up pick from b
+        *pEven = _mm512_permutex2var_ps(a, _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30), b);
+        *pOdd = _mm512_permutex2var_ps(a, _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31), b);
+    }
+    static Vec  Dither(UINT32 *p)
+    {
+        __m512i x = _mm512_loadu_si512(p);
+        x = _mm512_xor_si512(x, _mm512_mask_slli_epi32(x, 0xFFFF, x, 13));
+        x = _mm512_xor_si512(x, _mm512_mask_srli_epi32(x, 0xFFFF, x, 17));
+        x = _mm512_xor_si512(x, _mm512_mask_slli_epi32(x, 0xFFFF, x, 5));
+        _mm512_storeu_si512(p, x);
+
+        const __m512i d = _mm512_sub_epi32(_mm512_and_si512(x, _mm512_set1_epi32(0xFFFF)),
+                                          _mm512_mask_srli_epi32(x, 0xFFFF, x, 16));
+        return _mm512_mul_ps(_mm512_mask_cvtepi32_ps(_mm512_setzero_ps(), 0xFFFF, d), _mm512_set1_ps(1.0f / 65536.0f));
+    }
+};
+
+} // namespace
+
+const MIX_KERNELS g_MixKernelsAVX512 = MakeMixKernels<MixVecAVX512>(MIX_ISA_AVX512, "AVX-512");
+
+#endif // MIX_KERNELS_X64
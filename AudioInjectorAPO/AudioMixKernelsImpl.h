@@ -0,0 +1,1659 @@
+//
+// AudioMixKernelsImpl.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Instruction set independent bodies of the mix kernels.  Every AudioMixKernels*.cpp
+//  translation unit defines a vector traits class and instantiates the templates
+//  below with it:
+//
+//      struct V
+//      {
+//          typedef ... Vec;                           // native vector type
+//          static const UINT32 Width;                 // FLOAT32 lanes per vector
+//          static Vec  Load(const FLOAT32 *p);        // unaligned load
+//          static void Store(FLOAT32 *p, Vec v);      // unaligned store
+//          static Vec  Set1(FLOAT32 f);               // broadcast
+//          static Vec  Add(Vec a, Vec b);
+//          static Vec  Mul(Vec a, Vec b);
+//          static Vec  Max(Vec a, Vec b);
+//          static Vec  Abs(Vec a);
+//          static Vec  Min(Vec a, Vec b);
+//          static Vec  LoadInt16(const INT16 *p);     // Width samples converted to float, unscaled
+//          static Vec  LoadInt32(const INT32 *p);     // same for 32 bit samples, rounded to nearest
+//          static void StoreInt16(INT16 *p, Vec v);   // rounded to nearest even, v is in range
+//          static void StoreInt32(INT32 *p, Vec v);   // same for 32 bit samples
+//          static Vec  Dither(UINT32 *p);             // steps Width xorshift generators, TPDF in (-1, 1)
+//      };
+//
+//  The SIMD translation units are compiled with instruction set specific options,
+//  so everything here lives in an anonymous namespace: an inline function shared
+//  between them could otherwise be folded by the linker into its AVX-512 copy.
+//  For the same reason these templates must not call into the standard library.
+//
+//  Besides the flat span kernels every translation unit builds the processing
+//  kernels APOProcess calls, specialized on the channel count and the MIX_STATE,
+//  so the channel count is a compile time constant in all of their loops.
+//
+
+#pragma once
+
+#include "AudioMixKernels.h"
+
+namespace
+{
+
+template <class V>
+void MixSpan(
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    const FLOAT32  *pf32File,
+    UINT32          u32SampleCount,
+    FLOAT32         f32InputWeight,
+    FLOAT32         f32FileWeight)
+{
+    typedef typename V::Vec Vec;
+
+    const Vec vInputWeight = V::Set1(f32InputWeight);
+    const Vec vFileWeight = V::Set1(f32FileWeight);
+    UINT32 i = 0;
+
+    // Two vectors per iteration to keep both load ports busy
+    for (; i + 2 * V::Width <= u32SampleCount; i += 2 * V::Width)
+    {
+        Vec vMix0 = V::Add(V::Mul(V::Load(pf32Input + i), vInputWeight),
+                           V::Mul(V::Load(pf32File + i), vFileWeight));
+        Vec vMix1 = V::Add(V::Mul(V::Load(pf32Input + i + V::Width), vInputWeight),
+                           V::Mul(V::Load(pf32File + i + V::Width), vFileWeight));
+        V::Store(pf32Output + i, vMix0);
+        V::Store(pf32Output + i + V::Width, vMix1);
+    }
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        V::Store(pf32Output + i, V::Add(V::Mul(V::Load(pf32Input + i), vInputWeight),
+                                        V::Mul(V::Load(pf32File + i), vFileWeight)));
+    }
+
+    // Scalar tail, same operation order as the vector body
+    for (; i < u32SampleCount; i++)
+    {
+        pf32Output[i] = (pf32Input[i] * f32InputWeight) + (pf32File[i] * f32FileWeight);
+    }
+}
+
+template <class V>
+void CopySpan(
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    UINT32          u32SampleCount)
+{
+    UINT32 i = 0;
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        V::Store(pf32Output + i, V::Load(pf32Input + i));
+    }
+
+    for (; i < u32SampleCount; i++)
+    {
+        pf32Output[i] = pf32Input[i];
+    }
+}
+
+template <class V>
+void ZeroSpan(
+    FLOAT32        *pf32Output,
+    UINT32          u32SampleCount)
+{
+    const typename V::Vec vZero = V::Set1(0.0f);
+    UINT32 i = 0;
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        V::Store(pf32Output + i, vZero);
+    }
+
+    for (; i < u32SampleCount; i++)
+    {
+        pf32Output[i] = 0.0f;
+    }
+}
+
+//
+// 16 bit clip samples to [-1, 1).  The conversion and the power of two scale are
+// exact, so every instruction set gives the same floats.
+//
+template <class V>
+void ConvertInt16Span(
+    FLOAT32        *pf32Output,
+    const INT16    *pi16Input,
+    UINT32          u32SampleCount)
+{
+    const FLOAT32 f32Scale = 1.0f / 32768.0f;
+    const typename V::Vec vScale = V::Set1(f32Scale);
+    UINT32 i = 0;
+
+    for (; i + 2 * V::Width <= u32SampleCount; i += 2 * V::Width)
+    {
+        V::Store(pf32Output + i, V::Mul(V::LoadInt16(pi16Input + i), vScale));
+        V::Store(pf32Output + i + V::Width, V::Mul(V::LoadInt16(pi16Input + i + V::Width), vScale));
+    }
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        V::Store(pf32Output + i, V::Mul(V::LoadInt16(pi16Input + i), vScale));
+    }
+
+    for (; i < u32SampleCount; i++)
+    {
+        pf32Output[i] = static_cast<FLOAT32>(pi16Input[i]) * f32Scale;
+    }
+}
+
+//
+// Mixes the weighted input and N clips, or u32SourceCount for N == 0, in a single
+// pass.  The sum of every vector runs through the clips one add after the other,
+// so four independent vectors are accumulated in registers per iteration to keep
+// the adds from waiting on each other, and stored once: the output is written
+// once however many clips there are.  With silent input the first clip starts the
+// sum instead of the zero input.
+//
+template <class V, bool bSilentInput, UINT32 N>
+void MixSourcesSpanN(
+    FLOAT32                *pf32Output,
+    const FLOAT32          *pf32Input,
+    const FLOAT32 * const  *ppf32Sources,
+    const FLOAT32          *pf32Weights,
+    UINT32                  u32SourceCount,
+    UINT32                  u32SampleCount,
+    FLOAT32                 f32InputWeight)
+{
+    typedef typename V::Vec Vec;
+
+    const UINT32 u32Sources = (N != 0) ? N : u32SourceCount;
+    const FLOAT32 *apf32Sources[(N != 0) ? N : MIX_CONTEXT_SOURCES];
+    Vec avWeights[(N != 0) ? N : MIX_CONTEXT_SOURCES];
+
+    for (UINT32 s = 0; s < u32Sources; s++)
+    {
+        apf32Sources[s] = ppf32Sources[s];
+        avWeights[s] = V::Set1(pf32Weights[s]);
+    }
+
+    const Vec vInputWeight = V::Set1(f32InputWeight);
+    const UINT32 u32First = bSilentInput ? 1 : 0;
+    UINT32 i = 0;
+
+    // Four vectors per iteration, written out so that they stay in registers
+    for (; i + 4 * V::Width <= u32SampleCount; i += 4 * V::Width)
+    {
+        Vec vMix0, vMix1, vMix2, vMix3;
+
+        if constexpr (bSilentInput)
+        {
+            vMix0 = V::Mul(V::Load(apf32Sources[0] + i), avWeights[0]);
+            vMix1 = V::Mul(V::Load(apf32Sources[0] + i + V::Width), avWeights[0]);
+            vMix2 = V::Mul(V::Load(apf32Sources[0] + i + 2 * V::Width), avWeights[0]);
+            vMix3 = V::Mul(V::Load(apf32Sources[0] + i + 3 * V::Width), avWeights[0]);
+        }
+        else
+        {
+            vMix0 = V::Mul(V::Load(pf32Input + i), vInputWeight);
+            vMix1 = V::Mul(V::Load(pf32Input + i + V::Width), vInputWeight);
+            vMix2 = V::Mul(V::Load(pf32Input + i + 2 * V::Width), vInputWeight);
+            vMix3 = V::Mul(V::Load(pf32Input + i + 3 * V::Width), vInputWeight);
+        }
+
+        for (UINT32 s = u32First; s < u32Sources; s++)
+        {
+            const FLOAT32 *pf32Source = apf32Sources[s] + i;
+            const Vec vWeight = avWeights[s];
+            vMix0 = V::Add(vMix0, V::Mul(V::Load(pf32Source), vWeight));
+            vMix1 = V::Add(vMix1, V::Mul(V::Load(pf32Source + V::Width), vWeight));
+            vMix2 = V::Add(vMix2, V::Mul(V::Load(pf32Source + 2 * V::Width), vWeight));
+            vMix3 = V::Add(vMix3, V::Mul(V::Load(pf32Source + 3 * V::Width), vWeight));
+        }
+
+        V::Store(pf32Output + i, vMix0);
+        V::Store(pf32Output + i + V::Width, vMix1);
+        V::Store(pf32Output + i + 2 * V::Width, vMix2);
+        V::Store(pf32Output + i + 3 * V::Width, vMix3);
+    }
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        Vec vMix;
+
+        if constexpr (bSilentInput)
+        {
+            vMix = V::Mul(V::Load(apf32Sources[0] + i), avWeights[0]);
+        }
+        else
+        {
+            vMix = V::Mul(V::Load(pf32Input + i), vInputWeight);
+        }
+
+        for (UINT32 s = u32First; s < u32Sources; s++)
+        {
+            vMix = V::Add(vMix, V::Mul(V::Load(apf32Sources[s] + i), avWeights[s]));
+        }
+
+        V::Store(pf32Output + i, vMix);
+    }
+
+    // Scalar tail, same operation order as the vector body
+    for (; i < u32SampleCount; i++)
+    {
+        FLOAT32 f32Mix;
+
+        if constexpr (bSilentInput)
+        {
+            f32Mix = apf32Sources[0][i] * pf32Weights[0];
+        }
+        else
+        {
+            f32Mix = pf32Input[i] * f32InputWeight;
+        }
+
+        for (UINT32 s = u32First; s < u32Sources; s++)
+        {
+            f32Mix = f32Mix + (apf32Sources[s][i] * pf32Weights[s]);
+        }
+
+        pf32Output[i] = f32Mix;
+    }
+
+    if constexpr (bSilentInput)
+    {
+        UNREFERENCED_PARAMETER(pf32Input);
+        UNREFERENCED_PARAMETER(vInputWeight);
+    }
+}
+
+//
+// Picks the kernel unrolled for the number of clips, the common layer counts keep
+// all of the clip pointers and weights in registers
+//
+template <class V, bool bSilentInput>
+void MixSourcesSpan(
+    FLOAT32                *pf32Output,
+    const FLOAT32          *pf32Input,
+    const FLOAT32 * const  *ppf32Sources,
+    const FLOAT32          *pf32Weights,
+    UINT32                  u32SourceCount,
+    UINT32                  u32SampleCount,
+    FLOAT32                 f32InputWeight)
+{
+    switch (u32SourceCount)
+    {
+    case 0:
+        if constexpr (bSilentInput)
+        {
+            ZeroSpan<V>(pf32Output, u32SampleCount);
+        }
+        else
+        {
+            MixSourcesSpanN<V, false, 0>(pf32Output, pf32Input, ppf32Sources, pf32Weights, 0, u32SampleCount, f32InputWeight);
+        }
+        break;
+    case 1:
+        MixSourcesSpanN<V, bSilentInput, 1>(pf32Output, pf32Input, ppf32Sources, pf32Weights, 1, u32SampleCount, f32InputWeight);
+        break;
+    case 2:
+        MixSourcesSpanN<V, bSilentInput, 2>(pf32Output, pf32Input, ppf32Sources, pf32Weights, 2, u32SampleCount, f32InputWeight);
+        break;
+    case 3:
+        MixSourcesSpanN<V, bSilentInput, 3>(pf32Output, pf32Input, ppf32Sources, pf32Weights, 3, u32SampleCount, f32InputWeight);
+        break;
+    case 4:
+        MixSourcesSpanN<V, bSilentInput, 4>(pf32Output, pf32Input, ppf32Sources, pf32Weights, 4, u32SampleCount, f32InputWeight);
+        break;
+    default:
+        MixSourcesSpanN<V, bSilentInput, 0>(pf32Output, pf32Input, ppf32Sources, pf32Weights,
+                                            u32SourceCount, u32SampleCount, f32InputWeight);
+        break;
+    }
+}
+
+// Only ever installed for BUFFER_INVALID input, which the audio engine never sends
+APO_BUFFER_FLAGS ProcessInvalid(
+    MIX_CONTEXT    *pContext,
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    UINT32          u32FrameCount)
+{
+    UNREFERENCED_PARAMETER(pContext);
+    UNREFERENCED_PARAMETER(pf32Output);
+    UNREFERENCED_PARAMETER(pf32Input);
+    UNREFERENCED_PARAMETER(u32FrameCount);
+    return BUFFER_INVALID;
+}
+
+// Exponential ramps are scaled so that they land exactly on the target, r^N is this
+const FLOAT32 c_f32RampFloor = 0.001f;
+
+// x^n by squaring, the kernels must not call into the C runtime
+inline FLOAT32 RampPower(FLOAT32 f32Base, UINT32 u32Exponent)
+{
+    FLOAT32 f32Result = 1.0f;
+    while (u32Exponent != 0)
+    {
+        if (u32Exponent & 1)
+        {
+            f32Result *= f32Base;
+        }
+        f32Base *= f32Base;
+        u32Exponent >>= 1;
+    }
+    return f32Result;
+}
+
+//
+// Mixes the input and the clips into a flat span with the channel gains of the
+// context.  The gains come from the lanes of a pattern of whole frames, so every
+// vector of samples takes one load of each on top of the plain mix:
+//
+//      pf32Output[i] = pf32Input[i] * f32InputWeight * input gain of i
+//                    + (sum of ppf32Sources[s][i] * pf32Weights[s]) * injection gain of i
+//
+// Vector and scalar lanes share the operation order, so the result does not
+// depend on the instruction set.
+//
+template <class V, bool bSilentInput>
+void MixGainSpan(
+    FLOAT32                *pf32Output,
+    const FLOAT32          *pf32Input,
+    const FLOAT32 * const  *ppf32Sources,
+    const FLOAT32          *pf32Weights,
+    UINT32                  u32SourceCount,
+    UINT32                  u32SampleCount,
+    const MIX_CONTEXT      *pContext)
+{
+    typedef typename V::Vec Vec;
+
+    // Nothing but silence to scale
+    if constexpr (bSilentInput)
+    {
+        if (u32SourceCount == 0)
+        {
+            ZeroSpan<V>(pf32Output, u32SampleCount);
+            return;
+        }
+    }
+
+    const FLOAT32 *pf32InputGains = pContext->af32InputGainLanes;
+    const FLOAT32 *pf32InjectionGains = pContext->af32InjectionGainLanes;
+    const FLOAT32 f32InputWeight = pContext->f32InputWeight;
+    const UINT32 u32Pattern = pContext->u32RampPattern;
+    const bool bVector = (u32Pattern % V::Width == 0);
+
+    const Vec vInputWeight = V::Set1(f32InputWeight);
+    Vec avWeights[MIX_CONTEXT_SOURCES];
+    for (UINT32 s = 0; s < u32SourceCount; s++)
+    {
+        avWeights[s] = V::Set1(pf32Weights[s]);
+    }
+
+    for (UINT32 i = 0; i < u32SampleCount; i += u32Pattern)
+    {
+        UINT32 k = 0;
+        const UINT32 u32Count = (u32SampleCount - i < u32Pattern) ? u32SampleCount - i : u32Pattern;
+
+        if (bVector)
+        {
+            for (; k + V::Width <= u32Count; k += V::Width)
+            {
+                Vec vMix = V::Set1(0.0f);
+
+                if constexpr (!bSilentInput)
+                {
+                    vMix = V::Mul(V::Mul(V::Load(pf32Input + i + k), vInputWeight), V::Load(pf32InputGains + k));
+                }
+
+                if (u32SourceCount != 0)
+                {
+                    Vec vSum = V::Mul(V::Load(ppf32Sources[0] + i + k), avWeights[0]);
+                    for (UINT32 s = 1; s < u32SourceCount; s++)
+                    {
+                        vSum = V::Add(vSum, V::Mul(V::Load(ppf32Sources[s] + i + k), avWeights[s]));
+                    }
+                    vSum = V::Mul(vSum, V::Load(pf32InjectionGains + k));
+                    vMix = bSilentInput ? vSum : V::Add(vMix, vSum);
+                }
+
+                V::Store(pf32Output + i + k, vMix);
+            }
+        }
+
+        for (; k < u32Count; k++)
+        {
+            FLOAT32 f32Mix = 0.0f;
+
+            if constexpr (!bSilentInput)
+            {
+                f32Mix = (pf32Input[i + k] * f32InputWeight) * pf32InputGains[k];
+            }
+
+            if (u32SourceCount != 0)
+            {
+                FLOAT32 f32Sum = ppf32Sources[0][i + k] * pf32Weights[0];
+                for (UINT32 s = 1; s < u32SourceCount; s++)
+                {
+                    f32Sum = f32Sum + (ppf32Sources[s][i + k] * pf32Weights[s]);
+                }
+                f32Sum = f32Sum * pf32InjectionGains[k];
+                f32Mix = bSilentInput ? f32Sum : f32Mix + f32Sum;
+            }
+
+            pf32Output[i + k] = f32Mix;
+        }
+    }
+
+    if constexpr (bSilentInput)
+    {
+        UNREFERENCED_PARAMETER(pf32Input);
+        UNREFERENCED_PARAMETER(vInputWeight);
+    }
+}
+
+//
+// Mixes the input and the clips into a flat span while all of their weights
+// ramp.  With g(f) falling from 1 to 0 over the N frames of the ramp, every
+// weight at ramp frame f is
+//
+//      w(f) = target + (start - target) * g(f)
+//
+//      linear          g(f) = 1 - f / N
+//      exponential     g(f) = (r^f - r^N) / (1 - r^N)
+//
+// Both are affine in a per-lane term T, t or r^t for the frame offset t within
+// a pattern of samples that lines up with both frames and vectors, see
+// ApplyMixRequest.  So a pattern costs two scalar coefficients per weight, and
+// every vector one load of T from the context on top of the plain mix.  With
+// bGains the channel gains ramp the same way, from lanes of their own, and
+// scale the input and the sum of the clips as in MixGainSpan.  Vector and
+// scalar lanes share the operation order, so the result does not depend on
+// the instruction set.
+//
+template <class V, bool bSilentInput, bool bGains>
+void MixRampSpan(
+    FLOAT32                *pf32Output,
+    const FLOAT32          *pf32Input,
+    const FLOAT32 * const  *ppf32Sources,
+    const FLOAT32          *pf32StartWeights,
+    const FLOAT32          *pf32TargetWeights,
+    UINT32                  u32SourceCount,
+    UINT32                  u32FrameCount,
+    UINT32                  u32Channels,
+    const MIX_CONTEXT      *pContext,
+    UINT32                  u32RampFrame)
+{
+    typedef typename V::Vec Vec;
+
+    const UINT32 u32SampleCount = u32FrameCount * u32Channels;
+
+    // Nothing but silence to ramp
+    if constexpr (bSilentInput)
+    {
+        if (u32SourceCount == 0)
+        {
+            ZeroSpan<V>(pf32Output, u32SampleCount);
+            return;
+        }
+    }
+
+    const bool bExponential = (pContext->rampShape == MIX_RAMP_EXPONENTIAL);
+    const FLOAT32 f32InvRampFrames = 1.0f / static_cast<FLOAT32>(pContext->u32RampFrames);
+    const FLOAT32 f32InputDelta = pContext->f32InputWeight - pContext->f32TargetInputWeight;
+    const UINT32 u32First = (bSilentInput || bGains) ? 1 : 0;
+
+    const FLOAT32 *pf32T = pContext->af32RampLanes;
+    const FLOAT32 *pf32InputGains = pContext->af32InputGainLanes;
+    const FLOAT32 *pf32InputSteps = pContext->af32InputGainSteps;
+    const FLOAT32 *pf32InjectionGains = pContext->af32InjectionGainLanes;
+    const FLOAT32 *pf32InjectionSteps = pContext->af32InjectionGainSteps;
+    const UINT32 u32Pattern = pContext->u32RampPattern;
+    const UINT32 u32PatternFrames = u32Pattern / u32Channels;
+    const bool bVector = (u32Pattern % V::Width == 0);
+
+    const FLOAT32 f32PatternDecay = bExponential ? RampPower(pContext->f32RampDecay, u32PatternFrames) : 0.0f;
+    FLOAT32 f32Decay = bExponential ? RampPower(pContext->f32RampDecay, u32RampFrame) : 0.0f;
+
+    FLOAT32 af32A[MIX_CONTEXT_SOURCES];
+    FLOAT32 af32B[MIX_CONTEXT_SOURCES];
+    Vec avA[MIX_CONTEXT_SOURCES];
+    Vec avB[MIX_CONTEXT_SOURCES];
+
+    UINT32 u32Frame = u32RampFrame;
+
+    for (UINT32 i = 0; i < u32SampleCount; i += u32Pattern, u32Frame += u32PatternFrames)
+    {
+        FLOAT32 f32A, f32B;
+
+        if (bExponential)
+        {
+            f32A = -c_f32RampFloor / (1.0f - c_f32RampFloor);
+            f32B = f32Decay / (1.0f - c_f32RampFloor);
+            f32Decay *= f32PatternDecay;
+        }
+        else
+        {
+            f32A = 1.0f - static_cast<FLOAT32>(u32Frame) * f32InvRampFrames;
+            f32B = -f32InvRampFrames;
+        }
+
+        const FLOAT32 f32InputA = pContext->f32TargetInputWeight + f32InputDelta * f32A;
+        const FLOAT32 f32InputB = f32InputDelta * f32B;
+        for (UINT32 s = 0; s < u32SourceCount; s++)
+        {
+            const FLOAT32 f32Delta = pf32StartWeights[s] - pf32TargetWeights[s];
+            af32A[s] = pf32TargetWeights[s] + f32Delta * f32A;
+            af32B[s] = f32Delta * f32B;
+        }
+
+        UINT32 k = 0;
+        const UINT32 u32Count = (u32SampleCount - i < u32Pattern) ? u32SampleCount - i : u32Pattern;
+
+        if (bVector)
+        {
+            const Vec vInputA = V::Set1(f32InputA);
+            const Vec vInputB = V::Set1(f32InputB);
+            const Vec vA = V::Set1(f32A);
+            const Vec vB = V::Set1(f32B);
+            for (UINT32 s = 0; s < u32SourceCount; s++)
+            {
+                avA[s] = V::Set1(af32A[s]);
+                avB[s] = V::Set1(af32B[s]);
+            }
+
+            for (; k + V::Width <= u32Count; k += V::Width)
+            {
+                const Vec vT = V::Load(pf32T + k);
+                Vec vMix;
+
+                if constexpr (bGains)
+                {
+                    const Vec vG = V::Add(vA, V::Mul(vB, vT));
+                    Vec vSum = V::Set1(0.0f);
+
+                    if (u32SourceCount != 0)
+                    {
+                        vSum = V::Mul(V::Load(ppf32Sources[0] + i + k), V::Add(avA[0], V::Mul(avB[0], vT)));
+                    }
+                    for (UINT32 s = u32First; s < u32SourceCount; s++)
+                    {
+                        vSum = V::Add(vSum, V::Mul(V::Load(ppf32Sources[s] + i + k), V::Add(avA[s], V::Mul(avB[s], vT))));
+                    }
+                    vMix = V::Mul(vSum, V::Add(V::Load(pf32InjectionGains + k), V::Mul(V::Load(pf32InjectionSteps + k), vG)));
+
+                    if constexpr (!bSilentInput)
+                    {
+                        const Vec vInputGain = V::Add(V::Load(pf32InputGains + k), V::Mul(V::Load(pf32InputSteps + k), vG));
+                        vMix = V::Add(V::Mul(V::Mul(V::Load(pf32Input + i + k), V::Add(vInputA, V::Mul(vInputB, vT))), vInputGain),
+                                      vMix);
+                    }
+                }
+                else
+                {
+                    if constexpr (bSilentInput)
+                    {
+                        vMix = V::Mul(V::Load(ppf32Sources[0] + i + k), V::Add(avA[0], V::Mul(avB[0], vT)));
+                    }
+                    else
+                    {
+                        vMix = V::Mul(V::Load(pf32Input + i + k), V::Add(vInputA, V::Mul(vInputB, vT)));
+                    }
+
+                    for (UINT32 s = u32First; s < u32SourceCount; s++)
+                    {
+                        vMix = V::Add(vMix, V::Mul(V::Load(ppf32Sources[s] + i + k), V::Add(avA[s], V::Mul(avB[s], vT))));
+                    }
+                }
+
+                V::Store(pf32Output + i + k, vMix);
+            }
+        }
+
+        for (; k < u32Count; k++)
+        {
+            FLOAT32 f32Mix;
+
+            if constexpr (bGains)
+            {
+                const FLOAT32 f32G = f32A + (f32B * pf32T[k]);
+                FLOAT32 f32Sum = 0.0f;
+
+                if (u32SourceCount != 0)
+                {
+                    f32Sum = ppf32Sources[0][i + k] * (af32A[0] + (af32B[0] * pf32T[k]));
+                }
+                for (UINT32 s = u32First; s < u32SourceCount; s++)
+                {
+                    f32Sum = f32Sum + (ppf32Sources[s][i + k] * (af32A[s] + (af32B[s] * pf32T[k])));
+                }
+                f32Mix = f32Sum * (pf32InjectionGains[k] + (pf32InjectionSteps[k] * f32G));
+
+                if constexpr (!bSilentInput)
+                {
+                    const FLOAT32 f32InputGain = pf32InputGains[k] + (pf32InputSteps[k] * f32G);
+                    f32Mix = ((pf32Input[i + k] * (f32InputA + (f32InputB * pf32T[k]))) * f32InputGain) + f32Mix;
+                }
+            }
+            else
+            {
+                if constexpr (bSilentInput)
+                {
+                    f32Mix = ppf32Sources[0][i + k] * (af32A[0] + (af32B[0] * pf32T[k]));
+                }
+                else
+                {
+                    f32Mix = pf32Input[i + k] * (f32InputA + (f32InputB * pf32T[k]));
+                }
+
+                for (UINT32 s = u32First; s < u32SourceCount; s++)
+                {
+                    f32Mix = f32Mix + (ppf32Sources[s][i + k] * (af32A[s] + (af32B[s] * pf32T[k])));
+                }
+            }
+
+            pf32Output[i + k] = f32Mix;
+        }
+    }
+
+    if constexpr (bSilentInput)
+    {
+        UNREFERENCED_PARAMETER(pf32Input);
+        UNREFERENCED_PARAMETER(pf32InputGains);
+        UNREFERENCED_PARAMETER(pf32InputSteps);
+    }
+    if constexpr (!bGains)
+    {
+        UNREFERENCED_PARAMETER(pf32InputGains);
+        UNREFERENCED_PARAMETER(pf32InputSteps);
+        UNREFERENCED_PARAMETER(pf32InjectionGains);
+        UNREFERENCED_PARAMETER(pf32InjectionSteps);
+    }
+}
+
+//
+// Mixes u32FrameCount frames of all of the clips of the context, with the steady
+// weights or, for bRamp, with the running ramp, and with the channel gains if
+// any of them is not unity.  The period is split where one of the clips wraps or
+// ends, or where the clips with a channel map or 16 bit samples fill the scratch
+// buffer, and every part is mixed in a single pass.  With silent input the input
+// weight would only multiply zeros, so just the weighted clips are written.
+//
+template <class V, bool bSilentInput, bool bRamp>
+void MixSourceFrames(
+    MIX_CONTEXT    *pContext,
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    UINT32          u32FrameCount,
+    UINT32          u32Channels)
+{
+    UINT32 au32Active[MIX_CONTEXT_SOURCES];
+    const FLOAT32 *apf32Sources[MIX_CONTEXT_SOURCES];
+    FLOAT32 af32Weights[MIX_CONTEXT_SOURCES];
+    FLOAT32 af32TargetWeights[MIX_CONTEXT_SOURCES];
+    UINT32 u32Done = 0;
+
+    while (u32Done < u32FrameCount)
+    {
+        UINT32 u32Active = 0;
+        UINT32 u32Frames = PlanMixSourceBlock(pContext->aSources, pContext->u32SourceCount,
+                                              u32FrameCount - u32Done, au32Active, &u32Active);
+        u32Frames = GetMixSourceFrames(pContext->aSources, au32Active, u32Active, u32Frames, u32Channels,
+                                       ConvertInt16Span<V>, pContext->af32MapScratch, apf32Sources);
+
+        for (UINT32 a = 0; a < u32Active; a++)
+        {
+            const MIX_SOURCE &source = pContext->aSources[au32Active[a]];
+            af32Weights[a] = source.f32Weight;
+            af32TargetWeights[a] = source.f32TargetWeight;
+        }
+
+        const size_t offset = static_cast<size_t>(u32Done) * u32Channels;
+
+        if constexpr (bRamp)
+        {
+            if (pContext->bChannelGains)
+            {
+                MixRampSpan<V, bSilentInput, true>(pf32Output + offset, pf32Input + offset, apf32Sources,
+                                                   af32Weights, af32TargetWeights, u32Active, u32Frames, u32Channels,
+                                                   pContext, pContext->u32RampPosition + u32Done);
+            }
+            else
+            {
+                MixRampSpan<V, bSilentInput, false>(pf32Output + offset, pf32Input + offset, apf32Sources,
+                                                    af32Weights, af32TargetWeights, u32Active, u32Frames, u32Channels,
+                                                    pContext, pContext->u32RampPosition + u32Done);
+            }
+        }
+        else if (pContext->bChannelGains)
+        {
+            MixGainSpan<V, bSilentInput>(pf32Output + offset, pf32Input + offset, apf32Sources,
+                                         af32Weights, u32Active, u32Frames * u32Channels, pContext);
+        }
+        else
+        {
+            MixSourcesSpan<V, bSilentInput>(pf32Output + offset, pf32Input + offset, apf32Sources,
+                                            af32Weights, u32Active, u32Frames * u32Channels,
+                                            pContext->f32InputWeight);
+        }
+
+        AdvanceMixSources(pContext->aSources, au32Active, u32Active, u32Frames);
+        u32Done += u32Frames;
+    }
+}
+
+//
+// C is the channel count, or 0 to read it from the context.  In place the
+// period is left as it is, flags included, so passing through costs nothing.
+// Otherwise silent input is zeroed in the output and stays silent.
+//
+template <class V, UINT32 C, bool bInPlace, bool bSilentInput>
+APO_BUFFER_FLAGS ProcessPassthrough(
+    MIX_CONTEXT    *pContext,
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    UINT32          u32FrameCount)
+{
+    // Starting to mix switches to the mix processor for the whole period
+    if (IsMixRequestPending(pContext) && ApplyMixRequest(pContext))
+    {
+        const PFN_MIX_PROCESS pfnProcess = pContext->pProcessor->pfnProcess[bSilentInput ? BUFFER_SILENT : BUFFER_VALID];
+        if (pfnProcess != &ProcessPassthrough<V, C, bInPlace, bSilentInput>)
+        {
+            return pfnProcess(pContext, pf32Output, pf32Input, u32FrameCount);
+        }
+    }
+
+    const UINT32 u32Channels = (C != 0) ? C : pContext->u32SamplesPerFrame;
+
+    if constexpr (bInPlace)
+    {
+        UNREFERENCED_PARAMETER(pf32Output);
+        UNREFERENCED_PARAMETER(pf32Input);
+        UNREFERENCED_PARAMETER(u32Channels);
+        return bSilentInput ? BUFFER_SILENT : BUFFER_VALID;
+    }
+    else if constexpr (bSilentInput)
+    {
+        UNREFERENCED_PARAMETER(pf32Input);
+        ZeroSpan<V>(pf32Output, u32FrameCount * u32Channels);
+        return BUFFER_SILENT;
+    }
+    else
+    {
+        CopySpan<V>(pf32Output, pf32Input, u32FrameCount * u32Channels);
+        return BUFFER_VALID;
+    }
+}
+
+//
+// Mixes the clips into a period.  A ramp in progress covers the first frames
+// of the period; once it ends the rest is mixed with the steady weights, and the
+// processor to settle on is installed for the next period.  Silent input is not
+// read: the output is the weighted clips alone, and if those are silent too the
+// period is zeroed and stays silent.
+//
+template <class V, UINT32 C, bool bSilentInput>
+APO_BUFFER_FLAGS ProcessMix(
+    MIX_CONTEXT    *pContext,
+    FLOAT32        *pf32Output,
+    const FLOAT32  *pf32Input,
+    UINT32          u32FrameCount)
+{
+    if (IsMixRequestPending(pContext) && ApplyMixRequest(pContext))
+    {
+        const PFN_MIX_PROCESS pfnProcess = pContext->pProcessor->pfnProcess[bSilentInput ? BUFFER_SILENT : BUFFER_VALID];
+        if (pfnProcess != &ProcessMix<V, C, bSilentInput>)
+        {
+            return pfnProcess(pContext, pf32Output, pf32Input, u32FrameCount);
+        }
+    }
+
+    const UINT32 u32Channels = (C != 0) ? C : pContext->u32SamplesPerFrame;
+    UINT32 u32Done = 0;
+
+    if constexpr (bSilentInput)
+    {
+        if (AreMixSourcesSilent(pContext->aSources, pContext->u32SourceCount, u32FrameCount))
+        {
+            ZeroSpan<V>(pf32Output, u32FrameCount * u32Channels);
+            SkipMixFrames(pContext, u32FrameCount);
+            return BUFFER_SILENT;
+        }
+    }
+
+    if (pContext->u32RampPosition < pContext->u32RampFrames)
+    {
+        u32Done = pContext->u32RampFrames - pContext->u32RampPosition;
+        if (u32Done > u32FrameCount)
+        {
+            u32Done = u32FrameCount;
+        }
+
+        MixSourceFrames<V, bSilentInput, true>(pContext, pf32Output, pf32Input, u32Done, u32Channels);
+
+        pContext->u32RampPosition += u32Done;
+        if (pContext->u32RampPosition == pContext->u32RampFrames)
+        {
+            FinishMixRamp(pContext);
+        }
+    }
+
+    if (u32Done < u32FrameCount)
+    {
+        const size_t offset = static_cast<size_t>(u32Done) * u32Channels;
+        MixSourceFrames<V, bSilentInput, false>(pContext, pf32Output + offset, pf32Input + offset,
+                                                u32FrameCount - u32Done, u32Channels);
+    }
+
+    return BUFFER_VALID;
+}
+
+// Largest magnitude of a span
+template <class V>
+FLOAT32 PeakSpan(
+    const FLOAT32  *pf32Input,
+    UINT32          u32SampleCount)
+{
+    typedef typename V::Vec Vec;
+
+    Vec vPeak = V::Set1(0.0f);
+    UINT32 i = 0;
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        vPeak = V::Max(vPeak, V::Abs(V::Load(pf32Input + i)));
+    }
+
+    FLOAT32 af32Lanes[V::Width];
+    V::Store(af32Lanes, vPeak);
+
+    FLOAT32 f32Peak = 0.0f;
+    for (UINT32 k = 0; k < V::Width; k++)
+    {
+        if (af32Lanes[k] > f32Peak)
+        {
+            f32Peak = af32Lanes[k];
+        }
+    }
+
+    for (; i < u32SampleCount; i++)
+    {
+        const FLOAT32 f32Magnitude = (pf32Input[i] < 0.0f) ? -pf32Input[i] : pf32Input[i];
+        if (f32Magnitude > f32Peak)
+        {
+            f32Peak = f32Magnitude;
+        }
+    }
+
+    return f32Peak;
+}
+
+//
+// Swaps a span of the period with the same span of the delay line, so the
+// period gets the delayed samples, scaled by the gains for bGain, and the delay
+// line keeps the new ones
+//
+template <class V, bool bGain>
+void DelaySpan(
+    FLOAT32        *pf32Frames,
+    FLOAT32        *pf32Delay,
+    const FLOAT32  *pf32Gains,
+    UINT32          u32SampleCount)
+{
+    typedef typename V::Vec Vec;
+
+    UINT32 i = 0;
+
+    for (; i + V::Width <= u32SampleCount; i += V::Width)
+    {
+        const Vec vNew = V::Load(pf32Frames + i);
+        Vec vDelayed = V::Load(pf32Delay + i);
+        if constexpr (bGain)
+        {
+            vDelayed = V::Mul(vDelayed, V::Load(pf32Gains + i));
+        }
+        V::Store(pf32Frames + i, vDelayed);
+        V::Store(pf32Delay + i, vNew);
+    }
+
+    for (; i < u32SampleCount; i++)
+    {
+        const FLOAT32 f32New = pf32Frames[i];
+        pf32Frames[i] = bGain ? pf32Delay[i] * pf32Gains[i] : pf32Delay[i];
+        pf32Delay[i] = f32New;
+    }
+
+    if constexpr (!bGain)
+    {
+        UNREFERENCED_PARAMETER(pf32Gains);
+    }
+}
+
+// Runs whole frames of the period through the delay line, splitting them where it wraps
+template <class V, bool bGain>
+void DelayLimiterFrames(
+    MIX_LIMITER    *pLimiter,
+    FLOAT32        *pf32Frames,
+    const FLOAT32  *pf32Gains,
+    UINT32          u32SampleCount)
+{
+    const UINT32 u32DelaySamples = pLimiter->u32LookaheadFrames * pLimiter->u32Channels;
+    UINT32 u32Done = 0;
+
+    while (u32Done < u32SampleCount)
+    {
+        UINT32 u32Count = u32DelaySamples - pLimiter->u32DelayPosition;
+        if (u32Count > u32SampleCount - u32Done)
+        {
+            u32Count = u32SampleCount - u32Done;
+        }
+
+        DelaySpan<V, bGain>(pf32Frames + u32Done, pLimiter->pf32Delay + pLimiter->u32DelayPosition,
+                            bGain ? pf32Gains + u32Done : nullptr, u32Count);
+
+        pLimiter->u32DelayPosition += u32Count;
+        if (pLimiter->u32DelayPosition == u32DelaySamples)
+        {
+            pLimiter->u32DelayPosition = 0;
+        }
+        u32Done += u32Count;
+    }
+}
+
+//
+// Lookahead limiter after the mix, see MIX_LIMITER.  While the gain is at unity
+// and no sample of the period is above the ceiling, which is nearly always, the
+// period costs a vector peak scan and a pass through the delay line.  Otherwise
+// the gains are worked out frame by frame in blocks, spread over the samples of
+// each block and applied in a vector pass.
+//
+template <class V>
+APO_BUFFER_FLAGS LimitFrames(
+    MIX_LIMITER        *pLimiter,
+    FLOAT32            *pf32Frames,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags)
+{
+    const UINT32 u32Channels = pLimiter->u32Channels;
+    const UINT32 u32SampleCount = u32FrameCount * u32Channels;
+
+    if (flags == BUFFER_SILENT)
+    {
+        if (pLimiter->u32QuietFrames >= pLimiter->u32LookaheadFrames)
+        {
+            SkipMixLimiterGains(pLimiter, u32FrameCount, 0.0f);
+            return BUFFER_SILENT;
+        }
+
+        // The tail of the mix is still in the delay line
+        ZeroSpan<V>(pf32Frames, u32SampleCount);
+        flags = BUFFER_VALID;
+    }
+
+    if (pLimiter->u32UnityFrames > pLimiter->u32LookaheadFrames)
+    {
+        const FLOAT32 f32Peak = PeakSpan<V>(pf32Frames, u32SampleCount);
+        if (f32Peak <= pLimiter->f32Ceiling)
+        {
+            DelayLimiterFrames<V, false>(pLimiter, pf32Frames, nullptr, u32SampleCount);
+            SkipMixLimiterGains(pLimiter, u32FrameCount, f32Peak);
+            return flags;
+        }
+    }
+
+    for (UINT32 u32Done = 0; u32Done < u32FrameCount; )
+    {
+        UINT32 u32Frames = u32FrameCount - u32Done;
+        if (u32Frames > pLimiter->u32BlockFrames)
+        {
+            u32Frames = pLimiter->u32BlockFrames;
+        }
+
+        FLOAT32 *pf32Block = pf32Frames + static_cast<size_t>(u32Done) * u32Channels;
+        UpdateMixLimiterGains(pLimiter, pf32Block, u32Frames);
+
+        FLOAT32 *pf32Gains = pLimiter->af32SampleGains;
+        for (UINT32 f = 0; f < u32Frames; f++)
+        {
+            const FLOAT32 f32Gain = pLimiter->af32FrameGains[f];
+            for (UINT32 c = 0; c < u32Channels; c++)
+            {
+                *pf32Gains++ = f32Gain;
+            }
+        }
+
+        DelayLimiterFrames<V, true>(pLimiter, pf32Block, pLimiter->af32SampleGains, u32Frames * u32Channels);
+        u32Done += u32Frames;
+    }
+
+    return flags;
+}
+
+// Magnitude of the most negative fixed point sample, 2^(bits - 1)
+template <MIX_SAMPLE_FORMAT F>
+constexpr FLOAT32 GetFormatScale()
+{
+    return (F == MIX_SAMPLE_INT16) ? 32768.0f : (F == MIX_SAMPLE_INT24) ? 8388608.0f : 2147483648.0f;
+}
+
+// Largest float that converts to a fixed point sample without overflowing
+template <MIX_SAMPLE_FORMAT F>
+constexpr FLOAT32 GetFormatHigh()
+{
+    return (F == MIX_SAMPLE_INT16) ? 32767.0f : (F == MIX_SAMPLE_INT24) ? 8388607.0f : 2147483520.0f;
+}
+
+template <MIX_SAMPLE_FORMAT F>
+constexpr size_t GetFormatBytes()
+{
+    return (F == MIX_SAMPLE_INT16) ? 2 : (F == MIX_SAMPLE_INT24) ? 3 : 4;
+}
+
+// Sign extends a packed little endian 24 bit sample
+inline INT32 UnpackInt24(const BYTE *pb)
+{
+    const UINT32 u32 = (static_cast<UINT32>(pb[0]) << 8) | (static_cast<UINT32>(pb[1]) << 16) |
+                       (static_cast<UINT32>(pb[2]) << 24);
+    return static_cast<INT32>(u32) >> 8;
+}
+
+// Integer a fixed point sample is rounded to, 24 bit samples are packed afterwards
+template <MIX_SAMPLE_FORMAT F>
+struct FormatSample
+{
+    typedef INT32 Type;
+};
+
+template <>
+struct FormatSample<MIX_SAMPLE_INT16>
+{
+    typedef INT16 Type;
+};
+
+inline void PackInt24(BYTE *pb, INT32 i32)
+{
+    pb[0] = static_cast<BYTE>(i32);
+    pb[1] = static_cast<BYTE>(i32 >> 8);
+    pb[2] = static_cast<BYTE>(i32 >> 16);
+}
+
+inline void ZeroBytes(BYTE *pb, size_t cb)
+{
+    for (size_t i = 0; i < cb; i++)
+    {
+        pb[i] = 0;
+    }
+}
+
+inline void CopyBytes(BYTE *pbOutput, const BYTE *pbInput, size_t cb)
+{
+    for (size_t i = 0; i < cb; i++)
+    {
+        pbOutput[i] = pbInput[i];
+    }
+}
+
+// Converts fixed point samples to floats in [-1, 1)
+template <class V, MIX_SAMPLE_FORMAT F>
+void ConvertFromFormat(
+    FLOAT32        *pf32Output,
+    const BYTE     *pbInput,
+    UINT32          u32SampleCount)
+{
+    if constexpr (F == MIX_SAMPLE_INT16)
+    {
+        ConvertInt16Span<V>(pf32Output, reinterpret_cast<const INT16*>(pbInput), u32SampleCount);
+    }
+    else
+    {
+        const FLOAT32 f32Scale = 1.0f / GetFormatScale<F>();
+        const typename V::Vec vScale = V::Set1(f32Scale);
+        const INT32 *pi32Input = reinterpret_cast<const INT32*>(pbInput);
+        UINT32 i = 0;
+
+        for (; i + V::Width <= u32SampleCount; i += V::Width)
+        {
+            if constexpr (F == MIX_SAMPLE_INT24)
+            {
+                INT32 ai32Unpacked[V::Width];
+                for (UINT32 k = 0; k < V::Width; k++)
+                {
+                    ai32Unpacked[k] = UnpackInt24(pbInput + 3 * static_cast<size_t>(i + k));
+                }
+                V::Store(pf32Output + i, V::Mul(V::LoadInt32(ai32Unpacked), vScale));
+            }
+            else
+            {
+                V::Store(pf32Output + i, V::Mul(V::LoadInt32(pi32Input + i), vScale));
+            }
+        }
+
+        for (; i < u32SampleCount; i++)
+        {
+            const INT32 i32 = (F == MIX_SAMPLE_INT24) ? UnpackInt24(pbInput + 3 * static_cast<size_t>(i)) : pi32Input[i];
+            pf32Output[i] = static_cast<FLOAT32>(i32) * f32Scale;
+        }
+    }
+}
+
+//
+// Converts the PCM samples of a WAV file to floats in [-1, 1).  8 and 24 bit
+// samples are widened to 32 bits a block at a time and converted from there,
+// which keeps the scalar unpacking out of the vector loop.  16 and 32 bit ones off
+// their alignment go through an aligned copy, as the scalar kernels read them as
+// their type.
+//
+template <class V>
+void ConvertPcmSpan(
+    FLOAT32        *pf32Output,
+    const BYTE     *pbInput,
+    UINT32          u32SampleCount,
+    UINT32          u32BytesPerSample)
+{
+    const bool bWide = (u32BytesPerSample == 2 || u32BytesPerSample == 4);
+    if (bWide && reinterpret_cast<uintptr_t>(pbInput) % u32BytesPerSample == 0)
+    {
+        if (u32BytesPerSample == 2)
+        {
+            ConvertFromFormat<V, MIX_SAMPLE_INT16>(pf32Output, pbInput, u32SampleCount);
+        }
+        else
+        {
+            ConvertFromFormat<V, MIX_SAMPLE_INT32>(pf32Output, pbInput, u32SampleCount);
+        }
+        return;
+    }
+
+    const UINT32 u32BlockSamples = 256;
+    INT32 ai32Block[u32BlockSamples];
+    const FLOAT32 f32Scale = (u32BytesPerSample == 1) ? 1.0f / 128.0f : 1.0f / GetFormatScale<MIX_SAMPLE_INT24>();
+    const typename V::Vec vScale = V::Set1(f32Scale);
+
+    for (UINT32 first = 0; first < u32SampleCount; first += u32BlockSamples)
+    {
+        const UINT32 u32Block = (u32SampleCount - first < u32BlockSamples) ? u32SampleCount - first : u32BlockSamples;
+        const BYTE *pbBlock = pbInput + static_cast<size_t>(first) * u32BytesPerSample;
+        FLOAT32 *pf32Block = pf32Output + first;
+
+        if (bWide)
+        {
+            CopyBytes(reinterpret_cast<BYTE*>(ai32Block), pbBlock, static_cast<size_t>(u32Block) * u32BytesPerSample);
+            if (u32BytesPerSample == 2)
+            {
+                ConvertFromFormat<V, MIX_SAMPLE_INT16>(pf32Block, reinterpret_cast<const BYTE*>(ai32Block), u32Block);
+            }
+            else
+            {
+                ConvertFromFormat<V, MIX_SAMPLE_INT32>(pf32Block, reinterpret_cast<const BYTE*>(ai32Block), u32Block);
+            }
+            continue;
+        }
+
+        if (u32BytesPerSample == 1)
+        {
+            for (UINT32 i = 0; i < u32Block; i++)
+            {
+                ai32Block[i] = static_cast<INT32>(pbBlock[i]) - 128;
+            }
+        }
+        else
+        {
+            for (UINT32 i = 0; i < u32Block; i++)
+            {
+                ai32Block[i] = UnpackInt24(pbBlock + 3 * static_cast<size_t>(i));
+            }
+        }
+
+        UINT32 i = 0;
+        for (; i + V::Width <= u32Block; i += V::Width)
+        {
+            V::Store(pf32Block + i, V::Mul(V::LoadInt32(ai32Block + i), vScale));
+        }
+
+        for (; i < u32Block; i++)
+        {
+            pf32Block[i] = static_cast<FLOAT32>(ai32Block[i]) * f32Scale;
+        }
+    }
+}
+
+//
+// Converts floats to fixed point samples, rounded to nearest and clipped to the
+// range of the format.  The samples go in rows of MIX_DITHER_LANES, a short last
+// row through a padded copy, so every sample of a row is dithered by the same
+// generator whatever the vector width.
+//
+template <class V, MIX_SAMPLE_FORMAT F, bool bDither>
+void ConvertToFormat(
+    MIX_FORMAT     *pFormat,
+    BYTE           *pbOutput,
+    const FLOAT32  *pf32Input,
+    UINT32          u32SampleCount)
+{
+    typedef typename FormatSample<F>::Type SAMPLE;
+
+    // Only the dither generators are read
+    UNREFERENCED_PARAMETER(pFormat);
+
+    const typename V::Vec vScale = V::Set1(GetFormatScale<F>());
+    const typename V::Vec vLow = V::Set1(-GetFormatScale<F>());
+    const typename V::Vec vHigh = V::Set1(GetFormatHigh<F>());
+    SAMPLE *pOutput = reinterpret_cast<SAMPLE*>(pbOutput);
+    FLOAT32 af32Row[MIX_DITHER_LANES];
+    SAMPLE aRow[MIX_DITHER_LANES];
+
+    for (UINT32 i = 0; i < u32SampleCount; i += MIX_DITHER_LANES)
+    {
+        const UINT32 u32Row = (u32SampleCount - i < MIX_DITHER_LANES) ? u32SampleCount - i : MIX_DITHER_LANES;
+        const FLOAT32 *pf32Row = pf32Input + i;
+        if (u32Row < MIX_DITHER_LANES)
+        {
+            for (UINT32 k = 0; k < MIX_DITHER_LANES; k++)
+            {
+                af32Row[k] = (k < u32Row) ? pf32Row[k] : 0.0f;
+            }
+            pf32Row = af32Row;
+        }
+
+        // Whole rows of 16 and 32 bit samples are stored in place, the others go through aRow
+        const bool bDirect = (F != MIX_SAMPLE_INT24) && (u32Row == MIX_DITHER_LANES);
+        SAMPLE *pRow = bDirect ? pOutput + i : aRow;
+
+        for (UINT32 k = 0; k < MIX_DITHER_LANES; k += V::Width)
+        {
+            typename V::Vec v = V::Mul(V::Load(pf32Row + k), vScale);
+            if constexpr (bDither)
+            {
+                v = V::Add(v, V::Dither(pFormat->au32DitherState + k));
+            }
+            v = V::Min(V::Max(v, vLow), vHigh);
+
+            if constexpr (F == MIX_SAMPLE_INT16)
+            {
+                V::StoreInt16(pRow + k, v);
+            }
+            else
+            {
+                V::StoreInt32(pRow + k, v);
+            }
+        }
+
+        if constexpr (F == MIX_SAMPLE_INT24)
+        {
+            for (UINT32 k = 0; k < u32Row; k++)
+            {
+                PackInt24(pbOutput + 3 * static_cast<size_t>(i + k), aRow[k]);
+            }
+        }
+        else if (!bDirect)
+        {
+            for (UINT32 k = 0; k < u32Row; k++)
+            {
+                pOutput[i + k] = aRow[k];
+            }
+        }
+    }
+}
+
+//
+// Processes a period of fixed point samples block by block, see PFN_MIX_PROCESS_FORMAT.
+// Output blocks the processor leaves silent are zeroed once an earlier or later
+// block of the period is not.  bLimit must match a lookahead of the limiter.
+//
+template <class V, MIX_SAMPLE_FORMAT F, bool bLimit>
+APO_BUFFER_FLAGS ProcessFormatFrames(
+    MIX_FORMAT         *pFormat,
+    MIX_CONTEXT        *pContext,
+    MIX_LIMITER        *pLimiter,
+    BYTE               *pbOutput,
+    const BYTE         *pbInput,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags)
+{
+    const size_t frameBytes = GetFormatBytes<F>() * pFormat->u32Channels;
+
+    // Converting would only add dither to a period passed through as it is
+    if (!bLimit && pContext->pProcessor == pContext->pPassthroughProcessor && !IsMixRequestPending(pContext))
+    {
+        if (pbOutput != pbInput)
+        {
+            if (flags == BUFFER_VALID)
+            {
+                CopyBytes(pbOutput, pbInput, u32FrameCount * frameBytes);
+            }
+            else
+            {
+                ZeroBytes(pbOutput, u32FrameCount * frameBytes);
+            }
+        }
+        return (flags == BUFFER_VALID) ? BUFFER_VALID : BUFFER_SILENT;
+    }
+
+    FLOAT32 *pf32Block = pFormat->af32Block;
+    bool bValid = false;
+
+    for (UINT32 u32Done = 0; u32Done < u32FrameCount; )
+    {
+        UINT32 u32Frames = u32FrameCount - u32Done;
+        if (u32Frames > pFormat->u32BlockFrames)
+        {
+            u32Frames = pFormat->u32BlockFrames;
+        }
+
+        const UINT32 u32SampleCount = u32Frames * pFormat->u32Channels;
+        const size_t offset = u32Done * frameBytes;
+
+        if (flags == BUFFER_VALID)
+        {
+            ConvertFromFormat<V, F>(pf32Block, pbInput + offset, u32SampleCount);
+        }
+
+        // The processor may pick up a request and switch within the block
+        const bool bPassthrough = (pContext->pProcessor == pContext->pPassthroughProcessor);
+        APO_BUFFER_FLAGS blockFlags = pContext->pProcessor->pfnProcess[flags](pContext, pf32Block, pf32Block, u32Frames);
+        if (bLimit)
+        {
+            blockFlags = LimitFrames<V>(pLimiter, pf32Block, u32Frames, blockFlags);
+        }
+
+        if (blockFlags == BUFFER_VALID)
+        {
+            if (!bValid)
+            {
+                ZeroBytes(pbOutput, offset);
+                bValid = true;
+            }
+
+            // Input samples that come out at unity gain are already on the grid of the format
+            const bool bExact = bPassthrough && (pContext->pProcessor == pContext->pPassthroughProcessor) &&
+                (!bLimit || pLimiter->u32UnityFrames >= pLimiter->u32LookaheadFrames + u32Frames);
+
+            if constexpr (F != MIX_SAMPLE_INT32)
+            {
+                if (pFormat->bDither && !bExact)
+                {
+                    ConvertToFormat<V, F, true>(pFormat, pbOutput + offset, pf32Block, u32SampleCount);
+                }
+                else
+                {
+                    ConvertToFormat<V, F, false>(pFormat, pbOutput + offset, pf32Block, u32SampleCount);
+                }
+            }
+            else
+            {
+                UNREFERENCED_PARAMETER(bExact);
+                ConvertToFormat<V, F, false>(pFormat, pbOutput + offset, pf32Block, u32SampleCount);
+            }
+        }
+        else if (bValid)
+        {
+            ZeroBytes(pbOutput + offset, u32Frames * frameBytes);
+        }
+
+        u32Done += u32Frames;
+    }
+
+    if (!bValid && pbOutput != pbInput)
+    {
+        ZeroBytes(pbOutput, u32FrameCount * frameBytes);
+    }
+    return bValid ? BUFFER_VALID : BUFFER_SILENT;
+}
+
+//
+// Float periods need no conversion and are processed where they are
+//
+template <class V, bool bLimit>
+APO_BUFFER_FLAGS ProcessFloatFrames(
+    MIX_FORMAT         *pFormat,
+    MIX_CONTEXT        *pContext,
+    MIX_LIMITER        *pLimiter,
+    BYTE               *pbOutput,
+    const BYTE         *pbInput,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags)
+{
+    UNREFERENCED_PARAMETER(pFormat);
+
+    FLOAT32 *pf32Output = reinterpret_cast<FLOAT32*>(pbOutput);
+    flags = pContext->pProcessor->pfnProcess[flags](
+        pContext, pf32Output, reinterpret_cast<const FLOAT32*>(pbInput), u32FrameCount);
+    if (bLimit)
+    {
+        flags = LimitFrames<V>(pLimiter, pf32Output, u32FrameCount, flags);
+    }
+    return flags;
+}
+
+template <class V, bool bLimit>
+APO_BUFFER_FLAGS ProcessPeriod(
+    MIX_FORMAT         *pFormat,
+    MIX_CONTEXT        *pContext,
+    MIX_LIMITER        *pLimiter,
+    BYTE               *pbOutput,
+    const BYTE         *pbInput,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags)
+{
+    switch (pFormat->format)
+    {
+    case MIX_SAMPLE_INT16:
+        return ProcessFormatFrames<V, MIX_SAMPLE_INT16, bLimit>(pFormat, pContext, pLimiter, pbOutput, pbInput, u32FrameCount, flags);
+    case MIX_SAMPLE_INT24:
+        return ProcessFormatFrames<V, MIX_SAMPLE_INT24, bLimit>(pFormat, pContext, pLimiter, pbOutput, pbInput, u32FrameCount, flags);
+    case MIX_SAMPLE_INT32:
+        return ProcessFormatFrames<V, MIX_SAMPLE_INT32, bLimit>(pFormat, pContext, pLimiter, pbOutput, pbInput, u32FrameCount, flags);
+    default:
+        return ProcessFloatFrames<V, bLimit>(pFormat, pContext, pLimiter, pbOutput, pbInput, u32FrameCount, flags);
+    }
+}
+
+template <class V>
+APO_BUFFER_FLAGS ProcessFormat(
+    MIX_FORMAT         *pFormat,
+    MIX_CONTEXT        *pContext,
+    MIX_LIMITER        *pLimiter,
+    BYTE               *pbOutput,
+    const BYTE         *pbInput,
+    UINT32              u32FrameCount,
+    APO_BUFFER_FLAGS    flags)
+{
+    return (pLimiter->u32LookaheadFrames != 0) ?
+        ProcessPeriod<V, true>(pFormat, pContext, pLimiter, pbOutput, pbInput, u32FrameCount, flags) :
+        ProcessPeriod<V, false>(pFormat, pContext, pLimiter, pbOutput, pbInput, u32FrameCount, flags);
+}
+
+//
+// Stereo frames are split into the two planes a vector pair at a time by the
+// Deinterleave2 shuffle, other layouts go channel by channel with a stride.  Only
+// samples are moved, so every instruction set gives the same planes.
+//
+template <class V>
+void DeinterleaveFrames(
+    FLOAT32 *const     *ppf32Planes,
+    const FLOAT32      *pf32Frames,
+    UINT32              u32FrameCount,
+    UINT32              u32Channels)
+{
+    if (u32Channels == 2)
+    {
+        FLOAT32 *pf32Left = ppf32Planes[0];
+        FLOAT32 *pf32Right = ppf32Planes[1];
+        UINT32 i = 0;
+
+        for (; i + V::Width <= u32FrameCount; i += V::Width)
+        {
+            typename V::Vec vLeft;
+            typename V::Vec vRight;
+            V::Deinterleave2(V::Load(pf32Frames + 2 * i), V::Load(pf32Frames + 2 * i + V::Width), &vLeft, &vRight);
+            V::Store(pf32Left + i, vLeft);
+            V::Store(pf32Right + i, vRight);
+        }
+
+        for (; i < u32FrameCount; i++)
+        {
+            pf32Left[i] = pf32Frames[2 * i];
+            pf32Right[i] = pf32Frames[2 * i + 1];
+        }
+        return;
+    }
+
+    for (UINT32 c = 0; c < u32Channels; c++)
+    {
+        FLOAT32 *pf32Plane = ppf32Planes[c];
+        const FLOAT32 *pf32Sample = pf32Frames + c;
+        for (UINT32 i = 0; i < u32FrameCount; i++, pf32Sample += u32Channels)
+        {
+            pf32Plane[i] = *pf32Sample;
+        }
+    }
+}
+
+//
+// Sum of u32TapCount taps times input samples.  The products go into the lanes of
+// MIX_RAMP_VECTOR_WIDTH / V::Width vectors, which are added up pairwise, half the
+// lanes onto the other half, so the order of the additions is the same for every
+// vector width.  The halves that are whole vectors are added as vectors.
+//
+template <class V>
+FLOAT32 SumResampleTaps(
+    const FLOAT32      *pf32Taps,
+    const FLOAT32      *pf32Input,
+    UINT32              u32TapCount)
+{
+    typedef typename V::Vec Vec;
+    const UINT32 c_u32Vectors = MIX_RAMP_VECTOR_WIDTH / V::Width;
+
+    Vec avSum[c_u32Vectors];
+    for (UINT32 j = 0; j < c_u32Vectors; j++)
+    {
+        avSum[j] = V::Set1(0.0f);
+    }
+
+    for (UINT32 k = 0; k < u32TapCount; k += MIX_RAMP_VECTOR_WIDTH)
+    {
+        for (UINT32 j = 0; j < c_u32Vectors; j++)
+        {
+            const UINT32 u32Tap = k + j * V::Width;
+            avSum[j] = V::Add(avSum[j], V::Mul(V::Load(pf32Taps + u32Tap), V::Load(pf32Input + u32Tap)));
+        }
+    }
+
+    for (UINT32 h = c_u32Vectors / 2; h > 0; h /= 2)
+    {
+        for (UINT32 j = 0; j < h; j++)
+        {
+            avSum[j] = V::Add(avSum[j], avSum[j + h]);
+        }
+    }
+
+    FLOAT32 af32Lanes[V::Width];
+    V::Store(af32Lanes, avSum[0]);
+    for (UINT32 w = V::Width / 2; w > 0; w /= 2)
+    {
+        for (UINT32 i = 0; i < w; i++)
+        {
+            af32Lanes[i] = af32Lanes[i] + af32Lanes[i + w];
+        }
+    }
+    return af32Lanes[0];
+}
+
+//
+// The rows of the taps are shared by the channels of a frame, which are summed
+// one after the other while the rows are in the cache.  Between two rows the sums
+// of both are interpolated, at a row the second one is skipped.
+//
+template <class V>
+UINT32 ResampleFrames(
+    const MIX_RESAMPLER    *pResampler,
+    MIX_RESAMPLE_POSITION  *pPosition,
+    FLOAT32                *pf32Output,
+    UINT32                  u32OutputFrames,
+    const FLOAT32 *const   *ppf32Planes,
+    UINT32                  u32InputFrames,
+    UINT32                  u32Channels)
+{
+    const UINT32 u32TapCount = pResampler->u32TapCount;
+    UINT32 u32Frame = pPosition->u32Frame;
+    UINT32 u32Phase = pPosition->u32Phase;
+    UINT32 u32Fraction = pPosition->u32Fraction;
+
+    UINT32 n = 0;
+    for (; n < u32OutputFrames && u32Frame < u32InputFrames && u32InputFrames - u32Frame >= u32TapCount; n++)
+    {
+        const FLOAT32 *pf32Taps = pResampler->pf32Taps + static_cast<size_t>(u32Phase) * u32TapCount;
+        const FLOAT32 f32Fraction = static_cast<FLOAT32>(u32Fraction) * pResampler->f32FractionScale;
+
+        for (UINT32 c = 0; c < u32Channels; c++)
+        {
+            FLOAT32 f32Sample = SumResampleTaps<V>(pf32Taps, ppf32Planes[c] + u32Frame, u32TapCount);
+            if (u32Fraction != 0)
+            {
+                const FLOAT32 f32Next = SumResampleTaps<V>(pf32Taps + u32TapCount, ppf32Planes[c] + u32Frame, u32TapCount);
+                f32Sample = f32Sample + (f32Next - f32Sample) * f32Fraction;
+            }
+            pf32Output[static_cast<size_t>(n) * u32Channels + c] = f32Sample;
+        }
+
+        u32Frame += pResampler->u32StepFrames;
+        u32Phase += pResampler->u32StepPhases;
+        u32Fraction += pResampler->u32StepFraction;
+        if (u32Fraction >= pResampler->u32Up)
+        {
+            u32Fraction -= pResampler->u32Up;
+            u32Phase++;
+        }
+        if (u32Phase >= pResampler->u32Phases)
+        {
+            u32Phase -= pResampler->u32Phases;
+            u32Frame++;
+        }
+    }
+
+    pPosition->u32Frame = u32Frame;
+    pPosition->u32Phase = u32Phase;
+    pPosition->u32Fraction = u32Fraction;
+    return n;
+}
+
+template <class V, UINT32 C>
+constexpr MIX_CHANNEL_PROCESSORS MakeChannelProcessors()
+{
+    // Entries follow MIX_STATE, each indexed by BUFFER_INVALID, BUFFER_VALID and BUFFER_SILENT
+    return MIX_CHANNEL_PROCESSORS{ {
+        { { ProcessInvalid, ProcessPassthrough<V, C, false, false>, ProcessPassthrough<V, C, false, true> } },
+        { { ProcessInvalid, ProcessPassthrough<V, C, true, false>,  ProcessPassthrough<V, C, true, true> } },
+        { { ProcessInvalid, ProcessMix<V, C, false>,                ProcessMix<V, C, true> } },
+        { { ProcessInvalid, ProcessMix<V, C, false>,                ProcessMix<V, C, true> } },
+    } };
+}
+
+template <class V>
+constexpr MIX_KERNELS MakeMixKernels(MIX_ISA isa, const char *pszName)
+{
+    // Entries follow MIX_CHANNELS
+    return MIX_KERNELS{ isa, pszName, MixSpan<V>, MixSourcesSpan<V, false>, ConvertInt16Span<V>, ConvertPcmSpan<V>,
+                        LimitFrames<V>, ProcessFormat<V>, {
+        // Entries follow MIX_SAMPLE_FORMAT, each without and with the limiter
+        { ProcessFloatFrames<V, false>,                         ProcessFloatFrames<V, true> },
+        { ProcessFormatFrames<V, MIX_SAMPLE_INT16, false>,      ProcessFormatFrames<V, MIX_SAMPLE_INT16, true> },
+        { ProcessFormatFrames<V, MIX_SAMPLE_INT24, false>,      ProcessFormatFrames<V, MIX_SAMPLE_INT24, true> },
+        { ProcessFormatFrames<V, MIX_SAMPLE_INT32, false>,      ProcessFormatFrames<V, MIX_SAMPLE_INT32, true> },
+    }, DeinterleaveFrames<V>, ResampleFrames<V>, {
+        MakeChannelProcessors<V, 1>(),
+        MakeChannelProcessors<V, 2>(),
+        MakeChannelProcessors<V, 4>(),
+        MakeChannelProcessors<V, 6>(),
+        MakeChannelProcessors<V, 8>(),
+        MakeChannelProcessors<V, 0>(),
+    } };
+}
+
+} // namespace
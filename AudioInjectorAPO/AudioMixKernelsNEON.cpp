@@ -0,0 +1,63 @@
+//
+// AudioMixKernelsNEON.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  NEON instantiation of the mix kernels (ARM64 baseline).  Multiplies and adds
+//  are kept separate (no vmlaq/vfmaq) to stay bit compatible with the scalar
+//  kernels.
+//
+
+#include "AudioMixKernels.h"
+
+#if defined(MIX_KERNELS_ARM64)
+
+#include <arm_neon.h>
+
+#include "AudioMixKernelsImpl.h"
+
+namespace
+{
+
+struct MixVecNEON
+{
+    typedef float32x4_t Vec;
+    static const UINT32 Width = 4;
+
+    static Vec  Load(const FLOAT32 *p)      { return vld1q_f32(p); }
+    static void Store(FLOAT32 *p, Vec v)    { vst1q_f32(p, v); }
+    static Vec  Set1(FLOAT32 f)             { return vdupq_n_f32(f); }
+    static Vec  Add(Vec a, Vec b)           { return vaddq_f32(a, b); }
+    static Vec  Mul(Vec a, Vec b)           { return vmulq_f32(a, b); }
+    static Vec  Max(Vec a, Vec b)           { return vmaxq_f32(a, b); }
+    static Vec  Abs(Vec a)                  { return vabsq_f32(a); }
+    static Vec  Min(Vec a, Vec b)           { return vminq_f32(a, b); }
+    static Vec  LoadInt16(const INT16 *p)   { return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))); }
+    static Vec  LoadInt32(const INT32 *p)   { return vcvtq_f32_s32(vld1q_s32(p)); }
+    static void StoreInt16(INT16 *p, Vec v) { vst1_s16(p, vqmovn_s32(vcvtnq_s32_f32(v))); }
+    static void StoreInt32(INT32 *p, Vec v) { vst1q_s32(p, vcvtnq_s32_f32(v)); }
+    static void Deinterleave2(Vec a, Vec b, Vec *pEven, Vec *pOdd)
+    {
+        const float32x4x2_t v = vuzpq_f32(a, b);
+        *pEven = v.val[0];
+        *pOdd = v.val[1];
+    }
+    static Vec  Dither(UINT32 *p)
+    {
+        uint32x4_t x = vld1q_u32(p);
+        x = veorq_u32(x, vshlq_n_u32(x, 13));
+        x = veorq_u32(x, vshrq_n_u32(x, 17));
+        x = veorq_u32(x, vshlq_n_u32(x, 5));
+        vst1q_u32(p, x);
+
+        const int32x4_t d = vsubq_s32(vreinterpretq_s32_u32(vandq_u32(x, vdupq_n_u32(0xFFFF))),
+                                      vreinterpretq_s32_u32(vshrq_n_u32(x, 16)));
+        return vmulq_f32(vcvtq_f32_s32(d), vdupq_n_f32(1.0f / 65536.0f));
+    }
+};
+
+} // namespace
+
+const MIX_KERNELS g_MixKernelsNEON = MakeMixKernels<MixVecNEON>(MIX_ISA_NEON, "NEON");
+
+#endif // MIX_KERNELS_ARM64
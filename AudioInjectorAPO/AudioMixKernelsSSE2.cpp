@@ -0,0 +1,74 @@
+//
+// AudioMixKernelsSSE2.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  SSE2 instantiation of the mix kernels (x64 baseline)
+//
+
+#include "AudioMixKernels.h"
+
+#if defined(MIX_KERNELS_X64)
+
+#include <emmintrin.h>
+
+#include "AudioMixKernelsImpl.h"
+
+namespace
+{
+
+struct MixVecSSE2
+{
+    typedef __m128 Vec;
+    static const UINT32 Width = 4;
+
+    static Vec  Load(const FLOAT32 *p)      { return _mm_loadu_ps(p); }
+    static void Store(FLOAT32 *p, Vec v)    { _mm_storeu_ps(p, v); }
+    static Vec  Set1(FLOAT32 f)             { return _mm_set1_ps(f); }
+    static Vec  Add(Vec a, Vec b)           { return _mm_add_ps(a, b); }
+    static Vec  Mul(Vec a, Vec b)           { return _mm_mul_ps(a, b); }
+    static Vec  Max(Vec a, Vec b)           { return _mm_max_ps(a, b); }
+    static Vec  Abs(Vec a)                  { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static Vec  Min(Vec a, Vec b)           { return _mm_min_ps(a, b); }
+    static Vec  LoadInt16(const INT16 *p)
+    {
+        // Sign extend by moving every sample to the upper half of a 32 bit lane
+        const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+        return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    }
+    static Vec  LoadInt32(const INT32 *p)
+    {
+        return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    }
+    static void StoreInt16(INT16 *p, Vec v)
+    {
+        const __m128i i = _mm_cvtps_epi32(v);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(i, i));
+    }
+    static void StoreInt32(INT32 *p, Vec v)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvtps_epi32(v));
+    }
+    static void Deinterleave2(Vec a, Vec b, Vec *pEven, Vec *pOdd)
+    {
+        *pEven = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        *pOdd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    static Vec  Dither(UINT32 *p)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+        x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), x);
+
+        const __m128i d = _mm_sub_epi32(_mm_and_si128(x, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(x, 16));
+        return _mm_mul_ps(_mm_cvtepi32_ps(d), _mm_set1_ps(1.0f / 65536.0f));
+    }
+};
+
+} // namespace
+
+const MIX_KERNELS g_MixKernelsSSE2 = MakeMixKernels<MixVecSSE2>(MIX_ISA_SSE2, "SSE2");
+
+#endif // MIX_KERNELS_X64
@@ -16,92 +16,898 @@
 #include "AudioFileReader.h"
 
 #pragma AVRT_CODE_BEGIN
-void ProcessAudioMix(
-    _Out_writes_(u32ValidFrameCount * u32SamplesPerFrame)
-        FLOAT32 *pf32OutputFrames,
-    _In_reads_(u32ValidFrameCount * u32SamplesPerFrame)
-        const FLOAT32 *pf32InputFrames,
-    UINT32       u32ValidFrameCount,
-    UINT32       u32SamplesPerFrame,
-    _In_reads_opt_(u32FileFrameCount * u32SamplesPerFrame)
-        const FLOAT32 *pf32FileBuffer,
-    UINT32       u32FileFrameCount,
-    _Inout_
-        UINT32  *pu32FileIndex,
-    FLOAT32     fMixRatio)
+void WriteSilence(
+    _Out_writes_(u32FrameCount * u32SamplesPerFrame)
+        FLOAT32 *pf32Frames,
+    UINT32 u32FrameCount,
+    UINT32 u32SamplesPerFrame )
 {
-    ASSERT_REALTIME();
-    ATLASSERT(IS_VALID_TYPED_READ_POINTER(pf32InputFrames));
-    ATLASSERT(IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames));
+    ZeroMemory(pf32Frames, sizeof(FLOAT32) * u32FrameCount * u32SamplesPerFrame);
+}
+#pragma AVRT_CODE_END
 
-    // If no file buffer or 0 mix ratio, just copy the input to output
-    if (pf32FileBuffer == nullptr || u32FileFrameCount == 0 || fMixRatio <= 0.0f)
+#pragma AVRT_CODE_BEGIN
+void CopyFrames(
+    _Out_writes_(u32FrameCount * u32SamplesPerFrame)
+        FLOAT32 *pf32OutFrames,
+    _In_reads_(u32FrameCount * u32SamplesPerFrame)
+        const FLOAT32 *pf32InFrames,
+    UINT32 u32FrameCount,
+    UINT32 u32SamplesPerFrame )
+{
+    CopyMemory(pf32OutFrames, pf32InFrames, sizeof(FLOAT32) * u32FrameCount * u32SamplesPerFrame);
+}
+#pragma AVRT_CODE_END
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Waits until the real-time thread has finished ramping to a mix request.
+//
+// Parameters:
+//
+//      pContext        - [in] mix context the request was posted to
+//      u32Serial       - [in] serial returned by PostMixRequest
+//      u32TimeoutMs    - [in] longest time to wait, in milliseconds
+//
+// Remarks:
+//
+// Return values:
+//
+//      TRUE if the ramp has ended, FALSE if the wait timed out
+//
+// Remarks:
+//
+//  Gives up after the timeout, which is the case when the stream is not
+//  running and nobody picks up the request.  Must not be called from the
+//  real-time thread.
+//
+BOOL WaitForMixRequest(
+    _In_
+        const MIX_CONTEXT *pContext,
+    UINT32 u32Serial,
+    UINT32 u32TimeoutMs )
+{
+    ASSERT_NONREALTIME();
+
+    const ULONGLONG ullDeadline = GetTickCount64() + u32TimeoutMs;
+    while (!IsMixRequestSettled(pContext, u32Serial))
     {
-        CopyFrames(pf32OutputFrames,
-                pf32InputFrames,
-                u32ValidFrameCount,
-                u32SamplesPerFrame);
-        return;
+        if (GetTickCount64() >= ullDeadline)
+        {
+            return FALSE;
+        }
+        Sleep(1);
+    }
+
+    return TRUE;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the clips to layer from the value of the file path property.
+//
+// Parameters:
+//
+//      pVar    - [in] property value, a single path or a vector of paths
+//      pPaths  - [out] up to MIX_MAX_SOURCES paths
+//
+// Return values:
+//
+//      TRUE if the value holds at least one path
+//
+BOOL GetAudioFilePaths(
+    _In_
+        const PROPVARIANT *pVar,
+    _Out_
+        std::vector<std::wstring> *pPaths )
+{
+    pPaths->clear();
+
+    if (pVar->vt == VT_LPWSTR && pVar->pwszVal != nullptr)
+    {
+        pPaths->push_back(pVar->pwszVal);
     }
+    else if (pVar->vt == (VT_VECTOR | VT_LPWSTR))
+    {
+        for (ULONG i = 0; i < pVar->calpwstr.cElems && pPaths->size() < MIX_MAX_SOURCES; i++)
+        {
+            if (pVar->calpwstr.pElems[i] != nullptr)
+            {
+                pPaths->push_back(pVar->calpwstr.pElems[i]);
+            }
+        }
+    }
+
+    return !pPaths->empty();
+}
 
-    // Ensure mix ratio is valid
-    if (fMixRatio > 1.0f)
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the gains of the layered clips from the value of the gains property.
+//
+// Parameters:
+//
+//      pVar    - [in] property value, a single gain or a vector of gains
+//      pGains  - [out] gain of every layer, clamped to [0, 1]
+//
+// Return values:
+//
+//      TRUE if the value holds at least one gain
+//
+BOOL GetAudioFileGains(
+    _In_
+        const PROPVARIANT *pVar,
+    _Out_
+        std::vector<FLOAT32> *pGains )
+{
+    pGains->clear();
+
+    if (pVar->vt == VT_R4)
     {
-        fMixRatio = 1.0f;
+        pGains->push_back(pVar->fltVal);
+    }
+    else if (pVar->vt == (VT_VECTOR | VT_R4))
+    {
+        pGains->assign(pVar->caflt.pElems, pVar->caflt.pElems + pVar->caflt.cElems);
+    }
+
+    for (FLOAT32 &f32Gain : *pGains)
+    {
+        if (f32Gain < 0.0f) f32Gain = 0.0f;
+        if (f32Gain > 1.0f) f32Gain = 1.0f;
     }
 
-    // Calculate mix weights
-    const FLOAT32 fInputWeight = 1.0f - fMixRatio;
-    const FLOAT32 fFileWeight = fMixRatio;
+    return !pGains->empty();
+}
 
-    // Mix the audio streams
-    for (UINT32 i = 0; i < u32ValidFrameCount; i++)
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the clips to layer from the APO properties.
+//
+// Parameters:
+//
+//      pProperties - [in] property store of the APO
+//      pPaths      - [out] up to MIX_MAX_SOURCES paths
+//
+// Return values:
+//
+//      TRUE if the property holds at least one path, see GetAudioFilePaths
+//
+BOOL GetAudioFilePaths(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        std::vector<std::wstring> *pPaths )
+{
+    PROPERTYKEY PKEY_AudioMix_FilePath = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 0 };
+    BOOL bPaths = FALSE;
+
+    pPaths->clear();
+
+    PROPVARIANT var;
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_FilePath, &var)))
     {
-        for (UINT32 j = 0; j < u32SamplesPerFrame; j++)
-        {
-            // Index for the current sample
-            UINT32 sampleIndex = i * u32SamplesPerFrame + j;
+        bPaths = GetAudioFilePaths(&var, pPaths);
+    }
+    PropVariantClear(&var);
+
+    return bPaths;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the gains of the layered clips from the APO properties.
+//
+// Parameters:
+//
+//      pProperties - [in] property store of the APO
+//      pGains      - [out] gain of every layer, none if the property is not set
+//
+// Return values:
+//
+//      TRUE if the property holds at least one gain, see GetAudioFileGains
+//
+BOOL GetAudioFileGains(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        std::vector<FLOAT32> *pGains )
+{
+    PROPERTYKEY PKEY_AudioMix_Gains = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 2 };
+    BOOL bGains = FALSE;
+
+    pGains->clear();
 
-            // Get the file sample, using the current file position
-            FLOAT32 fileSample = 0.0f;
-            if (u32FileFrameCount > 0)
+    PROPVARIANT var;
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_Gains, &var)))
+    {
+        bGains = GetAudioFileGains(&var, pGains);
+    }
+    PropVariantClear(&var);
+
+    return bGains;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the mix ratio from the APO properties.
+//
+// Parameters:
+//
+//      pProperties - [in] property store of the APO
+//      pf32Ratio   - [out] ratio clamped to [0, 1], left alone if the property is not set
+//
+// Return values:
+//
+//      TRUE if the property holds a ratio
+//
+BOOL GetMixRatio(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        FLOAT32 *pf32Ratio )
+{
+    PROPERTYKEY PKEY_AudioMix_Ratio = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 1 };
+    BOOL bRatio = FALSE;
+
+    PROPVARIANT var;
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_Ratio, &var)) && var.vt == VT_R4)
+    {
+        *pf32Ratio = var.fltVal;
+        if (*pf32Ratio < 0.0f) *pf32Ratio = 0.0f;
+        if (*pf32Ratio > 1.0f) *pf32Ratio = 1.0f;
+        bRatio = TRUE;
+    }
+    PropVariantClear(&var);
+
+    return bRatio;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Describes the format the clips of a locked APO are prepared for.
+//
+// Parameters:
+//
+//      pFormat             - [out] format of the clips
+//      u32FramesPerSecond  - [in] sample rate of the stream
+//      u32Channels         - [in] channel count of the stream
+//      dwChannelMask       - [in] speaker positions of the stream, 0 if not known
+//      u32MaxFrameCount    - [in] longest period of the stream
+//      u32LoopCrossfadeMs  - [in] crossfade at the loop point of the clips, 0 for a hard wrap
+//
+void InitAudioClipFormat(
+    _Out_
+        AUDIO_CLIP_FORMAT *pFormat,
+    UINT32 u32FramesPerSecond,
+    UINT32 u32Channels,
+    DWORD dwChannelMask,
+    UINT32 u32MaxFrameCount,
+    UINT32 u32LoopCrossfadeMs )
+{
+    pFormat->u32SampleRate = u32FramesPerSecond;
+    pFormat->u32ChannelCount = u32Channels;
+    pFormat->dwChannelMask = dwChannelMask;
+    pFormat->u32MaxFrameCount = u32MaxFrameCount;
+    pFormat->u32CrossfadeFrames = u32FramesPerSecond * u32LoopCrossfadeMs / 1000;
+    pFormat->u32StreamMinMs = MIN_STREAMED_CLIP_MS;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Loads the layered clips of an APO at the processing format.
+//
+// Parameters:
+//
+//      pLayers     - [in, out] layers loaded so far, replaced by the ones of paths
+//      paths       - [in] file of every layer
+//      format      - [in] format to prepare the clips for
+//      pReplaced   - [out] readers of the earlier layers that were not taken over
+//
+// Remarks:
+//
+//  A layer whose file is loaded already at the same format takes its reader
+//  over, so that the clip plays on.  The others come from AudioClipCache,
+//  which shares a clip in memory with every APO instance that plays the file
+//  at the same format.  A file that cannot be loaded leaves its layer silent
+//  instead of failing the APO.  The mix context may still read the replaced
+//  readers, see RetireAudioFileReaders.
+//
+void LoadAudioFileLayers(
+    _Inout_
+        AUDIO_FILE_LAYERS *pLayers,
+    const std::vector<std::wstring> &paths,
+    const AUDIO_CLIP_FORMAT &format,
+    _Out_
+        std::vector<std::shared_ptr<AudioFileReader>> *pReplaced )
+{
+    ASSERT_NONREALTIME();
+
+    std::vector<std::shared_ptr<AudioFileReader>> readers;
+    pReplaced->clear();
+
+    // Every field of the format changes the samples or the channel map of a clip, or the ring of a streamed one
+    const bool bSameFormat = IsSameAudioClipFormat(format, pLayers->format);
+
+    for (const std::wstring &path : paths)
+    {
+        std::shared_ptr<AudioFileReader> reader;
+
+        for (size_t i = 0; bSameFormat && i < pLayers->readers.size() && i < pLayers->paths.size(); i++)
+        {
+            if (pLayers->readers[i] && pLayers->paths[i] == path)
             {
-                UINT32 filePos = ((*pu32FileIndex) + i) % u32FileFrameCount;
-                fileSample = pf32FileBuffer[filePos * u32SamplesPerFrame + j];
+                reader = std::move(pLayers->readers[i]);
+                break;
             }
+        }
 
-            // Mix the streams with the appropriate weights
-            pf32OutputFrames[sampleIndex] =
-                (pf32InputFrames[sampleIndex] * fInputWeight) +
-                (fileSample * fFileWeight);
+        if (!reader)
+        {
+            // A failed load leaves reader empty
+            AudioClipCache::GetInstance().Acquire(path.c_str(), format, &reader);
         }
+
+        readers.push_back(std::move(reader));
     }
 
-    // Update the file position index for next time
-    *pu32FileIndex = (*pu32FileIndex + u32ValidFrameCount) % u32FileFrameCount;
+    for (std::shared_ptr<AudioFileReader> &reader : pLayers->readers)
+    {
+        if (reader)
+        {
+            pReplaced->push_back(std::move(reader));
+        }
+    }
+
+    pLayers->readers.swap(readers);
+    pLayers->paths = paths;
+    pLayers->format = format;
 }
-#pragma AVRT_CODE_END
 
-#pragma AVRT_CODE_BEGIN
-void WriteSilence(
-    _Out_writes_(u32FrameCount * u32SamplesPerFrame)
-        FLOAT32 *pf32Frames,
-    UINT32 u32FrameCount,
-    UINT32 u32SamplesPerFrame )
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Lets go of the readers LoadAudioFileLayers replaced once the mix context no
+//  longer reads them.
+//
+// Parameters:
+//
+//      pLayers     - [in, out] layers the readers were replaced in
+//      pContext    - [in] mix context the new layers were posted to
+//      u32Serial   - [in] serial returned by PostMixRequest for them
+//      pReplaced   - [in, out] replaced readers, emptied
+//
+// Remarks:
+//
+//  Waits for the replaced clips to fade out.  If the stream is not running
+//  they are still in the mix context, so they are kept in pLayers->retired
+//  until the next LockForProcess.
+//
+void RetireAudioFileReaders(
+    _Inout_
+        AUDIO_FILE_LAYERS *pLayers,
+    _In_
+        const MIX_CONTEXT *pContext,
+    UINT32 u32Serial,
+    _Inout_
+        std::vector<std::shared_ptr<AudioFileReader>> *pReplaced )
 {
-    ZeroMemory(pf32Frames, sizeof(FLOAT32) * u32FrameCount * u32SamplesPerFrame);
+    ASSERT_NONREALTIME();
+
+    if (!WaitForMixRequest(pContext, u32Serial, MAX_MIX_FADE_WAIT_MS))
+    {
+        for (std::shared_ptr<AudioFileReader> &reader : *pReplaced)
+        {
+            pLayers->retired.push_back(std::move(reader));
+        }
+    }
+
+    pReplaced->clear();
 }
-#pragma AVRT_CODE_END
 
-#pragma AVRT_CODE_BEGIN
-void CopyFrames(
-    _Out_writes_(u32FrameCount * u32SamplesPerFrame)
-        FLOAT32 *pf32OutFrames,
-    _In_reads_(u32FrameCount * u32SamplesPerFrame)
-        const FLOAT32 *pf32InFrames,
-    UINT32 u32FrameCount,
-    UINT32 u32SamplesPerFrame )
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Lets go of every clip of an APO.
+//
+// Parameters:
+//
+//      pLayers - [in, out] layers to empty
+//
+// Remarks:
+//
+//  The mix context must no longer refer to them, as after InitMixContext.
+//
+void ReleaseAudioFileLayers(
+    _Inout_
+        AUDIO_FILE_LAYERS *pLayers )
 {
-    CopyMemory(pf32OutFrames, pf32InFrames, sizeof(FLOAT32) * u32FrameCount * u32SamplesPerFrame);
+    pLayers->readers.clear();
+    pLayers->paths.clear();
+    pLayers->retired.clear();
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Adds the layered clips of an APO to a mix request.
+//
+// Parameters:
+//
+//      pRequest        - [in, out] request to post
+//      pLayers         - [in] layers of the APO
+//      gains           - [in] gain of every layer, 1 for layers without one
+//      f32FileWeight   - [in] weight of the clips from the mix law, every gain applies to it
+//
+// Remarks:
+//
+//  Every layer that loaded is mixed in a single pass, up to MIX_MAX_SOURCES.
+//
+void SetMixSources(
+    _Inout_
+        MIX_REQUEST *pRequest,
+    _In_
+        const AUDIO_FILE_LAYERS *pLayers,
+    const std::vector<FLOAT32> &gains,
+    FLOAT32 f32FileWeight )
+{
+    pRequest->u32SourceCount = 0;
+
+    for (size_t i = 0; i < pLayers->readers.size() && pRequest->u32SourceCount < MIX_MAX_SOURCES; i++)
+    {
+        const AudioFileReader *pReader = pLayers->readers[i].get();
+        if (pReader == nullptr || !pReader->IsValid())
+        {
+            continue;
+        }
+
+        MIX_SOURCE &source = pRequest->aSources[pRequest->u32SourceCount++];
+        source.pf32File = pReader->GetAudioData();
+        source.pi16File = pReader->GetAudioDataInt16();
+        source.pbSilentBlocks = pReader->GetSilentBlocks();
+        source.pChannelMap = pReader->GetChannelMap();
+        source.u32FileFrameCount = pReader->GetFrameCount();
+        source.pStream = pReader->GetStream();
+        source.f32Weight = f32FileWeight * ((i < gains.size()) ? gains[i] : 1.0f);
+        source.bLoop = TRUE;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the speaker positions of the channels of a connection format.
+//
+// Parameters:
+//
+//      pFormat - [in] format of the connection
+//
+// Return values:
+//
+//      KSAUDIO_SPEAKER_* mask, 0 if the format does not tell
+//
+DWORD GetChannelMask(
+    _In_
+        IAudioMediaType *pFormat )
+{
+    const WAVEFORMATEX *pWaveFormat = pFormat->GetAudioFormat();
+
+    if (pWaveFormat != nullptr &&
+        pWaveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE &&
+        pWaveFormat->cbSize >= sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+    {
+        return reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(pWaveFormat)->dwChannelMask;
+    }
+
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Picks the sample format the mix kernels convert the periods of a connection
+//  from and to.
+//
+// Parameters:
+//
+//      pFormat         - [in] format of the connection
+//      pSampleFormat   - [out] sample format of the connection buffers
+//
+// Return values:
+//
+//      S_OK on success, APOERR_FORMAT_NOT_SUPPORTED for samples the kernels cannot convert
+//
+// Remarks:
+//
+//  24 bit samples in 32 bit containers sit in the upper bytes and are mixed as
+//  32 bit samples.
+//
+HRESULT GetMixSampleFormat(
+    _In_
+        IAudioMediaType *pFormat,
+    _Out_
+        MIX_SAMPLE_FORMAT *pSampleFormat )
+{
+    UNCOMPRESSEDAUDIOFORMAT format;
+    HRESULT hr = pFormat->GetUncompressedAudioFormat(&format);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    *pSampleFormat = MIX_SAMPLE_FLOAT32;
+    if (IsEqualGUID(format.guidFormatType, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT) && format.dwBytesPerSampleContainer == 4)
+    {
+        return S_OK;
+    }
+
+    if (!IsEqualGUID(format.guidFormatType, KSDATAFORMAT_SUBTYPE_PCM) ||
+        format.dwSamplesPerFrame > MIX_FORMAT_BLOCK_SAMPLES)
+    {
+        return APOERR_FORMAT_NOT_SUPPORTED;
+    }
+
+    switch (format.dwBytesPerSampleContainer)
+    {
+    case 2:
+        *pSampleFormat = MIX_SAMPLE_INT16;
+        return S_OK;
+    case 3:
+        *pSampleFormat = MIX_SAMPLE_INT24;
+        return S_OK;
+    case 4:
+        *pSampleFormat = MIX_SAMPLE_INT32;
+        return S_OK;
+    default:
+        return APOERR_FORMAT_NOT_SUPPORTED;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the lookahead of the output limiter from the APO properties.
+//
+// Parameters:
+//
+//      pProperties - [in] property store of the APO
+//
+// Return values:
+//
+//      Lookahead in milliseconds, at most MIX_LIMITER_MAX_LOOKAHEAD_MS, 0 if
+//      the limiter is off, which it is unless the property is set
+//
+UINT32 GetLimiterLookahead(
+    _In_
+        IPropertyStore *pProperties )
+{
+    PROPERTYKEY PKEY_AudioMix_LimiterLookahead = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 3 };
+    UINT32 u32LookaheadMs = 0;
+
+    PROPVARIANT var;
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_LimiterLookahead, &var)) && var.vt == VT_UI4)
+    {
+        u32LookaheadMs = var.ulVal;
+        if (u32LookaheadMs > MIX_LIMITER_MAX_LOOKAHEAD_MS) u32LookaheadMs = MIX_LIMITER_MAX_LOOKAHEAD_MS;
+    }
+    PropVariantClear(&var);
+
+    return u32LookaheadMs;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the crossfade at the loop point of the clips from the APO properties.
+//
+// Parameters:
+//
+//      pProperties - [in] property store of the APO
+//
+// Return values:
+//
+//      Crossfade in milliseconds, at most MIX_LOOP_MAX_CROSSFADE_MS, 0 if the
+//      clips wrap around without one, which they do unless the property is set
+//
+UINT32 GetLoopCrossfade(
+    _In_
+        IPropertyStore *pProperties )
+{
+    PROPERTYKEY PKEY_AudioMix_LoopCrossfade = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 6 };
+    UINT32 u32CrossfadeMs = 0;
+
+    PROPVARIANT var;
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_LoopCrossfade, &var)) && var.vt == VT_UI4)
+    {
+        u32CrossfadeMs = var.ulVal;
+        if (u32CrossfadeMs > MIX_LOOP_MAX_CROSSFADE_MS) u32CrossfadeMs = MIX_LOOP_MAX_CROSSFADE_MS;
+    }
+    PropVariantClear(&var);
+
+    return u32CrossfadeMs;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the mix law from the APO properties.
+//
+// Parameters:
+//
+//      pProperties - [in] property store of the APO
+//
+// Return values:
+//
+//      Mix law the ratio is turned into weights with, MIX_LAW_LINEAR unless the
+//      property holds another known one
+//
+MIX_LAW GetMixLaw(
+    _In_
+        IPropertyStore *pProperties )
+{
+    PROPERTYKEY PKEY_AudioMix_Law = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 7 };
+    MIX_LAW law = MIX_LAW_LINEAR;
+
+    PROPVARIANT var;
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_Law, &var)) && var.vt == VT_UI4 && var.ulVal < MIX_LAW_COUNT)
+    {
+        law = static_cast<MIX_LAW>(var.ulVal);
+    }
+    PropVariantClear(&var);
+
+    return law;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Sets the output limiter up for the locked format.
+//
+// Parameters:
+//
+//      pLimiter            - [out] limiter to set up
+//      pBuffer             - [in, out] storage of the limiter, resized as needed
+//      u32LookaheadMs      - [in] lookahead in milliseconds, 0 turns the limiter off
+//      u32FramesPerSecond  - [in] sample rate of the stream
+//      u32Channels         - [in] channel count of the stream
+//
+// Return values:
+//
+//      S_OK on success, E_OUTOFMEMORY if the delay line cannot be allocated
+//
+// Remarks:
+//
+//  The lookahead is the delay the APO adds, so it must only change when the
+//  connections are locked, never while streaming.
+//
+HRESULT InitLimiter(
+    _Out_
+        MIX_LIMITER *pLimiter,
+    _Inout_
+        std::vector<BYTE> *pBuffer,
+    UINT32 u32LookaheadMs,
+    UINT32 u32FramesPerSecond,
+    UINT32 u32Channels )
+{
+    ASSERT_NONREALTIME();
+
+    const UINT32 u32LookaheadFrames = u32FramesPerSecond * u32LookaheadMs / 1000;
+
+    try {
+        pBuffer->assign(GetMixLimiterBufferSize(u32LookaheadFrames, u32Channels), 0);
+    }
+    catch (std::bad_alloc&) {
+        InitMixLimiter(pLimiter, 0, u32Channels, MIX_LIMITER_CEILING, 0, nullptr);
+        return E_OUTOFMEMORY;
+    }
+
+    InitMixLimiter(pLimiter, u32LookaheadFrames, u32Channels, MIX_LIMITER_CEILING,
+                   u32FramesPerSecond * MIX_LIMITER_RELEASE_MS / 1000, pBuffer->data());
+    return S_OK;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Converts the delay of the output limiter to the units of GetLatency.
+//
+// Parameters:
+//
+//      u32LookaheadFrames  - [in] delay of the limiter in frames
+//      u32FramesPerSecond  - [in] sample rate of the stream
+//
+// Return values:
+//
+//      Delay in hundreds of nanoseconds
+//
+HNSTIME GetLimiterLatency(
+    UINT32 u32LookaheadFrames,
+    UINT32 u32FramesPerSecond )
+{
+    if (u32FramesPerSecond == 0)
+    {
+        return 0;
+    }
+    return static_cast<HNSTIME>(u32LookaheadFrames) * 10000000 / u32FramesPerSecond;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads per channel gains from the value of a channel gains property.
+//
+// Parameters:
+//
+//      pVar    - [in] property value, a single gain or a vector of gains
+//      pGains  - [out] gain of every channel, clamped to [0, MIX_MAX_CHANNEL_GAIN]
+//
+// Return values:
+//
+//      TRUE if the value holds at least one gain
+//
+// Remarks:
+//
+//  Unlike the gains of the clips, channel gains may boost a channel above
+//  unity, see ClampMixChannelGain.
+//
+BOOL GetChannelGainValues(
+    _In_
+        const PROPVARIANT *pVar,
+    _Out_
+        std::vector<FLOAT32> *pGains )
+{
+    pGains->clear();
+
+    if (pVar->vt == VT_R4)
+    {
+        pGains->push_back(pVar->fltVal);
+    }
+    else if (pVar->vt == (VT_VECTOR | VT_R4))
+    {
+        pGains->assign(pVar->caflt.pElems, pVar->caflt.pElems + pVar->caflt.cElems);
+    }
+
+    for (FLOAT32 &f32Gain : *pGains)
+    {
+        f32Gain = ClampMixChannelGain(f32Gain);
+    }
+
+    return !pGains->empty();
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Reads the per channel gains of the input and of the injected clips from the
+//  APO properties.
+//
+// Parameters:
+//
+//      pProperties         - [in] property store of the APO
+//      pInputGains         - [out] gains of the input, see ExpandChannelGains
+//      pInjectionGains     - [out] gains of the sum of the clips
+//
+// Remarks:
+//
+//  Both are in [0, MIX_MAX_CHANNEL_GAIN], see GetChannelGainValues.
+//
+void GetChannelGains(
+    _In_
+        IPropertyStore *pProperties,
+    _Out_
+        std::vector<FLOAT32> *pInputGains,
+    _Out_
+        std::vector<FLOAT32> *pInjectionGains )
+{
+    PROPERTYKEY PKEY_AudioMix_InputGains = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 4 };
+    PROPERTYKEY PKEY_AudioMix_InjectionGains = { 0x9f79cc99, 0x23ea, 0x4997, { 0x9d, 0x60, 0xf5, 0xe2, 0x2c, 0x1f, 0xd8, 0x45 }, 5 };
+
+    PROPVARIANT var;
+
+    pInputGains->clear();
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_InputGains, &var)))
+    {
+        GetChannelGainValues(&var, pInputGains);
+    }
+    PropVariantClear(&var);
+
+    pInjectionGains->clear();
+    PropVariantInit(&var);
+    if (SUCCEEDED(pProperties->GetValue(PKEY_AudioMix_InjectionGains, &var)))
+    {
+        GetChannelGainValues(&var, pInjectionGains);
+    }
+    PropVariantClear(&var);
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Spreads gains read by GetChannelGains over the channels of the stream.
+//
+// Parameters:
+//
+//      gains           - [in] no gain, a gain for every channel, or one per channel
+//      u32Channels     - [in] channel count of the stream
+//      pf32Gains       - [out] gain of every channel
+//
+// Remarks:
+//
+//  Channels without a gain of their own are left at unity.
+//
+void ExpandChannelGains(
+    const std::vector<FLOAT32> &gains,
+    UINT32 u32Channels,
+    _Out_writes_(u32Channels)
+        FLOAT32 *pf32Gains )
+{
+    for (UINT32 c = 0; c < u32Channels; c++)
+    {
+        if (gains.size() == 1)
+        {
+            pf32Gains[c] = gains[0];
+        }
+        else
+        {
+            pf32Gains[c] = (c < gains.size()) ? gains[c] : 1.0f;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Sets the per channel gains of a mix request.
+//
+// Parameters:
+//
+//      pRequest            - [in, out] request to post
+//      pf32InputGains      - [in] gain of the input on every channel
+//      pf32InjectionGains  - [in] gain of the clips on every channel
+//      u32Channels         - [in] channel count of the stream
+//
+// Remarks:
+//
+//  The mix kernels apply channel gains to at most MIX_MAP_MAX_CHANNELS
+//  channels, wider streams are left at unity gain.
+//
+void SetMixChannelGains(
+    _Inout_
+        MIX_REQUEST *pRequest,
+    _In_reads_(u32Channels)
+        const FLOAT32 *pf32InputGains,
+    _In_reads_(u32Channels)
+        const FLOAT32 *pf32InjectionGains,
+    UINT32 u32Channels )
+{
+    pRequest->bChannelGains = FALSE;
+    if (u32Channels > MIX_MAP_MAX_CHANNELS)
+    {
+        return;
+    }
+
+    for (UINT32 c = 0; c < u32Channels; c++)
+    {
+        pRequest->af32InputGains[c] = pf32InputGains[c];
+        pRequest->af32InjectionGains[c] = pf32InjectionGains[c];
+        if (pf32InputGains[c] != 1.0f || pf32InjectionGains[c] != 1.0f)
+        {
+            pRequest->bChannelGains = TRUE;
+        }
+    }
 }
-#pragma AVRT_CODE_END
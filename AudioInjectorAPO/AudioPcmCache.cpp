@@ -0,0 +1,398 @@
+//
+// AudioPcmCache.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  On-disk cache of decoded and resampled clips
+//
+
+#include "AudioPcmCache.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Primes of XXH64
+static const UINT64 c_u64Prime1 = 0x9E3779B185EBCA87ull;
+static const UINT64 c_u64Prime2 = 0xC2B2AE3D27D4EB4Full;
+static const UINT64 c_u64Prime3 = 0x165667B19E3779F9ull;
+static const UINT64 c_u64Prime4 = 0x85EBCA77C2B2AE63ull;
+static const UINT64 c_u64Prime5 = 0x27D4EB2F165667C5ull;
+
+// The samples start this far into the file, which keeps them aligned for any vector width
+static const UINT32 c_cbDataOffset = 256;
+
+static const BYTE c_abMagic[8] = { 'A', 'I', 'P', 'C', 'M', 'C', 'A', 'C' };
+
+//
+// Header at the start of a cache file, in the byte order of the machine that
+// wrote it; a file from another one fails its checksum and is written again.
+//
+struct PCM_CACHE_HEADER
+{
+    BYTE                    abMagic[8];
+    UINT32                  u32Version;         // AUDIO_PCM_CACHE_VERSION
+    UINT32                  u32DataOffset;      // of the first sample from the start of the file
+    UINT64                  u64DataBytes;
+    UINT64                  u64DataHash;        // of the samples
+    AUDIO_PCM_CACHE_INFO    info;
+    UINT64                  u64HeaderHash;      // of the bytes of the header before it
+};
+
+static_assert(sizeof(PCM_CACHE_HEADER) <= c_cbDataOffset, "The header must fit before the samples");
+
+static UINT64 RotateLeft(UINT64 u64, int bits)
+{
+    return (u64 << bits) | (u64 >> (64 - bits));
+}
+
+static UINT64 Read64(const BYTE *pb)
+{
+    UINT64 u64;
+    memcpy(&u64, pb, sizeof(u64));
+    return u64;
+}
+
+static UINT32 Read32(const BYTE *pb)
+{
+    UINT32 u32;
+    memcpy(&u32, pb, sizeof(u32));
+    return u32;
+}
+
+static UINT64 HashRound(UINT64 u64Acc, UINT64 u64Input)
+{
+    return RotateLeft(u64Acc + u64Input * c_u64Prime2, 31) * c_u64Prime1;
+}
+
+static UINT64 HashMerge(UINT64 u64Acc, UINT64 u64Lane)
+{
+    return (u64Acc ^ HashRound(0, u64Lane)) * c_u64Prime1 + c_u64Prime4;
+}
+
+UINT64 HashAudioBytes(
+    const BYTE         *pb,
+    UINT64              cb,
+    UINT64              u64Seed)
+{
+    const BYTE *pbEnd = pb + cb;
+    UINT64 u64Hash;
+
+    if (cb >= 32)
+    {
+        // Four independent lanes, so the multiplies of a round overlap
+        UINT64 v1 = u64Seed + c_u64Prime1 + c_u64Prime2;
+        UINT64 v2 = u64Seed + c_u64Prime2;
+        UINT64 v3 = u64Seed;
+        UINT64 v4 = u64Seed - c_u64Prime1;
+        for (; pbEnd - pb >= 32; pb += 32)
+        {
+            v1 = HashRound(v1, Read64(pb));
+            v2 = HashRound(v2, Read64(pb + 8));
+            v3 = HashRound(v3, Read64(pb + 16));
+            v4 = HashRound(v4, Read64(pb + 24));
+        }
+
+        u64Hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        u64Hash = HashMerge(u64Hash, v1);
+        u64Hash = HashMerge(u64Hash, v2);
+        u64Hash = HashMerge(u64Hash, v3);
+        u64Hash = HashMerge(u64Hash, v4);
+    }
+    else
+    {
+        u64Hash = u64Seed + c_u64Prime5;
+    }
+
+    u64Hash += cb;
+
+    // The tail, 8, 4 and 1 bytes at a time
+    for (; pbEnd - pb >= 8; pb += 8)
+    {
+        u64Hash ^= HashRound(0, Read64(pb));
+        u64Hash = RotateLeft(u64Hash, 27) * c_u64Prime1 + c_u64Prime4;
+    }
+    if (pbEnd - pb >= 4)
+    {
+        u64Hash ^= Read32(pb) * c_u64Prime1;
+        u64Hash = RotateLeft(u64Hash, 23) * c_u64Prime2 + c_u64Prime3;
+        pb += 4;
+    }
+    for (; pb < pbEnd; pb++)
+    {
+        u64Hash ^= *pb * c_u64Prime5;
+        u64Hash = RotateLeft(u64Hash, 11) * c_u64Prime1;
+    }
+
+    u64Hash ^= u64Hash >> 33;
+    u64Hash *= c_u64Prime2;
+    u64Hash ^= u64Hash >> 29;
+    u64Hash *= c_u64Prime3;
+    u64Hash ^= u64Hash >> 32;
+    return u64Hash;
+}
+
+static void AppendHex(std::wstring& text, UINT64 u64Value, int digits)
+{
+    for (int digit = digits - 1; digit >= 0; digit--)
+    {
+        text += L"0123456789abcdef"[(u64Value >> (digit * 4)) & 0xF];
+    }
+}
+
+HRESULT GetAudioPcmCachePath(
+    LPCWSTR             directory,
+    UINT64              u64SourceHash,
+    UINT32              u32SampleRate,
+    std::wstring       *pPath)
+{
+    if (directory == nullptr || *directory == 0 || u32SampleRate == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    try {
+        std::wstring path = directory;
+#if defined(_WIN32)
+        if (path.back() != L'\\' && path.back() != L'/')
+        {
+            path += L'\\';
+        }
+#else
+        if (path.back() != L'/')
+        {
+            path += L'/';
+        }
+#endif
+        AppendHex(path, u64SourceHash, 16);
+        path += L'-';
+        path += std::to_wstring(u32SampleRate);
+        path += L".pcm";
+        *pPath = std::move(path);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+HRESULT ParseAudioPcmCache(
+    const BYTE             *pbFile,
+    UINT64                  cbFile,
+    AUDIO_PCM_CACHE_INFO   *pInfo,
+    const FLOAT32         **ppf32Samples)
+{
+    if (pbFile == nullptr || cbFile < sizeof(PCM_CACHE_HEADER))
+    {
+        return E_FAIL;
+    }
+
+    PCM_CACHE_HEADER header;
+    memcpy(&header, pbFile, sizeof(header));
+    if (memcmp(header.abMagic, c_abMagic, sizeof(c_abMagic)) != 0 ||
+        header.u32Version != AUDIO_PCM_CACHE_VERSION ||
+        header.u64HeaderHash != HashAudioBytes(pbFile, offsetof(PCM_CACHE_HEADER, u64HeaderHash), 0))
+    {
+        return E_FAIL;
+    }
+
+    // The sizes are checked against each other before the samples are read
+    const AUDIO_PCM_CACHE_INFO& info = header.info;
+    if (info.u32ChannelCount == 0 || info.u32FrameCount == 0 || info.u32SampleRate == 0 ||
+        info.u32CuePoints > WAV_MAX_CUE_POINTS ||
+        header.u32DataOffset < sizeof(PCM_CACHE_HEADER) || header.u32DataOffset % sizeof(FLOAT32) != 0 ||
+        header.u64DataBytes != static_cast<UINT64>(info.u32FrameCount) * info.u32ChannelCount * sizeof(FLOAT32) ||
+        header.u32DataOffset > cbFile || header.u64DataBytes > cbFile - header.u32DataOffset)
+    {
+        return E_FAIL;
+    }
+
+    // A file cut short by a crash or a full disk ends up here
+    const BYTE *pbSamples = pbFile + header.u32DataOffset;
+    if (header.u64DataHash != HashAudioBytes(pbSamples, header.u64DataBytes, 0))
+    {
+        return E_FAIL;
+    }
+
+    *pInfo = info;
+    *ppf32Samples = reinterpret_cast<const FLOAT32*>(pbSamples);
+    return S_OK;
+}
+
+#if defined(_WIN32)
+
+HRESULT GetAudioPcmCacheDirectory(
+    std::wstring       *pDirectory)
+{
+    WCHAR tempPath[MAX_PATH + 1] = {};
+    const DWORD cchTempPath = GetTempPathW(ARRAYSIZE(tempPath), tempPath);
+    if (cchTempPath == 0 || cchTempPath > MAX_PATH)
+    {
+        return E_FAIL;
+    }
+
+    try {
+        std::wstring directory = tempPath;
+        directory += L"AudioInjectorCache";
+        if (!CreateDirectoryW(directory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+        *pDirectory = std::move(directory);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+static HRESULT WriteAll(HANDLE hFile, const BYTE *pb, UINT64 cb)
+{
+    while (cb > 0)
+    {
+        const DWORD cbChunk = (cb < 0x40000000) ? static_cast<DWORD>(cb) : 0x40000000;
+        DWORD cbWritten = 0;
+        if (!WriteFile(hFile, pb, cbChunk, &cbWritten, nullptr) || cbWritten == 0)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+        pb += cbWritten;
+        cb -= cbWritten;
+    }
+    return S_OK;
+}
+
+#else // !_WIN32
+
+HRESULT GetAudioPcmCacheDirectory(
+    std::wstring       *pDirectory)
+{
+    try {
+        std::wstring directory = L"/tmp/AudioInjectorCache";
+        if (mkdir(GetUtf8Path(directory.c_str()).c_str(), 0700) != 0 && errno != EEXIST)
+        {
+            return E_FAIL;
+        }
+        *pDirectory = std::move(directory);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+static HRESULT WriteAll(int fd, const BYTE *pb, UINT64 cb)
+{
+    while (cb > 0)
+    {
+        const size_t cbChunk = (cb < 0x40000000) ? static_cast<size_t>(cb) : 0x40000000;
+        const ssize_t cbWritten = write(fd, pb, cbChunk);
+        if (cbWritten < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (cbWritten <= 0)
+        {
+            return E_FAIL;
+        }
+        pb += cbWritten;
+        cb -= static_cast<UINT64>(cbWritten);
+    }
+    return S_OK;
+}
+
+#endif // _WIN32
+
+HRESULT WriteAudioPcmCache(
+    LPCWSTR                     filePath,
+    const AUDIO_PCM_CACHE_INFO *pInfo,
+    const FLOAT32              *pf32Samples)
+{
+    if (pInfo->u32ChannelCount == 0 || pInfo->u32FrameCount == 0 || pInfo->u32CuePoints > WAV_MAX_CUE_POINTS)
+    {
+        return E_INVALIDARG;
+    }
+
+    // Padding included, so the header hash is the same wherever it is computed
+    BYTE abHeader[c_cbDataOffset] = {};
+    PCM_CACHE_HEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.abMagic, c_abMagic, sizeof(c_abMagic));
+    header.u32Version = AUDIO_PCM_CACHE_VERSION;
+    header.u32DataOffset = c_cbDataOffset;
+    header.u64DataBytes = static_cast<UINT64>(pInfo->u32FrameCount) * pInfo->u32ChannelCount * sizeof(FLOAT32);
+    header.u64DataHash = HashAudioBytes(reinterpret_cast<const BYTE*>(pf32Samples), header.u64DataBytes, 0);
+    memcpy(&header.info, pInfo, sizeof(header.info));
+    memcpy(abHeader, &header, sizeof(header));
+    header.u64HeaderHash = HashAudioBytes(abHeader, offsetof(PCM_CACHE_HEADER, u64HeaderHash), 0);
+    memcpy(abHeader, &header, sizeof(header));
+
+    // Every writer has a name of its own, whoever renames last wins with a whole file
+    static std::atomic<UINT32> s_u32Writes(0);
+    std::wstring tempPath;
+    try {
+        tempPath = filePath;
+        tempPath += L'.';
+#if defined(_WIN32)
+        AppendHex(tempPath, GetCurrentProcessId(), 8);
+#else
+        AppendHex(tempPath, static_cast<UINT64>(getpid()), 8);
+#endif
+        tempPath += L'-';
+        AppendHex(tempPath, s_u32Writes++, 8);
+        tempPath += L".tmp";
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+#if defined(_WIN32)
+    HANDLE hFile = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = WriteAll(hFile, abHeader, sizeof(abHeader));
+    if (SUCCEEDED(hr))
+        hr = WriteAll(hFile, reinterpret_cast<const BYTE*>(pf32Samples), header.u64DataBytes);
+    CloseHandle(hFile);
+
+    // Fails while another process has the old file mapped, which then stays as good as this one
+    if (SUCCEEDED(hr) && !MoveFileExW(tempPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING))
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    if (FAILED(hr))
+        DeleteFileW(tempPath.c_str());
+    return hr;
+#else
+    const std::string tempName = GetUtf8Path(tempPath.c_str());
+    const int fd = open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = WriteAll(fd, abHeader, sizeof(abHeader));
+    if (SUCCEEDED(hr))
+        hr = WriteAll(fd, reinterpret_cast<const BYTE*>(pf32Samples), header.u64DataBytes);
+    if (close(fd) != 0 && SUCCEEDED(hr))
+        hr = E_FAIL;
+
+    // Readers that still map the old file keep it until they unmap it
+    if (SUCCEEDED(hr) && rename(tempName.c_str(), GetUtf8Path(filePath).c_str()) != 0)
+        hr = E_FAIL;
+    if (FAILED(hr))
+        unlink(tempName.c_str());
+    return hr;
+#endif
+}
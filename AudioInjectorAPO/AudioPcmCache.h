@@ -0,0 +1,91 @@
+//
+// AudioPcmCache.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  On-disk cache of clips decoded and resampled to the rate of a stream, so the
+//  next LockForProcess at that rate maps the float samples from the cache file
+//  instead of decoding and resampling the source again.  A cache file is named
+//  after a hash of the bytes of the source and the rate, carries the version of
+//  its layout, and has checksums over its header and its samples; one that does
+//  not match in every respect is ignored and written again.  Platform independent.
+//
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <string>
+#include "AudioFileMapping.h"
+
+// Layout of the cache files, and of what the decoders and the resampler put in them.
+// Raise it whenever either changes, the files of other versions are not read.
+#define AUDIO_PCM_CACHE_VERSION     3
+
+//
+// The clip a cache file holds, besides its samples.  The samples are interleaved
+// float frames at u32SampleRate, resampled from the source but with its channels.
+//
+struct AUDIO_PCM_CACHE_INFO
+{
+    UINT64      u64SourceHash;          // of the bytes of the source file, see HashAudioBytes
+    UINT64      cbSource;               // size of the source file
+    UINT32      u32SampleRate;          // the clip was resampled to
+    UINT32      u32ChannelCount;
+    DWORD       dwChannelMask;
+    UINT32      u32SourceBitsPerSample; // of PCM sources, 0 for compressed or float ones
+    UINT32      u32FrameCount;
+
+    // Loop and cue points at u32SampleRate, as AudioFileReader keeps them
+    UINT32      u32LoopStart;
+    UINT32      u32LoopEnd;
+    UINT32      u32CuePoints;
+    UINT32      au32CueFrames[WAV_MAX_CUE_POINTS];
+};
+
+//
+// 64 bit hash of cb bytes: the rounds of XXH64, four lanes of 8 bytes at a time,
+// so it runs at the speed of memory.  Not meant to withstand deliberate collisions.
+//
+UINT64 HashAudioBytes(
+    const BYTE         *pb,
+    UINT64              cb,
+    UINT64              u64Seed);
+
+//
+// Gets the path of the cache file of the source with the given hash resampled to
+// u32SampleRate, in directory.
+//
+HRESULT GetAudioPcmCachePath(
+    LPCWSTR             directory,
+    UINT64              u64SourceHash,
+    UINT32              u32SampleRate,
+    std::wstring       *pPath);
+
+//
+// Gets the directory the APOs keep their cache files in, under the temporary
+// directory of the process, and creates it if it is not there yet.
+//
+HRESULT GetAudioPcmCacheDirectory(
+    std::wstring       *pDirectory);
+
+//
+// Checks the cache file in pbFile and finds the clip in it.  Returns E_FAIL for a
+// file of another version, a truncated one, or one whose header or samples do not
+// match their checksum; reading the samples for that prefaults them as well.
+// *ppf32Samples points into pbFile and is aligned for the widest vectors if it is.
+//
+HRESULT ParseAudioPcmCache(
+    const BYTE             *pbFile,
+    UINT64                  cbFile,
+    AUDIO_PCM_CACHE_INFO   *pInfo,
+    const FLOAT32         **ppf32Samples);
+
+//
+// Writes the clip into the cache file filePath.  The file is written under another
+// name and renamed over filePath once complete, so readers never see half of it.
+//
+HRESULT WriteAudioPcmCache(
+    LPCWSTR                     filePath,
+    const AUDIO_PCM_CACHE_INFO *pInfo,
+    const FLOAT32              *pf32Samples);
@@ -0,0 +1,387 @@
+//
+// AudioResampler.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Implementation of the polyphase resampler
+//
+
+#include "AudioResampler.h"
+
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <tuple>
+
+// Input frames the planes take at a time on top of the ones under the taps
+static const UINT32 c_u32BlockFrames = 2048;
+
+// Taps a table with a row for every position of the ratio may take, 4 MB
+static const UINT64 c_u64MaxExactTaps = 1 << 20;
+
+// Tables the cache holds before it drops the ones no resampler holds
+static const UINT32 c_u32MaxTables = 16;
+
+static const AUDIO_RESAMPLE_FILTER c_aFilters[AUDIO_RESAMPLE_QUALITY_COUNT] =
+{
+    { 16,  60.0,  64 },
+    { 48,  100.0, 256 },
+    { 128, 130.0, 1024 },
+};
+
+const AUDIO_RESAMPLE_FILTER& GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY quality)
+{
+    return c_aFilters[(quality < AUDIO_RESAMPLE_QUALITY_COUNT) ? quality : AUDIO_RESAMPLE_QUALITY_HIGH];
+}
+
+static UINT32 GreatestCommonDivisor(UINT32 a, UINT32 b)
+{
+    while (b != 0)
+    {
+        const UINT32 r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Modified Bessel function of the first kind of order 0, by its power series
+static FLOAT64 BesselI0(FLOAT64 x)
+{
+    const FLOAT64 quarterSquare = x * x / 4.0;
+    FLOAT64 term = 1.0;
+    FLOAT64 sum = 1.0;
+    for (UINT32 k = 1; term > sum * 1e-17; k++)
+    {
+        term *= quarterSquare / (static_cast<FLOAT64>(k) * k);
+        sum += term;
+    }
+    return sum;
+}
+
+//
+// Tabulates a sinc cut off at f64Cutoff cycles per input frame under a Kaiser window
+// u32TapCount frames wide.  Row p is the filter for an output frame p / u32Phases of
+// an input frame after the frame under tap u32TapCount / 2 - 1, scaled so the taps of
+// every row add up to 1 and a constant passes unchanged.
+//
+static void DesignTaps(FLOAT32* pf32Taps, UINT32 u32TapCount, UINT32 u32Phases, FLOAT64 f64Cutoff, FLOAT64 f64Beta)
+{
+    const FLOAT64 pi = 3.14159265358979323846;
+    const FLOAT64 halfWidth = u32TapCount / 2.0;
+    const FLOAT64 windowScale = 1.0 / BesselI0(f64Beta);
+
+    for (UINT32 p = 0; p <= u32Phases; p++)
+    {
+        FLOAT32* pf32Row = pf32Taps + static_cast<size_t>(p) * u32TapCount;
+        const FLOAT64 offset = static_cast<FLOAT64>(p) / u32Phases + halfWidth - 1.0;
+
+        FLOAT64 sum = 0.0;
+        for (UINT32 k = 0; k < u32TapCount; k++)
+        {
+            // Input frames from the output frame to the one under the tap
+            const FLOAT64 t = offset - k;
+            const FLOAT64 x = t / halfWidth;
+            const FLOAT64 window = (x * x < 1.0) ? BesselI0(f64Beta * std::sqrt(1.0 - x * x)) * windowScale : 0.0;
+            const FLOAT64 sinc = (t == 0.0) ? 2.0 * f64Cutoff : std::sin(2.0 * pi * f64Cutoff * t) / (pi * t);
+            const FLOAT64 tap = sinc * window;
+
+            pf32Row[k] = static_cast<FLOAT32>(tap);
+            sum += tap;
+        }
+
+        const FLOAT64 scale = 1.0 / sum;
+        for (UINT32 k = 0; k < u32TapCount; k++)
+        {
+            pf32Row[k] = static_cast<FLOAT32>(pf32Row[k] * scale);
+        }
+    }
+}
+
+//
+// Designs the taps of filter from u32Down to u32Up frames.  Every one of the u32Up
+// positions of the ratio gets a row unless that takes more rows than interpolating
+// between filter.u32Phases per input frame and more taps than c_u64MaxExactTaps.
+//
+static HRESULT DesignTable(UINT32 u32Up, UINT32 u32Down, const AUDIO_RESAMPLE_FILTER& filter,
+                           std::shared_ptr<const AUDIO_RESAMPLE_TABLE>* ppTable)
+{
+    // Downsampling cuts off below the output Nyquist frequency, with a filter as much wider
+    const FLOAT64 ratio = (u32Up < u32Down) ? static_cast<FLOAT64>(u32Up) / u32Down : 1.0;
+    const FLOAT64 tapCount = std::ceil(filter.u32TapCount / ratio / MIX_RAMP_VECTOR_WIDTH) * MIX_RAMP_VECTOR_WIDTH;
+    const FLOAT64 phases = std::ceil(filter.u32Phases * ratio);
+    if (tapCount > 65536.0)
+        return E_INVALIDARG;
+
+    // The transition band a Kaiser window of the width gets to, the stopband starts at the lower Nyquist frequency
+    const FLOAT64 stopband = filter.f64StopbandDb;
+    const FLOAT64 transition = (stopband - 7.95) / (14.36 * (tapCount - 1.0));
+    const FLOAT64 cutoff = 0.5 * ratio - transition / 2.0;
+    const FLOAT64 beta = (stopband > 50.0) ? 0.1102 * (stopband - 8.7) : 0.5842 * std::pow(stopband - 21.0, 0.4) + 0.07886 * (stopband - 21.0);
+    if (cutoff <= 0.0)
+        return E_INVALIDARG;
+
+    std::shared_ptr<AUDIO_RESAMPLE_TABLE> table;
+    try {
+        table = std::make_shared<AUDIO_RESAMPLE_TABLE>();
+        table->u32TapCount = static_cast<UINT32>(tapCount);
+        table->u32Phases = static_cast<UINT32>(phases);
+        if (u32Up <= table->u32Phases || (static_cast<UINT64>(u32Up) + 1) * table->u32TapCount <= c_u64MaxExactTaps)
+            table->u32Phases = u32Up;
+        table->pf32Taps = std::make_unique<FLOAT32[]>(static_cast<size_t>(table->u32Phases + 1) * table->u32TapCount);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+    DesignTaps(table->pf32Taps.get(), table->u32TapCount, table->u32Phases, cutoff, beta);
+
+    *ppTable = std::move(table);
+    return S_OK;
+}
+
+bool AudioResampleTableCache::TABLE_KEY::operator<(const TABLE_KEY& other) const
+{
+    return std::tie(u32Up, u32Down, filter.u32TapCount, filter.f64StopbandDb, filter.u32Phases) <
+           std::tie(other.u32Up, other.u32Down, other.filter.u32TapCount, other.filter.f64StopbandDb, other.filter.u32Phases);
+}
+
+AudioResampleTableCache::AudioResampleTableCache()
+    : m_u32Designs(0)
+{
+}
+
+AudioResampleTableCache& AudioResampleTableCache::GetInstance()
+{
+    static AudioResampleTableCache s_cache;
+    return s_cache;
+}
+
+HRESULT AudioResampleTableCache::Acquire(UINT32 u32Up, UINT32 u32Down, const AUDIO_RESAMPLE_FILTER& filter,
+                                         std::shared_ptr<const AUDIO_RESAMPLE_TABLE>* ppTable)
+{
+    if (ppTable == nullptr)
+        return E_POINTER;
+    ppTable->reset();
+    if (u32Up == 0 || u32Down == 0)
+        return E_INVALIDARG;
+
+    TABLE_KEY key;
+    key.u32Up = u32Up;
+    key.u32Down = u32Down;
+    key.filter = filter;
+
+    // A design takes milliseconds, so it is done under the lock and callers of the same
+    // table never design it twice
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_tables.find(key);
+    if (it != m_tables.end())
+    {
+        *ppTable = it->second;
+        return S_OK;
+    }
+
+    std::shared_ptr<const AUDIO_RESAMPLE_TABLE> table;
+    HRESULT hr = DesignTable(u32Up, u32Down, filter, &table);
+    if (FAILED(hr)) return hr;
+    m_u32Designs++;
+
+    try {
+        Prune();
+        m_tables.emplace(key, table);
+    }
+    catch (std::bad_alloc&) {
+        // The table still works, it is just not shared
+    }
+    *ppTable = std::move(table);
+    return S_OK;
+}
+
+UINT32 AudioResampleTableCache::GetDesignCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_u32Designs;
+}
+
+UINT32 AudioResampleTableCache::GetTableCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<UINT32>(m_tables.size());
+}
+
+void AudioResampleTableCache::Prune()
+{
+    if (m_tables.size() < c_u32MaxTables)
+        return;
+
+    for (auto it = m_tables.begin(); it != m_tables.end(); )
+    {
+        if (it->second.use_count() == 1)
+            it = m_tables.erase(it);
+        else
+            ++it;
+    }
+}
+
+AudioResampler::AudioResampler()
+    : m_pKernels(nullptr)
+    , m_resampler()
+    , m_position()
+    , m_u32Down(0)
+    , m_u32Channels(0)
+    , m_u32PlaneFrames(0)
+    , m_u32Buffered(0)
+    , m_u64InputFrames(0)
+    , m_u64OutputFrames(0)
+{
+}
+
+HRESULT AudioResampler::Initialize(UINT32 u32InputRate, UINT32 u32OutputRate, UINT32 u32Channels,
+                                   AUDIO_RESAMPLE_QUALITY quality)
+{
+    return Initialize(u32InputRate, u32OutputRate, u32Channels, GetAudioResampleFilter(quality));
+}
+
+HRESULT AudioResampler::Initialize(UINT32 u32InputRate, UINT32 u32OutputRate, UINT32 u32Channels,
+                                   const AUDIO_RESAMPLE_FILTER& filter, const MIX_KERNELS* pKernels)
+{
+    m_pTable.reset();
+    if (u32InputRate == 0 || u32OutputRate == 0 || u32Channels == 0 || filter.u32TapCount == 0 ||
+        filter.u32Phases == 0 || filter.f64StopbandDb <= 21.0)
+        return E_INVALIDARG;
+
+    const UINT32 gcd = GreatestCommonDivisor(u32InputRate, u32OutputRate);
+    const UINT32 up = u32OutputRate / gcd;
+    const UINT32 down = u32InputRate / gcd;
+
+    std::shared_ptr<const AUDIO_RESAMPLE_TABLE> table;
+    HRESULT hr = AudioResampleTableCache::GetInstance().Acquire(up, down, filter, &table);
+    if (FAILED(hr)) return hr;
+
+    m_resampler.u32TapCount = table->u32TapCount;
+    m_resampler.u32Phases = table->u32Phases;
+    m_u32Channels = u32Channels;
+    m_u32PlaneFrames = c_u32BlockFrames + m_resampler.u32TapCount;
+    try {
+        m_pPlaneBuffer = std::make_unique<FLOAT32[]>(static_cast<size_t>(m_u32PlaneFrames) * u32Channels);
+        m_ppPlanes = std::make_unique<FLOAT32*[]>(u32Channels);
+        m_ppFill = std::make_unique<FLOAT32*[]>(u32Channels);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    for (UINT32 c = 0; c < u32Channels; c++)
+        m_ppPlanes[c] = m_pPlaneBuffer.get() + static_cast<size_t>(c) * m_u32PlaneFrames;
+
+    // Output frames step by down / up input frames, the fraction in rows and parts of a row;
+    // with a row per position the parts of a row are always 0
+    const UINT64 stepRows = static_cast<UINT64>(down % up) * m_resampler.u32Phases;
+    m_resampler.pf32Taps = table->pf32Taps.get();
+    m_resampler.u32Up = up;
+    m_resampler.u32StepFrames = down / up;
+    m_resampler.u32StepPhases = static_cast<UINT32>(stepRows / up);
+    m_resampler.u32StepFraction = static_cast<UINT32>(stepRows % up);
+    m_resampler.f32FractionScale = static_cast<FLOAT32>(1.0 / up);
+    m_u32Down = down;
+    m_pKernels = (pKernels != nullptr) ? pKernels : SelectMixKernels();
+    m_pTable = std::move(table);
+
+    Reset();
+    return S_OK;
+}
+
+void AudioResampler::Reset()
+{
+    // The first output frame is taken at the first input frame, with silence before it under the taps
+    m_u32Buffered = m_resampler.u32TapCount / 2 - 1;
+    for (UINT32 c = 0; c < m_u32Channels; c++)
+        memset(m_ppPlanes[c], 0, m_u32Buffered * sizeof(FLOAT32));
+
+    m_position = MIX_RESAMPLE_POSITION();
+    m_u64InputFrames = 0;
+    m_u64OutputFrames = 0;
+}
+
+UINT32 AudioResampler::GetMaxOutputFrames(UINT32 u32InputFrames) const
+{
+    if (m_u32Down == 0)
+        return 0;
+    return static_cast<UINT32>((static_cast<UINT64>(u32InputFrames) + m_resampler.u32TapCount) * m_resampler.u32Up / m_u32Down + 1);
+}
+
+UINT64 AudioResampler::GetClipFrames(UINT64 u64InputFrames) const
+{
+    if (m_u32Down == 0)
+        return 0;
+    return (u64InputFrames * m_resampler.u32Up + m_u32Down - 1) / m_u32Down;
+}
+
+HRESULT AudioResampler::Process(const FLOAT32* pf32Input, UINT32 u32InputFrames, FLOAT32* pf32Output, UINT32* pu32OutputFrames)
+{
+    *pu32OutputFrames = 0;
+    if (!m_pTable)
+        return E_FAIL;
+    if (pf32Input == nullptr && u32InputFrames != 0)
+        return E_POINTER;
+
+    *pu32OutputFrames = Feed(pf32Input, u32InputFrames, pf32Output, GetMaxOutputFrames(u32InputFrames));
+    m_u64InputFrames += u32InputFrames;
+    return S_OK;
+}
+
+HRESULT AudioResampler::Flush(FLOAT32* pf32Output, UINT32* pu32OutputFrames)
+{
+    *pu32OutputFrames = 0;
+    if (!m_pTable)
+        return E_FAIL;
+
+    // Half the filter of silence reaches the last output frame of the clip, the ones after it are not handed out
+    const UINT64 remaining = GetClipFrames(m_u64InputFrames) - m_u64OutputFrames;
+    *pu32OutputFrames = Feed(nullptr, m_resampler.u32TapCount / 2, pf32Output, static_cast<UINT32>(remaining));
+    return S_OK;
+}
+
+UINT32 AudioResampler::Feed(const FLOAT32* pf32Input, UINT32 u32InputFrames, FLOAT32* pf32Output, UINT32 u32OutputFrames)
+{
+    UINT32 u32Written = 0;
+    for (;;)
+    {
+        UINT32 u32Frames = m_u32PlaneFrames - m_u32Buffered;
+        if (u32Frames > u32InputFrames)
+            u32Frames = u32InputFrames;
+
+        if (pf32Input != nullptr)
+        {
+            for (UINT32 c = 0; c < m_u32Channels; c++)
+                m_ppFill[c] = m_ppPlanes[c] + m_u32Buffered;
+            m_pKernels->pfnDeinterleave(m_ppFill.get(), pf32Input, u32Frames, m_u32Channels);
+            pf32Input += static_cast<size_t>(u32Frames) * m_u32Channels;
+        }
+        else
+        {
+            for (UINT32 c = 0; c < m_u32Channels; c++)
+                memset(m_ppPlanes[c] + m_u32Buffered, 0, u32Frames * sizeof(FLOAT32));
+        }
+        m_u32Buffered += u32Frames;
+        u32InputFrames -= u32Frames;
+
+        u32Written += m_pKernels->pfnResample(&m_resampler, &m_position, pf32Output + static_cast<size_t>(u32Written) * m_u32Channels,
+                                              u32OutputFrames - u32Written, m_ppPlanes.get(), m_u32Buffered, m_u32Channels);
+
+        // The frames before the taps of the next output frame are done with
+        const UINT32 u32Done = (m_position.u32Frame < m_u32Buffered) ? m_position.u32Frame : m_u32Buffered;
+        if (u32Done != 0)
+        {
+            for (UINT32 c = 0; c < m_u32Channels; c++)
+                memmove(m_ppPlanes[c], m_ppPlanes[c] + u32Done, (m_u32Buffered - u32Done) * sizeof(FLOAT32));
+            m_u32Buffered -= u32Done;
+            m_position.u32Frame -= u32Done;
+        }
+
+        if (u32InputFrames == 0)
+            break;
+    }
+
+    m_u64OutputFrames += u32Written;
+    return u32Written;
+}
@@ -0,0 +1,171 @@
+//
+// AudioResampler.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Resampler of interleaved float frames between any two rates, a polyphase
+//  windowed sinc filter run by the PFN_MIX_RESAMPLE kernel of the instruction set
+//  of the CPU.  The filter is a sinc cut off below the lower of the two Nyquist
+//  frequencies under a Kaiser window.  The reduced ratio of the rates repeats
+//  every u32Up output frames, so the filter is tabulated at each of their
+//  positions and used as is; where that takes too many rows it is tabulated at a
+//  number of fractions of an input frame and interpolated in between.  The taps
+//  are designed once per ratio and filter and shared by the resamplers of the
+//  process, see AudioResampleTableCache.  Frames go in and come out in blocks of
+//  any size, so a clip can be resampled whole or on its way into a stream.
+//  Platform independent, with no resampler of the system involved.
+//
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include "AudioMixKernels.h"
+
+//
+// Presets of the filter, from the cheapest to the cleanest.  The passband of each
+// ends where its transition band has to start for the stopband to begin at the
+// lower Nyquist frequency, so nothing aliases above the stopband attenuation.
+//
+enum AUDIO_RESAMPLE_QUALITY
+{
+    AUDIO_RESAMPLE_QUALITY_LOW = 0,     // 16 taps, 60 dB, passband to 0.26 of the rate
+    AUDIO_RESAMPLE_QUALITY_MEDIUM,      // 48 taps, 100 dB, passband to 0.36 of the rate
+    AUDIO_RESAMPLE_QUALITY_HIGH,        // 128 taps, 130 dB, passband to 0.43 of the rate
+    AUDIO_RESAMPLE_QUALITY_COUNT
+};
+
+//
+// Filter of a resampler.  The taps and phases are the ones of a ratio of 1;
+// downsampling widens the filter by the ratio and thins the phases by it, so the
+// transition band keeps its place relative to the output rate.  The phases only
+// count for ratios whose positions take too many rows to tabulate each.
+//
+struct AUDIO_RESAMPLE_FILTER
+{
+    UINT32      u32TapCount;            // rounded up to a multiple of MIX_RAMP_VECTOR_WIDTH
+    FLOAT64     f64StopbandDb;          // attenuation of the stopband, sets the Kaiser window
+    UINT32      u32Phases;              // rows per input frame of a filter interpolated between them
+};
+
+// Gets the filter of a preset
+const AUDIO_RESAMPLE_FILTER& GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY quality);
+
+// Taps of a filter at a ratio, see MIX_RESAMPLER
+struct AUDIO_RESAMPLE_TABLE
+{
+    UINT32                          u32TapCount;
+    UINT32                          u32Phases;      // u32Up of the ratio if every position has a row
+    std::unique_ptr<FLOAT32[]>      pf32Taps;       // u32Phases + 1 rows
+};
+
+//
+// Process-wide cache of the taps of the resamplers, so that every clip and stream
+// resampled at the same ratio with the same filter shares one table and only the
+// first pays for the design.  Tables are kept while the process runs, those no
+// resampler holds are dropped once there are more than a few of them.
+//
+class AudioResampleTableCache
+{
+public:
+    AudioResampleTableCache();
+
+    AudioResampleTableCache(const AudioResampleTableCache&) = delete;
+    AudioResampleTableCache& operator=(const AudioResampleTableCache&) = delete;
+
+    // Get the cache the resamplers of the process share
+    static AudioResampleTableCache& GetInstance();
+
+    // Get the taps of filter from u32Down to u32Up frames, a reduced ratio, designing them
+    // if no resampler did before.  Callers that ask while they are designed wait for them.
+    HRESULT Acquire(UINT32 u32Up, UINT32 u32Down, const AUDIO_RESAMPLE_FILTER& filter,
+                    std::shared_ptr<const AUDIO_RESAMPLE_TABLE>* ppTable);
+
+    // Get the number of tables designed so far
+    UINT32 GetDesignCount();
+
+    // Get the number of tables in the cache
+    UINT32 GetTableCount();
+
+private:
+    struct TABLE_KEY
+    {
+        UINT32                  u32Up;
+        UINT32                  u32Down;
+        AUDIO_RESAMPLE_FILTER   filter;
+
+        bool operator<(const TABLE_KEY& other) const;
+    };
+
+    // Drop the tables no resampler holds once there are too many, with m_mutex held
+    void Prune();
+
+    std::mutex m_mutex;
+    std::map<TABLE_KEY, std::shared_ptr<const AUDIO_RESAMPLE_TABLE>> m_tables;
+    UINT32 m_u32Designs;
+};
+
+class AudioResampler
+{
+public:
+    AudioResampler();
+
+    // Set up for u32Channels channels from u32InputRate to u32OutputRate with the taps of
+    // the filter out of AudioResampleTableCache.  Runs the kernels of pKernels, the ones
+    // of the CPU by default.
+    HRESULT Initialize(UINT32 u32InputRate, UINT32 u32OutputRate, UINT32 u32Channels,
+                       const AUDIO_RESAMPLE_FILTER& filter, const MIX_KERNELS* pKernels = nullptr);
+
+    HRESULT Initialize(UINT32 u32InputRate, UINT32 u32OutputRate, UINT32 u32Channels,
+                       AUDIO_RESAMPLE_QUALITY quality = AUDIO_RESAMPLE_QUALITY_HIGH);
+
+    // Forget the frames so far, the next one is the start of a clip again
+    void Reset();
+
+    // Get the most frames Process hands out for u32InputFrames more frames
+    UINT32 GetMaxOutputFrames(UINT32 u32InputFrames) const;
+
+    // Get the frames of a clip of u64InputFrames frames resampled whole, by Process and Flush
+    UINT64 GetClipFrames(UINT64 u64InputFrames) const;
+
+    // Resample u32InputFrames interleaved frames into pf32Output, which has room for
+    // GetMaxOutputFrames(u32InputFrames) frames.  Output frames wait for the input
+    // half the filter past them, the first one is taken at the first input frame.  No more
+    // than GetClipFrames of the input so far are handed out, so a clip can be resampled
+    // straight into a buffer of GetClipFrames frames.
+    HRESULT Process(const FLOAT32* pf32Input, UINT32 u32InputFrames, FLOAT32* pf32Output, UINT32* pu32OutputFrames);
+
+    // Hand out the output frames still waiting for input past the end of a clip, as if
+    // silence followed it, into room for GetMaxOutputFrames(0) frames.  Together with
+    // Process they make up GetClipFrames of the input.
+    HRESULT Flush(FLOAT32* pf32Output, UINT32* pu32OutputFrames);
+
+    // Get the taps per output frame and channel, a multiple of MIX_RAMP_VECTOR_WIDTH
+    UINT32 GetTapCount() const { return m_resampler.u32TapCount; }
+
+    // Get the rows of taps per input frame, u32Up of the reduced ratio if no output frame
+    // is interpolated between two of them
+    UINT32 GetPhaseCount() const { return m_resampler.u32Phases; }
+
+private:
+    // Run the kernel over u32InputFrames frames, zeros if pf32Input is nullptr, handing out
+    // up to u32OutputFrames frames
+    UINT32 Feed(const FLOAT32* pf32Input, UINT32 u32InputFrames, FLOAT32* pf32Output, UINT32 u32OutputFrames);
+
+    const MIX_KERNELS* m_pKernels;
+    MIX_RESAMPLER m_resampler;
+    MIX_RESAMPLE_POSITION m_position;
+    std::shared_ptr<const AUDIO_RESAMPLE_TABLE> m_pTable;
+    std::unique_ptr<FLOAT32[]> m_pPlaneBuffer;
+    std::unique_ptr<FLOAT32*[]> m_ppPlanes;        // input frames under the taps, m_u32Buffered of them
+    std::unique_ptr<FLOAT32*[]> m_ppFill;          // where the next input frames go in each plane
+    UINT32 m_u32Down;                               // input frames per m_resampler.u32Up output frames
+    UINT32 m_u32Channels;
+    UINT32 m_u32PlaneFrames;
+    UINT32 m_u32Buffered;
+    UINT64 m_u64InputFrames;                        // since Reset
+    UINT64 m_u64OutputFrames;
+};
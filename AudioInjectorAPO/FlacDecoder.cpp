@@ -0,0 +1,1021 @@
+//
+// FlacDecoder.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Implementation of the FLAC decoder, after the format as RFC 9639 describes it
+//
+
+#include "FlacDecoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Bytes of the file a thread of DecodeAll gets at least, a few dozen frames of a typical file
+static const UINT64 c_cbMinRangeBytes = 64 * 1024;
+
+// Sample rates of the frame header codes 1 to 11
+static const UINT32 c_au32SampleRates[12] =
+    { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+
+// Bits per sample of the frame header codes, 0 where the code does not give them
+static const UINT32 c_au32SampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+
+static UINT32 ReadBE16(const BYTE *pb)
+{
+    return (static_cast<UINT32>(pb[0]) << 8) | pb[1];
+}
+
+static UINT32 ReadBE24(const BYTE *pb)
+{
+    return (static_cast<UINT32>(pb[0]) << 16) | (static_cast<UINT32>(pb[1]) << 8) | pb[2];
+}
+
+static UINT64 ReadBE64(const BYTE *pb)
+{
+    UINT64 u64Value = 0;
+    for (UINT32 i = 0; i < 8; i++)
+    {
+        u64Value = (u64Value << 8) | pb[i];
+    }
+    return u64Value;
+}
+
+static UINT32 CountLeadingZeros(UINT64 u64Value)
+{
+#if defined(_MSC_VER)
+    unsigned long ulIndex = 0;
+    _BitScanReverse64(&ulIndex, u64Value);
+    return 63 - ulIndex;
+#else
+    return static_cast<UINT32>(__builtin_clzll(u64Value));
+#endif
+}
+
+// CRC-8 of the frame headers and CRC-16 of the whole frames, built on first use
+struct FLAC_CRC_TABLES
+{
+    BYTE        ab8[256];
+    UINT16      au16[256];
+
+    FLAC_CRC_TABLES()
+    {
+        for (UINT32 i = 0; i < 256; i++)
+        {
+            UINT32 u32Crc8 = i;
+            UINT32 u32Crc16 = i << 8;
+            for (UINT32 bit = 0; bit < 8; bit++)
+            {
+                u32Crc8 = (u32Crc8 & 0x80) ? ((u32Crc8 << 1) ^ 0x07) : (u32Crc8 << 1);
+                u32Crc16 = (u32Crc16 & 0x8000) ? ((u32Crc16 << 1) ^ 0x8005) : (u32Crc16 << 1);
+            }
+            ab8[i] = static_cast<BYTE>(u32Crc8);
+            au16[i] = static_cast<UINT16>(u32Crc16);
+        }
+    }
+};
+
+static const FLAC_CRC_TABLES& GetCrcTables()
+{
+    static const FLAC_CRC_TABLES s_tables;
+    return s_tables;
+}
+
+//
+// Reads the big endian bit fields of a frame.  Past the end of the bytes it reads
+// zeros and remembers that it did, which the callers check once in a while, so a
+// damaged frame costs no bounds check per field.
+//
+class FlacBitReader
+{
+public:
+    FlacBitReader(const BYTE *pbData, UINT64 cbData, UINT64 u64Offset)
+        : m_pbData(pbData)
+        , m_cbData(cbData)
+        , m_u64Next(u64Offset)
+        , m_u64Cache(0)
+        , m_u32Bits(0)
+    {
+    }
+
+    // Read an unsigned field of up to 32 bits
+    UINT32 Read(UINT32 u32Count)
+    {
+        if (u32Count == 0)
+        {
+            return 0;
+        }
+        if (m_u32Bits < u32Count)
+        {
+            Refill();
+        }
+
+        const UINT32 u32Value = static_cast<UINT32>(m_u64Cache >> (64 - u32Count));
+        m_u64Cache <<= u32Count;
+        m_u32Bits -= u32Count;
+        return u32Value;
+    }
+
+    // Read a two's complement field of up to 32 bits
+    INT32 ReadSigned(UINT32 u32Count)
+    {
+        if (u32Count == 0)
+        {
+            return 0;
+        }
+        const UINT32 u32Shift = 32 - u32Count;
+        return static_cast<INT32>(Read(u32Count) << u32Shift) >> u32Shift;
+    }
+
+    // Read the zeros before the next one and the one
+    UINT32 ReadUnary()
+    {
+        UINT32 u32Zeros = 0;
+        for (;;)
+        {
+            // The bits below the cached ones are always zero
+            if (m_u64Cache != 0)
+            {
+                const UINT32 u32Leading = CountLeadingZeros(m_u64Cache);
+                m_u64Cache = (m_u64Cache << u32Leading) << 1;
+                m_u32Bits -= u32Leading + 1;
+                return u32Zeros + u32Leading;
+            }
+
+            u32Zeros += m_u32Bits;
+            m_u32Bits = 0;
+            if (IsOverrun())
+            {
+                return u32Zeros;
+            }
+            Refill();
+        }
+    }
+
+    // Read a zigzag coded Rice code of parameter u32Parameter
+    INT32 ReadRice(UINT32 u32Parameter)
+    {
+        const UINT32 u32Value = (ReadUnary() << u32Parameter) | Read(u32Parameter);
+        return static_cast<INT32>(u32Value >> 1) ^ -static_cast<INT32>(u32Value & 1);
+    }
+
+    // Skip to the next whole byte
+    void AlignToByte()
+    {
+        const UINT32 u32Drop = m_u32Bits % 8;
+        m_u64Cache <<= u32Drop;
+        m_u32Bits -= u32Drop;
+    }
+
+    // Get the offset of the next byte, once aligned
+    UINT64 GetOffset() const { return m_u64Next - m_u32Bits / 8; }
+
+    // Check whether more bits were read than there are
+    bool IsOverrun() const { return m_u64Next * 8 - m_u32Bits > m_cbData * 8; }
+
+private:
+    void Refill()
+    {
+        while (m_u32Bits <= 56)
+        {
+            const UINT64 u64Byte = (m_u64Next < m_cbData) ? m_pbData[m_u64Next] : 0;
+            m_u64Cache |= u64Byte << (56 - m_u32Bits);
+            m_u32Bits += 8;
+            m_u64Next++;
+        }
+    }
+
+    const BYTE *m_pbData;
+    UINT64 m_cbData;
+    UINT64 m_u64Next;       // of the next byte to cache
+    UINT64 m_u64Cache;      // the next bits at the top
+    UINT32 m_u32Bits;
+};
+
+// Reads the partitioned Rice coded residual of a subframe after its u32Order warm-up samples
+static bool DecodeResidual(FlacBitReader& reader, INT32 *pi32Samples, UINT32 u32BlockSize, UINT32 u32Order)
+{
+    const UINT32 u32Method = reader.Read(2);
+    if (u32Method > 1)
+    {
+        return false;
+    }
+
+    const UINT32 u32ParameterBits = (u32Method == 0) ? 4 : 5;
+    const UINT32 u32Escape = (1u << u32ParameterBits) - 1;
+    const UINT32 u32PartitionOrder = reader.Read(4);
+    const UINT32 u32PerPartition = u32BlockSize >> u32PartitionOrder;
+    if ((u32PerPartition << u32PartitionOrder) != u32BlockSize || u32PerPartition < u32Order)
+    {
+        return false;
+    }
+
+    INT32 *pi32Residual = pi32Samples + u32Order;
+    for (UINT32 partition = 0; partition < (1u << u32PartitionOrder); partition++)
+    {
+        const UINT32 u32Count = (partition == 0) ? u32PerPartition - u32Order : u32PerPartition;
+        const UINT32 u32Parameter = reader.Read(u32ParameterBits);
+        if (u32Parameter == u32Escape)
+        {
+            // Escaped partitions hold plain signed values of the width that follows
+            const UINT32 u32Bits = reader.Read(5);
+            for (UINT32 i = 0; i < u32Count; i++)
+            {
+                pi32Residual[i] = reader.ReadSigned(u32Bits);
+            }
+        }
+        else
+        {
+            for (UINT32 i = 0; i < u32Count; i++)
+            {
+                pi32Residual[i] = reader.ReadRice(u32Parameter);
+            }
+        }
+
+        pi32Residual += u32Count;
+        if (reader.IsOverrun())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Adds the prediction of the fixed polynomial of u32Order to the residual
+static void RestoreFixed(INT32 *pi32Samples, UINT32 u32BlockSize, UINT32 u32Order)
+{
+    INT32 *s = pi32Samples;
+    switch (u32Order)
+    {
+    case 1:
+        for (UINT32 i = 1; i < u32BlockSize; i++)
+            s[i] = static_cast<INT32>(s[i] + static_cast<INT64>(s[i - 1]));
+        break;
+    case 2:
+        for (UINT32 i = 2; i < u32BlockSize; i++)
+            s[i] = static_cast<INT32>(s[i] + 2 * static_cast<INT64>(s[i - 1]) - s[i - 2]);
+        break;
+    case 3:
+        for (UINT32 i = 3; i < u32BlockSize; i++)
+            s[i] = static_cast<INT32>(s[i] + 3 * (static_cast<INT64>(s[i - 1]) - s[i - 2]) + s[i - 3]);
+        break;
+    case 4:
+        for (UINT32 i = 4; i < u32BlockSize; i++)
+            s[i] = static_cast<INT32>(s[i] + 4 * (static_cast<INT64>(s[i - 1]) + s[i - 3]) - 6 * static_cast<INT64>(s[i - 2]) - s[i - 4]);
+        break;
+    default:
+        break;
+    }
+}
+
+//
+// Adds the prediction of the quantized linear predictor to the residual.  The sums
+// are made in 32 bits where the widths of the samples and the coefficients allow it,
+// which is the case for 16 bit sources, and in 64 bits otherwise.
+//
+static void RestoreLpc(INT32 *pi32Samples, UINT32 u32BlockSize, const INT32 *pi32Coefficients,
+                       UINT32 u32Order, UINT32 u32Precision, UINT32 u32Shift, UINT32 u32Bits)
+{
+    UINT32 u32OrderBits = 0;
+    while ((1u << u32OrderBits) < u32Order)
+    {
+        u32OrderBits++;
+    }
+
+    if (u32Bits + u32Precision + u32OrderBits <= 32)
+    {
+        for (UINT32 i = u32Order; i < u32BlockSize; i++)
+        {
+            const INT32 *pi32History = pi32Samples + i - 1;
+            INT32 i32Sum = 0;
+            for (UINT32 j = 0; j < u32Order; j++)
+            {
+                i32Sum += pi32Coefficients[j] * pi32History[-static_cast<INT32>(j)];
+            }
+            pi32Samples[i] += i32Sum >> u32Shift;
+        }
+    }
+    else
+    {
+        for (UINT32 i = u32Order; i < u32BlockSize; i++)
+        {
+            const INT32 *pi32History = pi32Samples + i - 1;
+            INT64 i64Sum = 0;
+            for (UINT32 j = 0; j < u32Order; j++)
+            {
+                i64Sum += static_cast<INT64>(pi32Coefficients[j]) * pi32History[-static_cast<INT32>(j)];
+            }
+            pi32Samples[i] = static_cast<INT32>(pi32Samples[i] + (i64Sum >> u32Shift));
+        }
+    }
+}
+
+// Reads a subframe of u32BlockSize samples of u32Bits bits into pi32Samples
+static bool DecodeSubframe(FlacBitReader& reader, INT32 *pi32Samples, UINT32 u32BlockSize, UINT32 u32Bits)
+{
+    if (reader.Read(1) != 0)
+    {
+        return false;
+    }
+
+    const UINT32 u32Type = reader.Read(6);
+
+    // Low bits that are zero in every sample are left out and shifted back in at the end
+    UINT32 u32Wasted = 0;
+    if (reader.Read(1) != 0)
+    {
+        u32Wasted = reader.ReadUnary() + 1;
+        if (u32Wasted >= u32Bits)
+        {
+            return false;
+        }
+        u32Bits -= u32Wasted;
+    }
+
+    if (u32Type == 0)
+    {
+        // CONSTANT
+        const INT32 i32Value = reader.ReadSigned(u32Bits);
+        for (UINT32 i = 0; i < u32BlockSize; i++)
+        {
+            pi32Samples[i] = i32Value;
+        }
+    }
+    else if (u32Type == 1)
+    {
+        // VERBATIM
+        for (UINT32 i = 0; i < u32BlockSize; i++)
+        {
+            pi32Samples[i] = reader.ReadSigned(u32Bits);
+        }
+    }
+    else if (u32Type >= 8 && u32Type <= 12)
+    {
+        // FIXED of order 0 to 4
+        const UINT32 u32Order = u32Type - 8;
+        if (u32Order > u32BlockSize)
+        {
+            return false;
+        }
+        for (UINT32 i = 0; i < u32Order; i++)
+        {
+            pi32Samples[i] = reader.ReadSigned(u32Bits);
+        }
+        if (!DecodeResidual(reader, pi32Samples, u32BlockSize, u32Order))
+        {
+            return false;
+        }
+        RestoreFixed(pi32Samples, u32BlockSize, u32Order);
+    }
+    else if (u32Type >= 32)
+    {
+        // LPC of order 1 to 32
+        const UINT32 u32Order = u32Type - 31;
+        if (u32Order > u32BlockSize)
+        {
+            return false;
+        }
+        for (UINT32 i = 0; i < u32Order; i++)
+        {
+            pi32Samples[i] = reader.ReadSigned(u32Bits);
+        }
+
+        const UINT32 u32Precision = reader.Read(4) + 1;
+        const INT32 i32Shift = reader.ReadSigned(5);
+        if (u32Precision == 16 || i32Shift < 0)
+        {
+            return false;
+        }
+
+        INT32 ai32Coefficients[32];
+        for (UINT32 i = 0; i < u32Order; i++)
+        {
+            ai32Coefficients[i] = reader.ReadSigned(u32Precision);
+        }
+        if (!DecodeResidual(reader, pi32Samples, u32BlockSize, u32Order))
+        {
+            return false;
+        }
+        RestoreLpc(pi32Samples, u32BlockSize, ai32Coefficients, u32Order, u32Precision, static_cast<UINT32>(i32Shift), u32Bits);
+    }
+    else
+    {
+        return false;
+    }
+
+    if (u32Wasted != 0)
+    {
+        for (UINT32 i = 0; i < u32BlockSize; i++)
+        {
+            pi32Samples[i] = static_cast<INT32>(static_cast<UINT32>(pi32Samples[i]) << u32Wasted);
+        }
+    }
+    return !reader.IsOverrun();
+}
+
+FlacDecoder::FlacDecoder()
+    : m_pbFile(nullptr)
+    , m_cbFile(0)
+    , m_u64FirstFrameOffset(0)
+    , m_info()
+    , m_u64Offset(0)
+    , m_u64Position(0)
+    , m_u32Skip(0)
+{
+}
+
+HRESULT FlacDecoder::Open(const BYTE* pbFile, UINT64 cbFile)
+{
+    m_pbFile = nullptr;
+    m_cbFile = 0;
+    m_info = FLAC_STREAM_INFO();
+    m_seekPoints.clear();
+
+    if (pbFile == nullptr || cbFile < 8 || std::memcmp(pbFile, "fLaC", 4) != 0)
+    {
+        return E_FAIL;
+    }
+
+    // STREAMINFO comes first, the other blocks but the seek table are of no use here
+    FLAC_STREAM_INFO info = {};
+    std::vector<FLAC_SEEK_POINT> seekPoints;
+    UINT64 u64Offset = 4;
+    bool bLast = false;
+    while (!bLast)
+    {
+        if (u64Offset + 4 > cbFile)
+        {
+            return E_FAIL;
+        }
+
+        const BYTE *pbBlock = pbFile + u64Offset;
+        const UINT32 u32Type = pbBlock[0] & 0x7F;
+        const UINT32 u32Size = ReadBE24(pbBlock + 1);
+        const BYTE *pbBody = pbBlock + 4;
+        bLast = (pbBlock[0] & 0x80) != 0;
+        if (u64Offset + 4 + u32Size > cbFile || (u64Offset == 4) != (u32Type == 0))
+        {
+            return E_FAIL;
+        }
+
+        if (u32Type == 0)
+        {
+            if (u32Size < 34)
+            {
+                return E_FAIL;
+            }
+            info.u32MinBlockSize = ReadBE16(pbBody);
+            info.u32MaxBlockSize = ReadBE16(pbBody + 2);
+            info.u32SampleRate = (ReadBE24(pbBody + 10) >> 4);
+            info.u16Channels = static_cast<UINT16>(((pbBody[12] >> 1) & 0x7) + 1);
+            info.u16BitsPerSample = static_cast<UINT16>((((pbBody[12] & 0x1) << 4) | (pbBody[13] >> 4)) + 1);
+            info.u64TotalFrames = ReadBE64(pbBody + 10) & 0xFFFFFFFFFULL;
+        }
+        else if (u32Type == 3)
+        {
+            try {
+                // Placeholders and points out of order are dropped
+                for (UINT32 u32Point = 0; u32Point + 18 <= u32Size; u32Point += 18)
+                {
+                    const FLAC_SEEK_POINT point = { ReadBE64(pbBody + u32Point), ReadBE64(pbBody + u32Point + 8) };
+                    if (point.u64Frame != UINT64_MAX && point.u64Offset < cbFile &&
+                        (seekPoints.empty() || (seekPoints.back().u64Frame < point.u64Frame && seekPoints.back().u64Offset < point.u64Offset)))
+                    {
+                        seekPoints.push_back(point);
+                    }
+                }
+            }
+            catch (std::bad_alloc&) {
+                return E_OUTOFMEMORY;
+            }
+        }
+
+        u64Offset += 4 + u32Size;
+    }
+
+    if (info.u32SampleRate == 0 || info.u32MaxBlockSize == 0 || info.u16BitsPerSample < 4)
+    {
+        return E_FAIL;
+    }
+    if (info.u16BitsPerSample > 24)
+    {
+        return E_NOTIMPL;
+    }
+
+    try {
+        m_planes.resize(static_cast<size_t>(info.u32MaxBlockSize) * info.u16Channels);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    m_pbFile = pbFile;
+    m_cbFile = cbFile;
+    m_u64FirstFrameOffset = u64Offset;
+    m_info = info;
+    m_seekPoints.swap(seekPoints);
+    m_u64Offset = u64Offset;
+    m_u64Position = 0;
+    m_u32Skip = 0;
+    return S_OK;
+}
+
+DWORD FlacDecoder::GetChannelMask() const
+{
+    // The channel orders of the FLAC specification
+    switch (m_info.u16Channels)
+    {
+    case 3:
+        return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER;
+    case 4:
+        return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 5:
+        return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 6:
+        return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+               SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 7:
+        return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+               SPEAKER_BACK_CENTER | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT;
+    case 8:
+        return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+               SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT;
+    default:
+        return 0;
+    }
+}
+
+bool FlacDecoder::ParseFrameHeader(UINT64 u64Offset, FLAC_FRAME_HEADER* pHeader) const
+{
+    // Sync code, codes, the shortest coded number and the CRC
+    if (u64Offset + 6 > m_cbFile)
+    {
+        return false;
+    }
+
+    const BYTE *pb = m_pbFile + u64Offset;
+    if (pb[0] != 0xFF || (pb[1] & 0xFE) != 0xF8 || (pb[3] & 0x1) != 0)
+    {
+        return false;
+    }
+
+    const bool bVariable = (pb[1] & 0x1) != 0;
+    const UINT32 u32BlockCode = pb[2] >> 4;
+    const UINT32 u32RateCode = pb[2] & 0xF;
+    const UINT32 u32Assignment = pb[3] >> 4;
+    const UINT32 u32SizeCode = (pb[3] >> 1) & 0x7;
+    if (u32BlockCode == 0 || u32RateCode == 15 || u32Assignment > 10 || u32SizeCode == 3)
+    {
+        return false;
+    }
+
+    // Frame or sample number, coded like UTF-8 with up to 36 bits
+    const UINT64 u64Limit = m_cbFile - u64Offset;
+    UINT64 u64Index = 4;
+    const UINT32 u32Lead = pb[u64Index++];
+    UINT32 u32Extra = 0;
+    UINT64 u64Number = 0;
+    if ((u32Lead & 0x80) == 0)
+    {
+        u64Number = u32Lead;
+    }
+    else
+    {
+        while (u32Extra < 7 && (u32Lead & (0x40 >> u32Extra)) != 0)
+        {
+            u32Extra++;
+        }
+        if (u32Extra == 0 || u32Extra > 6)
+        {
+            return false;
+        }
+        u64Number = u32Lead & (0x3F >> u32Extra);
+    }
+    if (u64Index + u32Extra + 1 > u64Limit)
+    {
+        return false;
+    }
+    for (UINT32 i = 0; i < u32Extra; i++)
+    {
+        const UINT32 u32Byte = pb[u64Index++];
+        if ((u32Byte & 0xC0) != 0x80)
+        {
+            return false;
+        }
+        u64Number = (u64Number << 6) | (u32Byte & 0x3F);
+    }
+
+    // Block size and sample rate that do not fit their codes follow
+    UINT32 u32BlockSize = 0;
+    if (u32BlockCode == 1)
+    {
+        u32BlockSize = 192;
+    }
+    else if (u32BlockCode <= 5)
+    {
+        u32BlockSize = 576u << (u32BlockCode - 2);
+    }
+    else if (u32BlockCode == 6)
+    {
+        if (u64Index + 2 > u64Limit)
+        {
+            return false;
+        }
+        u32BlockSize = pb[u64Index++] + 1u;
+    }
+    else if (u32BlockCode == 7)
+    {
+        if (u64Index + 3 > u64Limit)
+        {
+            return false;
+        }
+        u32BlockSize = ReadBE16(pb + u64Index) + 1u;
+        u64Index += 2;
+    }
+    else
+    {
+        u32BlockSize = 256u << (u32BlockCode - 8);
+    }
+
+    UINT32 u32SampleRate = 0;
+    if (u32RateCode < 12)
+    {
+        u32SampleRate = c_au32SampleRates[u32RateCode];
+    }
+    else
+    {
+        const UINT32 u32Bytes = (u32RateCode == 12) ? 1 : 2;
+        if (u64Index + u32Bytes + 1 > u64Limit)
+        {
+            return false;
+        }
+        const UINT32 u32Value = (u32Bytes == 1) ? pb[u64Index] : ReadBE16(pb + u64Index);
+        u32SampleRate = (u32RateCode == 12) ? u32Value * 1000 : (u32RateCode == 13) ? u32Value : u32Value * 10;
+        u64Index += u32Bytes;
+    }
+
+    BYTE bCrc = 0;
+    const FLAC_CRC_TABLES& tables = GetCrcTables();
+    for (UINT64 i = 0; i < u64Index; i++)
+    {
+        bCrc = tables.ab8[bCrc ^ pb[i]];
+    }
+    if (bCrc != pb[u64Index])
+    {
+        return false;
+    }
+
+    // A header that passes its CRC by chance still has to match the stream
+    const UINT64 u64FirstFrame = bVariable ? u64Number : u64Number * m_info.u32MaxBlockSize;
+    const UINT32 u32Channels = (u32Assignment < 8) ? u32Assignment + 1 : 2;
+    if ((u32SampleRate != 0 && u32SampleRate != m_info.u32SampleRate) ||
+        (u32SizeCode != 0 && c_au32SampleSizes[u32SizeCode] != m_info.u16BitsPerSample) ||
+        u32Channels != m_info.u16Channels ||
+        u32BlockSize > m_info.u32MaxBlockSize ||
+        (m_info.u64TotalFrames != 0 && u64FirstFrame >= m_info.u64TotalFrames))
+    {
+        return false;
+    }
+
+    pHeader->u64FirstFrame = u64FirstFrame;
+    pHeader->u32BlockSize = u32BlockSize;
+    pHeader->u32ChannelAssignment = u32Assignment;
+    pHeader->u32HeaderBytes = static_cast<UINT32>(u64Index + 1);
+    return true;
+}
+
+HRESULT FlacDecoder::DecodeFrame(UINT64 u64Offset, INT32* pi32Planes, FLAC_FRAME_HEADER* pHeader, UINT64* pu64Next) const
+{
+    if (!ParseFrameHeader(u64Offset, pHeader))
+    {
+        return E_FAIL;
+    }
+
+    const UINT32 u32BlockSize = pHeader->u32BlockSize;
+    const UINT32 u32Assignment = pHeader->u32ChannelAssignment;
+    const UINT32 u32PlaneSize = m_info.u32MaxBlockSize;
+    FlacBitReader reader(m_pbFile, m_cbFile, u64Offset + pHeader->u32HeaderBytes);
+
+    for (UINT32 c = 0; c < m_info.u16Channels; c++)
+    {
+        // The side channel has a bit more than the others
+        const bool bSide = (c == 1 && (u32Assignment == 8 || u32Assignment == 10)) || (c == 0 && u32Assignment == 9);
+        const UINT32 u32Bits = m_info.u16BitsPerSample + (bSide ? 1 : 0);
+        if (!DecodeSubframe(reader, pi32Planes + static_cast<size_t>(c) * u32PlaneSize, u32BlockSize, u32Bits))
+        {
+            return E_FAIL;
+        }
+    }
+
+    reader.AlignToByte();
+    const UINT64 u64End = reader.GetOffset();
+    if (u64End + 2 > m_cbFile)
+    {
+        return E_FAIL;
+    }
+
+    UINT32 u32Crc = 0;
+    const FLAC_CRC_TABLES& tables = GetCrcTables();
+    for (UINT64 i = u64Offset; i < u64End; i++)
+    {
+        u32Crc = ((u32Crc << 8) ^ tables.au16[(u32Crc >> 8) ^ m_pbFile[i]]) & 0xFFFF;
+    }
+    if (u32Crc != ReadBE16(m_pbFile + u64End))
+    {
+        return E_FAIL;
+    }
+
+    // Stereo decorrelation
+    INT32 *pi32Left = pi32Planes;
+    INT32 *pi32Right = pi32Planes + u32PlaneSize;
+    if (u32Assignment == 8)
+    {
+        for (UINT32 i = 0; i < u32BlockSize; i++)
+            pi32Right[i] = pi32Left[i] - pi32Right[i];
+    }
+    else if (u32Assignment == 9)
+    {
+        for (UINT32 i = 0; i < u32BlockSize; i++)
+            pi32Left[i] += pi32Right[i];
+    }
+    else if (u32Assignment == 10)
+    {
+        for (UINT32 i = 0; i < u32BlockSize; i++)
+        {
+            const INT32 i32Side = pi32Right[i];
+            const INT32 i32Mid = static_cast<INT32>((static_cast<UINT32>(pi32Left[i]) << 1) | (i32Side & 1));
+            pi32Left[i] = (i32Mid + i32Side) >> 1;
+            pi32Right[i] = (i32Mid - i32Side) >> 1;
+        }
+    }
+
+    *pu64Next = u64End + 2;
+    return S_OK;
+}
+
+void FlacDecoder::StoreFrames(const INT32* pi32Planes, UINT32 u32First, UINT32 u32Count, FLOAT32* pf32Output) const
+{
+    // The same scale as the int to float conversion of WAV samples
+    const UINT32 u32Channels = m_info.u16Channels;
+    const FLOAT32 f32Scale = 1.0f / static_cast<FLOAT32>(1u << (m_info.u16BitsPerSample - 1));
+    for (UINT32 c = 0; c < u32Channels; c++)
+    {
+        const INT32 *pi32Plane = pi32Planes + static_cast<size_t>(c) * m_info.u32MaxBlockSize + u32First;
+        FLOAT32 *pf32Channel = pf32Output + c;
+        for (UINT32 i = 0; i < u32Count; i++)
+        {
+            pf32Channel[static_cast<size_t>(i) * u32Channels] = static_cast<FLOAT32>(pi32Plane[i]) * f32Scale;
+        }
+    }
+}
+
+UINT64 FlacDecoder::FindFrame(UINT64 u64Offset, FLAC_FRAME_HEADER* pHeader) const
+{
+    while (u64Offset < m_cbFile)
+    {
+        const void *pvSync = std::memchr(m_pbFile + u64Offset, 0xFF, static_cast<size_t>(m_cbFile - u64Offset));
+        if (pvSync == nullptr)
+        {
+            break;
+        }
+
+        u64Offset = static_cast<UINT64>(static_cast<const BYTE*>(pvSync) - m_pbFile);
+        if (ParseFrameHeader(u64Offset, pHeader))
+        {
+            return u64Offset;
+        }
+        u64Offset++;
+    }
+    return UINT64_MAX;
+}
+
+HRESULT FlacDecoder::Seek(UINT64 u64Frame)
+{
+    if (m_pbFile == nullptr)
+    {
+        return E_FAIL;
+    }
+    if (m_info.u64TotalFrames != 0 && u64Frame >= m_info.u64TotalFrames)
+    {
+        return E_INVALIDARG;
+    }
+
+    // The last seek point at or before the frame, or the first frame without one
+    UINT64 u64Offset = m_u64FirstFrameOffset;
+    auto it = std::upper_bound(m_seekPoints.begin(), m_seekPoints.end(), u64Frame,
+                               [](UINT64 u64Target, const FLAC_SEEK_POINT& point) { return u64Target < point.u64Frame; });
+    if (it != m_seekPoints.begin())
+    {
+        u64Offset += (it - 1)->u64Offset;
+    }
+
+    FLAC_FRAME_HEADER header;
+    if (!ParseFrameHeader(u64Offset, &header) || header.u64FirstFrame > u64Frame)
+    {
+        return E_FAIL;
+    }
+
+    // The frames in between are skipped by their headers without decoding them
+    while (u64Frame >= header.u64FirstFrame + header.u32BlockSize)
+    {
+        const UINT64 u64Expected = header.u64FirstFrame + header.u32BlockSize;
+        u64Offset = FindFrame(u64Offset + header.u32HeaderBytes, &header);
+        while (u64Offset != UINT64_MAX && header.u64FirstFrame != u64Expected)
+        {
+            u64Offset = FindFrame(u64Offset + 1, &header);
+        }
+        if (u64Offset == UINT64_MAX)
+        {
+            return E_FAIL;
+        }
+    }
+
+    m_u64Offset = u64Offset;
+    m_u64Position = u64Frame;
+    m_u32Skip = static_cast<UINT32>(u64Frame - header.u64FirstFrame);
+    return S_OK;
+}
+
+HRESULT FlacDecoder::DecodeBlock(FLOAT32* pf32Output, UINT32* pu32Frames)
+{
+    *pu32Frames = 0;
+    if (m_pbFile == nullptr)
+    {
+        return E_FAIL;
+    }
+
+    // The stream ends where its length says, a tag after the last frame is not one.
+    // Without a length it ends where the frames do.
+    FLAC_FRAME_HEADER header;
+    if (m_info.u64TotalFrames != 0 ? m_u64Position >= m_info.u64TotalFrames : !ParseFrameHeader(m_u64Offset, &header))
+    {
+        return S_FALSE;
+    }
+
+    UINT64 u64Next = 0;
+    HRESULT hr = DecodeFrame(m_u64Offset, m_planes.data(), &header, &u64Next);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    if (header.u64FirstFrame + m_u32Skip != m_u64Position)
+    {
+        return E_FAIL;
+    }
+
+    UINT32 u32Count = header.u32BlockSize - m_u32Skip;
+    if (m_info.u64TotalFrames != 0 && m_u64Position + u32Count > m_info.u64TotalFrames)
+    {
+        u32Count = static_cast<UINT32>(m_info.u64TotalFrames - m_u64Position);
+    }
+    StoreFrames(m_planes.data(), m_u32Skip, u32Count, pf32Output);
+
+    m_u64Offset = u64Next;
+    m_u64Position += u32Count;
+    m_u32Skip = 0;
+    *pu32Frames = u32Count;
+    return S_OK;
+}
+
+HRESULT FlacDecoder::DecodeRange(UINT64 u64Begin, UINT64 u64End, FLOAT32* pf32Output, UINT64* pu64Frames) const
+{
+    *pu64Frames = 0;
+
+    std::vector<INT32> planes;
+    try {
+        planes.resize(static_cast<size_t>(m_info.u32MaxBlockSize) * m_info.u16Channels);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    FLAC_FRAME_HEADER header;
+    UINT64 u64Offset = FindFrame(u64Begin, &header);
+    UINT64 u64Next = 0;
+    UINT64 u64NextFrame = 0;
+    UINT64 u64Frames = 0;
+    bool bSynced = false;
+    while (u64Offset < u64End)
+    {
+        HRESULT hr = DecodeFrame(u64Offset, planes.data(), &header, &u64Next);
+        if (FAILED(hr))
+        {
+            // Before the first frame decodes, a sync code can be one inside another frame
+            if (!bSynced)
+            {
+                u64Offset = FindFrame(u64Offset + 1, &header);
+                continue;
+            }
+
+            // After the last frame of the stream there may be a tag
+            if (u64NextFrame == m_info.u64TotalFrames)
+            {
+                break;
+            }
+            return hr;
+        }
+
+        if (header.u64FirstFrame + header.u32BlockSize > m_info.u64TotalFrames)
+        {
+            return E_FAIL;
+        }
+
+        StoreFrames(planes.data(), 0, header.u32BlockSize, pf32Output + header.u64FirstFrame * m_info.u16Channels);
+        u64Frames += header.u32BlockSize;
+        u64NextFrame = header.u64FirstFrame + header.u32BlockSize;
+        u64Offset = u64Next;
+        bSynced = true;
+    }
+
+    *pu64Frames = u64Frames;
+    return S_OK;
+}
+
+HRESULT FlacDecoder::DecodeAll(FLOAT32* pf32Output, UINT32 u32Threads) const
+{
+    if (m_pbFile == nullptr || m_info.u64TotalFrames == 0)
+    {
+        return E_FAIL;
+    }
+
+    // A range per thread, but none so short that starting the thread costs more than it saves
+    const UINT64 cbFrames = m_cbFile - m_u64FirstFrameOffset;
+    UINT64 u64Ranges = cbFrames / c_cbMinRangeBytes;
+    if (u64Ranges > u32Threads)
+        u64Ranges = u32Threads;
+    if (u64Ranges == 0)
+        u64Ranges = 1;
+    const size_t ranges = static_cast<size_t>(u64Ranges);
+
+    std::vector<UINT64> bounds;
+    std::vector<UINT64> frames;
+    std::vector<HRESULT> results;
+    std::vector<std::thread> threads;
+    try {
+        bounds.resize(ranges + 1);
+        frames.resize(ranges);
+        results.resize(ranges, S_OK);
+        threads.reserve(ranges);
+    }
+    catch (std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+
+    // The ranges start at seek points where the table has them, the threads find those
+    // frames straight away.  Elsewhere they scan for the next frame header.
+    bounds[0] = m_u64FirstFrameOffset;
+    bounds[ranges] = m_cbFile;
+    for (size_t r = 1; r < ranges; r++)
+    {
+        const UINT64 u64Relative = cbFrames * r / ranges;
+        UINT64 u64Bound = m_u64FirstFrameOffset + u64Relative;
+        if (!m_seekPoints.empty())
+        {
+            auto it = std::lower_bound(m_seekPoints.begin(), m_seekPoints.end(), u64Relative,
+                                       [](const FLAC_SEEK_POINT& point, UINT64 u64Target) { return point.u64Offset < u64Target; });
+            u64Bound = (it != m_seekPoints.end()) ? m_u64FirstFrameOffset + it->u64Offset : m_cbFile;
+        }
+        bounds[r] = (u64Bound < bounds[r - 1]) ? bounds[r - 1] : u64Bound;
+    }
+
+    auto decode = [&](size_t r) {
+        results[r] = DecodeRange(bounds[r], bounds[r + 1], pf32Output, &frames[r]);
+    };
+
+    for (size_t r = 1; r < ranges; r++)
+    {
+        try {
+            threads.emplace_back(decode, r);
+        }
+        catch (std::system_error&) {
+            // Without a thread the range is decoded here
+            decode(r);
+        }
+    }
+    decode(0);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Every frame of the stream exactly once, or a sync code was not a frame after all
+    UINT64 u64Frames = 0;
+    for (size_t r = 0; r < ranges; r++)
+    {
+        if (FAILED(results[r]))
+        {
+            return results[r];
+        }
+        u64Frames += frames[r];
+    }
+    return (u64Frames == m_info.u64TotalFrames) ? S_OK : E_FAIL;
+}
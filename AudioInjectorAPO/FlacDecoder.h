@@ -0,0 +1,135 @@
+//
+// FlacDecoder.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Decoder of FLAC files held in memory, usually an AudioFileMapping of the file.
+//  Frames are decoded one block at a time into interleaved float samples, so a
+//  clip can be streamed without decoding it up front, and a whole file can be
+//  decoded by several threads at once, a range of frames each.  Seeking starts
+//  from the nearest point of the seek table.  Platform independent, with no
+//  codec of the system involved.
+//
+
+#pragma once
+
+#include "PortableTypes.h"
+
+#include <vector>
+
+//
+// Format of a FLAC stream, from its STREAMINFO block.  Frames are counted per
+// channel, like the samples of the stream in the FLAC specification.
+//
+struct FLAC_STREAM_INFO
+{
+    UINT32      u32MinBlockSize;        // in frames
+    UINT32      u32MaxBlockSize;        // in frames, the most DecodeBlock ever returns
+    UINT32      u32SampleRate;
+    UINT16      u16Channels;
+    UINT16      u16BitsPerSample;
+    UINT64      u64TotalFrames;         // 0 if the encoder did not know
+};
+
+// Seek point of the SEEKTABLE block, placeholders are dropped
+struct FLAC_SEEK_POINT
+{
+    UINT64      u64Frame;               // first frame of the FLAC frame the point is at
+    UINT64      u64Offset;              // of its header from the first frame header
+};
+
+//
+// Header of a FLAC frame, see FlacDecoder::ParseFrameHeader
+//
+struct FLAC_FRAME_HEADER
+{
+    UINT64      u64FirstFrame;          // position of the block in the stream
+    UINT32      u32BlockSize;           // in frames
+    UINT32      u32ChannelAssignment;   // 0 - 7 independent channels, 8 left/side, 9 side/right, 10 mid/side
+    UINT32      u32HeaderBytes;         // up to and with the CRC-8
+};
+
+class FlacDecoder
+{
+public:
+    FlacDecoder();
+
+    FlacDecoder(const FlacDecoder&) = delete;
+    FlacDecoder& operator=(const FlacDecoder&) = delete;
+
+    //
+    // Reads the metadata of the FLAC file in pbFile and moves to its first frame.
+    // The bytes are not copied and must outlive the decoder.  Returns E_FAIL for
+    // anything that is not a FLAC file and E_NOTIMPL for streams of more than 24
+    // bits, whose side channel does not fit the 32 bit samples of the decoder.
+    //
+    HRESULT Open(const BYTE* pbFile, UINT64 cbFile);
+
+    // Get the format of the stream
+    const FLAC_STREAM_INFO& GetStreamInfo() const { return m_info; }
+
+    // Get the speaker positions of the channels, 0 for mono and stereo whose order is the usual one
+    DWORD GetChannelMask() const;
+
+    // Get the points of the seek table, in the order of the stream
+    const std::vector<FLAC_SEEK_POINT>& GetSeekPoints() const { return m_seekPoints; }
+
+    // Get the frame DecodeBlock starts at
+    UINT64 GetPosition() const { return m_u64Position; }
+
+    //
+    // Moves to u64Frame.  The frame header at the last seek point before it is
+    // checked and the frames from there to the one holding u64Frame are skipped
+    // by their headers, so only one frame is ever decoded to get there.
+    //
+    HRESULT Seek(UINT64 u64Frame);
+
+    //
+    // Decodes the next frame of the stream into pf32Output, which holds
+    // u32MaxBlockSize frames, and sets *pu32Frames to the number of frames in it.
+    // Returns S_FALSE with no frames at the end of the stream and E_FAIL for a
+    // frame that cannot be decoded or fails its CRC.
+    //
+    HRESULT DecodeBlock(FLOAT32* pf32Output, UINT32* pu32Frames);
+
+    //
+    // Decodes the whole stream into pf32Output, which holds u64TotalFrames frames,
+    // on up to u32Threads threads.  Each thread decodes the frames that start in
+    // its range of the file, found by the seek table or else by the frame sync
+    // code.  Fails if the length of the stream is not known.  The position of
+    // DecodeBlock is not changed.
+    //
+    HRESULT DecodeAll(FLOAT32* pf32Output, UINT32 u32Threads) const;
+
+    //
+    // Parses the frame header at u64Offset and checks it against the stream.
+    // Returns false where there is no header, which is how the frames are found
+    // in the middle of the file.
+    //
+    bool ParseFrameHeader(UINT64 u64Offset, FLAC_FRAME_HEADER* pHeader) const;
+
+private:
+    // Decode the frame at u64Offset into the planes of pi32Planes, a plane of u32MaxBlockSize samples per channel
+    HRESULT DecodeFrame(UINT64 u64Offset, INT32* pi32Planes, FLAC_FRAME_HEADER* pHeader, UINT64* pu64Next) const;
+
+    // Interleave u32Count frames from u32First of the planes into pf32Output as float
+    void StoreFrames(const INT32* pi32Planes, UINT32 u32First, UINT32 u32Count, FLOAT32* pf32Output) const;
+
+    // Find the first frame header from u64Offset on, UINT64_MAX if there is none
+    UINT64 FindFrame(UINT64 u64Offset, FLAC_FRAME_HEADER* pHeader) const;
+
+    // Decode the frames that start in [u64Begin, u64End) into pf32Output, the body of a DecodeAll thread
+    HRESULT DecodeRange(UINT64 u64Begin, UINT64 u64End, FLOAT32* pf32Output, UINT64* pu64Frames) const;
+
+    const BYTE *m_pbFile;
+    UINT64 m_cbFile;
+    UINT64 m_u64FirstFrameOffset;
+    FLAC_STREAM_INFO m_info;
+    std::vector<FLAC_SEEK_POINT> m_seekPoints;
+
+    // State of DecodeBlock
+    UINT64 m_u64Offset;                 // of the next frame header
+    UINT64 m_u64Position;
+    UINT32 m_u32Skip;                   // frames of the next block before the position, after a seek
+    std::vector<INT32> m_planes;
+};
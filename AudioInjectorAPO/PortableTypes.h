@@ -0,0 +1,110 @@
+//
+// PortableTypes.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Minimal set of Windows types used by the platform independent parts of the
+//  APO (mix kernels and their helpers).  On Windows the real SDK headers are
+//  used, elsewhere the same names are mapped onto standard C++ types so that
+//  these sources can be built, tested and profiled on Linux as well.
+//
+
+#pragma once
+
+#if defined(_WIN32)
+
+#include <windows.h>
+#include <mmreg.h>
+#include <ks.h>
+#include <ksmedia.h>
+#include <AudioAPOTypes.h>
+
+#else // !_WIN32
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef float       FLOAT32;
+typedef double      FLOAT64;
+typedef uint8_t     BYTE;
+typedef int16_t     INT16;
+typedef uint16_t    UINT16;
+typedef int32_t     INT32;
+typedef uint32_t    UINT32;
+typedef int64_t     INT64;
+typedef uint64_t    UINT64;
+typedef int32_t     LONG;
+typedef uint32_t    DWORD;
+typedef int32_t     BOOL;
+typedef int64_t     HNSTIME;
+typedef int32_t     HRESULT;
+typedef wchar_t     WCHAR;
+typedef const WCHAR *LPCWSTR;
+
+#ifndef TRUE
+#define TRUE    1
+#define FALSE   0
+#endif
+
+#define S_OK            ((HRESULT)0x00000000L)
+#define S_FALSE         ((HRESULT)0x00000001L)
+#define E_FAIL          ((HRESULT)0x80004005L)
+#define E_NOTIMPL       ((HRESULT)0x80004001L)
+#define E_POINTER       ((HRESULT)0x80004003L)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000EL)
+#define E_INVALIDARG    ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+
+#define UNREFERENCED_PARAMETER(P)   ((void)(P))
+
+// Same values as in mmreg.h and ksmedia.h
+#define SPEAKER_FRONT_LEFT              0x00001
+#define SPEAKER_FRONT_RIGHT             0x00002
+#define SPEAKER_FRONT_CENTER            0x00004
+#define SPEAKER_LOW_FREQUENCY           0x00008
+#define SPEAKER_BACK_LEFT               0x00010
+#define SPEAKER_BACK_RIGHT              0x00020
+#define SPEAKER_FRONT_LEFT_OF_CENTER    0x00040
+#define SPEAKER_FRONT_RIGHT_OF_CENTER   0x00080
+#define SPEAKER_BACK_CENTER             0x00100
+#define SPEAKER_SIDE_LEFT               0x00200
+#define SPEAKER_SIDE_RIGHT              0x00400
+#define SPEAKER_TOP_CENTER              0x00800
+#define SPEAKER_TOP_FRONT_LEFT          0x01000
+#define SPEAKER_TOP_FRONT_CENTER        0x02000
+#define SPEAKER_TOP_FRONT_RIGHT         0x04000
+#define SPEAKER_TOP_BACK_LEFT           0x08000
+#define SPEAKER_TOP_BACK_CENTER         0x10000
+#define SPEAKER_TOP_BACK_RIGHT          0x20000
+
+#define KSAUDIO_SPEAKER_MONO            (SPEAKER_FRONT_CENTER)
+#define KSAUDIO_SPEAKER_STEREO          (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT)
+#define KSAUDIO_SPEAKER_QUAD            (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | \
+                                         SPEAKER_BACK_LEFT  | SPEAKER_BACK_RIGHT)
+#define KSAUDIO_SPEAKER_5POINT1         (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | \
+                                         SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY | \
+                                         SPEAKER_BACK_LEFT  | SPEAKER_BACK_RIGHT)
+#define KSAUDIO_SPEAKER_5POINT1_SURROUND (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | \
+                                         SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY | \
+                                         SPEAKER_SIDE_LEFT  | SPEAKER_SIDE_RIGHT)
+#define KSAUDIO_SPEAKER_7POINT1_SURROUND (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | \
+                                         SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY | \
+                                         SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | \
+                                         SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT)
+
+// Same values as in mmreg.h
+#define WAVE_FORMAT_PCM                 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT          0x0003
+#define WAVE_FORMAT_EXTENSIBLE          0xFFFE
+
+// Same values as in AudioAPOTypes.h
+typedef enum APO_BUFFER_FLAGS
+{
+    BUFFER_INVALID = 0,
+    BUFFER_VALID = 1,
+    BUFFER_SILENT = 2
+} APO_BUFFER_FLAGS;
+
+#endif // _WIN32
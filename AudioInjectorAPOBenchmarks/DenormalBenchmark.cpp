@@ -0,0 +1,191 @@
+//
+// DenormalBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Measures the per period cost of the processing stages with normal signals
+//  and with signals at denormal level, like the quiet tails of clips, once as
+//  is and once inside the MixDenormalGuard that APOProcess puts around them.
+//  The stages are the steady mix, a mix inside an exponential ramp and the
+//  limiter busy reducing the gain of a peak followed by a denormal tail.  With
+//  the guard the denormal column should match the normal one.
+//
+//  Build and run on Linux with ./build.sh && ./DenormalBenchmark
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "AudioMixKernels.h"
+
+namespace
+{
+
+const UINT32 c_u32FramesPerSecond = 48000;
+const UINT32 c_u32FramesPerPeriod = 480;        // 10 ms at 48 kHz
+const UINT32 c_u32FileFrameCount = c_u32FramesPerSecond;
+const UINT32 c_u32LookaheadFrames = c_u32FramesPerSecond * 5 / 1000;
+const UINT32 c_u32ReleaseFrames = c_u32FramesPerSecond * MIX_LIMITER_RELEASE_MS / 1000;
+const UINT32 c_u32Periods = 2000;
+const UINT32 c_u32Runs = 5;
+
+// Normal level and a level whose samples and products are all denormal
+const FLOAT32 c_f32NormalLevel = 0.5f;
+const FLOAT32 c_f32DenormalLevel = 1e-39f;
+
+void FillNoise(std::vector<FLOAT32>& buffer, UINT32 u32Seed, FLOAT32 f32Level)
+{
+    for (FLOAT32& f : buffer)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        f = static_cast<FLOAT32>(static_cast<INT32>(u32Seed)) / 2147483648.0f * f32Level;
+    }
+}
+
+// Best of a few runs, the differences are small enough to drown in scheduling noise
+template <class F>
+double NanosecondsPerPeriod(F process)
+{
+    double best = 0.0;
+    for (UINT32 run = 0; run < c_u32Runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (UINT32 i = 0; i < c_u32Periods; i++)
+        {
+            process();
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(stop - start).count() / c_u32Periods;
+        if (run == 0 || ns < best)
+        {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+// Times the stage as is and inside the guard, the guard is set up every period like in APOProcess
+template <class F>
+void TimeGuarded(F process, double *pUnguardedNs, double *pGuardedNs)
+{
+    *pUnguardedNs = NanosecondsPerPeriod(process);
+    *pGuardedNs = NanosecondsPerPeriod([&]() {
+        MixDenormalGuard denormalGuard;
+        process();
+    });
+}
+
+void PrintStage(const char *pszStage, const double (&ns)[2][2])
+{
+    std::printf("    %-18s off %9.1f / %9.1f ns/period %6.1fx   on %9.1f / %9.1f ns/period %6.1fx\n",
+                pszStage, ns[0][0], ns[1][0], ns[1][0] / ns[0][0], ns[0][1], ns[1][1], ns[1][1] / ns[0][1]);
+}
+
+void RunKernels(const MIX_KERNELS *pKernels, UINT32 u32Channels)
+{
+    const UINT32 u32SampleCount = c_u32FramesPerPeriod * u32Channels;
+
+    std::printf("  %u ch  %s, normal / denormal signal, guard off and on\n", u32Channels, pKernels->pszName);
+
+    // Index 0 is the normal signal, 1 the denormal one
+    double mixNs[2][2];
+    double rampNs[2][2];
+    double limiterNs[2][2];
+    for (int denormal = 0; denormal < 2; denormal++)
+    {
+        const FLOAT32 f32Level = denormal ? c_f32DenormalLevel : c_f32NormalLevel;
+
+        std::vector<FLOAT32> input(u32SampleCount);
+        std::vector<FLOAT32> file(c_u32FileFrameCount * u32Channels);
+        std::vector<FLOAT32> output(u32SampleCount);
+        FillNoise(input, 1, f32Level);
+        FillNoise(file, 2, f32Level);
+
+        MIX_CONTEXT context;
+        MIX_REQUEST request = {};
+        request.aSources[0].pf32File = file.data();
+        request.aSources[0].u32FileFrameCount = c_u32FileFrameCount;
+        request.aSources[0].f32Weight = 0.7f;
+        request.aSources[0].bLoop = TRUE;
+        request.u32SourceCount = 1;
+        request.bMix = TRUE;
+        request.f32InputWeight = 0.3f;
+
+        // Steady weights once the request has been picked up
+        InitMixContext(&context, pKernels, u32Channels, FALSE, 0);
+        PostMixRequest(&context, &request);
+        context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), c_u32FramesPerPeriod);
+        TimeGuarded([&]() {
+            context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), c_u32FramesPerPeriod);
+        }, &mixNs[denormal][0], &mixNs[denormal][1]);
+
+        // Every period inside a ramp long enough for all the runs
+        InitMixContext(&context, pKernels, u32Channels, FALSE, 2 * (c_u32Runs * c_u32Periods + 1) * c_u32FramesPerPeriod);
+        request.rampShape = MIX_RAMP_EXPONENTIAL;
+        PostMixRequest(&context, &request);
+        TimeGuarded([&]() {
+            context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), c_u32FramesPerPeriod);
+        }, &rampNs[denormal][0], &rampNs[denormal][1]);
+
+        // A peak in every period keeps the limiter reducing the gain of the tail that follows it
+        std::vector<FLOAT32> tail(input);
+        for (UINT32 i = 0; i < u32Channels; i++)
+        {
+            tail[i] = 3.0f;
+        }
+        std::vector<BYTE> buffer(GetMixLimiterBufferSize(c_u32LookaheadFrames, u32Channels));
+        MIX_LIMITER limiter;
+        InitMixLimiter(&limiter, c_u32LookaheadFrames, u32Channels, MIX_LIMITER_CEILING, c_u32ReleaseFrames, buffer.data());
+
+        // The limiter works in place, so every period starts from a copy of the signal
+        double copyNs[2];
+        TimeGuarded([&]() {
+            std::memcpy(output.data(), tail.data(), u32SampleCount * sizeof(FLOAT32));
+        }, &copyNs[0], &copyNs[1]);
+        TimeGuarded([&]() {
+            std::memcpy(output.data(), tail.data(), u32SampleCount * sizeof(FLOAT32));
+            pKernels->pfnLimit(&limiter, output.data(), c_u32FramesPerPeriod, BUFFER_VALID);
+        }, &limiterNs[denormal][0], &limiterNs[denormal][1]);
+        limiterNs[denormal][0] -= copyNs[0];
+        limiterNs[denormal][1] -= copyNs[1];
+    }
+
+    PrintStage("mix", mixNs);
+    PrintStage("exponential ramp", rampNs);
+    PrintStage("limiter", limiterNs);
+}
+
+// Checks that the guard flushes on this machine, otherwise the "on" columns mean nothing
+bool IsDenormalGuardEffective()
+{
+    volatile FLOAT32 f32Small = 1e-30f;
+    volatile FLOAT32 f32Scale = 1e-10f;
+
+    MixDenormalGuard denormalGuard;
+    return f32Small * f32Scale == 0.0f;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Denormal signals, %u frames per period, selected kernels: %s, guard %s\n",
+                c_u32FramesPerPeriod, SelectMixKernels()->pszName,
+                IsDenormalGuardEffective() ? "flushes denormals" : "has no effect on this machine");
+
+    for (UINT32 u32Channels : { 2u, 8u })
+    {
+        for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+        {
+            const MIX_KERNELS *pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+            if (pKernels != nullptr && isa <= DetectMixIsa())
+            {
+                RunKernels(pKernels, u32Channels);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,210 @@
+//
+// FlacEncoder.h -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Minimal FLAC encoder of the benchmarks: 16 bit stereo in left/side, FIXED
+//  subframes of order 2 and Rice residuals of one partition, which decodes like
+//  what the reference encoder writes at its fast settings.
+//
+
+#pragma once
+
+#include <vector>
+
+#include "FlacDecoder.h"
+
+const UINT16 c_u16FlacChannels = 2;
+const UINT32 c_u32FlacBlockSize = 4096;                   // the block size of the reference encoder
+
+// Big endian bit fields
+class BitWriter
+{
+public:
+    BitWriter() : m_u64Pending(0), m_u32Bits(0) {}
+
+    void Write(UINT32 u32Value, UINT32 u32Count)
+    {
+        if (u32Count == 0)
+        {
+            return;
+        }
+        m_u64Pending = (m_u64Pending << u32Count) | (u32Value & (0xFFFFFFFFu >> (32 - u32Count)));
+        m_u32Bits += u32Count;
+        while (m_u32Bits >= 8)
+        {
+            m_u32Bits -= 8;
+            m_bytes.push_back(static_cast<BYTE>(m_u64Pending >> m_u32Bits));
+        }
+    }
+
+    void WriteZeros(UINT32 u32Count)
+    {
+        for (; u32Count > 24; u32Count -= 24)
+        {
+            Write(0, 24);
+        }
+        Write(0, u32Count);
+    }
+
+    void Align()
+    {
+        if (m_u32Bits != 0)
+        {
+            Write(0, 8 - m_u32Bits);
+        }
+    }
+
+    std::vector<BYTE>& Bytes() { return m_bytes; }
+
+private:
+    std::vector<BYTE> m_bytes;
+    UINT64 m_u64Pending;
+    UINT32 m_u32Bits;
+};
+
+inline BYTE Crc8(const BYTE *pb, size_t cb)
+{
+    UINT32 u32Crc = 0;
+    for (size_t i = 0; i < cb; i++)
+    {
+        u32Crc ^= pb[i];
+        for (UINT32 bit = 0; bit < 8; bit++)
+        {
+            u32Crc = ((u32Crc & 0x80) ? ((u32Crc << 1) ^ 0x07) : (u32Crc << 1)) & 0xFF;
+        }
+    }
+    return static_cast<BYTE>(u32Crc);
+}
+
+inline UINT32 Crc16(const BYTE *pb, size_t cb)
+{
+    UINT32 u32Crc = 0;
+    for (size_t i = 0; i < cb; i++)
+    {
+        u32Crc ^= static_cast<UINT32>(pb[i]) << 8;
+        for (UINT32 bit = 0; bit < 8; bit++)
+        {
+            u32Crc = ((u32Crc & 0x8000) ? ((u32Crc << 1) ^ 0x8005) : (u32Crc << 1)) & 0xFFFF;
+        }
+    }
+    return u32Crc;
+}
+
+// A FIXED subframe of order 2, its residual in one partition of the best Rice parameter
+inline void WriteSubframe(BitWriter& writer, const INT32 *pi32Samples, UINT32 u32Count, UINT32 u32Bits)
+{
+    writer.Write(0, 1);
+    writer.Write(8 + 2, 6);
+    writer.Write(0, 1);
+    writer.Write(static_cast<UINT32>(pi32Samples[0]), u32Bits);
+    writer.Write(static_cast<UINT32>(pi32Samples[1]), u32Bits);
+
+    std::vector<UINT32> folded(u32Count - 2);
+    UINT64 u64Sum = 0;
+    for (UINT32 i = 2; i < u32Count; i++)
+    {
+        const INT32 i32Residual = pi32Samples[i] - 2 * pi32Samples[i - 1] + pi32Samples[i - 2];
+        folded[i - 2] = (static_cast<UINT32>(i32Residual) << 1) ^ static_cast<UINT32>(i32Residual >> 31);
+        u64Sum += folded[i - 2];
+    }
+
+    // The parameter near the log of the mean, as the reference encoder estimates it
+    UINT32 u32Parameter = 0;
+    while (u32Parameter < 14 && (static_cast<UINT64>(folded.size()) << (u32Parameter + 1)) < u64Sum)
+    {
+        u32Parameter++;
+    }
+
+    writer.Write(0, 2);
+    writer.Write(0, 4);
+    writer.Write(u32Parameter, 4);
+    for (UINT32 u32Folded : folded)
+    {
+        writer.WriteZeros(u32Folded >> u32Parameter);
+        writer.Write(1, 1);
+        writer.Write(u32Folded, u32Parameter);
+    }
+}
+
+// A stereo FLAC file of samples at u32SampleRate, with a seek point a second
+inline std::vector<BYTE> MakeFlacFile(const std::vector<INT32>& samples, UINT32 u32SampleRate)
+{
+    const UINT32 u32FrameCount = static_cast<UINT32>(samples.size() / c_u16FlacChannels);
+    const UINT32 u32SeekSpacing = u32SampleRate;
+
+    BitWriter frames;
+    std::vector<FLAC_SEEK_POINT> seekPoints;
+    std::vector<INT32> left(c_u32FlacBlockSize);
+    std::vector<INT32> side(c_u32FlacBlockSize);
+    for (UINT32 u32First = 0, u32Index = 0; u32First < u32FrameCount; u32First += c_u32FlacBlockSize, u32Index++)
+    {
+        const UINT32 u32Count = (u32FrameCount - u32First < c_u32FlacBlockSize) ? u32FrameCount - u32First : c_u32FlacBlockSize;
+        if (u32First / u32SeekSpacing != (u32First + u32Count - 1) / u32SeekSpacing || u32First == 0)
+        {
+            seekPoints.push_back({ u32First, frames.Bytes().size() });
+        }
+
+        const size_t headerStart = frames.Bytes().size();
+        frames.Write(0xFFF8, 16);
+        frames.Write(7, 4);                                 // 16 bit block size at the end of the header
+        frames.Write((u32SampleRate == 48000) ? 10 : (u32SampleRate == 44100) ? 9 : 0, 4);  // or as in STREAMINFO
+        frames.Write(8, 4);                                 // left/side
+        frames.Write(4, 3);                                 // 16 bits
+        frames.Write(0, 1);
+        if (u32Index < 0x80)
+        {
+            frames.Write(u32Index, 8);
+        }
+        else
+        {
+            frames.Write(0xC0 | (u32Index >> 6), 8);
+            frames.Write(0x80 | (u32Index & 0x3F), 8);
+        }
+        frames.Write(u32Count - 1, 16);
+        frames.Write(Crc8(&frames.Bytes()[headerStart], frames.Bytes().size() - headerStart), 8);
+
+        for (UINT32 i = 0; i < u32Count; i++)
+        {
+            const size_t index = static_cast<size_t>(u32First + i) * c_u16FlacChannels;
+            left[i] = samples[index];
+            side[i] = samples[index] - samples[index + 1];
+        }
+        WriteSubframe(frames, left.data(), u32Count, 16);
+        WriteSubframe(frames, side.data(), u32Count, 17);
+        frames.Align();
+        frames.Write(Crc16(&frames.Bytes()[headerStart], frames.Bytes().size() - headerStart), 16);
+    }
+
+    BitWriter file;
+    file.Write(0x664C6143, 32);                             // fLaC
+    file.Write(0, 8);                                       // STREAMINFO
+    file.Write(34, 24);
+    file.Write(c_u32FlacBlockSize, 16);
+    file.Write(c_u32FlacBlockSize, 16);
+    file.Write(0, 24);
+    file.Write(0, 24);
+    file.Write(u32SampleRate, 20);
+    file.Write(c_u16FlacChannels - 1, 3);
+    file.Write(16 - 1, 5);
+    file.Write(0, 4);
+    file.Write(u32FrameCount, 32);
+    for (UINT32 i = 0; i < 4; i++)
+    {
+        file.Write(0, 32);
+    }
+
+    file.Write(0x83, 8);                                    // SEEKTABLE, the last block
+    file.Write(static_cast<UINT32>(seekPoints.size() * 18), 24);
+    for (const FLAC_SEEK_POINT& point : seekPoints)
+    {
+        file.Write(0, 32);
+        file.Write(static_cast<UINT32>(point.u64Frame), 32);
+        file.Write(0, 32);
+        file.Write(static_cast<UINT32>(point.u64Offset), 32);
+        file.Write(c_u32FlacBlockSize, 16);
+    }
+
+    file.Bytes().insert(file.Bytes().end(), frames.Bytes().begin(), frames.Bytes().end());
+    return file.Bytes();
+}
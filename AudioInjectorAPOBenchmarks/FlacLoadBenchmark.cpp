@@ -0,0 +1,267 @@
+//
+// FlacLoadBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Measures decoding FLAC clips with FlacDecoder, a block at a time as the
+//  stream worker does and whole on one to all threads, against loading the
+//  same clip as a 16 bit and a float WAV file.  Seeks through the seek table
+//  are timed too.  The clip is encoded by FlacEncoder.h.  Every decode is
+//  checked against the samples of the clip.
+//
+//  Build and run on Linux with ./build.sh && ./FlacLoadBenchmark
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioFileReader.h"
+#include "FlacDecoder.h"
+#include "FlacEncoder.h"
+
+namespace
+{
+
+const UINT32 c_u32SampleRate = 48000;
+const UINT16 c_u16Channels = 2;
+const UINT32 c_u32FrameCount = c_u32SampleRate * 60;      // a minute of a stereo clip
+const UINT32 c_u32BlockSize = c_u32FlacBlockSize;
+const UINT32 c_u32Seeks = 1000;
+const UINT32 c_u32Runs = 5;
+
+// Music-like content: a few partials with a slow tremolo over quiet noise, left and right related
+std::vector<INT32> MakeClip()
+{
+    std::vector<INT32> samples(static_cast<size_t>(c_u32FrameCount) * c_u16Channels);
+    UINT32 u32Seed = 1;
+    for (UINT32 i = 0; i < c_u32FrameCount; i++)
+    {
+        const double t = static_cast<double>(i) / c_u32SampleRate;
+        const double tremolo = 0.6 + 0.4 * std::sin(2.0 * 3.14159265358979 * 0.5 * t);
+        const double tone = std::sin(2.0 * 3.14159265358979 * 220.0 * t) + 0.5 * std::sin(2.0 * 3.14159265358979 * 331.0 * t) +
+                            0.25 * std::sin(2.0 * 3.14159265358979 * 1241.0 * t);
+        for (UINT32 c = 0; c < c_u16Channels; c++)
+        {
+            u32Seed = u32Seed * 1664525u + 1013904223u;
+            const INT32 i32Noise = static_cast<INT32>(u32Seed >> 24) - 128;
+            samples[static_cast<size_t>(i) * c_u16Channels + c] =
+                static_cast<INT32>(9000.0 * tremolo * tone * (c == 0 ? 1.0 : 0.8)) + i32Noise;
+        }
+    }
+    return samples;
+}
+
+std::vector<BYTE> MakeWavFile(const std::vector<INT32>& samples, bool bFloat)
+{
+    const UINT32 u32Bytes = bFloat ? 4 : 2;
+    const UINT32 u32DataBytes = c_u32FrameCount * c_u16Channels * u32Bytes;
+
+    std::vector<BYTE> file = { 'R', 'I', 'F', 'F' };
+    auto append = [&file](UINT32 u32Value, UINT32 u32Count) {
+        for (UINT32 b = 0; b < u32Count; b++)
+        {
+            file.push_back(static_cast<BYTE>(u32Value >> (8 * b)));
+        }
+    };
+    append(36 + u32DataBytes, 4);
+    file.insert(file.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    append(16, 4);
+    append(bFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, 2);
+    append(c_u16Channels, 2);
+    append(c_u32SampleRate, 4);
+    append(c_u32SampleRate * c_u16Channels * u32Bytes, 4);
+    append(c_u16Channels * u32Bytes, 2);
+    append(u32Bytes * 8, 2);
+    file.insert(file.end(), { 'd', 'a', 't', 'a' });
+    append(u32DataBytes, 4);
+
+    for (INT32 i32Sample : samples)
+    {
+        UINT32 u32Sample = static_cast<UINT32>(i32Sample);
+        if (bFloat)
+        {
+            const FLOAT32 f32 = static_cast<FLOAT32>(i32Sample) / 32768.0f;
+            std::memcpy(&u32Sample, &f32, sizeof(f32));
+        }
+        append(u32Sample, u32Bytes);
+    }
+    return file;
+}
+
+bool WriteFile(const std::string& path, const std::vector<BYTE>& file)
+{
+    FILE *pFile = std::fopen(path.c_str(), "wb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+    const bool ok = std::fwrite(file.data(), 1, file.size(), pFile) == file.size();
+    std::fclose(pFile);
+    return ok;
+}
+
+// Best of a few runs, the first one pulls the file into the page cache
+template <class F>
+double BestMilliseconds(F run)
+{
+    double best = 0.0;
+    for (UINT32 i = 0; i < c_u32Runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+        if (i == 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+bool Matches(const FLOAT32 *pf32Decoded, const std::vector<INT32>& samples)
+{
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (pf32Decoded[i] != static_cast<FLOAT32>(samples[i]) / 32768.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Report(const char *pszName, double ms, bool ok)
+{
+    // Throughput of the float samples handed out, the same measure for every path
+    const double mb = static_cast<double>(c_u32FrameCount) * c_u16Channels * sizeof(FLOAT32) / (1024.0 * 1024.0);
+    const double realtime = static_cast<double>(c_u32FrameCount) / c_u32SampleRate * 1000.0 / ms;
+    std::printf("  %-20s %8.2f ms  %8.0f MB/s  %7.0fx real time%s\n", pszName, ms, mb / ms * 1000.0, realtime,
+                ok ? "" : "  FAILED");
+}
+
+bool RunWav(const std::vector<INT32>& samples, bool bFloat)
+{
+    const std::string path = "/tmp/FlacLoadBenchmark.wav";
+    if (!WriteFile(path, MakeWavFile(samples, bFloat)))
+    {
+        std::printf("  cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    const std::wstring widePath(path.begin(), path.end());
+    AudioFileReader reader;
+    bool ok = true;
+    const double ms = BestMilliseconds([&]() {
+        ok = SUCCEEDED(reader.Initialize(widePath.c_str())) && reader.GetFrameCount() == c_u32FrameCount && ok;
+    });
+    reader.Cleanup();
+    std::remove(path.c_str());
+
+    Report(bFloat ? "wav float" : "wav pcm16", ms, ok);
+    return ok;
+}
+
+bool RunFlac(const std::vector<INT32>& samples)
+{
+    const std::vector<BYTE> file = MakeFlacFile(samples, c_u32SampleRate);
+    std::printf("FLAC file of %.1f MB, %.0f%% of the 16 bit WAV\n", file.size() / (1024.0 * 1024.0),
+                100.0 * file.size() / (samples.size() * 2.0));
+
+    FlacDecoder decoder;
+    if (FAILED(decoder.Open(file.data(), file.size())))
+    {
+        std::printf("  the FLAC file does not open\n");
+        return false;
+    }
+
+    // Block by block, as the stream worker reads it
+    std::vector<FLOAT32> output(samples.size());
+    bool ok = true;
+    double ms = BestMilliseconds([&]() {
+        UINT32 u32Position = 0;
+        UINT32 u32Frames = 0;
+        ok = SUCCEEDED(decoder.Seek(0)) && ok;
+        while (decoder.DecodeBlock(&output[static_cast<size_t>(u32Position) * c_u16Channels], &u32Frames) == S_OK)
+        {
+            u32Position += u32Frames;
+        }
+        ok = u32Position == c_u32FrameCount && ok;
+    });
+    ok = Matches(output.data(), samples) && ok;
+    Report("flac blocks", ms, ok);
+
+    // Whole, the frames split between the threads, at least four of them so the split is checked everywhere
+    bool allOk = ok;
+    const UINT32 u32MaxThreads = (std::thread::hardware_concurrency() > 4) ? std::thread::hardware_concurrency() : 4;
+    for (UINT32 u32Threads = 1; u32Threads <= u32MaxThreads; u32Threads *= 2)
+    {
+        std::fill(output.begin(), output.end(), 2.0f);
+        ok = true;
+        ms = BestMilliseconds([&]() {
+            ok = SUCCEEDED(decoder.DecodeAll(output.data(), u32Threads)) && ok;
+        });
+        ok = Matches(output.data(), samples) && ok;
+
+        char szName[32];
+        std::snprintf(szName, sizeof(szName), "flac %u thread%s", u32Threads, u32Threads == 1 ? "" : "s");
+        Report(szName, ms, ok);
+        allOk = allOk && ok;
+    }
+
+    // Through the reader, mapping the file and all
+    const std::string path = "/tmp/FlacLoadBenchmark.flac";
+    if (!WriteFile(path, file))
+    {
+        std::printf("  cannot write %s\n", path.c_str());
+        return false;
+    }
+    const std::wstring widePath(path.begin(), path.end());
+    AudioFileReader reader;
+    ok = true;
+    ms = BestMilliseconds([&]() {
+        ok = SUCCEEDED(reader.Initialize(widePath.c_str())) && reader.GetFrameCount() == c_u32FrameCount && ok;
+    });
+    ok = ok && Matches(reader.GetAudioData(), samples);
+    reader.Cleanup();
+    std::remove(path.c_str());
+    Report("flac reader", ms, ok);
+    allOk = allOk && ok;
+
+    // Seeks anywhere in the clip, each followed by the block it lands in
+    std::vector<FLOAT32> block(static_cast<size_t>(c_u32BlockSize) * c_u16Channels);
+    UINT32 u32Seed = 3;
+    ok = true;
+    ms = BestMilliseconds([&]() {
+        for (UINT32 i = 0; i < c_u32Seeks; i++)
+        {
+            u32Seed = u32Seed * 1664525u + 1013904223u;
+            const UINT32 u32Target = u32Seed % c_u32FrameCount;
+            UINT32 u32Frames = 0;
+            ok = SUCCEEDED(decoder.Seek(u32Target)) && decoder.DecodeBlock(block.data(), &u32Frames) == S_OK &&
+                 block[0] == static_cast<FLOAT32>(samples[static_cast<size_t>(u32Target) * c_u16Channels]) / 32768.0f && ok;
+        }
+    });
+    std::printf("  %-20s %8.2f us per seek and block%s\n", "flac seek", ms * 1000.0 / c_u32Seeks, ok ? "" : "  FAILED");
+    return allOk && ok;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Loading a minute of %u Hz stereo 16 bit audio\n", c_u32SampleRate);
+
+    const std::vector<INT32> samples = MakeClip();
+    bool ok = true;
+    ok = RunWav(samples, false) && ok;
+    ok = RunWav(samples, true) && ok;
+    ok = RunFlac(samples) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+//
+// FormatBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Measures mixing a clip into fixed point connection buffers with the fused
+//  convert, mix and dither kernels, next to mixing float buffers and to
+//  converting whole periods in separate passes around the float mix, the way
+//  conversion APOs before and after this one would.  The output of every
+//  kernel set is checked against the scalar one and against the float mix
+//  before timing.
+//
+//  Build and run on Linux with ./build.sh && ./FormatBenchmark
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "AudioMixKernels.h"
+
+namespace
+{
+
+const UINT32 c_u32FramesPerPeriod = 480;        // 10 ms at 48 kHz
+const UINT32 c_u32FileFrameCount = 48077;
+const UINT32 c_u32Periods = 5000;
+const UINT32 c_u32Runs = 5;
+
+const MIX_SAMPLE_FORMAT c_aFormats[] = { MIX_SAMPLE_INT16, MIX_SAMPLE_INT24, MIX_SAMPLE_INT32 };
+const char *c_apszFormatNames[MIX_SAMPLE_FORMAT_COUNT] = { "float", "int16", "int24", "int32" };
+
+void FillNoise(std::vector<FLOAT32>& buffer, UINT32 u32Seed, FLOAT32 f32Level)
+{
+    for (FLOAT32& f : buffer)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        f = static_cast<FLOAT32>(static_cast<INT32>(u32Seed)) / 2147483648.0f * f32Level;
+    }
+}
+
+// Best of a few runs, the differences are small enough to drown in scheduling noise
+template <class F>
+double NanosecondsPerPeriod(F process)
+{
+    double best = 0.0;
+    for (UINT32 run = 0; run < c_u32Runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (UINT32 i = 0; i < c_u32Periods; i++)
+        {
+            process();
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(stop - start).count() / c_u32Periods;
+        if (run == 0 || ns < best)
+        {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+double GetScale(MIX_SAMPLE_FORMAT format)
+{
+    return static_cast<double>(1u << (GetMixSampleBytes(format) * 8 - 1));
+}
+
+INT32 ReadSample(const std::vector<BYTE>& buffer, MIX_SAMPLE_FORMAT format, size_t i)
+{
+    const UINT32 u32Bytes = GetMixSampleBytes(format);
+    UINT32 u32 = 0;
+    for (UINT32 b = 0; b < u32Bytes; b++)
+    {
+        u32 |= static_cast<UINT32>(buffer[i * u32Bytes + b]) << (8 * (b + 4 - u32Bytes));
+    }
+    return static_cast<INT32>(u32) >> (32 - u32Bytes * 8);
+}
+
+void WriteSample(std::vector<BYTE>& buffer, MIX_SAMPLE_FORMAT format, size_t i, INT32 i32)
+{
+    const UINT32 u32Bytes = GetMixSampleBytes(format);
+    for (UINT32 b = 0; b < u32Bytes; b++)
+    {
+        buffer[i * u32Bytes + b] = static_cast<BYTE>(i32 >> (8 * b));
+    }
+}
+
+// What a conversion APO does: a typed pass over the whole period, rounded but not dithered
+void ConvertIn(std::vector<FLOAT32>& output, const std::vector<BYTE>& input, MIX_SAMPLE_FORMAT format)
+{
+    const FLOAT32 f32Scale = static_cast<FLOAT32>(1.0 / GetScale(format));
+    if (format == MIX_SAMPLE_INT16)
+    {
+        const INT16 *pi16Input = reinterpret_cast<const INT16*>(input.data());
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            output[i] = static_cast<FLOAT32>(pi16Input[i]) * f32Scale;
+        }
+    }
+    else if (format == MIX_SAMPLE_INT32)
+    {
+        const INT32 *pi32Input = reinterpret_cast<const INT32*>(input.data());
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            output[i] = static_cast<FLOAT32>(pi32Input[i]) * f32Scale;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            output[i] = static_cast<FLOAT32>(ReadSample(input, format, i)) * f32Scale;
+        }
+    }
+}
+
+void ConvertOut(std::vector<BYTE>& output, const std::vector<FLOAT32>& input, MIX_SAMPLE_FORMAT format)
+{
+    const FLOAT32 f32Scale = static_cast<FLOAT32>(GetScale(format));
+    const FLOAT32 f32High = (format == MIX_SAMPLE_INT32) ? 2147483520.0f : f32Scale - 1.0f;
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        FLOAT32 f32 = input[i] * f32Scale;
+        f32 = (f32 < -f32Scale) ? -f32Scale : (f32 > f32High) ? f32High : f32;
+        const INT32 i32 = static_cast<INT32>(std::lrint(f32));
+        if (format == MIX_SAMPLE_INT16)
+        {
+            reinterpret_cast<INT16*>(output.data())[i] = static_cast<INT16>(i32);
+        }
+        else if (format == MIX_SAMPLE_INT32)
+        {
+            reinterpret_cast<INT32*>(output.data())[i] = i32;
+        }
+        else
+        {
+            WriteSample(output, format, i, i32);
+        }
+    }
+}
+
+// Starts mixing the clip into the stream at half the level, without a ramp
+void StartMix(MIX_CONTEXT *pContext, const MIX_KERNELS *pKernels, UINT32 u32Channels, BOOL bInPlace,
+              const std::vector<FLOAT32>& file)
+{
+    InitMixContext(pContext, pKernels, u32Channels, bInPlace, 0);
+
+    MIX_REQUEST request = {};
+    request.aSources[0].pf32File = file.data();
+    request.aSources[0].u32FileFrameCount = c_u32FileFrameCount;
+    request.aSources[0].f32Weight = 0.5f;
+    request.aSources[0].bLoop = TRUE;
+    request.u32SourceCount = 1;
+    request.bMix = TRUE;
+    request.f32InputWeight = 0.5f;
+    PostMixRequest(pContext, &request);
+}
+
+// Mixes a few periods into the format with the kernel set and returns the output
+std::vector<BYTE> MixPeriods(const MIX_KERNELS *pKernels, MIX_SAMPLE_FORMAT format, UINT32 u32Channels,
+                             const std::vector<BYTE>& input, const std::vector<FLOAT32>& file)
+{
+    MIX_CONTEXT *pContext = new MIX_CONTEXT;
+    MIX_FORMAT *pFormat = new MIX_FORMAT;
+    MIX_LIMITER limiter;
+    StartMix(pContext, pKernels, u32Channels, TRUE, file);
+    InitMixFormat(pFormat, format, u32Channels);
+    InitMixLimiter(&limiter, 0, u32Channels, MIX_LIMITER_CEILING, 0, nullptr);
+
+    std::vector<BYTE> output;
+    std::vector<BYTE> period(input.size());
+    for (UINT32 i = 0; i < 20; i++)
+    {
+        pKernels->pfnProcessFormat(pFormat, pContext, &limiter, period.data(), input.data(), c_u32FramesPerPeriod, BUFFER_VALID);
+        output.insert(output.end(), period.begin(), period.end());
+    }
+
+    delete pFormat;
+    delete pContext;
+    return output;
+}
+
+// Largest distance of the fixed point output from the float mix, in steps of the format
+double GetMixError(const std::vector<BYTE>& output, MIX_SAMPLE_FORMAT format, UINT32 u32Channels,
+                   const std::vector<BYTE>& input, const std::vector<FLOAT32>& file)
+{
+    const UINT32 u32SampleCount = c_u32FramesPerPeriod * u32Channels;
+    std::vector<FLOAT32> floatInput(u32SampleCount);
+    std::vector<FLOAT32> mix(u32SampleCount);
+    ConvertIn(floatInput, input, format);
+
+    MIX_CONTEXT *pContext = new MIX_CONTEXT;
+    StartMix(pContext, GetMixKernels(MIX_ISA_SCALAR), u32Channels, FALSE, file);
+
+    double maxError = 0.0;
+    for (UINT32 period = 0; period < 20; period++)
+    {
+        pContext->pProcessor->pfnProcess[BUFFER_VALID](pContext, mix.data(), floatInput.data(), c_u32FramesPerPeriod);
+        for (UINT32 i = 0; i < u32SampleCount; i++)
+        {
+            const double error = std::fabs(ReadSample(output, format, static_cast<size_t>(period) * u32SampleCount + i) -
+                                           static_cast<double>(mix[i]) * GetScale(format));
+            maxError = (error > maxError) ? error : maxError;
+        }
+    }
+
+    delete pContext;
+    return maxError;
+}
+
+bool RunChannelCount(UINT32 u32Channels)
+{
+    const UINT32 u32SampleCount = c_u32FramesPerPeriod * u32Channels;
+
+    std::vector<FLOAT32> floatInput(u32SampleCount);
+    std::vector<FLOAT32> floatOutput(u32SampleCount);
+    std::vector<FLOAT32> file(static_cast<size_t>(c_u32FileFrameCount) * u32Channels);
+    FillNoise(floatInput, 1, 0.5f);
+    FillNoise(file, 2, 0.5f);
+
+    MIX_CONTEXT *pContext = new MIX_CONTEXT;
+    MIX_FORMAT *pFormat = new MIX_FORMAT;
+    MIX_LIMITER limiter;
+    InitMixLimiter(&limiter, 0, u32Channels, MIX_LIMITER_CEILING, 0, nullptr);
+
+    bool ok = true;
+    for (MIX_SAMPLE_FORMAT format : c_aFormats)
+    {
+        std::vector<BYTE> input(static_cast<size_t>(u32SampleCount) * GetMixSampleBytes(format));
+        std::vector<BYTE> output(input.size());
+        ConvertOut(input, floatInput, format);
+
+        // Dither adds up to a step on top of rounding to the nearest one
+        const double tolerance = (format == MIX_SAMPLE_INT32) ? 0.5 : 1.5;
+        const std::vector<BYTE> expected = MixPeriods(GetMixKernels(MIX_ISA_SCALAR), format, u32Channels, input, file);
+        const double error = GetMixError(expected, format, u32Channels, input, file);
+        if (error > tolerance)
+        {
+            std::printf("  %u ch  %s  off the float mix by %.2f steps\n", u32Channels, c_apszFormatNames[format], error);
+            ok = false;
+        }
+
+        for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+        {
+            const MIX_KERNELS *pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+            if (pKernels == nullptr || isa > DetectMixIsa())
+            {
+                continue;
+            }
+
+            if (MixPeriods(pKernels, format, u32Channels, input, file) != expected)
+            {
+                std::printf("  %u ch  %s  %-10s MISMATCH\n", u32Channels, c_apszFormatNames[format], pKernels->pszName);
+                ok = false;
+                continue;
+            }
+
+            StartMix(pContext, pKernels, u32Channels, FALSE, file);
+            double floatNs = NanosecondsPerPeriod([&]() {
+                pContext->pProcessor->pfnProcess[BUFFER_VALID](pContext, floatOutput.data(), floatInput.data(), c_u32FramesPerPeriod);
+            });
+
+            StartMix(pContext, pKernels, u32Channels, FALSE, file);
+            double separateNs = NanosecondsPerPeriod([&]() {
+                ConvertIn(floatOutput, input, format);
+                pContext->pProcessor->pfnProcess[BUFFER_VALID](pContext, floatOutput.data(), floatOutput.data(), c_u32FramesPerPeriod);
+                ConvertOut(output, floatOutput, format);
+            });
+
+            StartMix(pContext, pKernels, u32Channels, TRUE, file);
+            InitMixFormat(pFormat, format, u32Channels);
+            double fusedNs = NanosecondsPerPeriod([&]() {
+                pKernels->pfnProcessFormat(pFormat, pContext, &limiter, output.data(), input.data(), c_u32FramesPerPeriod, BUFFER_VALID);
+            });
+
+            std::printf("  %u ch  %s  %-10s float mix %8.1f ns/period  separate passes %8.1f ns/period  fused %8.1f ns/period  %5.2fx\n",
+                        u32Channels, c_apszFormatNames[format], pKernels->pszName, floatNs, separateNs, fusedNs,
+                        separateNs / fusedNs);
+        }
+        std::printf("  %u ch  %s  largest distance from the float mix %.3f steps\n",
+                    u32Channels, c_apszFormatNames[format], error);
+    }
+
+    delete pFormat;
+    delete pContext;
+    return ok;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Fixed point connections, %u frames per period, selected kernels: %s\n",
+                c_u32FramesPerPeriod, SelectMixKernels()->pszName);
+
+    bool ok = true;
+    for (UINT32 u32Channels : { 2u, 8u })
+    {
+        ok = RunChannelCount(u32Channels) && ok;
+    }
+    return ok ? 0 : 1;
+}
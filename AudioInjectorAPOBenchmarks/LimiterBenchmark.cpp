@@ -0,0 +1,159 @@
+//
+// LimiterBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Measures the per period cost of the lookahead limiter that runs after the
+//  mix, next to the cost of the mix itself.  A quiet mix takes the fast path,
+//  a peak scan and a pass through the delay line; a hot one has its gains
+//  worked out frame by frame for the whole period.  The limited output of
+//  every kernel set is checked against the scalar one before timing.
+//
+//  Build and run on Linux with ./build.sh && ./LimiterBenchmark
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "AudioMixKernels.h"
+
+namespace
+{
+
+const UINT32 c_u32FramesPerSecond = 48000;
+const UINT32 c_u32FramesPerPeriod = 480;        // 10 ms at 48 kHz
+const UINT32 c_u32LookaheadFrames = c_u32FramesPerSecond * 5 / 1000;
+const UINT32 c_u32ReleaseFrames = c_u32FramesPerSecond * MIX_LIMITER_RELEASE_MS / 1000;
+const UINT32 c_u32Periods = 5000;
+const UINT32 c_u32Runs = 5;
+
+void FillNoise(std::vector<FLOAT32>& buffer, UINT32 u32Seed, FLOAT32 f32Level)
+{
+    for (FLOAT32& f : buffer)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        f = static_cast<FLOAT32>(static_cast<INT32>(u32Seed)) / 2147483648.0f * f32Level;
+    }
+}
+
+// Best of a few runs, the differences are small enough to drown in scheduling noise
+template <class F>
+double NanosecondsPerPeriod(F process)
+{
+    double best = 0.0;
+    for (UINT32 run = 0; run < c_u32Runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (UINT32 i = 0; i < c_u32Periods; i++)
+        {
+            process();
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(stop - start).count() / c_u32Periods;
+        if (run == 0 || ns < best)
+        {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+// Limits a few periods of the signal with the kernel set and returns the output
+std::vector<FLOAT32> LimitPeriods(const MIX_KERNELS *pKernels, const std::vector<FLOAT32>& signal, UINT32 u32Channels)
+{
+    std::vector<BYTE> buffer(GetMixLimiterBufferSize(c_u32LookaheadFrames, u32Channels));
+    MIX_LIMITER limiter;
+    InitMixLimiter(&limiter, c_u32LookaheadFrames, u32Channels, MIX_LIMITER_CEILING, c_u32ReleaseFrames, buffer.data());
+
+    std::vector<FLOAT32> output;
+    std::vector<FLOAT32> period(signal);
+    for (UINT32 i = 0; i < 20; i++)
+    {
+        period = signal;
+        pKernels->pfnLimit(&limiter, period.data(), c_u32FramesPerPeriod, BUFFER_VALID);
+        output.insert(output.end(), period.begin(), period.end());
+    }
+    return output;
+}
+
+bool RunChannelCount(UINT32 u32Channels)
+{
+    const UINT32 u32SampleCount = c_u32FramesPerPeriod * u32Channels;
+
+    std::vector<FLOAT32> input(u32SampleCount);
+    std::vector<FLOAT32> file(u32SampleCount);
+    std::vector<FLOAT32> quiet(u32SampleCount);
+    std::vector<FLOAT32> hot(u32SampleCount);
+    std::vector<FLOAT32> frames(u32SampleCount);
+    FillNoise(input, 1, 0.5f);
+    FillNoise(file, 2, 0.5f);
+    FillNoise(quiet, 3, 0.5f);
+    FillNoise(hot, 4, 4.0f);
+
+    std::vector<BYTE> buffer(GetMixLimiterBufferSize(c_u32LookaheadFrames, u32Channels));
+    MIX_LIMITER limiter;
+
+    const std::vector<FLOAT32> expectedQuiet = LimitPeriods(GetMixKernels(MIX_ISA_SCALAR), quiet, u32Channels);
+    const std::vector<FLOAT32> expectedHot = LimitPeriods(GetMixKernels(MIX_ISA_SCALAR), hot, u32Channels);
+
+    bool ok = true;
+    for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+    {
+        const MIX_KERNELS *pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+        if (pKernels == nullptr || isa > DetectMixIsa())
+        {
+            continue;
+        }
+
+        if (LimitPeriods(pKernels, quiet, u32Channels) != expectedQuiet ||
+            LimitPeriods(pKernels, hot, u32Channels) != expectedHot)
+        {
+            std::printf("  %u ch  %-10s MISMATCH\n", u32Channels, pKernels->pszName);
+            ok = false;
+            continue;
+        }
+
+        double mixNs = NanosecondsPerPeriod([&]() {
+            pKernels->pfnMixSpan(frames.data(), input.data(), file.data(), u32SampleCount, 0.5f, 0.5f);
+        });
+
+        // The limiter works in place, so every period starts from a copy of the signal
+        double copyNs = NanosecondsPerPeriod([&]() {
+            std::memcpy(frames.data(), quiet.data(), u32SampleCount * sizeof(FLOAT32));
+        });
+
+        InitMixLimiter(&limiter, c_u32LookaheadFrames, u32Channels, MIX_LIMITER_CEILING, c_u32ReleaseFrames, buffer.data());
+        double quietNs = NanosecondsPerPeriod([&]() {
+            std::memcpy(frames.data(), quiet.data(), u32SampleCount * sizeof(FLOAT32));
+            pKernels->pfnLimit(&limiter, frames.data(), c_u32FramesPerPeriod, BUFFER_VALID);
+        }) - copyNs;
+
+        InitMixLimiter(&limiter, c_u32LookaheadFrames, u32Channels, MIX_LIMITER_CEILING, c_u32ReleaseFrames, buffer.data());
+        double hotNs = NanosecondsPerPeriod([&]() {
+            std::memcpy(frames.data(), hot.data(), u32SampleCount * sizeof(FLOAT32));
+            pKernels->pfnLimit(&limiter, frames.data(), c_u32FramesPerPeriod, BUFFER_VALID);
+        }) - copyNs;
+
+        std::printf("  %u ch  %-10s mix %8.1f ns/period  limiter quiet %8.1f ns/period  hot %9.1f ns/period\n",
+                    u32Channels, pKernels->pszName, mixNs, quietNs, hotNs);
+    }
+    return ok;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Lookahead limiter, %u frames per period, %u frames lookahead, selected kernels: %s\n",
+                c_u32FramesPerPeriod, c_u32LookaheadFrames, SelectMixKernels()->pszName);
+
+    bool ok = true;
+    for (UINT32 u32Channels : { 2u, 8u })
+    {
+        ok = RunChannelCount(u32Channels) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+//
+// MixBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Compares every mix kernel set available on this machine with the original
+//  per-sample modulo implementation of ProcessAudioMix.  Each kernel set is
+//  checked to produce bit identical output before it is timed.  The processors
+//  APOProcess calls are timed both specialized for the channel count and with
+//  the channel count read at run time, and while ramping the mix weights.
+//
+//  Build and run on Linux with ./build.sh && ./MixBenchmark
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "AudioMixKernels.h"
+
+namespace
+{
+
+const UINT32 c_u32FramesPerPeriod = 480;        // 10 ms at 48 kHz
+const UINT32 c_u32FileFrameCount = 48000 + 77;  // not a multiple of the period, so runs wrap
+const UINT32 c_u32Periods = 20000;
+
+// The scalar loop ProcessAudioMix used before the kernels were introduced
+void ReferenceAudioMix(
+    FLOAT32 *pf32OutputFrames, const FLOAT32 *pf32InputFrames,
+    UINT32 u32ValidFrameCount, UINT32 u32SamplesPerFrame,
+    const FLOAT32 *pf32FileBuffer, UINT32 u32FileFrameCount,
+    UINT32 *pu32FileIndex, FLOAT32 fInputWeight, FLOAT32 fFileWeight)
+{
+    for (UINT32 i = 0; i < u32ValidFrameCount; i++)
+    {
+        for (UINT32 j = 0; j < u32SamplesPerFrame; j++)
+        {
+            UINT32 sampleIndex = i * u32SamplesPerFrame + j;
+            UINT32 filePos = ((*pu32FileIndex) + i) % u32FileFrameCount;
+            FLOAT32 fileSample = pf32FileBuffer[filePos * u32SamplesPerFrame + j];
+            pf32OutputFrames[sampleIndex] =
+                (pf32InputFrames[sampleIndex] * fInputWeight) +
+                (fileSample * fFileWeight);
+        }
+    }
+    *pu32FileIndex = (*pu32FileIndex + u32ValidFrameCount) % u32FileFrameCount;
+}
+
+void FillNoise(std::vector<FLOAT32>& buffer, UINT32 u32Seed)
+{
+    for (FLOAT32& f : buffer)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        f = static_cast<FLOAT32>(static_cast<INT32>(u32Seed)) / 2147483648.0f;
+    }
+}
+
+template <class F>
+double NanosecondsPerPeriod(F mix)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (UINT32 i = 0; i < c_u32Periods; i++)
+    {
+        mix();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / c_u32Periods;
+}
+
+bool RunChannelCount(UINT32 u32Channels)
+{
+    const FLOAT32 fInputWeight = 0.65f;
+    const FLOAT32 fFileWeight = 0.35f;
+
+    std::vector<FLOAT32> input(c_u32FramesPerPeriod * u32Channels);
+    std::vector<FLOAT32> file(static_cast<size_t>(c_u32FileFrameCount) * u32Channels);
+    std::vector<FLOAT32> expected(input.size());
+    std::vector<FLOAT32> output(input.size());
+    FillNoise(input, 1);
+    FillNoise(file, 2);
+
+    UINT32 u32RefIndex = 0;
+    double refNs = NanosecondsPerPeriod([&]() {
+        ReferenceAudioMix(expected.data(), input.data(), c_u32FramesPerPeriod, u32Channels,
+                          file.data(), c_u32FileFrameCount, &u32RefIndex, fInputWeight, fFileWeight);
+    });
+    std::printf("  %u ch  %-10s %9.1f ns/period\n", u32Channels, "reference", refNs);
+
+    bool ok = true;
+    for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+    {
+        const MIX_KERNELS *pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+        if (pKernels == nullptr || isa > DetectMixIsa())
+        {
+            continue;
+        }
+
+        // Verify bit exactness over enough periods to cross the loop point several times
+        UINT32 u32ExpectedIndex = 0, u32Index = 0;
+        for (UINT32 period = 0; period < 1000; period++)
+        {
+            ReferenceAudioMix(expected.data(), input.data(), c_u32FramesPerPeriod, u32Channels,
+                              file.data(), c_u32FileFrameCount, &u32ExpectedIndex, fInputWeight, fFileWeight);
+            MixAudioFrames(pKernels, output.data(), input.data(), c_u32FramesPerPeriod, u32Channels,
+                           file.data(), c_u32FileFrameCount, &u32Index, fInputWeight, fFileWeight);
+            if (u32Index != u32ExpectedIndex ||
+                std::memcmp(output.data(), expected.data(), output.size() * sizeof(FLOAT32)) != 0)
+            {
+                std::printf("  %u ch  %-10s MISMATCH in period %u\n", u32Channels, pKernels->pszName, period);
+                ok = false;
+                break;
+            }
+        }
+
+        double ns = NanosecondsPerPeriod([&]() {
+            MixAudioFrames(pKernels, output.data(), input.data(), c_u32FramesPerPeriod, u32Channels,
+                           file.data(), c_u32FileFrameCount, &u32Index, fInputWeight, fFileWeight);
+        });
+        std::printf("  %u ch  %-10s %9.1f ns/period  %5.1fx\n", u32Channels, pKernels->pszName, ns, refNs / ns);
+
+        // Processors with fixed weights, then with every period inside a ramp
+        MIX_CONTEXT context;
+        MIX_REQUEST request = {};
+        request.aSources[0].pf32File = file.data();
+        request.aSources[0].u32FileFrameCount = c_u32FileFrameCount;
+        request.aSources[0].f32Weight = fFileWeight;
+        request.aSources[0].bLoop = TRUE;
+        request.u32SourceCount = 1;
+        request.bMix = TRUE;
+        request.f32InputWeight = fInputWeight;
+
+        InitMixContext(&context, pKernels, u32Channels, FALSE, 0);
+        PostMixRequest(&context, &request);
+        context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), c_u32FramesPerPeriod);
+
+        const PFN_MIX_PROCESS pfnSpecialized = context.pProcessor->pfnProcess[BUFFER_VALID];
+        const PFN_MIX_PROCESS pfnGeneric = pKernels->channels[MIX_CHANNELS_ANY].states[MIX_STATE_MIX].pfnProcess[BUFFER_VALID];
+
+        for (PFN_MIX_PROCESS pfnProcess : { pfnSpecialized, pfnGeneric })
+        {
+            double processNs = NanosecondsPerPeriod([&]() {
+                pfnProcess(&context, output.data(), input.data(), c_u32FramesPerPeriod);
+            });
+            std::printf("  %u ch  %-10s %9.1f ns/period  %5.1fx  processor, %s\n", u32Channels, pKernels->pszName,
+                        processNs, refNs / processNs, pfnProcess == pfnGeneric ? "any channel count" : "specialized");
+        }
+
+        for (MIX_RAMP_SHAPE shape : { MIX_RAMP_LINEAR, MIX_RAMP_EXPONENTIAL })
+        {
+            InitMixContext(&context, pKernels, u32Channels, FALSE, (c_u32Periods + 1) * c_u32FramesPerPeriod);
+            request.rampShape = shape;
+            PostMixRequest(&context, &request);
+
+            double rampNs = NanosecondsPerPeriod([&]() {
+                context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), c_u32FramesPerPeriod);
+            });
+            std::printf("  %u ch  %-10s %9.1f ns/period  %5.1fx  processor, %s ramp\n", u32Channels, pKernels->pszName,
+                        rampNs, refNs / rampNs, shape == MIX_RAMP_LINEAR ? "linear" : "exponential");
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Audio mix, %u frames per period, selected kernels: %s\n",
+                c_u32FramesPerPeriod, SelectMixKernels()->pszName);
+
+    bool ok = true;
+    for (UINT32 u32Channels : { 1u, 2u, 4u, 6u, 8u })
+    {
+        ok = RunChannelCount(u32Channels) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+//
+// PcmCacheBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Measures what the on-disk cache of AudioPcmCache.h saves LockForProcess: a
+//  minute of 44.1 kHz FLAC opened for a 48 kHz stream without the cache (decode
+//  and resample), with a cold cache (the same plus writing the cache file), and
+//  with a warm one (hashing the source, mapping the cache file and checking its
+//  samples).  The bare mapping of the cache file is the floor of the last one.
+//  Where the reader cannot resample the clip is opened at its own rate, which
+//  leaves the decode alone to be saved.  Every load is checked against the first.
+//
+//  Build and run on Linux with ./build.sh && ./PcmCacheBenchmark
+//
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "AudioFileReader.h"
+#include "AudioPcmCache.h"
+#include "FlacEncoder.h"
+
+namespace
+{
+
+const UINT32 c_u32SourceRate = 44100;
+const UINT32 c_u32StreamRate = 48000;
+const UINT32 c_u32FrameCount = c_u32SourceRate * 60;      // a minute of a stereo clip
+const UINT32 c_u32MaxFrameCount = 480;
+const UINT32 c_u32StreamMinMs = 120000;                   // the clip is read whole
+const UINT32 c_u32Runs = 5;
+
+// Music-like content: a few partials with a slow tremolo over quiet noise, left and right related
+std::vector<INT32> MakeClip()
+{
+    std::vector<INT32> samples(static_cast<size_t>(c_u32FrameCount) * c_u16FlacChannels);
+    UINT32 u32Seed = 1;
+    for (UINT32 i = 0; i < c_u32FrameCount; i++)
+    {
+        const double t = static_cast<double>(i) / c_u32SourceRate;
+        const double tremolo = 0.6 + 0.4 * std::sin(2.0 * 3.14159265358979 * 0.5 * t);
+        const double tone = std::sin(2.0 * 3.14159265358979 * 220.0 * t) + 0.5 * std::sin(2.0 * 3.14159265358979 * 331.0 * t) +
+                            0.25 * std::sin(2.0 * 3.14159265358979 * 1241.0 * t);
+        for (UINT32 c = 0; c < c_u16FlacChannels; c++)
+        {
+            u32Seed = u32Seed * 1664525u + 1013904223u;
+            const INT32 i32Noise = static_cast<INT32>(u32Seed >> 24) - 128;
+            samples[static_cast<size_t>(i) * c_u16FlacChannels + c] =
+                static_cast<INT32>(9000.0 * tremolo * tone * (c == 0 ? 1.0 : 0.8)) + i32Noise;
+        }
+    }
+    return samples;
+}
+
+bool WriteFile(const std::string& path, const std::vector<BYTE>& file)
+{
+    FILE *pFile = std::fopen(path.c_str(), "wb");
+    if (pFile == nullptr)
+    {
+        return false;
+    }
+    const bool ok = std::fwrite(file.data(), 1, file.size(), pFile) == file.size();
+    std::fclose(pFile);
+    return ok;
+}
+
+// Best of a few runs, the first one pulls the files into the page cache
+template <class F>
+double BestMilliseconds(F run)
+{
+    double best = 0.0;
+    for (UINT32 i = 0; i < c_u32Runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+        if (i == 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+void Report(const char *pszName, double ms, bool ok)
+{
+    std::printf("  %-20s %8.2f ms  %7.0fx real time%s\n", pszName, ms,
+                static_cast<double>(c_u32FrameCount) / c_u32SourceRate * 1000.0 / ms, ok ? "" : "  FAILED");
+}
+
+// Open the clip as LockForProcess does, with its cache files in pcmCacheDirectory if it is not nullptr
+HRESULT Load(AudioFileReader& reader, const std::wstring& path, UINT32 u32StreamRate, LPCWSTR pcmCacheDirectory)
+{
+    HRESULT hr = reader.Open(path.c_str(), u32StreamRate, c_u32MaxFrameCount, c_u32StreamMinMs, pcmCacheDirectory);
+    if (SUCCEEDED(hr))
+    {
+        hr = reader.ResampleAudio(u32StreamRate, reader.GetChannelCount());
+    }
+    return hr;
+}
+
+bool SameClip(const AudioFileReader& reader, const std::vector<FLOAT32>& expected)
+{
+    return reader.GetAudioData() != nullptr &&
+           static_cast<size_t>(reader.GetFrameCount()) * reader.GetChannelCount() == expected.size() &&
+           std::memcmp(reader.GetAudioData(), expected.data(), expected.size() * sizeof(FLOAT32)) == 0;
+}
+
+} // namespace
+
+int main()
+{
+    const std::string path = "/tmp/PcmCacheBenchmark.flac";
+    const std::string cacheDirectory = "/tmp/PcmCacheBenchmark";
+    const std::vector<BYTE> file = MakeFlacFile(MakeClip(), c_u32SourceRate);
+    if (!WriteFile(path, file) || (mkdir(cacheDirectory.c_str(), 0700) != 0 && errno != EEXIST))
+    {
+        std::printf("cannot write %s\n", path.c_str());
+        return 1;
+    }
+    const std::wstring widePath(path.begin(), path.end());
+    const std::wstring wideCacheDirectory(cacheDirectory.begin(), cacheDirectory.end());
+
+    // The reference load, which also tells whether the reader resamples here
+    AudioFileReader reader;
+    UINT32 u32StreamRate = c_u32StreamRate;
+    HRESULT hr = Load(reader, widePath, u32StreamRate, nullptr);
+    if (hr == E_NOTIMPL)
+    {
+        u32StreamRate = c_u32SourceRate;
+        hr = Load(reader, widePath, u32StreamRate, nullptr);
+    }
+    if (FAILED(hr) || reader.GetAudioData() == nullptr)
+    {
+        std::printf("the clip does not load\n");
+        return 1;
+    }
+    const std::vector<FLOAT32> expected(reader.GetAudioData(),
+                                        reader.GetAudioData() + static_cast<size_t>(reader.GetFrameCount()) * reader.GetChannelCount());
+    std::printf("Opening a minute of %u Hz stereo FLAC (%.1f MB) for a %u Hz stream, %.1f MB of float samples\n",
+                c_u32SourceRate, file.size() / (1024.0 * 1024.0), u32StreamRate,
+                expected.size() * sizeof(FLOAT32) / (1024.0 * 1024.0));
+    if (u32StreamRate == c_u32SourceRate)
+    {
+        std::printf("The reader does not resample here, the clip is opened at its own rate\n");
+    }
+
+    // Decoded and resampled every time
+    bool allOk = true;
+    bool ok = true;
+    double ms = BestMilliseconds([&]() {
+        ok = SUCCEEDED(Load(reader, widePath, u32StreamRate, nullptr)) && SameClip(reader, expected) && ok;
+    });
+    Report("no cache", ms, ok);
+    allOk = allOk && ok;
+
+    // The cache file is missing and written every time
+    const UINT64 u64SourceHash = HashAudioBytes(file.data(), file.size(), 0);
+    std::wstring cachePath;
+    if (FAILED(GetAudioPcmCachePath(wideCacheDirectory.c_str(), u64SourceHash, u32StreamRate, &cachePath)))
+    {
+        std::printf("no cache file name\n");
+        return 1;
+    }
+    const std::string narrowCachePath(cachePath.begin(), cachePath.end());
+    ok = true;
+    ms = BestMilliseconds([&]() {
+        reader.Cleanup();
+        std::remove(narrowCachePath.c_str());
+        ok = SUCCEEDED(Load(reader, widePath, u32StreamRate, wideCacheDirectory.c_str())) && !reader.IsMapped() &&
+             SameClip(reader, expected) && ok;
+    });
+    Report("cold cache", ms, ok);
+    allOk = allOk && ok;
+
+    // The cache file is there and mapped
+    ok = true;
+    ms = BestMilliseconds([&]() {
+        ok = SUCCEEDED(Load(reader, widePath, u32StreamRate, wideCacheDirectory.c_str())) && reader.IsMapped() &&
+             SameClip(reader, expected) && ok;
+    });
+    Report("warm cache", ms, ok);
+    allOk = allOk && ok;
+    reader.Cleanup();
+
+    // Only the mapping of the cache file, without hashing the source or checking the samples
+    AudioFileMapping mapping;
+    ok = true;
+    ms = BestMilliseconds([&]() {
+        mapping.Close();
+        ok = SUCCEEDED(mapping.Open(cachePath.c_str(), AUDIO_MAPPING_PREFAULT | AUDIO_MAPPING_LOCK)) && ok;
+    });
+    Report("mapping only", ms, ok);
+    allOk = allOk && ok;
+    mapping.Close();
+
+    std::remove(narrowCachePath.c_str());
+    std::remove(path.c_str());
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+//
+// SourcesBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Compares layering several clips with the fused MixAudioSources pass against
+//  chaining one MixAudioFrames call per clip, each of which reads and writes the
+//  whole output again.  Both produce bit identical output, which is checked
+//  before timing, because a weight of one leaves the running sum unchanged.
+//
+//  Build and run on Linux with ./build.sh && ./SourcesBenchmark
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "AudioMixKernels.h"
+
+namespace
+{
+
+const UINT32 c_u32FramesPerPeriod = 480;        // 10 ms at 48 kHz
+const UINT32 c_u32Periods = 5000;
+const UINT32 c_u32Runs = 5;
+
+// Clip lengths, none a multiple of the period so the loop points move around
+const UINT32 c_au32FileFrameCounts[MIX_MAX_SOURCES] = { 48077, 12345, 30011, 7919, 24007, 9973, 16001, 40009 };
+
+void FillNoise(std::vector<FLOAT32>& buffer, UINT32 u32Seed)
+{
+    for (FLOAT32& f : buffer)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        f = static_cast<FLOAT32>(static_cast<INT32>(u32Seed)) / 2147483648.0f;
+    }
+}
+
+// Best of a few runs, the differences are small enough to drown in scheduling noise
+template <class F>
+double NanosecondsPerPeriod(F mix)
+{
+    double best = 0.0;
+    for (UINT32 run = 0; run < c_u32Runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (UINT32 i = 0; i < c_u32Periods; i++)
+        {
+            mix();
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(stop - start).count() / c_u32Periods;
+        if (run == 0 || ns < best)
+        {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+// One pass per clip, the first one over the input and the others over the output
+void ChainedMix(const MIX_KERNELS *pKernels, FLOAT32 *pf32Output, const FLOAT32 *pf32Input, UINT32 u32Channels,
+                const std::vector<std::vector<FLOAT32>>& files, MIX_SOURCE *pSources, UINT32 u32SourceCount,
+                FLOAT32 f32InputWeight)
+{
+    for (UINT32 s = 0; s < u32SourceCount; s++)
+    {
+        MixAudioFrames(pKernels, pf32Output, (s == 0) ? pf32Input : pf32Output, c_u32FramesPerPeriod, u32Channels,
+                       files[s].data(), pSources[s].u32FileFrameCount, &pSources[s].u32FileIndex,
+                       (s == 0) ? f32InputWeight : 1.0f, pSources[s].f32Weight);
+    }
+}
+
+bool RunChannelCount(UINT32 u32Channels)
+{
+    const FLOAT32 f32InputWeight = 0.5f;
+
+    std::vector<FLOAT32> input(c_u32FramesPerPeriod * u32Channels);
+    std::vector<FLOAT32> expected(input.size());
+    std::vector<FLOAT32> output(input.size());
+    std::vector<std::vector<FLOAT32>> files(MIX_MAX_SOURCES);
+    FillNoise(input, 1);
+
+    MIX_SOURCE chained[MIX_MAX_SOURCES] = {};
+    MIX_SOURCE fused[MIX_MAX_SOURCES] = {};
+    for (UINT32 s = 0; s < MIX_MAX_SOURCES; s++)
+    {
+        files[s].resize(static_cast<size_t>(c_au32FileFrameCounts[s]) * u32Channels);
+        FillNoise(files[s], s + 2);
+
+        chained[s].pf32File = files[s].data();
+        chained[s].u32FileFrameCount = c_au32FileFrameCounts[s];
+        chained[s].f32Weight = 0.5f / MIX_MAX_SOURCES;
+        chained[s].bLoop = TRUE;
+    }
+
+    bool ok = true;
+    for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+    {
+        const MIX_KERNELS *pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+        if (pKernels == nullptr || isa > DetectMixIsa())
+        {
+            continue;
+        }
+
+        for (UINT32 u32Sources : { 1u, 2u, 3u, 4u, 8u })
+        {
+            // Verify bit exactness over enough periods to cross every loop point
+            for (UINT32 s = 0; s < MIX_MAX_SOURCES; s++)
+            {
+                chained[s].u32FileIndex = 0;
+                fused[s] = chained[s];
+            }
+            for (UINT32 period = 0; period < 300; period++)
+            {
+                ChainedMix(pKernels, expected.data(), input.data(), u32Channels, files, chained, u32Sources, f32InputWeight);
+                MixAudioSources(pKernels, output.data(), input.data(), c_u32FramesPerPeriod, u32Channels,
+                                fused, u32Sources, f32InputWeight);
+                if (std::memcmp(output.data(), expected.data(), output.size() * sizeof(FLOAT32)) != 0)
+                {
+                    std::printf("  %u ch  %-10s %u clips  MISMATCH in period %u\n",
+                                u32Channels, pKernels->pszName, u32Sources, period);
+                    ok = false;
+                    break;
+                }
+            }
+
+            double chainedNs = NanosecondsPerPeriod([&]() {
+                ChainedMix(pKernels, expected.data(), input.data(), u32Channels, files, chained, u32Sources, f32InputWeight);
+            });
+            double fusedNs = NanosecondsPerPeriod([&]() {
+                MixAudioSources(pKernels, output.data(), input.data(), c_u32FramesPerPeriod, u32Channels,
+                                fused, u32Sources, f32InputWeight);
+            });
+            std::printf("  %u ch  %-10s %u clips  chained %9.1f ns/period  fused %9.1f ns/period  %5.2fx\n",
+                        u32Channels, pKernels->pszName, u32Sources, chainedNs, fusedNs, chainedNs / fusedNs);
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Layered clips, %u frames per period, selected kernels: %s\n",
+                c_u32FramesPerPeriod, SelectMixKernels()->pszName);
+
+    bool ok = true;
+    for (UINT32 u32Channels : { 2u, 8u })
+    {
+        ok = RunChannelCount(u32Channels) && ok;
+    }
+    return ok ? 0 : 1;
+}
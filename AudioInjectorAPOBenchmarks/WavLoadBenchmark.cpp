@@ -0,0 +1,201 @@
+//
+// WavLoadBenchmark.cpp -- Copyright (c) 2025 Maxim [maxirmx] Samsonov. All rights reserved.
+//
+// Description:
+//
+//  Measures loading WAV clips with AudioFileReader::Initialize, for PCM of
+//  every width and for float samples, with the pages of the file already in
+//  the page cache.  Next to it the int to float conversion of every kernel set
+//  is timed on its own and checked against the scalar one.
+//
+//  Build and run on Linux with ./build.sh && ./WavLoadBenchmark
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AudioFileReader.h"
+
+namespace
+{
+
+const UINT32 c_u32SampleRate = 48000;
+const UINT16 c_u16Channels = 2;
+const UINT32 c_u32FrameCount = c_u32SampleRate * 60;      // a minute of a stereo clip
+const UINT32 c_u32ConvertSamples = 1u << 20;
+const UINT32 c_u32Runs = 5;
+
+void AppendLE16(std::vector<BYTE>& file, UINT32 value)
+{
+    file.push_back(static_cast<BYTE>(value));
+    file.push_back(static_cast<BYTE>(value >> 8));
+}
+
+void AppendLE32(std::vector<BYTE>& file, UINT32 value)
+{
+    AppendLE16(file, value & 0xFFFF);
+    AppendLE16(file, value >> 16);
+}
+
+// Noise at half scale in the format, as a WAV file with a plain fmt chunk
+std::vector<BYTE> MakeWavFile(UINT16 u16FormatTag, UINT16 u16Bits)
+{
+    const UINT32 u32Bytes = u16Bits / 8;
+    const UINT32 u32DataBytes = c_u32FrameCount * c_u16Channels * u32Bytes;
+
+    std::vector<BYTE> file = { 'R', 'I', 'F', 'F' };
+    AppendLE32(file, 36 + u32DataBytes);
+    file.insert(file.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    AppendLE32(file, 16);
+    AppendLE16(file, u16FormatTag);
+    AppendLE16(file, c_u16Channels);
+    AppendLE32(file, c_u32SampleRate);
+    AppendLE32(file, c_u32SampleRate * c_u16Channels * u32Bytes);
+    AppendLE16(file, c_u16Channels * u32Bytes);
+    AppendLE16(file, u16Bits);
+    file.insert(file.end(), { 'd', 'a', 't', 'a' });
+    AppendLE32(file, u32DataBytes);
+
+    UINT32 u32Seed = 1;
+    for (UINT32 i = 0; i < c_u32FrameCount * c_u16Channels; i++)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        UINT32 u32Sample = static_cast<UINT32>(static_cast<INT32>(u32Seed) / 2);
+        if (u16FormatTag == WAVE_FORMAT_IEEE_FLOAT)
+        {
+            const FLOAT32 f32 = static_cast<FLOAT32>(static_cast<INT32>(u32Seed)) / 4294967296.0f;
+            std::memcpy(&u32Sample, &f32, sizeof(f32));
+        }
+        else
+        {
+            u32Sample >>= 32 - u16Bits;
+            if (u16Bits == 8)
+            {
+                u32Sample ^= 0x80;
+            }
+        }
+
+        for (UINT32 b = 0; b < u32Bytes; b++)
+        {
+            file.push_back(static_cast<BYTE>(u32Sample >> (8 * b)));
+        }
+    }
+    return file;
+}
+
+// Best of a few runs, the first one pulls the file into the page cache
+template <class F>
+double BestMilliseconds(F run)
+{
+    double best = 0.0;
+    for (UINT32 i = 0; i < c_u32Runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+        if (i == 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+bool RunLoad(UINT16 u16FormatTag, UINT16 u16Bits, const char *pszName)
+{
+    const std::vector<BYTE> file = MakeWavFile(u16FormatTag, u16Bits);
+    const std::string path = "/tmp/WavLoadBenchmark.wav";
+    FILE *pFile = std::fopen(path.c_str(), "wb");
+    if (pFile == nullptr || std::fwrite(file.data(), 1, file.size(), pFile) != file.size())
+    {
+        std::printf("  %-8s cannot write %s\n", pszName, path.c_str());
+        if (pFile != nullptr)
+        {
+            std::fclose(pFile);
+        }
+        return false;
+    }
+    std::fclose(pFile);
+
+    const std::wstring widePath(path.begin(), path.end());
+    AudioFileReader reader;
+    bool ok = true;
+    const double ms = BestMilliseconds([&]() {
+        ok = SUCCEEDED(reader.Initialize(widePath.c_str())) && reader.GetFrameCount() == c_u32FrameCount && ok;
+    });
+    const bool bMapped = reader.IsMapped();
+    reader.Cleanup();
+    std::remove(path.c_str());
+
+    const double mb = static_cast<double>(file.size()) / (1024.0 * 1024.0);
+    std::printf("  %-8s %6.1f MB  %8.2f ms  %8.0f MB/s  %s%s\n", pszName, mb, ms, mb / ms * 1000.0,
+                bMapped ? "read in place" : "converted", ok ? "" : "  FAILED");
+    return ok;
+}
+
+bool RunConvert(UINT32 u32Bytes)
+{
+    std::vector<BYTE> input(static_cast<size_t>(c_u32ConvertSamples) * u32Bytes);
+    UINT32 u32Seed = 2;
+    for (BYTE& b : input)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        b = static_cast<BYTE>(u32Seed >> 24);
+    }
+
+    std::vector<FLOAT32> expected(c_u32ConvertSamples);
+    std::vector<FLOAT32> output(c_u32ConvertSamples);
+    GetMixKernels(MIX_ISA_SCALAR)->pfnConvertPcmSpan(expected.data(), input.data(), c_u32ConvertSamples, u32Bytes);
+
+    bool ok = true;
+    double scalarMs = 0.0;
+    for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+    {
+        const MIX_KERNELS *pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+        if (pKernels == nullptr || isa > DetectMixIsa())
+        {
+            continue;
+        }
+
+        const double ms = BestMilliseconds([&]() {
+            pKernels->pfnConvertPcmSpan(output.data(), input.data(), c_u32ConvertSamples, u32Bytes);
+        });
+        if (output != expected)
+        {
+            std::printf("  %u bit  %-10s MISMATCH\n", u32Bytes * 8, pKernels->pszName);
+            ok = false;
+            continue;
+        }
+
+        scalarMs = (isa == MIX_ISA_SCALAR) ? ms : scalarMs;
+        std::printf("  %2u bit  %-10s %8.3f ms  %8.0f Msamples/s  %5.2fx\n", u32Bytes * 8, pKernels->pszName, ms,
+                    c_u32ConvertSamples / ms / 1000.0, scalarMs / ms);
+    }
+    return ok;
+}
+
+} // namespace
+
+int main()
+{
+    std::printf("Loading a minute of %u Hz stereo, selected kernels: %s\n", c_u32SampleRate, SelectMixKernels()->pszName);
+
+    bool ok = true;
+    ok = RunLoad(WAVE_FORMAT_PCM, 8, "pcm8") && ok;
+    ok = RunLoad(WAVE_FORMAT_PCM, 16, "pcm16") && ok;
+    ok = RunLoad(WAVE_FORMAT_PCM, 24, "pcm24") && ok;
+    ok = RunLoad(WAVE_FORMAT_PCM, 32, "pcm32") && ok;
+    ok = RunLoad(WAVE_FORMAT_IEEE_FLOAT, 32, "float") && ok;
+
+    std::printf("Converting %u samples to float\n", c_u32ConvertSamples);
+    for (UINT32 u32Bytes = 1; u32Bytes <= 4; u32Bytes++)
+    {
+        ok = RunConvert(u32Bytes) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#!/usr/bin/env sh
+# build.sh - Builds the portable AudioInjectorAPO benchmarks on Linux
+#
+# The instruction set specific kernels get their -m options per file, exactly
+# like the dispatch in AudioMixKernels.cpp expects.  FP contraction is disabled
+# so that the compiler does not fuse multiplies and adds behind our back, which
+# would break bit compatibility between the kernel sets.
+
+set -e
+
+cd "$(dirname "$0")"
+
+CXX=${CXX:-g++}
+SRC=../AudioInjectorAPO
+OUT=${OUT:-.}
+CXXFLAGS="-std=c++17 -O2 -ffp-contract=off -Wall -Wextra -Wno-unknown-pragmas -I$SRC ${CXXFLAGS}"
+
+case "$(uname -m)" in
+    x86_64|amd64)
+        ISA_FLAGS_SSE2="-msse2"
+        ISA_FLAGS_AVX2="-mavx2"
+        ISA_FLAGS_AVX512="-mavx512f"
+        ;;
+    *)
+        ISA_FLAGS_SSE2=""
+        ISA_FLAGS_AVX2=""
+        ISA_FLAGS_AVX512=""
+        ;;
+esac
+
+mkdir -p "$OUT/obj"
+
+compile() {
+    echo "  CXX $1"
+    $CXX $CXXFLAGS $2 -c "$SRC/$1.cpp" -o "$OUT/obj/$1.o"
+}
+
+compile AudioMixKernels ""
+compile AudioMixKernelsSSE2 "$ISA_FLAGS_SSE2"
+compile AudioMixKernelsAVX2 "$ISA_FLAGS_AVX2"
+compile AudioMixKernelsAVX512 "$ISA_FLAGS_AVX512"
+compile AudioMixKernelsNEON ""
+
+compile AudioFileMapping ""
+compile FlacDecoder ""
+compile AudioPcmCache ""
+compile AudioResampler ""
+compile AudioFileReader ""
+compile AudioClipCache ""
+
+KERNEL_OBJS="$OUT/obj/AudioMixKernels.o $OUT/obj/AudioMixKernelsSSE2.o $OUT/obj/AudioMixKernelsAVX2.o $OUT/obj/AudioMixKernelsAVX512.o $OUT/obj/AudioMixKernelsNEON.o"
+READER_OBJS="$OUT/obj/AudioFileMapping.o $OUT/obj/FlacDecoder.o $OUT/obj/AudioPcmCache.o $OUT/obj/AudioResampler.o $OUT/obj/AudioFileReader.o $OUT/obj/AudioClipCache.o"
+
+echo "  LD  MixBenchmark"
+$CXX $CXXFLAGS MixBenchmark.cpp $KERNEL_OBJS -o "$OUT/MixBenchmark"
+
+echo "  LD  SourcesBenchmark"
+$CXX $CXXFLAGS SourcesBenchmark.cpp $KERNEL_OBJS -o "$OUT/SourcesBenchmark"
+
+echo "  LD  LimiterBenchmark"
+$CXX $CXXFLAGS LimiterBenchmark.cpp $KERNEL_OBJS -o "$OUT/LimiterBenchmark"
+
+echo "  LD  FormatBenchmark"
+$CXX $CXXFLAGS FormatBenchmark.cpp $KERNEL_OBJS -o "$OUT/FormatBenchmark"
+
+echo "  LD  DenormalBenchmark"
+$CXX $CXXFLAGS DenormalBenchmark.cpp $KERNEL_OBJS -o "$OUT/DenormalBenchmark"
+
+echo "  LD  WavLoadBenchmark"
+$CXX $CXXFLAGS WavLoadBenchmark.cpp $READER_OBJS $KERNEL_OBJS -o "$OUT/WavLoadBenchmark"
+
+echo "  LD  FlacLoadBenchmark"
+$CXX $CXXFLAGS FlacLoadBenchmark.cpp $READER_OBJS $KERNEL_OBJS -o "$OUT/FlacLoadBenchmark"
+
+echo "  LD  ResamplerBenchmark"
+$CXX $CXXFLAGS ResamplerBenchmark.cpp $OUT/obj/AudioResampler.o $KERNEL_OBJS -o "$OUT/ResamplerBenchmark"
+
+echo "  LD  PcmCacheBenchmark"
+$CXX $CXXFLAGS PcmCacheBenchmark.cpp $READER_OBJS $KERNEL_OBJS -o "$OUT/PcmCacheBenchmark"
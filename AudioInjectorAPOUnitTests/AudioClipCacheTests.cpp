@@ -0,0 +1,202 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/AudioClipCache.h"
+#include "TestHelpers.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AudioInjectorAPOUnitTests
+{
+   TEST_CLASS(AudioClipCacheTests)
+   {
+   private:
+       // Stereo at the rate of the files, so no resampler is involved
+       static AUDIO_CLIP_FORMAT MakeFormat(UINT32 channelCount, DWORD channelMask)
+       {
+           AUDIO_CLIP_FORMAT format = {};
+           format.u32SampleRate = 48000;
+           format.u32ChannelCount = channelCount;
+           format.dwChannelMask = channelMask;
+           format.u32MaxFrameCount = 480;
+           format.u32CrossfadeFrames = 0;
+           format.u32StreamMinMs = 30000;
+           return format;
+       }
+
+   public:
+       TEST_METHOD(SharesClipOfSameFileAndFormat)
+       {
+           const std::wstring path = WriteTempFile(L"AudioClipCacheTestsShare.wav", MakeRampWavFile(4800, true));
+           const AUDIO_CLIP_FORMAT stereo = MakeFormat(2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+           const AUDIO_CLIP_FORMAT surround = MakeFormat(6, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
+                                                            SPEAKER_LOW_FREQUENCY | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT);
+           AudioClipCache cache;
+
+           std::shared_ptr<AudioFileReader> first;
+           std::shared_ptr<AudioFileReader> second;
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), stereo, &first), L"The clip should load");
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), stereo, &second), L"The clip should be handed out again");
+           Assert::IsTrue(first == second, L"The same file at the same format should be one clip");
+           Assert::AreEqual(1u, cache.GetLoadCount(), L"The clip should be decoded once");
+           Assert::AreEqual(4800u, second->GetFrameCount(), L"The clip should be the file");
+
+           // Another layout maps the channels differently, so it is another clip
+           std::shared_ptr<AudioFileReader> third;
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), surround, &third), L"The clip should load for the other layout");
+           Assert::IsTrue(third != first, L"Another format should be another clip");
+           Assert::IsNotNull(third->GetChannelMap(), L"The clip should be mapped on the other layout");
+           Assert::AreEqual(2u, cache.GetLoadCount(), L"The other format should be decoded on its own");
+           Assert::AreEqual(2u, cache.GetClipCount(), L"Both clips should be held");
+
+           // The last one to let go of a clip frees it
+           first.reset();
+           Assert::AreEqual(2u, cache.GetClipCount(), L"A clip should stay while one caller holds it");
+           second.reset();
+           third.reset();
+           Assert::AreEqual(0u, cache.GetClipCount(), L"Clips no one holds should be freed");
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), stereo, &first), L"The clip should load again");
+           Assert::AreEqual(3u, cache.GetLoadCount(), L"A freed clip should be decoded again");
+
+           // A file that is not there is no clip
+           std::shared_ptr<AudioFileReader> missing;
+           Assert::IsTrue(FAILED(cache.Acquire(L"/nonexistent/AudioClipCacheTests.wav", stereo, &missing)), L"A missing file should fail");
+           Assert::IsTrue(missing == nullptr, L"A failed load should hand out no clip");
+
+           first.reset();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(SharesClipAcrossPeriods)
+       {
+           const std::wstring path = WriteTempFile(L"AudioClipCacheTestsPeriods.wav", MakeRampWavFile(1000, true));
+           AUDIO_CLIP_FORMAT shortPeriods = MakeFormat(2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+           AUDIO_CLIP_FORMAT longPeriods = shortPeriods;
+           longPeriods.u32MaxFrameCount = 1024;
+           AudioClipCache cache;
+
+           // The period only sizes the ring of a streamed clip, a clip in memory is the same for any
+           std::shared_ptr<AudioFileReader> first;
+           std::shared_ptr<AudioFileReader> second;
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), shortPeriods, &first), L"The clip should load");
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), longPeriods, &second), L"The clip should load for longer periods");
+           Assert::IsTrue(first == second, L"Endpoints with other periods should share the clip");
+           Assert::AreEqual(1u, cache.GetLoadCount(), L"The clip should be decoded once");
+
+           // Whole loops up to the fixed length, whatever the period
+           Assert::AreEqual(5000u, first->GetFrameCount(), L"The short clip should be repeated past AUDIO_CLIP_REPEAT_FRAMES");
+
+           first.reset();
+           second.reset();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(ConcurrentCallersWaitForOneLoad)
+       {
+           const std::wstring path = WriteTempFile(L"AudioClipCacheTestsConcurrent.wav", MakeRampWavFile(48000 * 5, true));
+           const AUDIO_CLIP_FORMAT format = MakeFormat(2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+           AudioClipCache cache;
+
+           std::vector<std::shared_ptr<AudioFileReader>> readers(8);
+           std::vector<HRESULT> results(readers.size(), E_FAIL);
+           std::vector<std::thread> threads;
+           for (size_t i = 0; i < readers.size(); i++)
+           {
+               threads.emplace_back([&, i]() { results[i] = cache.Acquire(path.c_str(), format, &readers[i]); });
+           }
+           for (std::thread& thread : threads)
+           {
+               thread.join();
+           }
+
+           for (size_t i = 0; i < readers.size(); i++)
+           {
+               Assert::AreEqual(S_OK, results[i], L"Every caller should get the clip");
+               Assert::IsTrue(readers[i] == readers[0], L"Every caller should get the same clip");
+           }
+           Assert::AreEqual(1u, cache.GetLoadCount(), L"The clip should be decoded once for all of them");
+
+           readers.clear();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(ChangedFileIsAnotherClip)
+       {
+           const std::wstring path = WriteTempFile(L"AudioClipCacheTestsChanged.wav", MakeRampWavFile(4800, true));
+
+           // The crossfade copies the clip out of the mapping, which lets the file be rewritten on Windows
+           AUDIO_CLIP_FORMAT format = MakeFormat(2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+           format.u32CrossfadeFrames = 48;
+           AudioClipCache cache;
+
+           std::shared_ptr<AudioFileReader> before;
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), format, &before), L"The clip should load");
+
+           // Rewritten with another length, the clip held so far stays as it was
+           WriteTestFile(path, MakeRampWavFile(9600, true));
+           std::shared_ptr<AudioFileReader> after;
+           Assert::AreEqual(S_OK, cache.Acquire(path.c_str(), format, &after), L"The changed file should load");
+           Assert::IsTrue(after != before, L"A changed file should be another clip");
+           Assert::AreEqual(9600u - 48u, after->GetFrameCount(), L"The new clip should be the changed file");
+           Assert::AreEqual(4800u - 48u, before->GetFrameCount(), L"The old clip should be left alone");
+
+           before.reset();
+           after.reset();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(ComparesEveryFieldOfTheFormat)
+       {
+           const AUDIO_CLIP_FORMAT format = MakeFormat(2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+           Assert::IsTrue(IsSameAudioClipFormat(format, format), L"A format should be the same as itself");
+
+           // A clip prepared for any other rate, layout, period, crossfade or streaming bound is another clip
+           AUDIO_CLIP_FORMAT other = format;
+           other.u32SampleRate = 44100;
+           Assert::IsFalse(IsSameAudioClipFormat(format, other), L"Another rate should be another format");
+           other = format;
+           other.u32ChannelCount = 6;
+           Assert::IsFalse(IsSameAudioClipFormat(format, other), L"Another channel count should be another format");
+           other = format;
+           other.dwChannelMask = SPEAKER_FRONT_CENTER;
+           Assert::IsFalse(IsSameAudioClipFormat(format, other), L"Another layout should be another format");
+           other = format;
+           other.u32MaxFrameCount = 960;
+           Assert::IsFalse(IsSameAudioClipFormat(format, other), L"Another period should be another format");
+           other = format;
+           other.u32CrossfadeFrames = 48;
+           Assert::IsFalse(IsSameAudioClipFormat(format, other), L"Another crossfade should be another format");
+           other = format;
+           other.u32StreamMinMs = 1000;
+           Assert::IsFalse(IsSameAudioClipFormat(format, other), L"Another streaming bound should be another format");
+       }
+   };
+}
@@ -0,0 +1,318 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/AudioFileMapping.h"
+#include "../AudioInjectorAPO/AudioFileReader.h"
+#include "TestHelpers.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AudioInjectorAPOUnitTests
+{
+   TEST_CLASS(AudioFileMappingTests)
+   {
+   private:
+       // test.wav is copied next to the test DLL on Windows and read from the source tree elsewhere
+       static std::wstring GetTestFilePath(const std::wstring& fileName)
+       {
+#if defined(_WIN32)
+           wchar_t modulePath[MAX_PATH]{0};
+           HMODULE hModule = nullptr;
+           GetModuleHandleExW(
+               GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+               reinterpret_cast<LPCWSTR>(&GetTestFilePath),
+               &hModule);
+           GetModuleFileNameW(hModule, modulePath, MAX_PATH);
+           std::wstring dirPath(modulePath);
+#else
+           const std::string source(__FILE__);
+           std::wstring dirPath(source.begin(), source.end());
+#endif
+           size_t pos = dirPath.find_last_of(L"\\/");
+           if (pos != std::wstring::npos)
+               dirPath = dirPath.substr(0, pos + 1);
+#if !defined(_WIN32)
+           dirPath += L"WavFiles/";
+#endif
+           return dirPath + fileName;
+       }
+
+       static void AppendChunk(std::vector<BYTE>& file, const char* id, const std::vector<BYTE>& body)
+       {
+           file.insert(file.end(), id, id + 4);
+           AppendLE32(file, static_cast<UINT32>(body.size()));
+           file.insert(file.end(), body.begin(), body.end());
+           if (body.size() & 1)
+               file.push_back(0);
+       }
+
+       // WAVE_FORMAT_EXTENSIBLE fmt chunk with a KSDATAFORMAT_SUBTYPE_PCM or _IEEE_FLOAT subformat
+       static std::vector<BYTE> MakeExtensibleFormat(UINT16 subformat, UINT16 channels, UINT32 sampleRate, UINT16 bits, UINT32 mask)
+       {
+           static const BYTE subformatTail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+           std::vector<BYTE> format;
+           AppendLE16(format, WAVE_FORMAT_EXTENSIBLE);
+           AppendLE16(format, channels);
+           AppendLE32(format, sampleRate);
+           AppendLE32(format, sampleRate * channels * (bits / 8));
+           AppendLE16(format, channels * (bits / 8));
+           AppendLE16(format, bits);
+           AppendLE16(format, 22);
+           AppendLE16(format, bits);
+           AppendLE32(format, mask);
+           AppendLE16(format, subformat);
+           format.insert(format.end(), subformatTail, subformatTail + sizeof(subformatTail));
+           return format;
+       }
+
+       // Plain fmt chunk, as written for up to two channels of up to 16 bits
+       static std::vector<BYTE> MakeFormat(UINT16 tag, UINT16 channels, UINT32 sampleRate, UINT16 bits)
+       {
+           std::vector<BYTE> format;
+           AppendLE16(format, tag);
+           AppendLE16(format, channels);
+           AppendLE32(format, sampleRate);
+           AppendLE32(format, sampleRate * channels * (bits / 8));
+           AppendLE16(format, channels * (bits / 8));
+           AppendLE16(format, bits);
+           return format;
+       }
+
+       static std::vector<BYTE> MakeWavFile(const std::vector<BYTE>& format, const std::vector<BYTE>& data)
+       {
+           std::vector<BYTE> file = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E' };
+           AppendChunk(file, "fmt ", format);
+           AppendChunk(file, "data", data);
+           return file;
+       }
+
+
+   public:
+       TEST_METHOD(ParsesMappedTestFile)
+       {
+           AudioFileMapping mapping;
+           HRESULT hr = mapping.Open(GetTestFilePath(L"test.wav").c_str(), AUDIO_MAPPING_PREFAULT | AUDIO_MAPPING_LOCK);
+           Assert::IsTrue(SUCCEEDED(hr), L"test.wav should map");
+           Assert::IsNotNull(mapping.GetData(), L"The mapping should have data");
+
+           WAV_FILE_FORMAT format;
+           hr = ParseWavHeader(mapping.GetData(), mapping.GetSize(), &format);
+           Assert::IsTrue(SUCCEEDED(hr), L"test.wav should parse");
+           Assert::AreEqual(static_cast<UINT16>(WAVE_FORMAT_IEEE_FLOAT), format.u16FormatTag, L"test.wav holds float samples");
+           Assert::AreEqual(static_cast<UINT16>(1), format.u16Channels, L"test.wav is mono");
+           Assert::AreEqual(44100u, format.u32SampleRate, L"test.wav is 44.1 kHz");
+           Assert::AreEqual(static_cast<UINT64>(44100 * sizeof(FLOAT32)), format.u64DataBytes, L"test.wav is one second long");
+
+           // The fact chunk puts the samples off their alignment, so they cannot be read in place
+           Assert::IsNull(GetWavSamplesInPlace(mapping.GetData(), &format), L"Misaligned samples should not be read in place");
+
+           // A 440 Hz sine at half scale, see WavFileGenerators/test-wav.py
+           for (UINT32 i = 0; i < 44100; i += 97)
+           {
+               FLOAT32 sample;
+               memcpy(&sample, mapping.GetData() + format.u64DataOffset + i * sizeof(FLOAT32), sizeof(sample));
+               const double expected = 0.5 * sin(2.0 * 3.14159265358979323846 * 440.0 * i / 44100.0);
+               Assert::AreEqual(expected, static_cast<double>(sample), 1e-5, L"Samples should be the sine of the file");
+           }
+
+           mapping.Close();
+           Assert::IsNull(mapping.GetData(), L"Close should unmap the file");
+           Assert::IsFalse(mapping.IsLocked(), L"Close should unlock the file");
+       }
+
+       TEST_METHOD(ParsesExtensibleAndPaddedChunks)
+       {
+           // An odd sized chunk before fmt, and a LIST chunk between fmt and data
+           std::vector<BYTE> file = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E' };
+           AppendChunk(file, "junk", std::vector<BYTE>(3, 0xEE));
+           AppendChunk(file, "fmt ", MakeExtensibleFormat(WAVE_FORMAT_PCM, 2, 48000, 16, 0x3));
+           AppendChunk(file, "LIST", std::vector<BYTE>(6, 0x11));
+
+           std::vector<BYTE> data;
+           for (UINT32 i = 0; i < 64; i++)
+               AppendLE16(data, i * 100);
+           data.push_back(0x7F);   // half a frame, as left by a writer that was cut off
+           AppendChunk(file, "data", data);
+
+           WAV_FILE_FORMAT format;
+           HRESULT hr = ParseWavHeader(file.data(), file.size(), &format);
+           Assert::IsTrue(SUCCEEDED(hr), L"The file should parse");
+           Assert::AreEqual(static_cast<UINT16>(WAVE_FORMAT_PCM), format.u16FormatTag, L"The subformat should give the format tag");
+           Assert::AreEqual(static_cast<UINT16>(2), format.u16Channels, L"The file is stereo");
+           Assert::AreEqual(48000u, format.u32SampleRate, L"The file is 48 kHz");
+           Assert::AreEqual(static_cast<DWORD>(0x3), format.dwChannelMask, L"The channel mask should be read");
+           Assert::AreEqual(static_cast<UINT64>(128), format.u64DataBytes, L"Only whole frames should be kept");
+
+           const INT16* pSamples = static_cast<const INT16*>(GetWavSamplesInPlace(file.data(), &format));
+           Assert::IsNotNull(pSamples, L"Aligned 16 bit samples should be read in place");
+           Assert::AreEqual(static_cast<INT16>(6300), pSamples[63], L"The samples should be the ones of the data chunk");
+
+           // A data chunk whose size runs past the end of the file keeps what is there
+           file.resize(file.size() - 33);
+           hr = ParseWavHeader(file.data(), file.size(), &format);
+           Assert::IsTrue(SUCCEEDED(hr), L"A truncated file should parse");
+           Assert::AreEqual(static_cast<UINT64>(96), format.u64DataBytes, L"The frames of a truncated file should be the ones in it");
+       }
+
+       TEST_METHOD(ReaderLoadsEveryPcmWidth)
+       {
+           const UINT32 frameCount = 37;
+           const UINT16 channels = 2;
+
+           for (UINT16 bits : { static_cast<UINT16>(8), static_cast<UINT16>(16), static_cast<UINT16>(24), static_cast<UINT16>(32) })
+           {
+               // A ramp over the whole range of the width, the first sample the most negative one
+               const UINT32 bytes = bits / 8;
+               const double scale = static_cast<double>(1ull << (bits - 1));
+               std::vector<BYTE> data;
+               std::vector<double> expected;
+               for (UINT32 i = 0; i < frameCount * channels; i++)
+               {
+                   const INT64 value = static_cast<INT64>(-scale + (2.0 * scale - 1.0) * i / (frameCount * channels - 1));
+                   const UINT32 stored = (bits == 8) ? static_cast<UINT32>(value + 128) : static_cast<UINT32>(value);
+                   for (UINT32 b = 0; b < bytes; b++)
+                       data.push_back(static_cast<BYTE>(stored >> (8 * b)));
+                   expected.push_back(static_cast<double>(value) / scale);
+               }
+
+               const std::wstring path = WriteTempFile(L"AudioFileMappingTests.wav", MakeWavFile(MakeFormat(WAVE_FORMAT_PCM, channels, 44100, bits), data));
+               AudioFileReader reader;
+               HRESULT hr = reader.Initialize(path.c_str());
+               Assert::IsTrue(SUCCEEDED(hr), L"The reader should load PCM of every width");
+               Assert::AreEqual(frameCount, reader.GetFrameCount(), L"Every frame should be read");
+               Assert::AreEqual(static_cast<UINT32>(channels), reader.GetChannelCount(), L"The file is stereo");
+               Assert::AreEqual(44100u, reader.GetSampleRate(), L"The file is 44.1 kHz");
+
+               // 16 bit samples stay in the mapping, the others are converted to float
+               if (bits == 16)
+               {
+                   Assert::IsTrue(reader.IsMapped(), L"Aligned 16 bit samples should be read in place");
+                   Assert::IsNotNull(reader.GetAudioDataInt16(), L"16 bit samples should stay 16 bit");
+                   for (UINT32 i = 0; i < frameCount * channels; i++)
+                       Assert::AreEqual(expected[i], reader.GetAudioDataInt16()[i] / scale, 0.0, L"Samples should be the ones of the file");
+               }
+               else
+               {
+                   Assert::IsNotNull(reader.GetAudioData(), L"Samples should be converted to float");
+                   for (UINT32 i = 0; i < frameCount * channels; i++)
+                       Assert::AreEqual(expected[i], static_cast<double>(reader.GetAudioData()[i]), (bits == 32) ? 1e-7 : 0.0,
+                                        L"Samples should be the ones of the file");
+               }
+
+               reader.Cleanup();
+               RemoveTestFile(path);
+           }
+       }
+
+       TEST_METHOD(ReaderKeepsLoopAndCuePoints)
+       {
+           // 24 bits in 32 bit containers, with smpl and cue chunks after the data
+           const UINT32 frameCount = 40;
+           std::vector<BYTE> data;
+           for (UINT32 i = 0; i < frameCount; i++)
+               AppendLE32(data, (i * 0x10000u) << 8);
+
+           std::vector<BYTE> file = MakeWavFile(MakeExtensibleFormat(WAVE_FORMAT_PCM, 1, 48000, 32, 0x4), data);
+           file[12 + 8 + 18] = 24;     // valid bits of the extensible fmt chunk
+
+           std::vector<BYTE> smpl(36, 0);
+           smpl[28] = 1;               // one loop
+           AppendLE32(smpl, 0);        // cue point id
+           AppendLE32(smpl, 0);        // forward
+           AppendLE32(smpl, 5);        // first frame
+           AppendLE32(smpl, 19);       // last frame
+           AppendLE32(smpl, 0);
+           AppendLE32(smpl, 0);
+           AppendChunk(file, "smpl", smpl);
+
+           std::vector<BYTE> cue;
+           AppendLE32(cue, 3);
+           for (UINT32 frame : { 3u, 30u, 1000u })
+           {
+               std::vector<BYTE> point(20, 0);
+               AppendLE32(point, frame);
+               cue.insert(cue.end(), point.begin(), point.end());
+           }
+           AppendChunk(file, "cue ", cue);
+
+           WAV_FILE_FORMAT format;
+           Assert::IsTrue(SUCCEEDED(ParseWavHeader(file.data(), file.size(), &format)), L"The file should parse");
+           Assert::AreEqual(static_cast<UINT16>(24), format.u16ValidBitsPerSample, L"The valid bits should be read");
+
+           const std::wstring path = WriteTempFile(L"AudioFileMappingTestsLoop.wav", file);
+           AudioFileReader reader;
+           HRESULT hr = reader.Initialize(path.c_str(), AUDIO_MAPPING_PREFAULT);
+           Assert::IsTrue(SUCCEEDED(hr), L"The reader should load the file");
+           Assert::AreEqual(frameCount, reader.GetFrameCount(), L"Every frame should be read");
+           Assert::AreEqual(5u, reader.GetLoopStart(), L"The loop should start at its first frame");
+           Assert::AreEqual(20u, reader.GetLoopEnd(), L"The loop should end after its last frame");
+           Assert::AreEqual(static_cast<size_t>(2), reader.GetCuePoints().size(), L"Cue points past the data should be dropped");
+           Assert::AreEqual(3u, reader.GetCuePoints()[0], L"Cue points should keep their frames");
+           Assert::AreEqual(30u, reader.GetCuePoints()[1], L"Cue points should keep their frames");
+           Assert::AreEqual(static_cast<double>(39 * 0x10000) / 8388608.0, static_cast<double>(reader.GetAudioData()[39]), 0.0,
+                            L"24 bit samples in 32 bit containers should be scaled as 32 bit ones");
+
+           reader.Cleanup();
+           Assert::AreEqual(0u, reader.GetLoopEnd(), L"Cleanup should drop the loop");
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(RejectsInvalidFiles)
+       {
+           WAV_FILE_FORMAT format;
+           const BYTE notRiff[] = { 'R', 'I', 'F', 'X', 0, 0, 0, 0, 'W', 'A', 'V', 'E' };
+           Assert::IsFalse(SUCCEEDED(ParseWavHeader(notRiff, sizeof(notRiff), &format)), L"A file that is not RIFF should fail");
+           Assert::IsFalse(SUCCEEDED(ParseWavHeader(nullptr, 0, &format)), L"No file should fail");
+
+           // No data chunk
+           std::vector<BYTE> file = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E' };
+           AppendChunk(file, "fmt ", MakeExtensibleFormat(WAVE_FORMAT_IEEE_FLOAT, 1, 44100, 32, 0x4));
+           Assert::IsFalse(SUCCEEDED(ParseWavHeader(file.data(), file.size(), &format)), L"A file without data should fail");
+
+           // A block alignment that does not match the channels
+           std::vector<BYTE> fmt = MakeExtensibleFormat(WAVE_FORMAT_IEEE_FLOAT, 1, 44100, 32, 0x4);
+           fmt[12] = 3;
+           file.resize(12);
+           AppendChunk(file, "fmt ", fmt);
+           AppendChunk(file, "data", std::vector<BYTE>(12, 0));
+           Assert::IsFalse(SUCCEEDED(ParseWavHeader(file.data(), file.size(), &format)), L"A wrong block alignment should fail");
+
+           AudioFileMapping mapping;
+           Assert::IsFalse(SUCCEEDED(mapping.Open(GetTestFilePath(L"missing.wav").c_str(), 0)), L"A missing file should not map");
+           Assert::IsNull(mapping.GetData(), L"A failed mapping should have no data");
+       }
+   };
+}
@@ -26,6 +26,10 @@
 #include "CppUnitTest.h"
 #include "../AudioInjectorAPO/AudioFileReader.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 
@@ -176,6 +180,56 @@ namespace AudioInjectorAPOUnitTests
            Assert::AreEqual(initialFrameCount, reader.GetFrameCount(), L"Frame count should match after reinitialization");
        }
 
+       TEST_METHOD(RepeatToLengthKeepsWholeLoops)
+       {
+           std::wstring filePath = GetTestFilePath(L"test.wav");
+           AudioFileReader reader;
+           HRESULT hr = reader.Initialize(filePath.c_str());
+           Assert::IsTrue(SUCCEEDED(hr), L"Initialization should succeed");
+
+           const UINT32 frameCount = reader.GetFrameCount();
+           const UINT32 channelCount = reader.GetChannelCount();
+           std::vector<FLOAT32> original(reader.GetAudioData(), reader.GetAudioData() + static_cast<size_t>(frameCount) * channelCount);
+
+           // A clip that is already long enough is left alone
+           hr = reader.RepeatToLength(frameCount);
+           Assert::IsTrue(SUCCEEDED(hr), L"RepeatToLength should succeed");
+           Assert::AreEqual(frameCount, reader.GetFrameCount(), L"Frame count should not change");
+
+           // A shorter clip is repeated a whole number of times
+           hr = reader.RepeatToLength(frameCount * 2 + 1);
+           Assert::IsTrue(SUCCEEDED(hr), L"RepeatToLength should succeed");
+           Assert::AreEqual(frameCount * 3, reader.GetFrameCount(), L"Clip should be repeated three times");
+
+           for (UINT32 loop = 0; loop < 3; loop++)
+           {
+               const FLOAT32* pLoop = reader.GetAudioData() + static_cast<size_t>(loop) * frameCount * channelCount;
+               Assert::IsTrue(std::equal(original.begin(), original.end(), pLoop), L"Every loop should be a copy of the clip");
+           }
+       }
+
+       TEST_METHOD(WavFileIsReadWithoutDecoding)
+       {
+           std::wstring filePath = GetTestFilePath(L"test.wav");
+           AudioFileReader reader;
+           HRESULT hr = reader.Initialize(filePath.c_str(), AUDIO_MAPPING_PREFAULT);
+           Assert::IsTrue(SUCCEEDED(hr), L"Initialization should succeed");
+           Assert::AreEqual(1u, reader.GetChannelCount(), L"test.wav is mono");
+           Assert::AreEqual(44100u, reader.GetSampleRate(), L"test.wav is 44.1 kHz");
+           Assert::AreEqual(44100u, reader.GetFrameCount(), L"test.wav is one second long");
+
+           // The fact chunk of test.wav leaves its samples misaligned, so they are copied out of the mapping once
+           Assert::IsFalse(reader.IsMapped(), L"Misaligned samples should not stay mapped");
+
+           const FLOAT32* pData = reader.GetAudioData();
+           Assert::IsNotNull(pData, L"Float samples should be available");
+           for (UINT32 i = 0; i < reader.GetFrameCount(); i += 97)
+           {
+               const double expected = 0.5 * sin(2.0 * 3.14159265358979323846 * 440.0 * i / 44100.0);
+               Assert::AreEqual(expected, static_cast<double>(pData[i]), 1e-5, L"Samples should be the ones of the file");
+           }
+       }
+
        TEST_METHOD(CleanupIdempotence)
        {
            std::wstring filePath = GetTestFilePath(L"test.wav");
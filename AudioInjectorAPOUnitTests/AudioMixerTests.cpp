@@ -0,0 +1,1590 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/AudioMixKernels.h"
+#include "TestHelpers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+namespace AudioInjectorAPOUnitTests
+{
+   TEST_CLASS(AudioMixerTests)
+   {
+   private:
+       static const UINT32 Channels = 2;
+
+       // The per-sample modulo loop that ProcessAudioMix used to run
+       static void ReferenceMix(std::vector<FLOAT32>& output, const std::vector<FLOAT32>& input,
+                                UINT32 frameCount, const std::vector<FLOAT32>& file,
+                                UINT32 fileFrameCount, UINT32& fileIndex,
+                                FLOAT32 inputWeight, FLOAT32 fileWeight)
+       {
+           for (UINT32 i = 0; i < frameCount; i++)
+           {
+               for (UINT32 j = 0; j < Channels; j++)
+               {
+                   UINT32 filePos = (fileIndex + i) % fileFrameCount;
+                   output[i * Channels + j] = (input[i * Channels + j] * inputWeight) +
+                                              (file[filePos * Channels + j] * fileWeight);
+               }
+           }
+           fileIndex = (fileIndex + frameCount) % fileFrameCount;
+       }
+
+       static std::vector<FLOAT32> Ramp(UINT32 frameCount, FLOAT32 start)
+       {
+           std::vector<FLOAT32> buffer(frameCount * Channels);
+           for (size_t i = 0; i < buffer.size(); i++)
+           {
+               buffer[i] = start + static_cast<FLOAT32>(i) * 0.001f;
+           }
+           return buffer;
+       }
+
+       // Mixes several consecutive periods with every kernel set and compares them with the reference
+       static void CheckAgainstReference(UINT32 periodFrames, UINT32 fileFrameCount, UINT32 startIndex, UINT32 periods)
+       {
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(fileFrameCount, 0.25f);
+
+           for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+           {
+               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+               if (pKernels == nullptr)
+               {
+                   continue;
+               }
+
+               std::vector<FLOAT32> expected(input.size());
+               std::vector<FLOAT32> actual(input.size());
+               UINT32 expectedIndex = startIndex;
+               UINT32 actualIndex = startIndex;
+
+               for (UINT32 period = 0; period < periods; period++)
+               {
+                   ReferenceMix(expected, input, periodFrames, file, fileFrameCount, expectedIndex, 0.7f, 0.3f);
+                   MixAudioFrames(pKernels, actual.data(), input.data(), periodFrames, Channels,
+                                  file.data(), fileFrameCount, &actualIndex, 0.7f, 0.3f);
+
+                   Assert::AreEqual(expectedIndex, actualIndex, L"File index should match the reference");
+                   for (size_t i = 0; i < expected.size(); i++)
+                   {
+                       Assert::AreEqual(expected[i], actual[i], L"Mixed sample should be bit identical to the reference");
+                   }
+               }
+           }
+       }
+
+       // Starts mixing the clip into the context the way the APO does after LockForProcess
+       static void StartMix(MIX_CONTEXT& context, const MIX_KERNELS* pKernels, UINT32 channels, BOOL inPlace,
+                            UINT32 rampFrames, const std::vector<FLOAT32>& file, FLOAT32 ratio,
+                            MIX_RAMP_SHAPE shape = MIX_RAMP_LINEAR)
+       {
+           InitMixContext(&context, pKernels, channels, inPlace, rampFrames);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(file, channels, ratio);
+           request.u32SourceCount = file.empty() ? 0 : 1;
+           request.bMix = !file.empty();
+           request.f32InputWeight = 1.0f - ratio;
+           request.rampShape = shape;
+           PostMixRequest(&context, &request);
+       }
+
+       static MIX_SOURCE Source(const std::vector<FLOAT32>& file, UINT32 channels, FLOAT32 weight, BOOL loop = TRUE)
+       {
+           MIX_SOURCE source = {};
+           source.pf32File = file.data();
+           source.u32FileFrameCount = static_cast<UINT32>(file.size() / channels);
+           source.f32Weight = weight;
+           source.bLoop = loop;
+           return source;
+       }
+
+       static std::vector<FLOAT32> Clip(UINT32 frameCount, UINT32 channels, FLOAT32 start, FLOAT32 step)
+       {
+           std::vector<FLOAT32> buffer(frameCount * channels);
+           for (size_t i = 0; i < buffer.size(); i++)
+           {
+               buffer[i] = start + static_cast<FLOAT32>(i) * step;
+           }
+           return buffer;
+       }
+
+       // Runs a period through the processor of the context
+       static APO_BUFFER_FLAGS Process(MIX_CONTEXT& context, std::vector<FLOAT32>& output,
+                                      const std::vector<FLOAT32>& input, UINT32 frameCount,
+                                      APO_BUFFER_FLAGS inputFlags = BUFFER_VALID)
+       {
+           return context.pProcessor->pfnProcess[inputFlags](&context, output.data(), input.data(), frameCount);
+       }
+
+       // Mixes a ramp of up to three clips over several periods with the kernel set and returns all of the output
+       static std::vector<FLOAT32> RunRamp(const MIX_KERNELS* pKernels, UINT32 channels, MIX_RAMP_SHAPE shape,
+                                           APO_BUFFER_FLAGS inputFlags, UINT32 sourceCount)
+       {
+           const UINT32 periodFrames = 100;
+           const UINT32 rampFrames = 333;
+           const std::vector<FLOAT32> input = Clip(periodFrames, channels, -0.5f, 0.001f);
+           const std::vector<FLOAT32> files[] = {
+               Clip(257, channels, 0.25f, -0.0001f),
+               Clip(131, channels, -0.125f, 0.0003f),
+               Clip(180, channels, 0.5f, -0.0002f),
+           };
+
+           MIX_CONTEXT context;
+           InitMixContext(&context, pKernels, channels, FALSE, rampFrames);
+
+           MIX_REQUEST request = {};
+           for (UINT32 s = 0; s < sourceCount; s++)
+           {
+               request.aSources[s] = Source(files[s], channels, 0.6f - 0.2f * static_cast<FLOAT32>(s));
+           }
+           request.u32SourceCount = sourceCount;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.4f;
+           request.rampShape = shape;
+           PostMixRequest(&context, &request);
+
+           std::vector<FLOAT32> result;
+           std::vector<FLOAT32> output(input.size());
+           for (int period = 0; period < 5; period++)
+           {
+               Process(context, output, input, periodFrames, inputFlags);
+               result.insert(result.end(), output.begin(), output.end());
+           }
+           return result;
+       }
+
+   public:
+
+       TEST_METHOD(PlanWithoutWrapIsSingleSegment)
+       {
+           MIX_SEGMENT segments[MIX_MAX_SEGMENTS];
+           UINT32 fileIndex = 100;
+           UINT32 planned = 0;
+
+           UINT32 count = PlanMixSegments(480, 48000, &fileIndex, segments, &planned);
+           Assert::AreEqual(1u, count, L"A period inside the clip should be one segment");
+           Assert::AreEqual(480u, planned, L"The whole period should be planned");
+           Assert::AreEqual(100u, segments[0].u32FileFrame, L"Segment should start at the file index");
+           Assert::AreEqual(580u, fileIndex, L"File index should advance by one period");
+       }
+
+       TEST_METHOD(PlanSplitsAtLoopPoint)
+       {
+           MIX_SEGMENT segments[MIX_MAX_SEGMENTS];
+           UINT32 fileIndex = 900;
+           UINT32 planned = 0;
+
+           UINT32 count = PlanMixSegments(480, 1000, &fileIndex, segments, &planned);
+           Assert::AreEqual(2u, count, L"A period across the loop point should be two segments");
+           Assert::AreEqual(100u, segments[0].u32FrameCount, L"First segment should end at the loop point");
+           Assert::AreEqual(100u, segments[1].u32OutputFrame, L"Second segment should follow the first one");
+           Assert::AreEqual(0u, segments[1].u32FileFrame, L"Second segment should restart the clip");
+           Assert::AreEqual(380u, segments[1].u32FrameCount, L"Second segment should fill the period");
+           Assert::AreEqual(380u, fileIndex, L"File index should continue after the loop point");
+       }
+
+       TEST_METHOD(PlanEndingAtLoopPointWrapsIndex)
+       {
+           MIX_SEGMENT segments[MIX_MAX_SEGMENTS];
+           UINT32 fileIndex = 520;
+           UINT32 planned = 0;
+
+           UINT32 count = PlanMixSegments(480, 1000, &fileIndex, segments, &planned);
+           Assert::AreEqual(1u, count, L"A period ending exactly at the loop point should be one segment");
+           Assert::AreEqual(0u, fileIndex, L"File index should wrap to the start of the clip");
+       }
+
+       TEST_METHOD(PlanShortClipIsBounded)
+       {
+           MIX_SEGMENT segments[MIX_MAX_SEGMENTS];
+           UINT32 fileIndex = 5;
+           UINT32 planned = 0;
+
+           UINT32 count = PlanMixSegments(480, 100, &fileIndex, segments, &planned);
+           Assert::AreEqual(static_cast<UINT32>(MIX_MAX_SEGMENTS), count, L"Plan should not exceed MIX_MAX_SEGMENTS");
+           Assert::AreEqual(295u, planned, L"Plan should cover whole segments only");
+           Assert::AreEqual(0u, fileIndex, L"File index should be at the next segment start");
+       }
+
+       TEST_METHOD(PlanEmptyClipIsNothing)
+       {
+           MIX_SEGMENT segments[MIX_MAX_SEGMENTS];
+           UINT32 fileIndex = 7;
+           UINT32 planned = 123;
+
+           UINT32 count = PlanMixSegments(480, 0, &fileIndex, segments, &planned);
+           Assert::AreEqual(0u, count, L"An empty clip should plan no segments");
+           Assert::AreEqual(0u, planned, L"An empty clip should plan no frames");
+
+           // The mix of an empty clip is the weighted input
+           std::vector<FLOAT32> input(480 * 2, 0.5f);
+           std::vector<FLOAT32> output(480 * 2, 9.0f);
+           fileIndex = 0;
+           MixAudioFrames(SelectMixKernels(), output.data(), input.data(), 480, 2, nullptr, 0, &fileIndex, 0.5f, 1.0f);
+           for (FLOAT32 sample : output)
+           {
+               Assert::AreEqual(0.25f, sample, L"An empty clip should mix as silence");
+           }
+       }
+
+       TEST_METHOD(MixMatchesReferenceWithoutWrap)
+       {
+           CheckAgainstReference(480, 48000, 0, 10);
+       }
+
+       TEST_METHOD(MixMatchesReferenceAcrossWrap)
+       {
+           // 1013 frames is not a multiple of the period, so the loop point moves within the period
+           CheckAgainstReference(480, 1013, 0, 50);
+       }
+
+       TEST_METHOD(MixMatchesReferenceWithWrapAtPeriodBoundary)
+       {
+           CheckAgainstReference(480, 960, 0, 10);
+       }
+
+       TEST_METHOD(MixMatchesReferenceForClipShorterThanPeriod)
+       {
+           CheckAgainstReference(480, 7, 3, 20);
+           CheckAgainstReference(480, 1, 0, 5);
+           CheckAgainstReference(441, 200, 150, 20);
+       }
+
+       TEST_METHOD(MixRecoversFromIndexBeyondClip)
+       {
+           // The clip may be swapped for a shorter one between two periods
+           CheckAgainstReference(480, 1000, 2500, 5);
+       }
+
+       TEST_METHOD(RepeatedClipMixesLikeLoopedClip)
+       {
+           const UINT32 periodFrames = 480;
+           const UINT32 fileFrameCount = 100;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(fileFrameCount, 0.25f);
+
+           // What AudioFileReader::RepeatToLength stores for a 480 frame period
+           std::vector<FLOAT32> repeated;
+           for (int i = 0; i < 5; i++)
+           {
+               repeated.insert(repeated.end(), file.begin(), file.end());
+           }
+
+           std::vector<FLOAT32> looped(input.size());
+           std::vector<FLOAT32> unrolled(input.size());
+           UINT32 loopedIndex = 0;
+           UINT32 unrolledIndex = 0;
+           const MIX_KERNELS* pKernels = SelectMixKernels();
+
+           for (int period = 0; period < 20; period++)
+           {
+               MixAudioFrames(pKernels, looped.data(), input.data(), periodFrames, Channels,
+                              file.data(), fileFrameCount, &loopedIndex, 0.5f, 0.5f);
+               MixAudioFrames(pKernels, unrolled.data(), input.data(), periodFrames, Channels,
+                              repeated.data(), fileFrameCount * 5, &unrolledIndex, 0.5f, 0.5f);
+
+               Assert::AreEqual(loopedIndex, unrolledIndex % fileFrameCount, L"Positions should stay in sync");
+               for (size_t i = 0; i < looped.size(); i++)
+               {
+                   Assert::AreEqual(looped[i], unrolled[i], L"Repeated clip should sound like the looped one");
+               }
+           }
+       }
+
+       TEST_METHOD(InPlaceMixMatchesReference)
+       {
+           const UINT32 periodFrames = 480;
+           const UINT32 fileFrameCount = 1013;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(fileFrameCount, 0.25f);
+
+           std::vector<FLOAT32> expected(input.size());
+           std::vector<FLOAT32> buffer;
+           UINT32 expectedIndex = 900;
+           UINT32 actualIndex = 900;
+
+           for (int period = 0; period < 10; period++)
+           {
+               buffer = input;
+               ReferenceMix(expected, input, periodFrames, file, fileFrameCount, expectedIndex, 0.7f, 0.3f);
+               MixAudioFrames(SelectMixKernels(), buffer.data(), buffer.data(), periodFrames, Channels,
+                              file.data(), fileFrameCount, &actualIndex, 0.7f, 0.3f);
+
+               for (size_t i = 0; i < expected.size(); i++)
+               {
+                   Assert::AreEqual(expected[i], buffer[i], L"In-place mix should match the reference");
+               }
+           }
+       }
+
+       TEST_METHOD(ProcessorsMatchMixAudioFrames)
+       {
+           const UINT32 periodFrames = 480;
+           const UINT32 fileFrameCount = 1013;
+
+           for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+           {
+               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+               if (pKernels == nullptr)
+               {
+                   continue;
+               }
+
+               // Every specialized channel count plus a few served by the generic kernels
+               for (UINT32 channels = 1; channels <= 8; channels++)
+               {
+                   std::vector<FLOAT32> input(periodFrames * channels);
+                   std::vector<FLOAT32> file(fileFrameCount * channels);
+                   for (size_t i = 0; i < input.size(); i++) input[i] = -0.5f + static_cast<FLOAT32>(i) * 0.001f;
+                   for (size_t i = 0; i < file.size(); i++) file[i] = 0.25f - static_cast<FLOAT32>(i) * 0.0001f;
+
+                   MIX_CONTEXT context;
+                   StartMix(context, pKernels, channels, FALSE, 0, file, 0.3f);
+
+                   std::vector<FLOAT32> expected(input.size());
+                   std::vector<FLOAT32> actual(input.size());
+                   UINT32 expectedIndex = 0;
+
+                   for (int period = 0; period < 5; period++)
+                   {
+                       MixAudioFrames(pKernels, expected.data(), input.data(), periodFrames, channels,
+                                      file.data(), fileFrameCount, &expectedIndex, 1.0f - 0.3f, 0.3f);
+                       APO_BUFFER_FLAGS flags = Process(context, actual, input, periodFrames);
+
+                       Assert::IsTrue(flags == BUFFER_VALID, L"Mixed output should be valid");
+                       Assert::AreEqual(expectedIndex, context.aSources[0].u32FileIndex, L"File index should match");
+                       for (size_t i = 0; i < expected.size(); i++)
+                       {
+                           Assert::AreEqual(expected[i], actual[i], L"Processor should match MixAudioFrames");
+                       }
+                   }
+               }
+           }
+       }
+
+       TEST_METHOD(SilentInputProcessorIgnoresInput)
+       {
+           const UINT32 periodFrames = 480;
+           const UINT32 fileFrameCount = 1013;
+           const std::vector<FLOAT32> garbage(periodFrames * Channels, 1000.0f);
+           const std::vector<FLOAT32> file = Ramp(fileFrameCount, 0.25f);
+           std::vector<FLOAT32> output(garbage.size());
+
+           MIX_CONTEXT context;
+           StartMix(context, SelectMixKernels(), Channels, FALSE, 0, file, 0.4f);
+
+           APO_BUFFER_FLAGS flags = Process(context, output, garbage, periodFrames, BUFFER_SILENT);
+           Assert::IsTrue(flags == BUFFER_VALID, L"Mixed output should be valid");
+
+           for (UINT32 i = 0; i < periodFrames; i++)
+           {
+               UINT32 filePos = i % fileFrameCount;
+               for (UINT32 j = 0; j < Channels; j++)
+               {
+                   Assert::AreEqual(file[filePos * Channels + j] * 0.4f, output[i * Channels + j],
+                                    L"Silent input should yield the weighted clip only");
+               }
+           }
+       }
+
+       TEST_METHOD(SilentInputOverSilentClipStaysSilent)
+       {
+           const UINT32 periodFrames = 200;
+           const std::vector<FLOAT32> garbage(periodFrames * Channels, 1000.0f);
+           std::vector<FLOAT32> file(1000 * Channels, 0.0f);
+           std::fill(file.begin() + 500 * Channels, file.end(), 0.5f);
+           std::vector<FLOAT32> output(garbage.size());
+
+           std::vector<BYTE> silentBlocks(GetMixSilentBlockCount(1000));
+           FindMixSilentBlocks(file.data(), 1000, Channels, silentBlocks.data());
+           Assert::AreEqual(size_t(16), silentBlocks.size(), L"Last block should be partial");
+           Assert::IsTrue(silentBlocks[6] && !silentBlocks[7] && !silentBlocks[15], L"Blocks up to frame 500 should be silent");
+
+           MIX_CONTEXT context;
+           InitMixContext(&context, SelectMixKernels(), Channels, FALSE, 0);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(file, Channels, 0.4f);
+           request.aSources[0].pbSilentBlocks = silentBlocks.data();
+           request.u32SourceCount = 1;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.6f;
+           PostMixRequest(&context, &request);
+
+           // Frames 0 to 399 of the clip are zero
+           for (int period = 0; period < 2; period++)
+           {
+               APO_BUFFER_FLAGS flags = Process(context, output, garbage, periodFrames, BUFFER_SILENT);
+               Assert::IsTrue(flags == BUFFER_SILENT, L"Silent input over a silent clip should stay silent");
+               Assert::IsTrue(std::vector<FLOAT32>(output.size(), 0.0f) == output, L"Silent output should be zeroed");
+           }
+           Assert::AreEqual(2 * periodFrames, context.aSources[0].u32FileIndex, L"Clip should move on while silent");
+
+           // Frames 400 to 599 reach into the sound
+           APO_BUFFER_FLAGS flags = Process(context, output, garbage, periodFrames, BUFFER_SILENT);
+           Assert::IsTrue(flags == BUFFER_VALID, L"Audible clip should make the output valid");
+           Assert::AreEqual(0.0f, output[99 * Channels], L"Silent part of the clip should mix as zero");
+           Assert::AreEqual(0.5f * 0.4f, output[100 * Channels], L"Audible part of the clip should be weighted");
+
+           // Frames 600 to 999 and on past the loop point
+           Process(context, output, garbage, periodFrames, BUFFER_SILENT);
+           Process(context, output, garbage, periodFrames, BUFFER_SILENT);
+           flags = Process(context, output, garbage, periodFrames, BUFFER_SILENT);
+           Assert::IsTrue(flags == BUFFER_SILENT, L"Clip should be silent again after the loop point");
+       }
+
+       TEST_METHOD(PassthroughProcessorsKeepFlags)
+       {
+           const UINT32 periodFrames = 480;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(1013, 0.25f);
+           std::vector<FLOAT32> output(input.size(), 5.0f);
+
+           // Zero ratio passes the input through even with a clip
+           MIX_CONTEXT context;
+           StartMix(context, SelectMixKernels(), Channels, FALSE, 0, file, 0.0f);
+
+           APO_BUFFER_FLAGS flags = Process(context, output, input, periodFrames);
+           Assert::IsTrue(context.pProcessor == GetMixProcessor(SelectMixKernels(), Channels, MIX_STATE_PASSTHROUGH),
+                          L"Zero ratio should select the passthrough processor");
+           Assert::IsTrue(flags == BUFFER_VALID, L"Valid input should stay valid");
+           Assert::IsTrue(input == output, L"Input should be copied as is");
+
+           flags = Process(context, output, input, periodFrames, BUFFER_SILENT);
+           Assert::IsTrue(flags == BUFFER_SILENT, L"Silent input should stay silent");
+           Assert::IsTrue(std::vector<FLOAT32>(input.size(), 0.0f) == output, L"Silent output should be zeroed");
+
+           // Without a clip the in-place passthrough leaves the buffer alone
+           std::vector<FLOAT32> buffer = input;
+           StartMix(context, SelectMixKernels(), Channels, TRUE, 0, std::vector<FLOAT32>(), 0.5f);
+
+           flags = Process(context, buffer, buffer, periodFrames);
+           Assert::IsTrue(context.pProcessor == GetMixProcessor(SelectMixKernels(), Channels, MIX_STATE_PASSTHROUGH_IN_PLACE),
+                          L"No clip should select the in-place passthrough processor");
+           Assert::IsTrue(flags == BUFFER_VALID, L"Valid input should stay valid");
+           Assert::IsTrue(input == buffer, L"In-place passthrough should not touch the buffer");
+
+           flags = Process(context, buffer, buffer, periodFrames, BUFFER_SILENT);
+           Assert::IsTrue(flags == BUFFER_SILENT, L"Silent input should stay silent");
+           Assert::IsTrue(input == buffer, L"In-place passthrough should not zero a silent buffer");
+       }
+
+       TEST_METHOD(RampFadesClipInThenMixesSteadily)
+       {
+           const UINT32 periodFrames = 256;
+           const UINT32 rampFrames = 480;
+           const UINT32 fileFrameCount = 1013;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(fileFrameCount, 0.25f);
+
+           MIX_CONTEXT context;
+           StartMix(context, SelectMixKernels(), Channels, FALSE, rampFrames, file, 0.3f);
+
+           // The ramp spans two periods and ends within the second one
+           std::vector<FLOAT32> output(input.size());
+           std::vector<FLOAT32> expected(input.size());
+           UINT32 fileIndex = 0;
+           for (UINT32 period = 0; period < 2; period++)
+           {
+               Process(context, output, input, periodFrames);
+               for (UINT32 i = 0; i < periodFrames; i++)
+               {
+                   const UINT32 rampFrame = period * periodFrames + i;
+                   const FLOAT32 g = (rampFrame < rampFrames) ? 1.0f - static_cast<FLOAT32>(rampFrame) / static_cast<FLOAT32>(rampFrames) : 0.0f;
+                   const UINT32 filePos = (fileIndex + i) % fileFrameCount;
+                   for (UINT32 j = 0; j < Channels; j++)
+                   {
+                       const FLOAT32 value = input[i * Channels + j] * (0.7f + 0.3f * g) +
+                                             file[filePos * Channels + j] * (0.3f - 0.3f * g);
+                       Assert::AreEqual(value, output[i * Channels + j], 1e-5f, L"Ramp should follow a straight line");
+                   }
+               }
+               fileIndex = (fileIndex + periodFrames) % fileFrameCount;
+           }
+
+           Assert::IsTrue(context.pProcessor == GetMixProcessor(SelectMixKernels(), Channels, MIX_STATE_MIX),
+                          L"Mix processor should be settled after the ramp");
+           Assert::IsTrue(IsMixRequestSettled(&context, context.u32RequestSerial.load()), L"Request should be settled");
+
+           // Past the ramp the weights are exactly the requested ones
+           Process(context, output, input, periodFrames);
+           MixAudioFrames(SelectMixKernels(), expected.data(), input.data(), periodFrames, Channels,
+                          file.data(), fileFrameCount, &fileIndex, 1.0f - 0.3f, 0.3f);
+           Assert::IsTrue(expected == output, L"Settled ramp should match the steady mix");
+       }
+
+       TEST_METHOD(RampHasNoSteps)
+       {
+           const UINT32 periodFrames = 128;
+           const UINT32 rampFrames = 480;
+           const std::vector<FLOAT32> input(periodFrames * Channels, 0.0f);
+           const std::vector<FLOAT32> file(64 * Channels, 1.0f);
+
+           const MIX_RAMP_SHAPE shapes[] = { MIX_RAMP_LINEAR, MIX_RAMP_EXPONENTIAL };
+           for (MIX_RAMP_SHAPE shape : shapes)
+           {
+               MIX_CONTEXT context;
+               StartMix(context, SelectMixKernels(), Channels, FALSE, rampFrames, file, 0.5f, shape);
+
+               // The output is the file weight itself, the steepest step of both shapes is the first one
+               const FLOAT32 maxStep = (shape == MIX_RAMP_LINEAR) ? 0.5f / static_cast<FLOAT32>(rampFrames) :
+                                       0.5f * (1.0f - context.f32RampDecay) / (1.0f - 0.001f);
+               std::vector<FLOAT32> output(input.size());
+               FLOAT32 previous = 0.0f;
+               for (UINT32 period = 0; period < 5; period++)
+               {
+                   Process(context, output, input, periodFrames);
+                   for (UINT32 i = 0; i < periodFrames; i++)
+                   {
+                       Assert::AreEqual(output[i * Channels], output[i * Channels + 1], L"Channels of a frame should share the weight");
+                       Assert::IsTrue(output[i * Channels] >= previous, L"Fade in should never go back");
+                       Assert::IsTrue(output[i * Channels] - previous <= maxStep * 1.01f, L"Fade in should not jump");
+                       previous = output[i * Channels];
+                   }
+               }
+               Assert::AreEqual(0.5f, previous, L"Fade in should end exactly on the requested weight");
+           }
+       }
+
+       TEST_METHOD(DisableFadesOutBeforePassingThrough)
+       {
+           const UINT32 periodFrames = 160;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(1013, 0.25f);
+           std::vector<FLOAT32> output(input.size());
+
+           MIX_CONTEXT context;
+           StartMix(context, SelectMixKernels(), Channels, FALSE, 0, file, 0.5f);
+           Process(context, output, input, periodFrames);
+
+           // Switch ramps on and fade the clip out
+           context.u32RampFrames = 400;
+           MIX_REQUEST request = {};
+           request.rampShape = MIX_RAMP_EXPONENTIAL;
+           const UINT32 serial = PostMixRequest(&context, &request);
+
+           Process(context, output, input, periodFrames);
+           Assert::IsFalse(IsMixRequestSettled(&context, serial), L"Fade out should take more than a period");
+           Assert::IsTrue(input != output, L"Clip should still be heard while fading out");
+
+           Process(context, output, input, periodFrames);
+           Process(context, output, input, periodFrames);
+           Assert::IsTrue(IsMixRequestSettled(&context, serial), L"Fade out should be over after the ramp");
+           Assert::IsTrue(context.pProcessor == GetMixProcessor(SelectMixKernels(), Channels, MIX_STATE_PASSTHROUGH),
+                          L"Passthrough processor should be installed after the fade out");
+
+           Process(context, output, input, periodFrames);
+           Assert::IsTrue(input == output, L"Input should pass through after the fade out");
+       }
+
+       TEST_METHOD(RampMatchesScalarKernels)
+       {
+           const MIX_RAMP_SHAPE shapes[] = { MIX_RAMP_LINEAR, MIX_RAMP_EXPONENTIAL };
+           const APO_BUFFER_FLAGS flags[] = { BUFFER_VALID, BUFFER_SILENT };
+
+           for (UINT32 channels = 1; channels <= 8; channels++)
+           {
+               for (UINT32 sourceCount = 1; sourceCount <= 3; sourceCount += 2)
+               {
+                   for (MIX_RAMP_SHAPE shape : shapes)
+                   {
+                       for (APO_BUFFER_FLAGS inputFlags : flags)
+                       {
+                           const std::vector<FLOAT32> expected =
+                               RunRamp(GetMixKernels(MIX_ISA_SCALAR), channels, shape, inputFlags, sourceCount);
+                           for (int isa = MIX_ISA_SCALAR + 1; isa <= DetectMixIsa(); isa++)
+                           {
+                               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+                               if (pKernels != nullptr)
+                               {
+                                   Assert::IsTrue(expected == RunRamp(pKernels, channels, shape, inputFlags, sourceCount),
+                                                  L"Ramp should be bit identical to the scalar kernels");
+                               }
+                           }
+                       }
+                   }
+               }
+           }
+       }
+
+       TEST_METHOD(SourcesMatchReferenceAcrossLoopPoints)
+       {
+           const UINT32 periodFrames = 480;
+
+           for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+           {
+               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+               if (pKernels == nullptr)
+               {
+                   continue;
+               }
+
+               for (UINT32 channels = 1; channels <= 8; channels++)
+               {
+                   // Loop points all over the period, one clip shorter than a period
+                   const UINT32 fileFrameCounts[] = { 1013, 300, 777, 4801, 97 };
+                   std::vector<std::vector<FLOAT32>> files;
+                   std::vector<MIX_SOURCE> sources;
+                   for (UINT32 s = 0; s < 5; s++)
+                   {
+                       files.push_back(Clip(fileFrameCounts[s], channels, 0.1f * static_cast<FLOAT32>(s), -0.0001f));
+                   }
+                   for (UINT32 s = 0; s < 5; s++)
+                   {
+                       sources.push_back(Source(files[s], channels, 0.1f + 0.05f * static_cast<FLOAT32>(s)));
+                   }
+                   std::vector<UINT32> expectedIndex(5, 0);
+
+                   const std::vector<FLOAT32> input = Clip(periodFrames, channels, -0.5f, 0.001f);
+                   std::vector<FLOAT32> output(input.size());
+
+                   for (int period = 0; period < 4; period++)
+                   {
+                       MixAudioSources(pKernels, output.data(), input.data(), periodFrames, channels,
+                                       sources.data(), 5, 0.5f);
+
+                       for (UINT32 i = 0; i < periodFrames; i++)
+                       {
+                           for (UINT32 j = 0; j < channels; j++)
+                           {
+                               // Clips added one after the other to the weighted input
+                               FLOAT32 expected = input[i * channels + j] * 0.5f;
+                               for (UINT32 s = 0; s < 5; s++)
+                               {
+                                   const UINT32 filePos = (expectedIndex[s] + i) % fileFrameCounts[s];
+                                   expected = expected + files[s][filePos * channels + j] * sources[s].f32Weight;
+                               }
+                               Assert::AreEqual(expected, output[i * channels + j], L"Fused mix should match the reference");
+                           }
+                       }
+
+                       for (UINT32 s = 0; s < 5; s++)
+                       {
+                           expectedIndex[s] = (expectedIndex[s] + periodFrames) % fileFrameCounts[s];
+                           Assert::AreEqual(expectedIndex[s], sources[s].u32FileIndex, L"Every clip should keep its own position");
+                       }
+                   }
+               }
+           }
+       }
+
+       TEST_METHOD(SingleSourceMatchesMixAudioFrames)
+       {
+           const UINT32 periodFrames = 480;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+           const std::vector<FLOAT32> file = Ramp(1013, 0.25f);
+           std::vector<FLOAT32> expected(input.size());
+           std::vector<FLOAT32> actual(input.size());
+
+           MIX_SOURCE source = Source(file, Channels, 0.3f);
+           UINT32 fileIndex = 0;
+           for (int period = 0; period < 5; period++)
+           {
+               MixAudioFrames(SelectMixKernels(), expected.data(), input.data(), periodFrames, Channels,
+                              file.data(), 1013, &fileIndex, 0.7f, 0.3f);
+               MixAudioSources(SelectMixKernels(), actual.data(), input.data(), periodFrames, Channels, &source, 1, 0.7f);
+
+               Assert::IsTrue(expected == actual, L"A single clip should mix like MixAudioFrames");
+               Assert::AreEqual(fileIndex, source.u32FileIndex, L"File index should match");
+           }
+       }
+
+       TEST_METHOD(OneShotSourceStopsAtItsEnd)
+       {
+           const UINT32 periodFrames = 256;
+           const std::vector<FLOAT32> input(periodFrames * Channels, 0.0f);
+           const std::vector<FLOAT32> once(300 * Channels, 1.0f);
+           const std::vector<FLOAT32> looped(100 * Channels, 0.25f);
+           std::vector<FLOAT32> output(input.size());
+
+           MIX_SOURCE sources[] = { Source(once, Channels, 1.0f, FALSE), Source(looped, Channels, 1.0f) };
+
+           MixAudioSources(SelectMixKernels(), output.data(), input.data(), periodFrames, Channels, sources, 2, 1.0f);
+           Assert::AreEqual(1.25f, output[0], L"Both clips should play");
+
+           MixAudioSources(SelectMixKernels(), output.data(), input.data(), periodFrames, Channels, sources, 2, 1.0f);
+           Assert::AreEqual(1.25f, output[(300 - periodFrames - 1) * Channels], L"One shot clip should play to its end");
+           Assert::AreEqual(0.25f, output[(300 - periodFrames) * Channels], L"One shot clip should stop at its end");
+           Assert::AreEqual(0.25f, output[(periodFrames - 1) * Channels], L"Looped clip should keep playing");
+           Assert::AreEqual(300u, sources[0].u32FileIndex, L"Ended clip should stay at its end");
+           Assert::AreEqual((2 * periodFrames) % 100, sources[1].u32FileIndex, L"Looped clip should wrap");
+       }
+
+       TEST_METHOD(CrossfadedLoopWrapsWithoutStep)
+       {
+           const UINT32 fileFrames = 1000;
+           const UINT32 crossfadeFrames = 100;
+           const UINT32 periodFrames = 256;
+           const std::vector<FLOAT32> clip = Ramp(fileFrames, 0.25f);
+
+           // Crossfading more than half of the clip is cut down to half
+           std::vector<FLOAT32> faded = clip;
+           Assert::AreEqual(fileFrames / 2, CrossfadeMixLoop(faded.data(), fileFrames, Channels, fileFrames), L"Crossfade should be at most half of the clip");
+
+           // The clip loses the crossfaded tail, the frames after the crossfade stay as they are
+           faded = clip;
+           const UINT32 fadedFrames = CrossfadeMixLoop(faded.data(), fileFrames, Channels, crossfadeFrames);
+           Assert::AreEqual(fileFrames - crossfadeFrames, fadedFrames, L"Crossfaded tail should be dropped");
+           faded.resize(fadedFrames * Channels);
+           Assert::IsTrue(std::equal(faded.begin() + crossfadeFrames * Channels, faded.end(), clip.begin() + crossfadeFrames * Channels),
+                          L"Frames after the crossfade should not change");
+
+           // Played through the loop point by the mix, consecutive frames stay close together
+           const std::vector<FLOAT32> input(periodFrames * Channels, 0.0f);
+           std::vector<FLOAT32> output(input.size());
+           MIX_SOURCE source = Source(faded, Channels, 1.0f);
+           FLOAT32 previous[Channels] = { faded[(fadedFrames - 1) * Channels], faded[(fadedFrames - 1) * Channels + 1] };
+           for (UINT32 period = 0; period < 2 * fileFrames / periodFrames; period++)
+           {
+               MixAudioSources(SelectMixKernels(), output.data(), input.data(), periodFrames, Channels, &source, 1, 0.0f);
+               for (UINT32 i = 0; i < periodFrames * Channels; i++)
+               {
+                   const FLOAT32 step = output[i] - previous[i % Channels];
+                   Assert::IsTrue(step < 0.05f && step > -0.05f, L"Looped clip should not step at the loop point");
+                   previous[i % Channels] = output[i];
+               }
+           }
+       }
+
+       TEST_METHOD(ReplacedLayerFadesOutWhileOthersPlayOn)
+       {
+           const UINT32 periodFrames = 160;
+           const std::vector<FLOAT32> input(periodFrames * Channels, 0.0f);
+           const std::vector<FLOAT32> noise = Ramp(1013, 0.25f);
+           const std::vector<FLOAT32> speech = Ramp(777, -0.25f);
+           const std::vector<FLOAT32> tone = Ramp(500, 0.5f);
+           std::vector<FLOAT32> output(input.size());
+
+           MIX_CONTEXT context;
+           InitMixContext(&context, SelectMixKernels(), Channels, FALSE, 0);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(noise, Channels, 0.2f);
+           request.aSources[1] = Source(speech, Channels, 0.5f);
+           request.u32SourceCount = 2;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.5f;
+           PostMixRequest(&context, &request);
+           Process(context, output, input, periodFrames);
+           Assert::AreEqual(2u, context.u32SourceCount, L"Both layers should play");
+
+           // Swap the speech for a tone
+           context.u32RampFrames = 400;
+           request.aSources[1] = Source(tone, Channels, 0.5f);
+           const UINT32 serial = PostMixRequest(&context, &request);
+
+           Process(context, output, input, periodFrames);
+           Assert::AreEqual(3u, context.u32SourceCount, L"Replaced layer should fade out, not stop");
+           Assert::AreEqual(2 * periodFrames, context.aSources[0].u32FileIndex, L"Kept layer should play on");
+           Assert::AreEqual(periodFrames, context.aSources[1].u32FileIndex, L"New layer should start from its first frame");
+
+           Process(context, output, input, periodFrames);
+           Process(context, output, input, periodFrames);
+           Assert::IsTrue(IsMixRequestSettled(&context, serial), L"Ramp should be over");
+           Assert::AreEqual(2u, context.u32SourceCount, L"Faded out layer should be dropped");
+           Assert::IsTrue(context.aSources[1].pf32File == tone.data(), L"New layer should stay");
+           Assert::AreEqual(0.2f, context.aSources[0].f32Weight, L"Kept layer should keep its weight");
+       }
+
+       TEST_METHOD(ChannelMapsFollowSpeakerPositions)
+       {
+           MIX_CHANNEL_MAP map;
+
+           Assert::IsTrue(BuildMixChannelMap(2, 0, 2, KSAUDIO_SPEAKER_STEREO, &map), L"Stereo should map");
+           Assert::IsTrue(map.mapping == MIX_MAPPING_IDENTITY, L"Same layout should need no map");
+
+           Assert::IsTrue(BuildMixChannelMap(1, 0, 8, KSAUDIO_SPEAKER_7POINT1_SURROUND, &map), L"Mono should map");
+           Assert::IsTrue(map.mapping == MIX_MAPPING_MONO_TO_ALL, L"Mono should go to every channel");
+
+           // Stereo on 5.1 plays on the front pair only
+           Assert::IsTrue(BuildMixChannelMap(2, 0, 6, KSAUDIO_SPEAKER_5POINT1, &map), L"Stereo should map on 5.1");
+           Assert::IsTrue(map.mapping == MIX_MAPPING_MATRIX, L"Stereo on 5.1 should need a matrix");
+           Assert::AreEqual(1u, map.au32TapCount[0], L"Front left should have one tap");
+           Assert::AreEqual(1u, map.au32TapCount[1], L"Front right should have one tap");
+           Assert::AreEqual(0, static_cast<int>(map.aau8TapChannels[0][0]), L"Front left should take the left channel");
+           Assert::AreEqual(1, static_cast<int>(map.aau8TapChannels[1][0]), L"Front right should take the right channel");
+           for (UINT32 c = 2; c < 6; c++)
+           {
+               Assert::AreEqual(0u, map.au32TapCount[c], L"Other channels should stay silent");
+           }
+
+           // 5.1 on stereo folds the center and the back pair in and drops the LFE
+           Assert::IsTrue(BuildMixChannelMap(6, 0, 2, 0, &map), L"5.1 should map on stereo");
+           Assert::AreEqual(3u, map.au32TapCount[0], L"Left should get front left, center and back left");
+           Assert::AreEqual(3u, map.au32TapCount[1], L"Right should get front right, center and back right");
+           Assert::AreEqual(2, static_cast<int>(map.aau8TapChannels[0][1]), L"Center should fold into left");
+           Assert::AreEqual(0.70710678f, map.aaf32TapGains[0][1], L"Center should be split at -3 dB");
+           Assert::AreEqual(4, static_cast<int>(map.aau8TapChannels[0][2]), L"Back left should fold into left");
+
+           // No positions on a microphone array, channels go round
+           Assert::IsTrue(BuildMixChannelMap(3, 0, 5, 0, &map), L"Array should map");
+           Assert::AreEqual(0, static_cast<int>(map.aau8TapChannels[3][0]), L"Channel 3 should take clip channel 0");
+           Assert::AreEqual(1, static_cast<int>(map.aau8TapChannels[4][0]), L"Channel 4 should take clip channel 1");
+
+           Assert::IsFalse(BuildMixChannelMap(2, 0, 20, 0, &map), L"Too many channels for a matrix");
+       }
+
+       TEST_METHOD(MappedClipMatchesExpandedClip)
+       {
+           // Longer than the scratch buffer holds at once, across loop points and a ramp
+           const UINT32 channels = 8;
+           const UINT32 periodFrames = 700;
+           const UINT32 monoFrames = 1013;
+           const std::vector<FLOAT32> input = Clip(periodFrames, channels, -0.5f, 0.0001f);
+           const std::vector<FLOAT32> mono = Clip(monoFrames, 1, 0.25f, -0.0003f);
+           const std::vector<FLOAT32> stereo = Clip(777, 2, -0.125f, 0.0002f);
+
+           MIX_CHANNEL_MAP monoMap, stereoMap;
+           Assert::IsTrue(BuildMixChannelMap(1, 0, channels, 0, &monoMap), L"Mono should map");
+           Assert::IsTrue(BuildMixChannelMap(2, 0, channels, 0, &stereoMap), L"Stereo should map");
+
+           std::vector<FLOAT32> monoExpanded(monoFrames * channels);
+           std::vector<FLOAT32> stereoExpanded(777 * channels);
+           MapMixChannels(&monoMap, mono.data(), monoFrames, monoExpanded.data());
+           MapMixChannels(&stereoMap, stereo.data(), 777, stereoExpanded.data());
+           Assert::AreEqual(mono[5], monoExpanded[5 * channels + 7], L"Mono should be copied to every channel");
+           Assert::AreEqual(stereo[11], stereoExpanded[5 * channels + 1], L"Right should go to front right");
+           Assert::AreEqual(0.0f, stereoExpanded[5 * channels + 6], L"Stereo should leave the sides silent");
+
+           MIX_CONTEXT mapped, expanded;
+           InitMixContext(&mapped, SelectMixKernels(), channels, FALSE, 450);
+           InitMixContext(&expanded, SelectMixKernels(), channels, FALSE, 450);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(mono, 1, 0.5f);
+           request.aSources[0].pChannelMap = &monoMap;
+           request.aSources[1] = Source(stereo, 2, 0.25f);
+           request.aSources[1].pChannelMap = &stereoMap;
+           request.u32SourceCount = 2;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.25f;
+           PostMixRequest(&mapped, &request);
+
+           request.aSources[0] = Source(monoExpanded, channels, 0.5f);
+           request.aSources[1] = Source(stereoExpanded, channels, 0.25f);
+           PostMixRequest(&expanded, &request);
+
+           std::vector<FLOAT32> actual(input.size());
+           std::vector<FLOAT32> expected(input.size());
+           for (int period = 0; period < 4; period++)
+           {
+               Process(mapped, actual, input, periodFrames);
+               Process(expanded, expected, input, periodFrames);
+               Assert::IsTrue(expected == actual, L"Mapped clips should mix like clips stored at the stream layout");
+               Assert::AreEqual(expanded.aSources[0].u32FileIndex, mapped.aSources[0].u32FileIndex, L"Clip index should match");
+           }
+       }
+
+       TEST_METHOD(Int16ClipMatchesFloatClip)
+       {
+           const UINT32 periodFrames = 480;
+           const UINT32 fileFrameCount = 1013;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+
+           std::vector<INT16> compact(fileFrameCount * Channels);
+           std::vector<FLOAT32> file(compact.size());
+           for (size_t i = 0; i < compact.size(); i++)
+           {
+               compact[i] = static_cast<INT16>((i * 7919) % 65536 - 32768);
+               file[i] = static_cast<FLOAT32>(compact[i]) / 32768.0f;
+           }
+
+           // Every instruction set converts exactly
+           for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+           {
+               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+               if (pKernels == nullptr)
+               {
+                   continue;
+               }
+
+               std::vector<FLOAT32> converted(compact.size());
+               pKernels->pfnConvertInt16Span(converted.data(), compact.data(), static_cast<UINT32>(compact.size()));
+               Assert::IsTrue(file == converted, L"16 bit samples should convert exactly");
+           }
+
+           // Ramping in and across loop points, split where the scratch buffer is full
+           MIX_CONTEXT compactContext, floatContext;
+           InitMixContext(&compactContext, SelectMixKernels(), Channels, FALSE, 600);
+           InitMixContext(&floatContext, SelectMixKernels(), Channels, FALSE, 600);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(file, Channels, 0.5f);
+           request.u32SourceCount = 1;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.5f;
+           PostMixRequest(&floatContext, &request);
+
+           request.aSources[0].pf32File = nullptr;
+           request.aSources[0].pi16File = compact.data();
+           PostMixRequest(&compactContext, &request);
+
+           std::vector<FLOAT32> actual(input.size());
+           std::vector<FLOAT32> expected(input.size());
+           for (int period = 0; period < 5; period++)
+           {
+               Process(compactContext, actual, input, periodFrames);
+               Process(floatContext, expected, input, periodFrames);
+               Assert::IsTrue(expected == actual, L"16 bit clip should mix like its float samples");
+           }
+       }
+
+       TEST_METHOD(ChannelGainsSteerInjectedClips)
+       {
+           const UINT32 channels = 4;
+           const UINT32 periodFrames = 100;
+           const FLOAT32 inputGains[channels] = { 1.0f, 0.5f, 0.0f, 1.0f };
+           const FLOAT32 injectionGains[channels] = { 0.0f, 1.0f, 0.25f, 0.75f };
+           const std::vector<FLOAT32> input = Clip(periodFrames, channels, -0.5f, 0.001f);
+           const std::vector<FLOAT32> files[] = {
+               Clip(257, channels, 0.25f, -0.0001f),
+               Clip(131, channels, -0.125f, 0.0003f),
+           };
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(files[0], channels, 0.3f);
+           request.aSources[1] = Source(files[1], channels, 0.2f);
+           request.u32SourceCount = 2;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.5f;
+           request.bChannelGains = TRUE;
+           std::copy(inputGains, inputGains + channels, request.af32InputGains);
+           std::copy(injectionGains, injectionGains + channels, request.af32InjectionGains);
+
+           std::vector<FLOAT32> expected;
+           for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+           {
+               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+               if (pKernels == nullptr)
+               {
+                   continue;
+               }
+
+               // Gains ramp in with the clips, then the steady mix follows them exactly
+               MIX_CONTEXT context;
+               InitMixContext(&context, pKernels, channels, FALSE, 150);
+               PostMixRequest(&context, &request);
+
+               std::vector<FLOAT32> result;
+               std::vector<FLOAT32> output(input.size());
+               for (UINT32 period = 0; period < 4; period++)
+               {
+                   Process(context, output, input, periodFrames);
+                   result.insert(result.end(), output.begin(), output.end());
+               }
+
+               for (UINT32 i = 0; i < input.size(); i++)
+               {
+                   const UINT32 c = i % channels;
+                   const UINT32 frame = 3 * periodFrames + i / channels;
+                   const FLOAT32 sum = (files[0][(frame % 257) * channels + c] * 0.3f) +
+                                       (files[1][(frame % 131) * channels + c] * 0.2f);
+                   const FLOAT32 mix = ((input[i] * 0.5f) * inputGains[c]) + (sum * injectionGains[c]);
+                   Assert::AreEqual(mix, output[i], L"Steady mix should apply the channel gains");
+               }
+
+               if (expected.empty())
+               {
+                   expected = result;
+               }
+               Assert::IsTrue(expected == result, L"Every instruction set should apply the gains alike");
+
+               // Back to unity gains without the clips ends up passing the input through
+               MIX_REQUEST stop = {};
+               PostMixRequest(&context, &stop);
+               Process(context, output, input, periodFrames);
+               Process(context, output, input, periodFrames);
+               Assert::IsTrue(context.pProcessor == context.pPassthroughProcessor, L"Unity gains should pass through");
+               Assert::IsTrue(!context.bChannelGains, L"Unity gains should not be applied");
+           }
+       }
+
+       TEST_METHOD(ChannelGainsBoostAboveUnity)
+       {
+           Assert::AreEqual(2.5f, ClampMixChannelGain(2.5f), L"A gain above 1 should boost");
+           Assert::AreEqual(MIX_MAX_CHANNEL_GAIN, ClampMixChannelGain(100.0f), L"A gain should stop at the largest boost");
+           Assert::AreEqual(0.0f, ClampMixChannelGain(-1.0f), L"A negative gain should mute");
+           Assert::AreEqual(1.0f, ClampMixChannelGain(std::numeric_limits<FLOAT32>::quiet_NaN()), L"A gain that is not a number should be unity");
+
+           const UINT32 channels = 2;
+           const UINT32 periodFrames = 100;
+           const FLOAT32 injectionGains[channels] = { 2.0f, ClampMixChannelGain(3.0f) };
+           const std::vector<FLOAT32> input = Clip(periodFrames, channels, -0.5f, 0.001f);
+           const std::vector<FLOAT32> file = Clip(257, channels, 0.125f, -0.0001f);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(file, channels, 0.25f);
+           request.u32SourceCount = 1;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.5f;
+           request.bChannelGains = TRUE;
+           std::fill(request.af32InputGains, request.af32InputGains + channels, 1.0f);
+           std::copy(injectionGains, injectionGains + channels, request.af32InjectionGains);
+
+           MIX_CONTEXT context;
+           InitMixContext(&context, GetMixKernels(MIX_ISA_SCALAR), channels, FALSE, 150);
+           PostMixRequest(&context, &request);
+
+           std::vector<FLOAT32> output(input.size());
+           for (UINT32 period = 0; period < 4; period++)
+           {
+               Process(context, output, input, periodFrames);
+           }
+
+           for (UINT32 i = 0; i < input.size(); i++)
+           {
+               const UINT32 c = i % channels;
+               const UINT32 frame = 3 * periodFrames + i / channels;
+               const FLOAT32 sum = file[(frame % 257) * channels + c] * 0.25f;
+               const FLOAT32 mix = (input[i] * 0.5f) + (sum * injectionGains[c]);
+               Assert::AreEqual(mix, output[i], L"A boosted channel should scale the clips past unity");
+           }
+       }
+
+       TEST_METHOD(MixLawsShapeTheWeights)
+       {
+           FLOAT32 inputWeight = 0.0f;
+           FLOAT32 fileWeight = 0.0f;
+
+           for (MIX_LAW law : { MIX_LAW_LINEAR, MIX_LAW_EQUAL_POWER, MIX_LAW_DECIBEL })
+           {
+               GetMixLawWeights(law, 0.0f, &inputWeight, &fileWeight);
+               Assert::IsTrue(inputWeight == 1.0f && fileWeight == 0.0f, L"Ratio 0 should pass the input through");
+               GetMixLawWeights(law, 1.0f, &inputWeight, &fileWeight);
+               Assert::IsTrue(inputWeight == 0.0f && fileWeight == 1.0f, L"Ratio 1 should play the clips only");
+
+               // Every law is symmetric
+               for (FLOAT32 ratio = 0.0f; ratio <= 1.0f; ratio += 0.0625f)
+               {
+                   FLOAT32 mirroredInputWeight = 0.0f;
+                   FLOAT32 mirroredFileWeight = 0.0f;
+                   GetMixLawWeights(law, ratio, &inputWeight, &fileWeight);
+                   GetMixLawWeights(law, 1.0f - ratio, &mirroredInputWeight, &mirroredFileWeight);
+                   Assert::AreEqual(inputWeight, mirroredFileWeight, L"Input weight should mirror the clip weight");
+               }
+           }
+
+           for (FLOAT32 ratio = 0.0f; ratio <= 1.0f; ratio += 0.01f)
+           {
+               GetMixLawWeights(MIX_LAW_LINEAR, ratio, &inputWeight, &fileWeight);
+               Assert::AreEqual(1.0f, inputWeight + fileWeight, 1e-6f, L"Linear weights should add up to 1");
+               Assert::AreEqual(ratio, fileWeight, 1e-6f, L"Linear clip weight should be the ratio");
+
+               GetMixLawWeights(MIX_LAW_EQUAL_POWER, ratio, &inputWeight, &fileWeight);
+               Assert::AreEqual(1.0f, inputWeight * inputWeight + fileWeight * fileWeight, 1e-4f,
+                                L"Equal power weights should keep the power");
+           }
+
+           // The decibel law holds both sides at full level halfway and fades linearly in dB beyond
+           GetMixLawWeights(MIX_LAW_DECIBEL, 0.5f, &inputWeight, &fileWeight);
+           Assert::IsTrue(inputWeight == 1.0f && fileWeight == 1.0f, L"Both sides should be at full level halfway");
+           GetMixLawWeights(MIX_LAW_DECIBEL, 0.25f, &inputWeight, &fileWeight);
+           Assert::AreEqual(0.0316228f, fileWeight, 1e-5f, L"Clip should be half way down the decibel range");
+           Assert::AreEqual(1.0f, inputWeight, L"Input should stay at full level");
+
+           // Out of range laws and ratios fall back to the defaults
+           GetMixLawWeights(MIX_LAW_COUNT, 2.0f, &inputWeight, &fileWeight);
+           Assert::IsTrue(inputWeight == 0.0f && fileWeight == 1.0f, L"Unknown law should be linear and the ratio clamped");
+       }
+
+       TEST_METHOD(DeinterleaveSplitsChannels)
+       {
+           const UINT32 frameCount = 101;
+
+           for (UINT32 channels : { 1u, 2u, 3u, 6u })
+           {
+               const std::vector<FLOAT32> frames = Clip(frameCount, channels, -0.5f, 0.001f);
+               std::vector<std::vector<FLOAT32>> planes(channels, std::vector<FLOAT32>(frameCount));
+               std::vector<FLOAT32*> planePointers;
+               for (std::vector<FLOAT32> &plane : planes)
+               {
+                   planePointers.push_back(plane.data());
+               }
+
+               for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+               {
+                   const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+                   if (pKernels == nullptr)
+                   {
+                       continue;
+                   }
+
+                   for (std::vector<FLOAT32> &plane : planes)
+                   {
+                       std::fill(plane.begin(), plane.end(), 0.0f);
+                   }
+
+                   pKernels->pfnDeinterleave(planePointers.data(), frames.data(), frameCount, channels);
+                   for (UINT32 c = 0; c < channels; c++)
+                   {
+                       for (UINT32 i = 0; i < frameCount; i++)
+                       {
+                           Assert::AreEqual(frames[i * channels + c], planes[c][i], L"Plane should hold its channel");
+                       }
+                   }
+               }
+           }
+       }
+
+       TEST_METHOD(PcmSamplesConvertExactly)
+       {
+           // Odd lengths for the scalar tails, and an input one byte off any alignment
+           const UINT32 sampleCount = 515;
+           std::vector<BYTE> bytes(sampleCount * 4 + 1);
+           UINT32 seed = 7;
+           for (BYTE& b : bytes)
+           {
+               seed = seed * 1664525u + 1013904223u;
+               b = static_cast<BYTE>(seed >> 24);
+           }
+
+           for (UINT32 width = 1; width <= 4; width++)
+           {
+               for (size_t offset : { static_cast<size_t>(0), static_cast<size_t>(1) })
+               {
+                   const BYTE* pbInput = bytes.data() + offset;
+
+                   // The conversions and the power of two scales are exact
+                   std::vector<FLOAT32> expected(sampleCount);
+                   for (UINT32 i = 0; i < sampleCount; i++)
+                   {
+                       UINT32 u32 = 0;
+                       for (UINT32 b = 0; b < width; b++)
+                           u32 |= static_cast<UINT32>(pbInput[i * width + b]) << (8 * (b + 4 - width));
+                       const INT32 i32 = (width == 1) ? static_cast<INT32>(pbInput[i]) - 128 : static_cast<INT32>(u32) >> (32 - 8 * width);
+                       expected[i] = static_cast<FLOAT32>(i32) * (1.0f / static_cast<FLOAT32>(1u << (8 * width - 1)));
+                   }
+
+                   for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+                   {
+                       const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+                       if (pKernels == nullptr)
+                       {
+                           continue;
+                       }
+
+                       std::vector<FLOAT32> output(sampleCount);
+                       pKernels->pfnConvertPcmSpan(output.data(), pbInput, sampleCount, width);
+                       Assert::IsTrue(output == expected, L"Samples of every width should convert exactly");
+                   }
+               }
+           }
+       }
+
+       TEST_METHOD(StreamRingKeepsMemoryFlat)
+       {
+           // 2 GiB of stereo frames go through a one second ring, written by a worker thread.
+           // The reader that fills the ring from a file is covered by FlacDecoderTests.
+           const UINT64 totalFrames = (2ull << 30) / (Channels * sizeof(FLOAT32));
+           const UINT32 ringFrames = 48000;
+           const UINT32 periodFrames = 480;
+           const UINT32 chunkFrames = 4096;
+
+           // A sawtooth that is never zero, a zero frame is one the ring ran short of
+           auto value = [](UINT32 phase) { return static_cast<FLOAT32>(phase + 1) / 1024.0f; };
+           auto next = [](UINT32 phase) { return (phase == 999) ? 0 : phase + 1; };
+
+           std::vector<BYTE> buffer(GetMixStreamBufferSize(ringFrames, periodFrames, Channels));
+           MIX_STREAM stream;
+           InitMixStream(&stream, ringFrames, periodFrames, Channels, buffer.data());
+
+           MIX_CONTEXT context;
+           InitMixContext(&context, SelectMixKernels(), Channels, FALSE, 0);
+           MIX_REQUEST request = {};
+           request.aSources[0].pStream = &stream;
+           request.aSources[0].f32Weight = 1.0f;
+           request.aSources[0].bLoop = TRUE;
+           request.u32SourceCount = 1;
+           request.bMix = TRUE;
+           request.f32InputWeight = 0.0f;
+           PostMixRequest(&context, &request);
+
+           const std::vector<FLOAT32> input(periodFrames * Channels, 0.0f);
+           std::vector<FLOAT32> output(periodFrames * Channels);
+           const size_t residentBefore = GetResidentBytes();
+
+           std::thread worker([&]() {
+               std::vector<FLOAT32> chunk(chunkFrames * Channels);
+               UINT32 phase = 0;
+               for (UINT64 written = 0; written < totalFrames; )
+               {
+                   UINT32 frames = static_cast<UINT32>(std::min<UINT64>(chunkFrames, totalFrames - written));
+                   for (UINT32 i = 0; i < frames; i++)
+                   {
+                       chunk[i * Channels] = value(phase);
+                       chunk[i * Channels + 1] = -value(phase);
+                       phase = next(phase);
+                   }
+                   for (UINT32 done = 0; done < frames; )
+                   {
+                       done += WriteMixStream(&stream, chunk.data() + done * Channels, frames - done);
+                       if (done < frames)
+                       {
+                           std::this_thread::yield();
+                       }
+                   }
+                   written += frames;
+               }
+           });
+
+           // Every frame comes out in order; the periods wait for the worker like they would for the device
+           UINT64 expected = 0;
+           UINT32 phase = 0;
+           while (expected < totalFrames)
+           {
+               const UINT32 frames = static_cast<UINT32>(std::min<UINT64>(periodFrames, totalFrames - expected));
+               if (stream.u64WrittenFrames.load() - stream.u64ReadFrames.load() < frames)
+               {
+                   std::this_thread::yield();
+                   continue;
+               }
+
+               PrepareMixStreams(&context, frames);
+               context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), frames);
+
+               bool inOrder = true;
+               for (UINT32 i = 0; i < frames; i++)
+               {
+                   inOrder = inOrder && output[i * Channels] == value(phase) && output[i * Channels + 1] == -value(phase);
+                   phase = next(phase);
+               }
+               Assert::IsTrue(inOrder, L"Streamed frames should play in order");
+               expected += frames;
+           }
+           worker.join();
+
+           const size_t residentAfter = GetResidentBytes();
+           Assert::AreEqual(totalFrames, stream.u64ReadFrames.load(), L"Every frame of the clip should play");
+           Assert::AreEqual(0u, stream.u32Underruns.load(), L"A ring that keeps up should not underrun");
+           Assert::IsTrue(residentAfter < residentBefore + (16u << 20), L"Memory should not grow with the length of the clip");
+
+           // Once the worker is done the ring runs dry, the period plays silence and counts it
+           PrepareMixStreams(&context, periodFrames);
+           context.pProcessor->pfnProcess[BUFFER_VALID](&context, output.data(), input.data(), periodFrames);
+           Assert::IsTrue(std::all_of(output.begin(), output.end(), [](FLOAT32 f) { return f == 0.0f; }), L"A dry ring should play silence");
+           Assert::AreEqual(1u, stream.u32Underruns.load(), L"The dry period should count as an underrun");
+           Assert::AreEqual(static_cast<UINT64>(periodFrames), stream.u64MissingFrames.load(), L"Every frame of it should count as missing");
+       }
+
+       TEST_METHOD(LimiterDelaysQuietMixUnchanged)
+       {
+           const UINT32 lookahead = 48;
+           const UINT32 periodFrames = 100;
+           const std::vector<FLOAT32> input = Ramp(periodFrames, -0.5f);
+
+           std::vector<BYTE> buffer(GetMixLimiterBufferSize(lookahead, Channels));
+           MIX_LIMITER limiter;
+           InitMixLimiter(&limiter, lookahead, Channels, MIX_LIMITER_CEILING, 480, buffer.data());
+
+           // Below the ceiling the output is the mix delayed by the lookahead
+           std::vector<FLOAT32> stream;
+           std::vector<FLOAT32> output;
+           for (int period = 0; period < 3; period++)
+           {
+               std::vector<FLOAT32> frames = input;
+               Assert::AreEqual(static_cast<int>(BUFFER_VALID),
+                                static_cast<int>(SelectMixKernels()->pfnLimit(&limiter, frames.data(), periodFrames, BUFFER_VALID)),
+                                L"Limited mix should be valid");
+               stream.insert(stream.end(), input.begin(), input.end());
+               output.insert(output.end(), frames.begin(), frames.end());
+           }
+           stream.insert(stream.begin(), lookahead * Channels, 0.0f);
+           stream.resize(output.size());
+           Assert::IsTrue(stream == output, L"Quiet mix should only be delayed");
+
+           // The delayed tail comes out of the first silent period, the next one stays silent
+           std::vector<FLOAT32> frames(input.size(), 1.0f);
+           Assert::AreEqual(static_cast<int>(BUFFER_VALID),
+                            static_cast<int>(SelectMixKernels()->pfnLimit(&limiter, frames.data(), periodFrames, BUFFER_SILENT)),
+                            L"Tail of the mix should not be silent");
+           Assert::IsTrue(std::equal(frames.begin(), frames.begin() + lookahead * Channels,
+                                     input.end() - lookahead * Channels),
+                          L"Tail should be the end of the last period");
+           Assert::IsTrue(std::all_of(frames.begin() + lookahead * Channels, frames.end(), [](FLOAT32 f) { return f == 0.0f; }),
+                          L"Silence should follow the tail");
+           Assert::AreEqual(static_cast<int>(BUFFER_SILENT),
+                            static_cast<int>(SelectMixKernels()->pfnLimit(&limiter, frames.data(), periodFrames, BUFFER_SILENT)),
+                            L"Silence after the tail should stay silent");
+       }
+
+       TEST_METHOD(DenormalGuardFlushesAndRestores)
+       {
+#if defined(MIX_KERNELS_X64) || defined(MIX_KERNELS_ARM64)
+           // Volatile keeps the compiler from folding the products at build time
+           volatile FLOAT32 f32Small = 1e-30f;
+           volatile FLOAT32 f32Scale = 1e-10f;
+
+           Assert::IsTrue(f32Small * f32Scale != 0.0f, L"Denormal result should survive outside of the guard");
+           {
+               MixDenormalGuard outerGuard;
+               Assert::IsTrue(f32Small * f32Scale == 0.0f, L"Denormal result should be flushed inside of the guard");
+               {
+                   MixDenormalGuard innerGuard;
+               }
+               Assert::IsTrue(f32Small * f32Scale == 0.0f, L"Nested guard should leave the outer one in force");
+           }
+           Assert::IsTrue(f32Small * f32Scale != 0.0f, L"Guard should restore denormal handling");
+#endif
+       }
+
+       TEST_METHOD(LimiterKeepsPeaksUnderCeiling)
+       {
+           const UINT32 lookahead = 48;
+           const UINT32 periodFrames = 480;
+           const UINT32 periods = 20;
+
+           // Hot bursts over a quiet signal, then quiet only
+           std::vector<FLOAT32> mix(periodFrames * periods * Channels);
+           UINT32 seed = 1;
+           for (size_t i = 0; i < mix.size(); i++)
+           {
+               seed = seed * 1664525u + 1013904223u;
+               const FLOAT32 noise = static_cast<FLOAT32>(static_cast<INT32>(seed)) / 2147483648.0f;
+               const size_t frame = i / Channels;
+               const bool hot = frame < periodFrames * 4 && (frame / 300) % 2 == 0;
+               mix[i] = noise * (hot ? 3.0f : 0.25f);
+           }
+
+           std::vector<FLOAT32> expected;
+           for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+           {
+               const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+               if (pKernels == nullptr)
+               {
+                   continue;
+               }
+
+               std::vector<BYTE> buffer(GetMixLimiterBufferSize(lookahead, Channels));
+               MIX_LIMITER limiter;
+               InitMixLimiter(&limiter, lookahead, Channels, MIX_LIMITER_CEILING, 480, buffer.data());
+
+               std::vector<FLOAT32> output = mix;
+               for (UINT32 period = 0; period < periods; period++)
+               {
+                   pKernels->pfnLimit(&limiter, output.data() + period * periodFrames * Channels, periodFrames, BUFFER_VALID);
+               }
+
+               for (FLOAT32 f : output)
+               {
+                   Assert::IsTrue(f <= MIX_LIMITER_CEILING * 1.000001f && f >= -MIX_LIMITER_CEILING * 1.000001f,
+                                  L"Limited mix should stay under the ceiling");
+               }
+
+               // Once the gain has recovered the mix is only delayed again
+               const size_t last = (periods - 1) * periodFrames * Channels;
+               Assert::IsTrue(std::equal(output.begin() + last, output.end(), mix.begin() + last - lookahead * Channels),
+                              L"Gain should recover after the bursts");
+
+               if (expected.empty())
+               {
+                   expected = output;
+               }
+               Assert::IsTrue(expected == output, L"Every instruction set should limit alike");
+           }
+       }
+
+       TEST_METHOD(PeriodKernelsMatchProcessFormat)
+       {
+           const UINT32 lookahead = 48;
+           const UINT32 periodFrames = 480;
+           const UINT32 periods = 3;
+           const std::vector<FLOAT32> file = Ramp(1013, -0.75f);
+
+           MIX_REQUEST request = {};
+           request.aSources[0] = Source(file, Channels, 1.0f);
+           request.u32SourceCount = 1;
+           request.bMix = TRUE;
+           request.f32InputWeight = 1.0f;
+
+           for (int format = MIX_SAMPLE_FLOAT32; format < MIX_SAMPLE_FORMAT_COUNT; format++)
+           {
+               // Loud noise, so the mix with the clip goes over the ceiling
+               const size_t sampleCount = periodFrames * periods * Channels;
+               std::vector<BYTE> input(sampleCount * GetMixSampleBytes(static_cast<MIX_SAMPLE_FORMAT>(format)));
+               UINT32 seed = 1;
+               if (format == MIX_SAMPLE_FLOAT32)
+               {
+                   for (size_t i = 0; i < sampleCount; i++)
+                   {
+                       seed = seed * 1664525u + 1013904223u;
+                       const FLOAT32 sample = static_cast<FLOAT32>(static_cast<INT32>(seed)) / 2147483648.0f * 0.9f;
+                       std::memcpy(&input[i * sizeof(FLOAT32)], &sample, sizeof(sample));
+                   }
+               }
+               else
+               {
+                   for (size_t i = 0; i < input.size(); i++)
+                   {
+                       seed = seed * 1664525u + 1013904223u;
+                       input[i] = static_cast<BYTE>(seed >> 24);
+                   }
+               }
+               const size_t periodBytes = input.size() / periods;
+
+               for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+               {
+                   const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+                   if (pKernels == nullptr)
+                   {
+                       continue;
+                   }
+
+                   for (UINT32 limit = 0; limit < 2; limit++)
+                   {
+                       // The entry picked once per lock processes as the kernel that checks on every period
+                       std::vector<BYTE> outputs[2];
+                       for (UINT32 run = 0; run < 2; run++)
+                       {
+                           const UINT32 frames = limit ? lookahead : 0;
+                           std::vector<BYTE> limiterBuffer(GetMixLimiterBufferSize(frames, Channels));
+                           MIX_LIMITER limiter;
+                           InitMixLimiter(&limiter, frames, Channels, MIX_LIMITER_CEILING, 480, limiterBuffer.data());
+                           MIX_FORMAT mixFormat;
+                           InitMixFormat(&mixFormat, static_cast<MIX_SAMPLE_FORMAT>(format), Channels);
+                           MIX_CONTEXT context;
+                           InitMixContext(&context, pKernels, Channels, format != MIX_SAMPLE_FLOAT32, 0);
+                           PostMixRequest(&context, &request);
+
+                           const PFN_MIX_PROCESS_FORMAT pfnProcess = run ? pKernels->pfnProcessPeriod[format][limit] :
+                                                                           pKernels->pfnProcessFormat;
+                           outputs[run].resize(input.size());
+                           for (UINT32 period = 0; period < periods; period++)
+                           {
+                               pfnProcess(&mixFormat, &context, &limiter, outputs[run].data() + period * periodBytes,
+                                          input.data() + period * periodBytes, periodFrames, BUFFER_VALID);
+                           }
+                       }
+                       Assert::IsTrue(outputs[0] == outputs[1], L"Period kernel should match the format kernel");
+                   }
+               }
+           }
+       }
+
+       TEST_METHOD(FixedPointPeriodsMixWithDither)
+       {
+           const UINT32 periodFrames = 480;
+           const std::vector<FLOAT32> file = Ramp(1013, -0.25f);
+           const MIX_SAMPLE_FORMAT formats[] = { MIX_SAMPLE_INT16, MIX_SAMPLE_INT24, MIX_SAMPLE_INT32 };
+
+           for (MIX_SAMPLE_FORMAT format : formats)
+           {
+               const UINT32 bytes = GetMixSampleBytes(format);
+               const FLOAT64 scale = static_cast<FLOAT64>(1u << (bytes * 8 - 1));
+
+               // Little endian samples of a quiet noise, and the floats the kernels convert them to
+               std::vector<BYTE> input(periodFrames * Channels * bytes);
+               std::vector<FLOAT32> floatInput(periodFrames * Channels);
+               UINT32 seed = 1;
+               for (size_t i = 0; i < floatInput.size(); i++)
+               {
+                   seed = seed * 1664525u + 1013904223u;
+                   const INT32 sample = static_cast<INT32>(seed) >> (40 - bytes * 8);
+                   for (UINT32 b = 0; b < bytes; b++)
+                   {
+                       input[i * bytes + b] = static_cast<BYTE>(sample >> (8 * b));
+                   }
+                   floatInput[i] = static_cast<FLOAT32>(sample) * static_cast<FLOAT32>(1.0 / scale);
+               }
+               auto decode = [&](const std::vector<BYTE>& buffer, size_t i) {
+                   UINT32 u32 = 0;
+                   for (UINT32 b = 0; b < bytes; b++)
+                   {
+                       u32 |= static_cast<UINT32>(buffer[i * bytes + b]) << (8 * (b + 4 - bytes));
+                   }
+                   return static_cast<FLOAT64>(static_cast<INT32>(u32) >> (32 - bytes * 8));
+               };
+
+               MIX_REQUEST request = {};
+               request.aSources[0] = Source(file, Channels, 0.5f);
+               request.u32SourceCount = 1;
+               request.bMix = TRUE;
+               request.f32InputWeight = 0.5f;
+
+               MIX_CONTEXT floatContext;
+               InitMixContext(&floatContext, SelectMixKernels(), Channels, FALSE, 0);
+               PostMixRequest(&floatContext, &request);
+               std::vector<FLOAT32> mix(floatInput.size());
+               Process(floatContext, mix, floatInput, periodFrames);
+
+               std::vector<BYTE> expected;
+               for (int isa = MIX_ISA_SCALAR; isa <= DetectMixIsa(); isa++)
+               {
+                   const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+                   if (pKernels == nullptr)
+                   {
+                       continue;
+                   }
+
+                   MIX_FORMAT mixFormat;
+                   InitMixFormat(&mixFormat, format, Channels);
+                   MIX_LIMITER limiter;
+                   InitMixLimiter(&limiter, 0, Channels, MIX_LIMITER_CEILING, 480, nullptr);
+                   MIX_CONTEXT context;
+                   InitMixContext(&context, pKernels, Channels, TRUE, 0);
+
+                   // Passing through leaves the samples as they are
+                   std::vector<BYTE> output(input.size());
+                   Assert::AreEqual(static_cast<int>(BUFFER_VALID),
+                                    static_cast<int>(pKernels->pfnProcessFormat(&mixFormat, &context, &limiter, output.data(),
+                                                                                input.data(), periodFrames, BUFFER_VALID)),
+                                    L"Passed through period should be valid");
+                   Assert::IsTrue(input == output, L"Passed through samples should not change");
+
+                   // The mix comes out rounded, within the dither of the narrow formats
+                   PostMixRequest(&context, &request);
+                   pKernels->pfnProcessFormat(&mixFormat, &context, &limiter, output.data(), input.data(), periodFrames, BUFFER_VALID);
+
+                   bool dithered = false;
+                   for (size_t i = 0; i < mix.size(); i++)
+                   {
+                       const FLOAT64 error = decode(output, i) - static_cast<FLOAT64>(mix[i]) * scale;
+                       Assert::IsTrue(error <= (mixFormat.bDither ? 1.5 : 0.5) && error >= (mixFormat.bDither ? -1.5 : -0.5),
+                                      L"Fixed point sample should follow the float mix");
+                       dithered = dithered || error > 0.5 || error < -0.5;
+                   }
+                   Assert::AreEqual(static_cast<bool>(mixFormat.bDither), dithered, L"Only narrow formats should be dithered");
+
+                   if (expected.empty())
+                   {
+                       expected = output;
+                   }
+                   Assert::IsTrue(expected == output, L"Every instruction set should convert and dither alike");
+               }
+           }
+       }
+   };
+}
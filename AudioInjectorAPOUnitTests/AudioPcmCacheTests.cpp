@@ -0,0 +1,176 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/AudioPcmCache.h"
+#include "../AudioInjectorAPO/AudioFileMapping.h"
+#include "../AudioInjectorAPO/AudioFileReader.h"
+#include "TestHelpers.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AudioInjectorAPOUnitTests
+{
+   TEST_CLASS(AudioPcmCacheTests)
+   {
+   private:
+       // Open the clip for a 48 kHz stream, as the clip cache does
+       static HRESULT OpenClip(AudioFileReader& reader, const std::wstring& path, const std::wstring& cacheDirectory)
+       {
+           return reader.Open(path.c_str(), 48000, 480, 30000, cacheDirectory.c_str());
+       }
+
+       // The reader copies a mapping it cannot lock, which the limits of the process decide
+       static bool CanLockMapping(const std::wstring& path)
+       {
+           AudioFileMapping mapping;
+           return SUCCEEDED(mapping.Open(path.c_str(), AUDIO_MAPPING_LOCK)) && mapping.IsLocked();
+       }
+
+   public:
+       TEST_METHOD(HashesLikeXxh64)
+       {
+           const char* text = "Nobody inspects the spammish repetition";
+           Assert::AreEqual(0xEF46DB3751D8E999ull, static_cast<unsigned long long>(HashAudioBytes(nullptr, 0, 0)),
+                            L"The empty input should hash as with XXH64");
+           Assert::AreEqual(0x44BC2CF5AD770999ull, static_cast<unsigned long long>(HashAudioBytes(reinterpret_cast<const BYTE*>("abc"), 3, 0)),
+                            L"A short input should hash as with XXH64");
+           Assert::AreEqual(0xFBCEA83C8A378BF1ull, static_cast<unsigned long long>(HashAudioBytes(reinterpret_cast<const BYTE*>(text), strlen(text), 0)),
+                            L"An input of all lanes and tails should hash as with XXH64");
+       }
+
+       TEST_METHOD(RejectsDamagedCacheFiles)
+       {
+           std::vector<FLOAT32> samples(3 * 1000);
+           for (size_t i = 0; i < samples.size(); i++)
+           {
+               samples[i] = static_cast<FLOAT32>(i) / 3000.0f;
+           }
+
+           AUDIO_PCM_CACHE_INFO info = {};
+           info.u64SourceHash = 0x0123456789ABCDEFull;
+           info.cbSource = 12345;
+           info.u32SampleRate = 48000;
+           info.u32ChannelCount = 3;
+           info.dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER;
+           info.u32SourceBitsPerSample = 24;
+           info.u32FrameCount = 1000;
+           info.u32LoopStart = 100;
+           info.u32LoopEnd = 900;
+           info.u32CuePoints = 2;
+           info.au32CueFrames[0] = 10;
+           info.au32CueFrames[1] = 20;
+
+           const std::wstring directory = CreateTempDirectory(L"AudioPcmCacheTestsDamaged");
+           std::wstring path;
+           Assert::AreEqual(S_OK, GetAudioPcmCachePath(directory.c_str(), info.u64SourceHash, 48000, &path), L"The cache file should be named");
+           Assert::AreEqual(S_OK, WriteAudioPcmCache(path.c_str(), &info, samples.data()), L"The cache file should be written");
+           std::vector<BYTE> file = ReadTestFile(path);
+           RemoveTestFile(path);
+           RemoveTempDirectory(directory);
+
+           AUDIO_PCM_CACHE_INFO read = {};
+           const FLOAT32* pf32Samples = nullptr;
+           Assert::AreEqual(S_OK, ParseAudioPcmCache(file.data(), file.size(), &read, &pf32Samples), L"The cache file should be read back");
+           Assert::AreEqual(0, std::memcmp(&info, &read, sizeof(info)), L"The clip should be described as written");
+           Assert::AreEqual(0, std::memcmp(samples.data(), pf32Samples, samples.size() * sizeof(FLOAT32)), L"The samples should be as written");
+
+           // A flipped bit in the samples, in the header, or a file cut short is no cache file
+           std::vector<BYTE> damaged = file;
+           damaged[damaged.size() - 5] ^= 0x10;
+           Assert::AreEqual(E_FAIL, ParseAudioPcmCache(damaged.data(), damaged.size(), &read, &pf32Samples), L"Damaged samples should be rejected");
+
+           damaged = file;
+           damaged[40] ^= 0x01;
+           Assert::AreEqual(E_FAIL, ParseAudioPcmCache(damaged.data(), damaged.size(), &read, &pf32Samples), L"A damaged header should be rejected");
+
+           Assert::AreEqual(E_FAIL, ParseAudioPcmCache(file.data(), file.size() - 4, &read, &pf32Samples), L"A truncated file should be rejected");
+           Assert::AreEqual(E_FAIL, ParseAudioPcmCache(file.data(), 64, &read, &pf32Samples), L"A header alone should be rejected");
+       }
+
+       TEST_METHOD(ReaderMapsClipFromCache)
+       {
+           const std::wstring directory = CreateTempDirectory(L"AudioPcmCacheTestsReader");
+           const std::vector<BYTE> source = MakeRampWavFile(4800, false);
+           const std::wstring path = directory + L"AudioPcmCacheTests.wav";
+           WriteTestFile(path, source);
+
+           std::wstring cachePath;
+           Assert::AreEqual(S_OK, GetAudioPcmCachePath(directory.c_str(), HashAudioBytes(source.data(), source.size(), 0), 48000, &cachePath),
+                            L"The cache file should be named");
+           RemoveTestFile(cachePath);
+
+           // The 24 bit samples are converted, so the first load writes the cache
+           AudioFileReader decoded;
+           Assert::AreEqual(S_OK, OpenClip(decoded, path, directory), L"The clip should load");
+           Assert::IsFalse(decoded.IsMapped(), L"The first load should convert the samples");
+           Assert::IsFalse(ReadTestFile(cachePath).empty(), L"The first load should write the cache file");
+
+           AudioFileReader cached;
+           Assert::AreEqual(S_OK, OpenClip(cached, path, directory), L"The clip should load from the cache");
+           Assert::AreEqual(CanLockMapping(cachePath), cached.IsMapped(), L"The clip should be mapped out of the cache file");
+           Assert::AreEqual(decoded.GetFrameCount(), cached.GetFrameCount(), L"The cached clip should be as long");
+           Assert::AreEqual(decoded.GetChannelCount(), cached.GetChannelCount(), L"The cached clip should have the channels");
+           Assert::AreEqual(0, std::memcmp(decoded.GetAudioData(), cached.GetAudioData(), 4800 * 2 * sizeof(FLOAT32)),
+                            L"The cached samples should be the decoded ones");
+           Assert::IsNotNull(cached.GetSilentBlocks(), L"The cached clip should be scanned for silence");
+           cached.Cleanup();
+
+           // A damaged cache file is decoded around and written again
+           std::vector<BYTE> cache = ReadTestFile(cachePath);
+           cache[cache.size() - 1] ^= 0x40;
+           WriteTestFile(cachePath, cache);
+           Assert::AreEqual(S_OK, OpenClip(cached, path, directory), L"The clip should load past a damaged cache file");
+           Assert::IsFalse(cached.IsMapped(), L"A damaged cache file should not be used");
+           Assert::AreEqual(0, std::memcmp(decoded.GetAudioData(), cached.GetAudioData(), 4800 * 2 * sizeof(FLOAT32)),
+                            L"The clip should be decoded again");
+           cached.Cleanup();
+           Assert::AreEqual(S_OK, OpenClip(cached, path, directory), L"The clip should load from the rewritten cache");
+           Assert::AreEqual(CanLockMapping(cachePath), cached.IsMapped(), L"The rewritten cache file should be mapped");
+           cached.Cleanup();
+           RemoveTestFile(cachePath);
+
+           // A float WAV file at the rate of the stream is its own cache
+           const std::vector<BYTE> floatSource = MakeRampWavFile(4800, true);
+           WriteTestFile(path, floatSource);
+           Assert::AreEqual(S_OK, GetAudioPcmCachePath(directory.c_str(), HashAudioBytes(floatSource.data(), floatSource.size(), 0), 48000, &cachePath),
+                            L"The cache file should be named");
+           Assert::AreEqual(S_OK, OpenClip(cached, path, directory), L"The float clip should load");
+           Assert::AreEqual(CanLockMapping(path), cached.IsMapped(), L"The float clip should be mapped out of its own file");
+           Assert::IsTrue(ReadTestFile(cachePath).empty(), L"No cache file should be written for it");
+           cached.Cleanup();
+
+           decoded.Cleanup();
+           RemoveTestFile(path);
+           RemoveTempDirectory(directory);
+       }
+   };
+}
@@ -0,0 +1,382 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/AudioResampler.h"
+#include "../AudioInjectorAPO/AudioFileReader.h"
+#include "TestHelpers.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AudioInjectorAPOUnitTests
+{
+   TEST_CLASS(AudioResamplerTests)
+   {
+   private:
+       static std::vector<FLOAT32> MakeSine(UINT32 rate, double frequency, UINT32 frameCount)
+       {
+           std::vector<FLOAT32> sine(frameCount);
+           for (UINT32 i = 0; i < frameCount; i++)
+           {
+               sine[i] = static_cast<FLOAT32>(0.5 * std::sin(2.0 * 3.14159265358979 * frequency * i / rate));
+           }
+           return sine;
+       }
+
+       static std::vector<FLOAT32> MakeNoise(size_t sampleCount)
+       {
+           std::vector<FLOAT32> noise(sampleCount);
+           UINT32 seed = 7;
+           for (FLOAT32& f : noise)
+           {
+               seed = seed * 1664525u + 1013904223u;
+               f = static_cast<FLOAT32>(static_cast<INT32>(seed)) / 2147483648.0f * 0.5f;
+           }
+           return noise;
+       }
+
+       // Resamples the frames in blocks of blockFrames, the last one possibly shorter, and flushes
+       static std::vector<FLOAT32> Resample(AudioResampler& resampler, const std::vector<FLOAT32>& input,
+                                            UINT32 channelCount, UINT32 blockFrames)
+       {
+           const UINT32 frameCount = static_cast<UINT32>(input.size() / channelCount);
+           std::vector<FLOAT32> output;
+           std::vector<FLOAT32> block(static_cast<size_t>(resampler.GetMaxOutputFrames(blockFrames)) * channelCount);
+           UINT32 outputFrames = 0;
+
+           resampler.Reset();
+           for (UINT32 i = 0; i < frameCount; i += blockFrames)
+           {
+               const UINT32 frames = (frameCount - i < blockFrames) ? frameCount - i : blockFrames;
+               Assert::AreEqual(S_OK, resampler.Process(&input[static_cast<size_t>(i) * channelCount], frames, block.data(), &outputFrames),
+                                L"The frames should resample");
+               output.insert(output.end(), block.begin(), block.begin() + static_cast<size_t>(outputFrames) * channelCount);
+           }
+
+           block.resize(static_cast<size_t>(resampler.GetMaxOutputFrames(0)) * channelCount);
+           Assert::AreEqual(S_OK, resampler.Flush(block.data(), &outputFrames), L"The end of the clip should resample");
+           output.insert(output.end(), block.begin(), block.begin() + static_cast<size_t>(outputFrames) * channelCount);
+           return output;
+       }
+
+       // A stereo WAV file at 48 kHz of the samples, as floats or rounded to 16 bits
+       static std::vector<BYTE> MakeWavFile(const std::vector<FLOAT32>& samples, bool bFloat)
+       {
+           const UINT16 bytesPerSample = bFloat ? 4 : 2;
+           std::vector<BYTE> file = MakeWavHeader(bFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, 2, 48000,
+                                                  bytesPerSample * 8, static_cast<UINT32>(samples.size()) * bytesPerSample);
+           for (FLOAT32 sample : samples)
+           {
+               UINT32 bits = 0;
+               std::memcpy(&bits, &sample, sizeof(bits));
+               if (bFloat)
+                   AppendLE32(file, bits);
+               else
+                   AppendLE16(file, static_cast<UINT32>(static_cast<INT32>(std::lround(sample * 32768.0f))) & 0xFFFF);
+           }
+           return file;
+       }
+
+   public:
+       TEST_METHOD(ResamplesSineCleanly)
+       {
+           // Largest distance from the sine away from the ends, per quality
+           const double tolerances[AUDIO_RESAMPLE_QUALITY_COUNT] = { 2e-3, 2e-5, 1e-6 };
+           const std::vector<FLOAT32> sine = MakeSine(44100, 1000.0, 4410);
+
+           for (int quality = 0; quality < AUDIO_RESAMPLE_QUALITY_COUNT; quality++)
+           {
+               AudioResampler resampler;
+               Assert::AreEqual(S_OK, resampler.Initialize(44100, 48000, 1, static_cast<AUDIO_RESAMPLE_QUALITY>(quality)),
+                                L"The resampler should initialize");
+               const std::vector<FLOAT32> output = Resample(resampler, sine, 1, 4410);
+               Assert::AreEqual(static_cast<size_t>(4800), output.size(), L"A tenth of a second should stay one");
+
+               double maxError = 0.0;
+               for (size_t n = resampler.GetTapCount(); n + resampler.GetTapCount() < output.size(); n++)
+               {
+                   const double error = std::fabs(output[n] - 0.5 * std::sin(2.0 * 3.14159265358979 * 1000.0 * n / 48000));
+                   maxError = (error > maxError) ? error : maxError;
+               }
+               Assert::IsTrue(maxError < tolerances[quality], L"The output should be the sine at the new rate");
+           }
+
+           // A constant passes unchanged, down to the rounding of the taps
+           AudioResampler resampler;
+           Assert::AreEqual(S_OK, resampler.Initialize(48000, 16000, 1), L"The resampler should initialize");
+           const std::vector<FLOAT32> output = Resample(resampler, std::vector<FLOAT32>(4800, 0.25f), 1, 4800);
+           Assert::AreEqual(static_cast<size_t>(1600), output.size(), L"A third of the frames should come out");
+           for (size_t n = resampler.GetTapCount(); n + resampler.GetTapCount() < output.size(); n++)
+           {
+               Assert::IsTrue(std::fabs(output[n] - 0.25f) < 1e-6f, L"A constant should pass unchanged");
+           }
+       }
+
+       TEST_METHOD(KernelsOfEveryInstructionSetMatch)
+       {
+           const std::vector<FLOAT32> noise = MakeNoise(3 * 9600);
+           for (const UINT32 outputRate : { 44100u, 16000u })
+           {
+               AudioResampler reference;
+               Assert::AreEqual(S_OK, reference.Initialize(48000, outputRate, 3, GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY_HIGH),
+                                                           GetMixKernels(MIX_ISA_SCALAR)), L"The resampler should initialize");
+               const std::vector<FLOAT32> expected = Resample(reference, noise, 3, 9600);
+
+               for (int isa = MIX_ISA_SCALAR; isa < MIX_ISA_COUNT; isa++)
+               {
+                   const MIX_KERNELS* pKernels = GetMixKernels(static_cast<MIX_ISA>(isa));
+                   if (pKernels == nullptr || isa > DetectMixIsa())
+                       continue;
+
+                   AudioResampler resampler;
+                   Assert::AreEqual(S_OK, resampler.Initialize(48000, outputRate, 3, GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY_HIGH),
+                                                               pKernels), L"The resampler should initialize");
+                   Assert::IsTrue(Resample(resampler, noise, 3, 9600) == expected, L"Every instruction set should give the same samples");
+               }
+           }
+       }
+
+       TEST_METHOD(BlocksOfAnySizeMatchWholeClip)
+       {
+           const std::vector<FLOAT32> noise = MakeNoise(2 * 10007);
+           AudioResampler resampler;
+           Assert::AreEqual(S_OK, resampler.Initialize(22050, 48000, 2, AUDIO_RESAMPLE_QUALITY_MEDIUM), L"The resampler should initialize");
+
+           const std::vector<FLOAT32> whole = Resample(resampler, noise, 2, 10007);
+           Assert::AreEqual(static_cast<size_t>(2 * resampler.GetClipFrames(10007)), whole.size(), L"The clip should come out whole");
+           for (const UINT32 blockFrames : { 1u, 37u, 480u, 4096u })
+           {
+               Assert::IsTrue(Resample(resampler, noise, 2, blockFrames) == whole, L"Blocks should not change the samples");
+           }
+       }
+
+       TEST_METHOD(RejectsBadFormats)
+       {
+           AudioResampler resampler;
+           Assert::AreEqual(E_INVALIDARG, resampler.Initialize(0, 48000, 2), L"A rate of 0 should fail");
+           Assert::AreEqual(E_INVALIDARG, resampler.Initialize(44100, 0, 2), L"A rate of 0 should fail");
+           Assert::AreEqual(E_INVALIDARG, resampler.Initialize(44100, 48000, 0), L"No channels should fail");
+
+           // A Kaiser window does no better than a rectangular one below 21 dB
+           const AUDIO_RESAMPLE_FILTER weak = { 16, 20.0, 64 };
+           Assert::AreEqual(E_INVALIDARG, resampler.Initialize(44100, 48000, 2, weak), L"A stopband under 21 dB should fail");
+           const AUDIO_RESAMPLE_FILTER huge = { 4096, 100.0, 64 };
+           Assert::AreEqual(E_INVALIDARG, resampler.Initialize(48000, 1000, 2, huge), L"Too many taps should fail");
+
+           UINT32 outputFrames = 0;
+           FLOAT32 output[16];
+           Assert::AreEqual(E_FAIL, resampler.Process(output, 1, output, &outputFrames), L"A resampler that did not initialize should fail");
+       }
+
+       TEST_METHOD(ReaderResamplesRateAndChannels)
+       {
+           const std::vector<FLOAT32> noise = MakeNoise(2 * 4800);
+           const std::wstring path = WriteTempFile(L"AudioResamplerTestsReader.wav", MakeWavFile(noise, true));
+
+           AudioFileReader reader;
+           Assert::AreEqual(S_OK, reader.Initialize(path.c_str()), L"The clip should load");
+           Assert::AreEqual(S_OK, reader.ResampleAudio(44100, 1), L"The clip should resample");
+           Assert::AreEqual(44100u, reader.GetSampleRate(), L"The clip should be at the new rate");
+           Assert::AreEqual(1u, reader.GetChannelCount(), L"The clip should have the new channel count");
+           Assert::AreEqual(4410u, reader.GetFrameCount(), L"A tenth of a second should stay one");
+           Assert::IsFalse(reader.IsMapped(), L"The resampled clip should be owned");
+
+           // The channels are spread as the mix would, the front pair of the file goes into the center
+           AudioResampler resampler;
+           Assert::AreEqual(S_OK, resampler.Initialize(48000, 44100, 2), L"The resampler should initialize");
+           const std::vector<FLOAT32> stereo = Resample(resampler, noise, 2, 4800);
+           MIX_CHANNEL_MAP map;
+           Assert::IsTrue(BuildMixChannelMap(2, 0, 1, 0, &map) != FALSE, L"Stereo should map on mono");
+           std::vector<FLOAT32> mono(4410);
+           MapMixChannels(&map, stereo.data(), 4410, mono.data());
+           Assert::IsTrue(std::memcmp(mono.data(), reader.GetAudioData(), mono.size() * sizeof(FLOAT32)) == 0,
+                          L"The clip should be the resampled frames mapped on mono");
+
+           Assert::IsFalse(SUCCEEDED(reader.ResampleAudio(0, 1)), L"A rate of 0 should fail");
+           Assert::IsFalse(SUCCEEDED(reader.ResampleAudio(48000, 0)), L"No channels should fail");
+
+           reader.Cleanup();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(Int16ClipResamplesLikeFloatClip)
+       {
+           // Samples 16 bits hold exactly, so both files give the same floats
+           std::vector<FLOAT32> noise = MakeNoise(2 * 10000);
+           for (FLOAT32& f : noise)
+               f = std::round(f * 32768.0f) / 32768.0f;
+           const std::wstring int16Path = WriteTempFile(L"AudioResamplerTestsInt16.wav", MakeWavFile(noise, false));
+           const std::wstring floatPath = WriteTempFile(L"AudioResamplerTestsFloat.wav", MakeWavFile(noise, true));
+
+           for (const UINT32 channelCount : { 2u, 1u, 6u })
+           {
+               AudioFileReader int16Reader;
+               AudioFileReader floatReader;
+               Assert::AreEqual(S_OK, int16Reader.Initialize(int16Path.c_str()), L"The 16 bit clip should load");
+               Assert::AreEqual(S_OK, floatReader.Initialize(floatPath.c_str()), L"The float clip should load");
+               Assert::IsNotNull(int16Reader.GetAudioDataInt16(), L"The 16 bit clip should stay 16 bit");
+               Assert::AreEqual(S_OK, int16Reader.ResampleAudio(22050, channelCount), L"The 16 bit clip should resample");
+               Assert::AreEqual(S_OK, floatReader.ResampleAudio(22050, channelCount), L"The float clip should resample");
+
+               Assert::AreEqual(4594u, int16Reader.GetFrameCount(), L"The clip should be as long at the new rate");
+               Assert::AreEqual(floatReader.GetFrameCount(), int16Reader.GetFrameCount(), L"Both clips should be as long");
+               Assert::AreEqual(channelCount, int16Reader.GetChannelCount(), L"The clip should have the new channel count");
+               Assert::IsNull(int16Reader.GetAudioDataInt16(), L"The resampled clip should be float");
+               Assert::IsTrue(std::memcmp(floatReader.GetAudioData(), int16Reader.GetAudioData(),
+                                          static_cast<size_t>(4594) * channelCount * sizeof(FLOAT32)) == 0,
+                              L"Both clips should resample to the same samples");
+           }
+
+           // Only the channels change, the samples are converted on the way
+           AudioFileReader int16Reader;
+           AudioFileReader floatReader;
+           Assert::AreEqual(S_OK, int16Reader.Initialize(int16Path.c_str()), L"The 16 bit clip should load");
+           Assert::AreEqual(S_OK, floatReader.Initialize(floatPath.c_str()), L"The float clip should load");
+           Assert::AreEqual(S_OK, int16Reader.ResampleAudio(48000, 1), L"The channels of the 16 bit clip should convert");
+           Assert::AreEqual(S_OK, floatReader.ResampleAudio(48000, 1), L"The channels of the float clip should convert");
+           Assert::AreEqual(10000u, int16Reader.GetFrameCount(), L"The clip should keep its frames");
+           Assert::IsTrue(std::memcmp(floatReader.GetAudioData(), int16Reader.GetAudioData(), 10000 * sizeof(FLOAT32)) == 0,
+                          L"Both clips should convert to the same samples");
+
+           int16Reader.Cleanup();
+           floatReader.Cleanup();
+           RemoveTestFile(int16Path);
+           RemoveTestFile(floatPath);
+       }
+
+       TEST_METHOD(LargeClipResamplesWithinOneNewCopy)
+       {
+           // Two minutes of 16 bit stereo, written a second at a time
+           const UINT32 frameCount = 48000 * 120;
+           std::wstring path;
+           FILE* pFile = CreateTempFile(L"AudioResamplerTestsLarge.wav", path);
+           const std::vector<BYTE> header = MakeWavHeader(WAVE_FORMAT_PCM, 2, 48000, 16, frameCount * 2 * sizeof(INT16));
+           std::fwrite(header.data(), 1, header.size(), pFile);
+           std::vector<INT16> second(48000 * 2);
+           for (UINT32 s = 0; s < 120; s++)
+           {
+               for (UINT32 i = 0; i < 48000; i++)
+               {
+                   second[2 * i] = static_cast<INT16>(((i * 37) % 2000) * 8 - 8000);
+                   second[2 * i + 1] = static_cast<INT16>(-second[2 * i]);
+               }
+               std::fwrite(second.data(), sizeof(INT16), second.size(), pFile);
+           }
+           std::fclose(pFile);
+
+           AudioFileReader reader;
+           Assert::AreEqual(S_OK, reader.Initialize(path.c_str()), L"The clip should load");
+           Assert::IsTrue(reader.IsMapped(), L"The 16 bit clip should be mapped");
+
+           // Next to the clip at the new rate only the mapped file and a chunk or so are in use,
+           // a float copy of the clip on top would go well past the bound
+           const UINT64 clipFrames = (static_cast<UINT64>(frameCount) * 147 + 159) / 160;
+           const size_t sourceBytes = static_cast<size_t>(frameCount) * 2 * sizeof(INT16);
+           const size_t clipBytes = static_cast<size_t>(clipFrames) * 2 * sizeof(FLOAT32);
+           const size_t bound = GetResidentBytes() + sourceBytes + clipBytes + (16 << 20);
+
+           ResidentBytesPeak peak;
+           Assert::AreEqual(S_OK, reader.ResampleAudio(44100, 2, AUDIO_RESAMPLE_QUALITY_LOW), L"The clip should resample");
+           Assert::IsTrue(peak.Stop() <= bound, L"Resampling should hold a single new copy of the clip");
+           Assert::AreEqual(static_cast<UINT32>(clipFrames), reader.GetFrameCount(), L"The clip should be as long at the new rate");
+
+           reader.Cleanup();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(ReducedRatiosGetRowPerPosition)
+       {
+           AudioResampler resampler;
+           Assert::AreEqual(S_OK, resampler.Initialize(44100, 48000, 2), L"The resampler should initialize");
+           Assert::AreEqual(160u, resampler.GetPhaseCount(), L"147 to 160 should have a row per output frame of the cycle");
+           Assert::AreEqual(S_OK, resampler.Initialize(48000, 16000, 2), L"The resampler should initialize");
+           Assert::AreEqual(1u, resampler.GetPhaseCount(), L"3 to 1 should have a single row");
+           Assert::AreEqual(S_OK, resampler.Initialize(22050, 48000, 2, AUDIO_RESAMPLE_QUALITY_LOW), L"The resampler should initialize");
+           Assert::AreEqual(320u, resampler.GetPhaseCount(), L"147 to 320 should have a row per output frame of the cycle");
+
+           // A cycle of 48001 output frames takes too many rows, the filter is interpolated instead
+           Assert::AreEqual(S_OK, resampler.Initialize(44100, 48001, 2), L"The resampler should initialize");
+           Assert::AreEqual(GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY_HIGH).u32Phases, resampler.GetPhaseCount(),
+                            L"An odd ratio should be interpolated");
+
+           // Every output frame 3 to 1 sits on an input frame, a constant comes out exactly
+           Assert::AreEqual(S_OK, resampler.Initialize(48000, 16000, 1), L"The resampler should initialize");
+           const std::vector<FLOAT32> output = Resample(resampler, std::vector<FLOAT32>(4800, 0.5f), 1, 4800);
+           FLOAT32 maxError = 0.0f;
+           for (size_t n = resampler.GetTapCount(); n + resampler.GetTapCount() < output.size(); n++)
+               maxError = std::fmax(maxError, std::fabs(output[n] - 0.5f));
+           Assert::IsTrue(maxError < 1e-6f, L"A constant should pass unchanged");
+       }
+
+       TEST_METHOD(TablesAreDesignedOncePerRatio)
+       {
+           AudioResampleTableCache cache;
+           const AUDIO_RESAMPLE_FILTER& filter = GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY_MEDIUM);
+           std::shared_ptr<const AUDIO_RESAMPLE_TABLE> first;
+           std::shared_ptr<const AUDIO_RESAMPLE_TABLE> second;
+           Assert::AreEqual(S_OK, cache.Acquire(80, 63, filter, &first), L"The table should be designed");
+           Assert::AreEqual(S_OK, cache.Acquire(80, 63, filter, &second), L"The table should come out of the cache");
+           Assert::IsTrue(first == second, L"Both callers should share the table");
+           Assert::AreEqual(1u, cache.GetDesignCount(), L"The table should be designed once");
+
+           Assert::AreEqual(S_OK, cache.Acquire(80, 63, GetAudioResampleFilter(AUDIO_RESAMPLE_QUALITY_LOW), &second), L"The table should be designed");
+           Assert::IsFalse(first == second, L"Another filter should have a table of its own");
+           Assert::AreEqual(2u, cache.GetDesignCount(), L"Another filter should be designed");
+           Assert::AreEqual(E_INVALIDARG, cache.Acquire(0, 63, filter, &second), L"A ratio of 0 should fail");
+
+           // Tables no one holds are dropped once there are too many, held ones stay shared
+           for (UINT32 up = 1; up <= 40; up++)
+           {
+               Assert::AreEqual(S_OK, cache.Acquire(up, 41, filter, &second), L"The table should be designed");
+           }
+           Assert::IsTrue(cache.GetTableCount() <= 17, L"Tables no one holds should be dropped");
+           const UINT32 designs = cache.GetDesignCount();
+           Assert::AreEqual(S_OK, cache.Acquire(80, 63, filter, &second), L"The held table should still be shared");
+           Assert::IsTrue(first == second, L"The held table should still be shared");
+           Assert::AreEqual(designs, cache.GetDesignCount(), L"The held table should not be designed again");
+
+           // Ten clips loaded at one ratio design its table once, whoever asks first
+           const std::wstring path = WriteTempFile(L"AudioResamplerTestsShared.wav", MakeWavFile(MakeNoise(2 * 4800), true));
+           const UINT32 processDesigns = AudioResampleTableCache::GetInstance().GetDesignCount();
+           for (int i = 0; i < 10; i++)
+           {
+               AudioFileReader reader;
+               Assert::AreEqual(S_OK, reader.Initialize(path.c_str()), L"The clip should load");
+               Assert::AreEqual(S_OK, reader.ResampleAudio(37800, 2), L"The clip should resample");
+           }
+           Assert::AreEqual(processDesigns + 1, AudioResampleTableCache::GetInstance().GetDesignCount(),
+                            L"The clips should share one table");
+           RemoveTestFile(path);
+       }
+   };
+}
@@ -0,0 +1,578 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/FlacDecoder.h"
+#include "../AudioInjectorAPO/AudioFileReader.h"
+#include "TestHelpers.h"
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace AudioInjectorAPOUnitTests
+{
+   TEST_CLASS(FlacDecoderTests)
+   {
+   private:
+       // Big endian bit fields, a bit at a time, which is plenty for the small streams of the tests
+       struct BitWriter
+       {
+           std::vector<BYTE> bytes;
+           UINT32 pending = 0;
+           UINT32 bits = 0;
+
+           void Write(UINT32 value, UINT32 count)
+           {
+               for (UINT32 i = count; i-- > 0;)
+               {
+                   pending = (pending << 1) | ((value >> i) & 1);
+                   if (++bits == 8)
+                   {
+                       bytes.push_back(static_cast<BYTE>(pending));
+                       pending = 0;
+                       bits = 0;
+                   }
+               }
+           }
+
+           void WriteSigned(INT32 value, UINT32 count)
+           {
+               Write(static_cast<UINT32>(value) & (count == 32 ? 0xFFFFFFFFu : (1u << count) - 1), count);
+           }
+
+           void WriteRice(INT32 value, UINT32 parameter)
+           {
+               const UINT32 folded = (static_cast<UINT32>(value) << 1) ^ static_cast<UINT32>(value >> 31);
+               for (UINT32 q = folded >> parameter; q > 0; q--)
+                   Write(0, 1);
+               Write(1, 1);
+               Write(folded, parameter);
+           }
+
+           void Align()
+           {
+               while (bits != 0)
+                   Write(0, 1);
+           }
+       };
+
+       static BYTE Crc8(const BYTE* pb, size_t cb)
+       {
+           UINT32 crc = 0;
+           for (size_t i = 0; i < cb; i++)
+           {
+               crc ^= pb[i];
+               for (UINT32 bit = 0; bit < 8; bit++)
+                   crc = ((crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1)) & 0xFF;
+           }
+           return static_cast<BYTE>(crc);
+       }
+
+       static UINT32 Crc16(const BYTE* pb, size_t cb)
+       {
+           UINT32 crc = 0;
+           for (size_t i = 0; i < cb; i++)
+           {
+               crc ^= static_cast<UINT32>(pb[i]) << 8;
+               for (UINT32 bit = 0; bit < 8; bit++)
+                   crc = ((crc & 0x8000) ? ((crc << 1) ^ 0x8005) : (crc << 1)) & 0xFFFF;
+           }
+           return crc;
+       }
+
+       // Rice coded residual in two partitions where the block allows it, the first one escaped if asked
+       static void WriteResidual(BitWriter& writer, const std::vector<INT32>& residual, UINT32 blockSize, UINT32 order, bool escape)
+       {
+           const UINT32 partitionOrder = (blockSize % 2 == 0 && blockSize / 2 >= order) ? 1 : 0;
+           const UINT32 perPartition = blockSize >> partitionOrder;
+           writer.Write(0, 2);
+           writer.Write(partitionOrder, 4);
+
+           size_t first = 0;
+           for (UINT32 partition = 0; partition < (1u << partitionOrder); partition++)
+           {
+               const size_t count = (partition == 0) ? perPartition - order : perPartition;
+               if (escape && partition == 0)
+               {
+                   writer.Write(15, 4);
+                   writer.Write(20, 5);
+                   for (size_t i = 0; i < count; i++)
+                       writer.WriteSigned(residual[first + i], 20);
+               }
+               else
+               {
+                   // The parameter that codes the partition in the fewest bits
+                   UINT32 best = 0;
+                   UINT64 bestBits = UINT64_MAX;
+                   for (UINT32 parameter = 0; parameter < 15; parameter++)
+                   {
+                       UINT64 total = 0;
+                       for (size_t i = 0; i < count; i++)
+                       {
+                           const UINT32 folded = (static_cast<UINT32>(residual[first + i]) << 1) ^ static_cast<UINT32>(residual[first + i] >> 31);
+                           total += (folded >> parameter) + 1 + parameter;
+                       }
+                       if (total < bestBits)
+                       {
+                           bestBits = total;
+                           best = parameter;
+                       }
+                   }
+                   writer.Write(best, 4);
+                   for (size_t i = 0; i < count; i++)
+                       writer.WriteRice(residual[first + i], best);
+               }
+               first += count;
+           }
+       }
+
+       // A subframe of the kind, CONSTANT where all samples are the same, with the wasted bits left out
+       static void WriteSubframe(BitWriter& writer, const INT32* samples, UINT32 blockSize, UINT32 bits, UINT32 kind)
+       {
+           bool constant = true;
+           UINT32 common = 0;
+           for (UINT32 i = 0; i < blockSize; i++)
+           {
+               constant = constant && samples[i] == samples[0];
+               common |= static_cast<UINT32>(samples[i]);
+           }
+           UINT32 wasted = 0;
+           while (common != 0 && (common & 1) == 0 && wasted + 1 < bits)
+           {
+               common >>= 1;
+               wasted++;
+           }
+
+           std::vector<INT32> s(samples, samples + blockSize);
+           for (INT32& sample : s)
+               sample >>= wasted;
+           bits -= wasted;
+
+           // 0 VERBATIM, 1 - 5 FIXED of order 0 - 4, 6 LPC of order 3
+           const UINT32 order = constant ? 0 : (kind == 0) ? 0 : (kind <= 5) ? kind - 1 : 3;
+           const UINT32 type = constant ? 0 : (kind == 0) ? 1 : (kind <= 5) ? 8 + order : 31 + order;
+           writer.Write(0, 1);
+           writer.Write(type, 6);
+           writer.Write(wasted != 0 ? 1 : 0, 1);
+           if (wasted != 0)
+           {
+               writer.Write(0, wasted - 1);
+               writer.Write(1, 1);
+           }
+
+           if (type == 0)
+           {
+               writer.WriteSigned(s[0], bits);
+               return;
+           }
+           if (type == 1)
+           {
+               for (INT32 sample : s)
+                   writer.WriteSigned(sample, bits);
+               return;
+           }
+
+           for (UINT32 i = 0; i < order; i++)
+               writer.WriteSigned(s[i], bits);
+
+           // Coefficients wide enough for the 64 bit sums of the decoder once the samples have 24 bits
+           const UINT32 precision = (bits > 16) ? 12 : 4;
+           const UINT32 shift = precision - 3;
+           const INT32 coefficients[3] = { 3 << (precision - 4), -(2 << (precision - 4)), 1 << (precision - 4) };
+           std::vector<INT32> residual;
+           for (UINT32 i = order; i < blockSize; i++)
+           {
+               INT64 prediction = 0;
+               if (type >= 32)
+               {
+                   for (UINT32 j = 0; j < order; j++)
+                       prediction += static_cast<INT64>(coefficients[j]) * s[i - 1 - j];
+                   prediction >>= shift;
+               }
+               else if (order == 1)
+                   prediction = s[i - 1];
+               else if (order == 2)
+                   prediction = 2 * static_cast<INT64>(s[i - 1]) - s[i - 2];
+               else if (order == 3)
+                   prediction = 3 * (static_cast<INT64>(s[i - 1]) - s[i - 2]) + s[i - 3];
+               else if (order == 4)
+                   prediction = 4 * (static_cast<INT64>(s[i - 1]) + s[i - 3]) - 6 * static_cast<INT64>(s[i - 2]) - s[i - 4];
+               residual.push_back(static_cast<INT32>(s[i] - prediction));
+           }
+
+           if (type >= 32)
+           {
+               writer.Write(precision - 1, 4);
+               writer.WriteSigned(static_cast<INT32>(shift), 5);
+               for (UINT32 j = 0; j < order; j++)
+                   writer.WriteSigned(coefficients[j], precision);
+           }
+           WriteResidual(writer, residual, blockSize, order, kind == 3);
+       }
+
+       //
+       // Encodes the planes as a FLAC stream of blockSize frames per FLAC frame.  The
+       // subframe kinds and the stereo decorrelations cycle from frame to frame, so a
+       // short stream has all of them.
+       //
+       static std::vector<BYTE> EncodeFlac(const std::vector<std::vector<INT32>>& planes, UINT32 sampleRate, UINT32 bits,
+                                           UINT32 blockSize, bool seekTable, bool knownLength)
+       {
+           const UINT32 channels = static_cast<UINT32>(planes.size());
+           const UINT32 total = static_cast<UINT32>(planes[0].size());
+
+           std::vector<BYTE> frames;
+           std::vector<UINT32> offsets;
+           for (UINT32 first = 0, index = 0; first < total; first += blockSize, index++)
+           {
+               const UINT32 size = (total - first < blockSize) ? total - first : blockSize;
+               const UINT32 assignment = (channels == 2) ? ((index % 4 == 0) ? 1 : 7 + index % 4) : channels - 1;
+               offsets.push_back(static_cast<UINT32>(frames.size()));
+
+               BitWriter header;
+               header.Write(0xFFF8, 16);
+               header.Write(size == 256 ? 8 : 7, 4);
+               header.Write(index % 2 ? 0 : 10, 4);     // 48 kHz coded, or from STREAMINFO
+               header.Write(assignment, 4);
+               header.Write(index % 3 ? 0 : (bits == 16 ? 4 : 6), 3);
+               header.Write(0, 1);
+               if (index < 0x80)
+               {
+                   header.Write(index, 8);
+               }
+               else
+               {
+                   header.Write(0xC0 | (index >> 6), 8);
+                   header.Write(0x80 | (index & 0x3F), 8);
+               }
+               if (size != 256)
+                   header.Write(size - 1, 16);
+               header.bytes.push_back(Crc8(header.bytes.data(), header.bytes.size()));
+
+               // Subframe signals of the decorrelation, the side channel a bit wider
+               std::vector<INT32> left(planes[0].begin() + first, planes[0].begin() + first + size);
+               std::vector<std::vector<INT32>> subframes;
+               for (UINT32 c = 0; c < channels; c++)
+                   subframes.emplace_back(planes[c].begin() + first, planes[c].begin() + first + size);
+               std::vector<UINT32> subframeBits(channels, bits);
+               if (assignment >= 8)
+               {
+                   std::vector<INT32> side(size);
+                   std::vector<INT32> mid(size);
+                   for (UINT32 i = 0; i < size; i++)
+                   {
+                       side[i] = subframes[0][i] - subframes[1][i];
+                       mid[i] = (subframes[0][i] + subframes[1][i]) >> 1;
+                   }
+                   if (assignment == 8)
+                       subframes[1] = side;
+                   else if (assignment == 9)
+                       subframes[0] = side;
+                   else
+                   {
+                       subframes[0] = mid;
+                       subframes[1] = side;
+                   }
+                   subframeBits[assignment == 9 ? 0 : 1]++;
+               }
+
+               BitWriter body;
+               body.bytes = header.bytes;
+               for (UINT32 c = 0; c < channels; c++)
+                   WriteSubframe(body, subframes[c].data(), size, subframeBits[c], (index + c) % 7);
+               body.Align();
+               const UINT32 crc = Crc16(body.bytes.data(), body.bytes.size());
+               body.Write(crc, 16);
+               frames.insert(frames.end(), body.bytes.begin(), body.bytes.end());
+           }
+
+           BitWriter stream;
+           stream.Write(0x664C6143, 32);          // fLaC
+           stream.Write(seekTable ? 0 : 1, 1);
+           stream.Write(0, 7);
+           stream.Write(34, 24);
+           stream.Write(blockSize, 16);
+           stream.Write(blockSize, 16);
+           stream.Write(0, 24);
+           stream.Write(0, 24);
+           stream.Write(sampleRate, 20);
+           stream.Write(channels - 1, 3);
+           stream.Write(bits - 1, 5);
+           stream.Write(0, 4);
+           stream.Write(knownLength ? total : 0, 32);
+           for (UINT32 i = 0; i < 4; i++)
+               stream.Write(0, 32);
+
+           if (seekTable)
+           {
+               // A point every fourth frame and a placeholder
+               const UINT32 points = static_cast<UINT32>((offsets.size() + 3) / 4) + 1;
+               stream.Write(0x83, 8);
+               stream.Write(points * 18, 24);
+               for (size_t f = 0; f < offsets.size(); f += 4)
+               {
+                   stream.Write(0, 32);
+                   stream.Write(static_cast<UINT32>(f * blockSize), 32);
+                   stream.Write(0, 32);
+                   stream.Write(offsets[f], 32);
+                   stream.Write(blockSize, 16);
+               }
+               stream.Write(0xFFFFFFFF, 32);
+               stream.Write(0xFFFFFFFF, 32);
+               stream.Write(0, 32);
+               stream.Write(0, 32);
+               stream.Write(0, 16);
+           }
+
+           stream.bytes.insert(stream.bytes.end(), frames.begin(), frames.end());
+           return stream.bytes;
+       }
+
+       // A sine over noise, with a stretch of silence in the right channel and of even samples in the left one
+       static std::vector<std::vector<INT32>> MakePlanes(UINT32 channels, UINT32 frameCount, UINT32 bits)
+       {
+           const double scale = static_cast<double>(1 << (bits - 2));
+           std::vector<std::vector<INT32>> planes(channels, std::vector<INT32>(frameCount));
+           UINT32 seed = 7;
+           for (UINT32 c = 0; c < channels; c++)
+           {
+               for (UINT32 i = 0; i < frameCount; i++)
+               {
+                   seed = seed * 1664525u + 1013904223u;
+                   const INT32 noise = static_cast<INT32>(seed >> 24) - 128;
+                   INT32 sample = static_cast<INT32>(scale * std::sin(0.01 * i * (c + 1))) + noise;
+                   if (c == 1 && i / 256 % 5 == 0)
+                       sample = -1234;
+                   if (c == 0 && i / 256 % 6 == 3)
+                       sample &= ~3;
+                   planes[c][i] = sample;
+               }
+           }
+           return planes;
+       }
+
+       static double ToFloat(INT32 sample, UINT32 bits)
+       {
+           return static_cast<double>(sample) / static_cast<double>(1 << (bits - 1));
+       }
+
+   public:
+       TEST_METHOD(DecodesEverySubframeType)
+       {
+           for (UINT32 bits : { 16u, 24u })
+           {
+               const UINT32 channels = (bits == 16) ? 2 : 1;
+               const UINT32 frameCount = 14 * 256 + 100;
+               const std::vector<std::vector<INT32>> planes = MakePlanes(channels, frameCount, bits);
+               std::vector<BYTE> file = EncodeFlac(planes, 48000, bits, 256, false, true);
+
+               FlacDecoder decoder;
+               Assert::IsTrue(SUCCEEDED(decoder.Open(file.data(), file.size())), L"The stream should open");
+               Assert::AreEqual(48000u, decoder.GetStreamInfo().u32SampleRate, L"The rate should be read");
+               Assert::AreEqual(static_cast<UINT16>(channels), decoder.GetStreamInfo().u16Channels, L"The channels should be read");
+               Assert::AreEqual(static_cast<UINT64>(frameCount), decoder.GetStreamInfo().u64TotalFrames, L"The length should be read");
+
+               std::vector<FLOAT32> block(256 * channels);
+               UINT32 position = 0;
+               UINT32 blockFrames = 0;
+               HRESULT hr = S_OK;
+               while ((hr = decoder.DecodeBlock(block.data(), &blockFrames)) == S_OK)
+               {
+                   for (UINT32 i = 0; i < blockFrames * channels; i++)
+                       Assert::AreEqual(ToFloat(planes[i % channels][position + i / channels], bits), static_cast<double>(block[i]), 0.0,
+                                        L"Every subframe type and decorrelation should decode exactly");
+                   position += blockFrames;
+               }
+               Assert::AreEqual(S_FALSE, hr, L"The stream should end without an error");
+               Assert::AreEqual(frameCount, position, L"Every frame should be decoded");
+
+               // A flipped bit fails the CRC of its frame
+               file[file.size() - 40] ^= 0x10;
+               Assert::IsTrue(SUCCEEDED(decoder.Open(file.data(), file.size())), L"The stream should open again");
+               while ((hr = decoder.DecodeBlock(block.data(), &blockFrames)) == S_OK)
+               {
+               }
+               Assert::AreEqual(E_FAIL, hr, L"A damaged frame should fail");
+           }
+
+           const std::vector<BYTE> wav = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E' };
+           FlacDecoder decoder;
+           Assert::AreEqual(E_FAIL, decoder.Open(wav.data(), wav.size()), L"Other files should be rejected");
+       }
+
+       TEST_METHOD(SeeksThroughSeekTable)
+       {
+           const UINT32 frameCount = 40 * 256;
+           const std::vector<std::vector<INT32>> planes = MakePlanes(2, frameCount, 16);
+           const std::vector<BYTE> file = EncodeFlac(planes, 48000, 16, 256, true, true);
+
+           FlacDecoder decoder;
+           Assert::IsTrue(SUCCEEDED(decoder.Open(file.data(), file.size())), L"The stream should open");
+           Assert::AreEqual(static_cast<size_t>(10), decoder.GetSeekPoints().size(), L"The placeholder should be dropped");
+
+           std::vector<FLOAT32> block(256 * 2);
+           for (UINT32 target : { 5000u, 0u, 1024u, 10239u, 3u })
+           {
+               Assert::IsTrue(SUCCEEDED(decoder.Seek(target)), L"Every frame of the stream should be reachable");
+               Assert::AreEqual(static_cast<UINT64>(target), decoder.GetPosition(), L"The position should be the frame sought");
+
+               UINT32 blockFrames = 0;
+               Assert::AreEqual(S_OK, decoder.DecodeBlock(block.data(), &blockFrames), L"The block after the seek should decode");
+               Assert::AreEqual(256 - target % 256, blockFrames, L"The block should start at the frame sought");
+               Assert::AreEqual(ToFloat(planes[1][target], 16), static_cast<double>(block[1]), 0.0, L"The first frame should be the one sought");
+           }
+           Assert::AreEqual(E_INVALIDARG, decoder.Seek(frameCount), L"Seeking past the end should fail");
+       }
+
+       TEST_METHOD(DecodesAllFramesInParallel)
+       {
+           // Long enough for four threads, with and without a seek table to start them from
+           const UINT32 frameCount = 300 * 256 + 17;
+           const std::vector<std::vector<INT32>> planes = MakePlanes(2, frameCount, 16);
+           for (bool seekTable : { true, false })
+           {
+               const std::vector<BYTE> file = EncodeFlac(planes, 48000, 16, 256, seekTable, true);
+               FlacDecoder decoder;
+               Assert::IsTrue(SUCCEEDED(decoder.Open(file.data(), file.size())), L"The stream should open");
+
+               std::vector<FLOAT32> output(static_cast<size_t>(frameCount) * 2, 2.0f);
+               Assert::IsTrue(SUCCEEDED(decoder.DecodeAll(output.data(), 4)), L"The stream should decode on four threads");
+               for (UINT32 i = 0; i < frameCount * 2; i++)
+                   Assert::AreEqual(ToFloat(planes[i % 2][i / 2], 16), static_cast<double>(output[i]), 0.0,
+                                    L"Every frame should be decoded by one of the threads");
+           }
+
+           // Without a length the frames can only be decoded in order
+           const std::vector<BYTE> file = EncodeFlac(planes, 48000, 16, 256, false, false);
+           FlacDecoder decoder;
+           Assert::IsTrue(SUCCEEDED(decoder.Open(file.data(), file.size())), L"The stream should open");
+           std::vector<FLOAT32> output(static_cast<size_t>(frameCount) * 2);
+           Assert::IsTrue(FAILED(decoder.DecodeAll(output.data(), 4)), L"A stream of unknown length should not be split");
+
+           const std::wstring path = WriteTempFile(L"FlacDecoderTests.flac", file);
+           AudioFileReader reader;
+           Assert::IsTrue(SUCCEEDED(reader.Initialize(path.c_str())), L"The reader should decode a stream of unknown length");
+           Assert::AreEqual(frameCount, reader.GetFrameCount(), L"Every frame should be read");
+           Assert::AreEqual(ToFloat(planes[0][frameCount - 1], 16), static_cast<double>(reader.GetAudioData()[frameCount * 2 - 2]), 0.0,
+                            L"The last frame should be the one of the stream");
+           reader.Cleanup();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(ReaderStreamsFlacFile)
+       {
+           const UINT32 frameCount = 80 * 256;
+           const std::vector<std::vector<INT32>> planes = MakePlanes(2, frameCount, 16);
+           const std::wstring path = WriteTempFile(L"FlacDecoderTestsStream.flac", EncodeFlac(planes, 48000, 16, 256, true, true));
+
+           // Longer than streamMinMs, so it is decoded a block at a time into the ring
+           AudioFileReader reader;
+           Assert::IsTrue(SUCCEEDED(reader.Open(path.c_str(), 48000, 480, 100)), L"The clip should be streamed");
+           Assert::IsNotNull(reader.GetStream(), L"A long clip should get a ring");
+           Assert::AreEqual(0u, reader.GetFrameCount(), L"A streamed clip has no length of its own");
+
+           // The ring starts full and loops the clip
+           std::vector<FLOAT32> period(480 * 2);
+           for (UINT32 first = 0; first < 2 * frameCount; first += 480)
+           {
+               Assert::AreEqual(480u, ReadMixStream(reader.GetStream(), period.data(), 480), L"The worker should keep the ring filled");
+               for (UINT32 i = 0; i < 480 * 2; i += 97)
+               {
+                   const UINT32 frame = (first + i / 2) % frameCount;
+                   Assert::AreEqual(ToFloat(planes[i % 2][frame], 16), static_cast<double>(period[i]), 0.0,
+                                    L"The stream should be the clip, looped");
+               }
+           }
+           Assert::AreEqual(0u, reader.GetStreamUnderruns(), L"The stream should never run dry");
+           reader.Cleanup();
+
+           // A short one is decoded whole
+           Assert::IsTrue(SUCCEEDED(reader.Open(path.c_str(), 48000, 480, 1000)), L"The clip should open");
+           Assert::IsNull(reader.GetStream(), L"A short clip should not be streamed");
+           Assert::AreEqual(frameCount, reader.GetFrameCount(), L"A short clip should be decoded whole");
+           Assert::AreEqual(2u, reader.GetChannelCount(), L"The channels of the stream should be kept");
+           reader.Cleanup();
+           RemoveTestFile(path);
+       }
+
+       TEST_METHOD(ReaderStreamKeepsMemoryFlat)
+       {
+           // Three rings of the reader long, so the worker decodes it a ring at a time
+           const UINT32 frameCount = 3 * 48000;
+           const UINT32 periodFrames = 480;
+           const std::vector<std::vector<INT32>> planes = MakePlanes(2, frameCount, 16);
+           const std::wstring path = WriteTempFile(L"FlacDecoderTestsLong.flac", EncodeFlac(planes, 48000, 16, 4096, true, true));
+
+           AudioFileReader reader;
+           Assert::IsTrue(SUCCEEDED(reader.Open(path.c_str(), 48000, periodFrames, 100)), L"The clip should be streamed");
+           MIX_STREAM* pStream = reader.GetStream();
+           Assert::IsNotNull(pStream, L"A long clip should get a ring");
+           Assert::IsTrue(pStream->u32RingFrames < frameCount, L"The ring should hold a part of the clip only");
+
+           // The periods wait for the worker like they would for the device
+           std::vector<FLOAT32> period(periodFrames * 2);
+           UINT64 played = 0;
+           bool inOrder = true;
+           auto play = [&](UINT64 frames)
+           {
+               for (const UINT64 last = played + frames; played < last; played += periodFrames)
+               {
+                   while (pStream->u64WrittenFrames.load() - pStream->u64ReadFrames.load() < periodFrames)
+                   {
+                       std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                   }
+                   Assert::AreEqual(periodFrames, ReadMixStream(pStream, period.data(), periodFrames), L"A filled ring should hand out the period");
+                   for (UINT32 i = 0; i < periodFrames * 2; i += 97)
+                   {
+                       const UINT32 frame = static_cast<UINT32>((played + i / 2) % frameCount);
+                       inOrder = inOrder && ToFloat(planes[i % 2][frame], 16) == static_cast<double>(period[i]);
+                   }
+               }
+           };
+
+           // Once through the clip every buffer of the reader is at its size, the next
+           // rings, over the loop point, take no more memory
+           play(frameCount);
+           const size_t residentBefore = GetResidentBytes();
+           play(4 * static_cast<UINT64>(pStream->u32RingFrames));
+           const size_t residentAfter = GetResidentBytes();
+
+           Assert::IsTrue(played > 2 * static_cast<UINT64>(frameCount), L"The stream should have looped");
+           Assert::IsTrue(inOrder, L"The stream should be the clip, looped");
+           Assert::AreEqual(0u, reader.GetStreamUnderruns(), L"The stream should never run dry");
+           Assert::IsTrue(residentAfter < residentBefore + pStream->u32RingFrames * 2 * sizeof(FLOAT32),
+                          L"Memory should stay flat while the clip streams");
+
+           reader.Cleanup();
+           RemoveTestFile(path);
+       }
+   };
+}
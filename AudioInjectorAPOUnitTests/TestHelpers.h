@@ -0,0 +1,288 @@
+// Copyright (C) 2025 Maxim [maxirmx] Samsonov (www.sw.consulting)
+// All rights reserved.
+// This file is a part of AudioInjector application
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+// TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+// BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+//
+// Helpers the unit tests share: WAV files built in memory, files in the temporary
+// directory of the platform under names unique to the test run, and the memory in
+// use by the test process.
+//
+
+#pragma once
+
+#include "CppUnitTest.h"
+#include "../AudioInjectorAPO/PortableTypes.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace AudioInjectorAPOUnitTests
+{
+   inline void AppendLE16(std::vector<BYTE>& file, UINT32 value)
+   {
+       file.push_back(static_cast<BYTE>(value));
+       file.push_back(static_cast<BYTE>(value >> 8));
+   }
+
+   inline void AppendLE32(std::vector<BYTE>& file, UINT32 value)
+   {
+       AppendLE16(file, value & 0xFFFF);
+       AppendLE16(file, value >> 16);
+   }
+
+   // Header of a WAV file with a plain fmt chunk, dataBytes of samples are to follow
+   inline std::vector<BYTE> MakeWavHeader(UINT16 tag, UINT16 channels, UINT32 sampleRate, UINT16 bits, UINT32 dataBytes)
+   {
+       std::vector<BYTE> file = { 'R', 'I', 'F', 'F' };
+       AppendLE32(file, 36 + dataBytes);
+       file.insert(file.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+       AppendLE32(file, 16);
+       AppendLE16(file, tag);
+       AppendLE16(file, channels);
+       AppendLE32(file, sampleRate);
+       AppendLE32(file, sampleRate * channels * (bits / 8));
+       AppendLE16(file, channels * (bits / 8));
+       AppendLE16(file, bits);
+       file.insert(file.end(), { 'd', 'a', 't', 'a' });
+       AppendLE32(file, dataBytes);
+       return file;
+   }
+
+   // A stereo WAV file of a ramp, frameCount frames at 48 kHz of 24 bit or float samples
+   inline std::vector<BYTE> MakeRampWavFile(UINT32 frameCount, bool bFloat)
+   {
+       const UINT16 bytesPerSample = bFloat ? 4 : 3;
+       std::vector<BYTE> file = MakeWavHeader(bFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, 2, 48000,
+                                              bytesPerSample * 8, frameCount * 2 * bytesPerSample);
+       for (UINT32 i = 0; i < frameCount * 2; i++)
+       {
+           const FLOAT32 sample = static_cast<FLOAT32>(i % 1000) / 1000.0f - 0.5f;
+           UINT32 bits = static_cast<UINT32>(static_cast<INT32>(sample * 8388608.0f));
+           if (bFloat)
+           {
+               std::memcpy(&bits, &sample, sizeof(bits));
+           }
+           for (UINT32 b = 0; b < bytesPerSample; b++)
+           {
+               file.push_back(static_cast<BYTE>(bits >> (8 * b)));
+           }
+       }
+       return file;
+   }
+
+   // Temporary directory of the platform, with a trailing separator
+   inline std::wstring GetTempDirectory()
+   {
+#if defined(_WIN32)
+       wchar_t tempPath[MAX_PATH]{0};
+       GetTempPathW(MAX_PATH, tempPath);
+       return tempPath;
+#else
+       const char* pszDirectory = std::getenv("TMPDIR");
+       std::string directory = (pszDirectory != nullptr && *pszDirectory != '\0') ? pszDirectory : "/tmp";
+       if (directory.back() != '/')
+           directory += '/';
+       return std::wstring(directory.begin(), directory.end());
+#endif
+   }
+
+   // Path in the temporary directory ending in fileName, unique to the process and the call,
+   // so that test runs side by side never share a file
+   inline std::wstring GetUniqueTempPath(const std::wstring& fileName)
+   {
+       static std::atomic<UINT32> s_u32Serial(0);
+#if defined(_WIN32)
+       const unsigned long processId = GetCurrentProcessId();
+#else
+       const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+       return GetTempDirectory() + L"AudioInjectorAPOUnitTests-" + std::to_wstring(processId) + L"-" +
+              std::to_wstring(s_u32Serial++) + L"-" + fileName;
+   }
+
+   inline FILE* OpenTestFile(const std::wstring& path, const char* mode)
+   {
+#if defined(_WIN32)
+       FILE* pFile = nullptr;
+       _wfopen_s(&pFile, path.c_str(), std::wstring(mode, mode + std::strlen(mode)).c_str());
+       return pFile;
+#else
+       return std::fopen(std::string(path.begin(), path.end()).c_str(), mode);
+#endif
+   }
+
+   inline void WriteTestFile(const std::wstring& path, const std::vector<BYTE>& file)
+   {
+       FILE* pFile = OpenTestFile(path, "wb");
+       Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsNotNull(pFile, L"The temporary file should be created");
+       std::fwrite(file.data(), 1, file.size(), pFile);
+       std::fclose(pFile);
+   }
+
+   // The whole file, empty if it cannot be read
+   inline std::vector<BYTE> ReadTestFile(const std::wstring& path)
+   {
+       std::vector<BYTE> file;
+       FILE* pFile = OpenTestFile(path, "rb");
+       if (pFile != nullptr)
+       {
+           BYTE buffer[4096];
+           size_t cb = 0;
+           while ((cb = std::fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+           {
+               file.insert(file.end(), buffer, buffer + cb);
+           }
+           std::fclose(pFile);
+       }
+       return file;
+   }
+
+   inline void RemoveTestFile(const std::wstring& path)
+   {
+#if defined(_WIN32)
+       _wremove(path.c_str());
+#else
+       std::remove(std::string(path.begin(), path.end()).c_str());
+#endif
+   }
+
+   // Creates a file ending in fileName in the temporary directory for writing, its path in path
+   inline FILE* CreateTempFile(const std::wstring& fileName, std::wstring& path)
+   {
+       path = GetUniqueTempPath(fileName);
+       FILE* pFile = OpenTestFile(path, "wb");
+       Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsNotNull(pFile, L"The temporary file should be created");
+       return pFile;
+   }
+
+   // Writes the file into the temporary directory and returns its path
+   inline std::wstring WriteTempFile(const std::wstring& fileName, const std::vector<BYTE>& file)
+   {
+       const std::wstring path = GetUniqueTempPath(fileName);
+       WriteTestFile(path, file);
+       return path;
+   }
+
+   // Creates an empty directory ending in name in the temporary directory, with a trailing separator
+   inline std::wstring CreateTempDirectory(const std::wstring& name)
+   {
+       const std::wstring path = GetUniqueTempPath(name);
+#if defined(_WIN32)
+       const bool bCreated = CreateDirectoryW(path.c_str(), nullptr) != FALSE;
+       const wchar_t separator = L'\\';
+#else
+       const bool bCreated = mkdir(std::string(path.begin(), path.end()).c_str(), 0700) == 0;
+       const wchar_t separator = L'/';
+#endif
+       Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsTrue(bCreated, L"The temporary directory should be created");
+       return path + separator;
+   }
+
+   // Removes a directory of CreateTempDirectory, which must be empty
+   inline void RemoveTempDirectory(const std::wstring& path)
+   {
+#if defined(_WIN32)
+       RemoveDirectoryW(path.c_str());
+#else
+       rmdir(std::string(path.begin(), path.end()).c_str());
+#endif
+   }
+
+   // Memory the process has in use
+   inline size_t GetResidentBytes()
+   {
+#if defined(_WIN32)
+       PROCESS_MEMORY_COUNTERS counters = {};
+       GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+       return counters.WorkingSetSize;
+#else
+       const char* pszField = "VmRSS: %lu kB";
+       size_t bytes = 0;
+       FILE* pFile = std::fopen("/proc/self/status", "r");
+       if (pFile != nullptr)
+       {
+           char line[256];
+           while (std::fgets(line, sizeof(line), pFile) != nullptr)
+           {
+               unsigned long kilobytes = 0;
+               if (std::sscanf(line, pszField, &kilobytes) == 1)
+                   bytes = static_cast<size_t>(kilobytes) * 1024;
+           }
+           std::fclose(pFile);
+       }
+       return bytes;
+#endif
+   }
+
+   // Most memory the process has in use from construction to Stop, sampled every
+   // millisecond.  Unlike the peak the platform keeps for the process, it does not
+   // include what earlier tests had in use.
+   class ResidentBytesPeak
+   {
+   public:
+       ResidentBytesPeak() : m_peak(GetResidentBytes()), m_stop(false), m_thread([this] { Sample(); }) {}
+       ~ResidentBytesPeak() { Stop(); }
+
+       size_t Stop()
+       {
+           if (m_thread.joinable())
+           {
+               m_stop = true;
+               m_thread.join();
+           }
+           return m_peak;
+       }
+
+   private:
+       void Sample()
+       {
+           while (!m_stop)
+           {
+               const size_t bytes = GetResidentBytes();
+               if (bytes > m_peak)
+                   m_peak = bytes;
+               std::this_thread::sleep_for(std::chrono::milliseconds(1));
+           }
+       }
+
+       size_t m_peak;
+       std::atomic<bool> m_stop;
+       std::thread m_thread;
+   };
+}